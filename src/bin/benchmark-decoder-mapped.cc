@@ -0,0 +1,163 @@
+// bin/benchmark-decoder-mapped.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "base/timer.h"
+
+namespace kaldi {
+
+// Decodes all the utterances in 'loglikes' 'num_repeats' times with a
+// LatticeFasterDecoderTpl<HashType>, and prints the speed in frames and
+// tokens per second, and the decoder statistics (see DecoderStats).  Only the
+// search itself is timed, not lattice generation.  Returns the total cost of
+// the best paths (from the first repeat), which should not depend on the hash
+// type.
+template <template <class, class> class HashType>
+double BenchmarkDecoder(const std::string &name,
+                        const TransitionModel &trans_model,
+                        const fst::Fst<fst::StdArc> &decode_fst,
+                        const LatticeFasterDecoderConfig &config,
+                        BaseFloat acoustic_scale,
+                        const std::vector<Matrix<BaseFloat> > &loglikes,
+                        int32 num_repeats) {
+  LatticeFasterDecoderTpl<HashType> decoder(decode_fst, config);
+  DecoderStats stats;
+  decoder.SetStats(&stats);
+  double elapsed = 0.0, tot_cost = 0.0;
+  int64 num_frames = 0, num_tokens = 0;
+  for (int32 r = 0; r < num_repeats; r++) {
+    for (size_t i = 0; i < loglikes.size(); i++) {
+      DecodableMatrixScaledMapped decodable(trans_model, loglikes[i],
+                                            acoustic_scale);
+      Timer timer;
+      decoder.Decode(&decodable);
+      elapsed += timer.Elapsed();
+      num_frames += decoder.NumFramesDecoded();
+      num_tokens += decoder.NumTokensCreated();
+      if (r == 0) {
+        Lattice best_path;
+        std::vector<int32> alignment, words;
+        LatticeWeight weight;
+        decoder.GetBestPath(&best_path);
+        if (GetLinearSymbolSequence(best_path, &alignment, &words, &weight))
+          tot_cost += weight.Value1() + weight.Value2();
+      }
+    }
+  }
+  KALDI_LOG << name << ": decoded " << num_frames << " frames in "
+            << elapsed << " seconds: " << (num_frames / elapsed)
+            << " frames/sec, " << (num_tokens / elapsed) << " tokens/sec ("
+            << (num_tokens * 1.0 / num_frames) << " tokens/frame).";
+  KALDI_LOG << name << ": " << stats.Info();
+  return tot_cost;
+}
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::Fst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Measure the speed of the lattice decoder (in frames and tokens per\n"
+        "second) with the different types of token hash, reading\n"
+        "log-likelihoods as matrices.  All the log-likelihoods are read into\n"
+        "memory first, and only the search is timed.\n"
+        "Usage: benchmark-decoder-mapped [options] <trans-model-in> <fst-in> "
+        "<loglikes-rspecifier>\n"
+        "e.g.: benchmark-decoder-mapped --max-active=7000 --beam=15 \\\n"
+        "   final.mdl HCLG.fst ark:loglikes.ark\n";
+    ParseOptions po(usage);
+    BaseFloat acoustic_scale = 0.1;
+    int32 num_repeats = 1;
+    std::string hash_type = "all";
+    LatticeFasterDecoderConfig config;
+
+    config.Register(&po);
+    po.Register("acoustic-scale", &acoustic_scale,
+                "Scaling factor for acoustic likelihoods");
+    po.Register("num-repeats", &num_repeats,
+                "Number of times to decode the data with each decoder");
+    po.Register("hash-type", &hash_type, "Type of token hash to benchmark: "
+                "hash-list, open-hash-list or all");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (hash_type != "hash-list" && hash_type != "open-hash-list" &&
+        hash_type != "all")
+      KALDI_ERR << "Invalid value for --hash-type: " << hash_type;
+    KALDI_ASSERT(num_repeats > 0);
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_filename = po.GetArg(2),
+        loglikes_rspecifier = po.GetArg(3);
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_in_filename, &trans_model);
+
+    std::vector<Matrix<BaseFloat> > loglikes;
+    SequentialBaseFloatMatrixReader loglike_reader(loglikes_rspecifier);
+    for (; !loglike_reader.Done(); loglike_reader.Next()) {
+      if (loglike_reader.Value().NumRows() == 0) {
+        KALDI_WARN << "Zero-length utterance: " << loglike_reader.Key();
+        continue;
+      }
+      loglikes.resize(loglikes.size() + 1);
+      loglikes.back().Swap(&loglike_reader.Value());
+    }
+    if (loglikes.empty())
+      KALDI_ERR << "No log-likelihoods read from " << loglikes_rspecifier;
+
+    Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_filename);
+
+    double hash_list_cost = 0.0, open_hash_list_cost = 0.0;
+    if (hash_type != "open-hash-list")
+      hash_list_cost = BenchmarkDecoder<HashList>(
+          "HashList", trans_model, *decode_fst, config, acoustic_scale,
+          loglikes, num_repeats);
+    if (hash_type != "hash-list")
+      open_hash_list_cost = BenchmarkDecoder<OpenHashList>(
+          "OpenHashList", trans_model, *decode_fst, config, acoustic_scale,
+          loglikes, num_repeats);
+    if (hash_type == "all" &&
+        !ApproxEqual(hash_list_cost, open_hash_list_cost))
+      KALDI_WARN << "Total best-path costs differ between hash types: "
+                 << hash_list_cost << " vs. " << open_hash_list_cost;
+
+    delete decode_fst;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -69,6 +69,14 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
     return scale_ * (*likes_)(frame, trans_model_.TransitionIdToPdf(tid));
   }
 
+  virtual void LogLikelihoods(int32 frame, const std::vector<int32> &tids,
+                              std::vector<BaseFloat> *log_likes) {
+    trans_model_.TransitionIdsToPdfValues(likes_->RowData(frame), tids,
+                                          log_likes);
+    for (size_t i = 0; i < log_likes->size(); i++)
+      (*log_likes)[i] *= scale_;
+  }
+
   // Indices are one-based!  This is for compatibility with OpenFst.
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
 
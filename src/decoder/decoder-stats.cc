@@ -0,0 +1,269 @@
+// decoder/decoder-stats.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iomanip>
+#include "decoder/decoder-stats.h"
+
+namespace kaldi {
+
+// The index of adaptive_beam in the output of GetValues(); it's the only field
+// for which we print averages rather than sums, and we only average over the
+// frames where it was finite.
+static const int32 kAdaptiveBeamField = 4;
+
+// Adds 'frame_stats' to 'totals', which is indexed as in GetValues(), and
+// increments *num_finite_beam_frames if the adaptive beam is finite.
+static void AddToTotals(const DecoderFrameStats &frame_stats,
+                        std::vector<double> *totals,
+                        int64 *num_finite_beam_frames) {
+  double values[DecoderFrameStats::kNumFields];
+  frame_stats.GetValues(values);
+  if (KALDI_ISFINITE(values[kAdaptiveBeamField]))
+    (*num_finite_beam_frames)++;
+  else
+    values[kAdaptiveBeamField] = 0.0;
+  for (int32 i = 0; i < DecoderFrameStats::kNumFields; i++)
+    (*totals)[i] += values[i];
+}
+
+void DecoderFrameStats::Reset() {
+  num_toks = 0;
+  num_toks_expanded = 0;
+  num_emitting_arcs = 0;
+  num_nonemitting_arcs = 0;
+  adaptive_beam = 0.0;
+  num_prune_passes = 0;
+  num_toks_pruned = 0;
+  prune_time = 0.0;
+  emitting_time = 0.0;
+  nonemitting_time = 0.0;
+  num_approx_cutoffs = 0;
+  num_max_active_limited = 0;
+  max_active_excess = 0;
+}
+
+void DecoderFrameStats::GetValues(double *values) const {
+  values[0] = num_toks;
+  values[1] = num_toks_expanded;
+  values[2] = num_emitting_arcs;
+  values[3] = num_nonemitting_arcs;
+  values[kAdaptiveBeamField] = adaptive_beam;
+  values[5] = num_prune_passes;
+  values[6] = num_toks_pruned;
+  values[7] = prune_time;
+  values[8] = emitting_time;
+  values[9] = nonemitting_time;
+  values[10] = num_approx_cutoffs;
+  values[11] = num_max_active_limited;
+  values[12] = max_active_excess;
+}
+
+const char *DecoderFrameStats::FieldName(int32 i) {
+  static const char *names[kNumFields] = {
+    "num_toks", "num_toks_expanded", "num_emitting_arcs",
+    "num_nonemitting_arcs", "adaptive_beam", "num_prune_passes",
+    "num_toks_pruned", "prune_time", "emitting_time", "nonemitting_time",
+    "num_approx_cutoffs", "num_max_active_limited", "max_active_excess" };
+  KALDI_ASSERT(i >= 0 && i < kNumFields);
+  return names[i];
+}
+
+
+DecoderStats::DecoderStats():
+    totals_(DecoderFrameStats::kNumFields, 0.0), num_frames_(0),
+    num_finite_beam_frames_(0), num_utterances_(0) { }
+
+void DecoderStats::StartUtterance() {
+  frames_.clear();
+  num_utterances_++;
+}
+
+void DecoderStats::AddFrame(const DecoderFrameStats &frame_stats) {
+  frames_.push_back(frame_stats);
+  AddToTotals(frame_stats, &totals_, &num_finite_beam_frames_);
+  num_frames_++;
+}
+
+void DecoderStats::GetUtteranceMatrix(Matrix<BaseFloat> *mat) const {
+  mat->Resize(frames_.size(), DecoderFrameStats::kNumFields, kUndefined);
+  double values[DecoderFrameStats::kNumFields];
+  for (size_t t = 0; t < frames_.size(); t++) {
+    frames_[t].GetValues(values);
+    for (int32 i = 0; i < DecoderFrameStats::kNumFields; i++)
+      (*mat)(t, i) = values[i];
+  }
+}
+
+void DecoderStats::GetUtteranceTotals(std::vector<double> *totals,
+                                      int64 *num_finite_beam_frames) const {
+  totals->assign(DecoderFrameStats::kNumFields, 0.0);
+  *num_finite_beam_frames = 0;
+  for (size_t t = 0; t < frames_.size(); t++)
+    AddToTotals(frames_[t], totals, num_finite_beam_frames);
+}
+
+void DecoderStats::AddUtterance(const DecoderStats &other) {
+  std::vector<double> totals;
+  int64 num_finite_beam_frames;
+  other.GetUtteranceTotals(&totals, &num_finite_beam_frames);
+  for (int32 i = 0; i < DecoderFrameStats::kNumFields; i++)
+    totals_[i] += totals[i];
+  num_frames_ += other.frames_.size();
+  num_finite_beam_frames_ += num_finite_beam_frames;
+  num_utterances_++;
+}
+
+void DecoderStats::Add(const DecoderStats &other) {
+  for (int32 i = 0; i < DecoderFrameStats::kNumFields; i++)
+    totals_[i] += other.totals_[i];
+  num_frames_ += other.num_frames_;
+  num_finite_beam_frames_ += other.num_finite_beam_frames_;
+  num_utterances_ += other.num_utterances_;
+}
+
+std::string DecoderStats::Info() const {
+  std::ostringstream os;
+  double frames = std::max<int64>(num_frames_, 1),
+      beam_frames = std::max<int64>(num_finite_beam_frames_, 1);
+  const std::vector<double> &t = totals_;
+  os << "Decoder stats for " << num_utterances_ << " utterances, "
+     << num_frames_ << " frames: per frame, " << (t[0] / frames)
+     << " tokens of which " << (t[1] / frames) << " expanded, "
+     << (t[2] / frames) << " emitting and " << (t[3] / frames)
+     << " nonemitting arcs, adaptive beam " << (t[4] / beam_frames)
+     << " (where finite); "
+     << t[5] << " pruning passes removed " << t[6] << " tokens; "
+     << "milliseconds per frame: " << (1000.0 * t[8] / frames)
+     << " emitting, " << (1000.0 * t[9] / frames) << " nonemitting, "
+     << (1000.0 * t[7] / frames) << " pruning; " << t[10]
+     << " frames used histogram cutoffs";
+  if (t[11] > 0)
+    os << "; on the " << t[11] << " frames limited by max-active, "
+       << (t[12] / t[11]) << " more tokens/frame were expanded than the "
+       << "exact cutoff would give";
+  os << '.';
+  return os.str();
+}
+
+
+// Writes a JSON object with the number of frames and the totals (the average
+// over the num_finite_beam_frames frames for adaptive_beam, or null if there
+// were none), preceded by 'prefix' which should contain any other members of
+// the object, each followed by ", ".
+static void WriteJsonTotals(const std::string &prefix, int64 num_frames,
+                            int64 num_finite_beam_frames,
+                            const std::vector<double> &totals,
+                            std::ostream &os) {
+  os << "{" << prefix << "\"num_frames\": " << num_frames;
+  for (int32 i = 0; i < DecoderFrameStats::kNumFields; i++) {
+    os << ", \"" << DecoderFrameStats::FieldName(i) << "\": ";
+    if (i != kAdaptiveBeamField)
+      os << totals[i];
+    else if (num_finite_beam_frames > 0)
+      os << (totals[i] / num_finite_beam_frames);
+    else
+      os << "null";
+  }
+  os << "}";
+}
+
+// Returns 'str' as a JSON string, with quotes.
+static std::string JsonString(const std::string &str) {
+  std::ostringstream os;
+  os << '"';
+  for (size_t i = 0; i < str.size(); i++) {
+    char c = str[i];
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      os << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+         << static_cast<int32>(c) << std::dec;
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+  return os.str();
+}
+
+
+DecoderStatsWriter::DecoderStatsWriter(const DecoderStatsOptions &opts):
+    opts_(opts),
+    open_(!opts.wspecifier.empty() || !opts.json_wxfilename.empty()) {
+  if (!opts_.wspecifier.empty() && !matrix_writer_.Open(opts_.wspecifier))
+    KALDI_ERR << "Could not open table for writing decoder stats: "
+              << opts_.wspecifier;
+  json_utterances_.precision(8);
+}
+
+void DecoderStatsWriter::Write(const std::string &utt,
+                               const DecoderStats &stats) {
+  KALDI_ASSERT(open_);
+  if (matrix_writer_.IsOpen()) {
+    Matrix<BaseFloat> mat;
+    stats.GetUtteranceMatrix(&mat);
+    matrix_writer_.Write(utt, mat);
+  }
+  if (!opts_.json_wxfilename.empty()) {
+    std::vector<double> totals;
+    int64 num_finite_beam_frames;
+    stats.GetUtteranceTotals(&totals, &num_finite_beam_frames);
+    if (totals_.NumUtterances() > 0)
+      json_utterances_ << ",\n";
+    json_utterances_ << "    ";
+    WriteJsonTotals("\"utt\": " + JsonString(utt) + ", ",
+                    stats.UtteranceFrames().size(), num_finite_beam_frames,
+                    totals, json_utterances_);
+  }
+  totals_.AddUtterance(stats);
+}
+
+void DecoderStatsWriter::Close() {
+  if (!open_)
+    return;
+  open_ = false;
+  if (matrix_writer_.IsOpen() && !matrix_writer_.Close())
+    KALDI_ERR << "Error closing table of decoder stats: " << opts_.wspecifier;
+  if (!opts_.json_wxfilename.empty()) {
+    Output ko(opts_.json_wxfilename, false);
+    std::ostream &os = ko.Stream();
+    os.precision(8);
+    std::ostringstream num_utts;
+    num_utts << "\"num_utterances\": " << totals_.NumUtterances() << ", ";
+    os << "{\n  \"utterances\": [\n" << json_utterances_.str()
+       << "\n  ],\n  \"totals\": ";
+    WriteJsonTotals(num_utts.str(), totals_.NumFrames(),
+                    totals_.NumFiniteBeamFrames(), totals_.Totals(), os);
+    os << "\n}\n";
+  }
+  KALDI_LOG << totals_.Info();
+}
+
+DecoderStatsWriter::~DecoderStatsWriter() {
+  // We must not throw from a destructor; call Close() yourself if you want
+  // errors to be fatal.
+  try {
+    Close();
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error closing decoder stats: " << e.what();
+  }
+}
+
+
+}  // namespace kaldi
@@ -0,0 +1,202 @@
+// decoder/decoder-stats.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_DECODER_STATS_H_
+#define KALDI_DECODER_DECODER_STATS_H_
+
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+/**
+   This header contains DecoderStats, which collects statistics about what the
+   lattice decoders (LatticeFasterDecoder and LatticeFasterOnlineDecoder) do on
+   each frame: how many tokens and arcs they process, the adaptive beam and
+   how the pruning cutoffs were arrived at, how often they prune, and how long
+   the different parts take.  It is for tuning
+   the beams and max-active against real-time-factor requirements.  You attach
+   a DecoderStats object to a decoder with its SetStats() function; if you
+   don't, the decoder collects nothing and does not read the clock.
+
+   DecoderStatsWriter writes the stats for each utterance to a table of
+   matrices and/or a JSON summary; it is used by the nnet3 decoding programs
+   via the options in DecoderStatsOptions.
+*/
+
+
+/// The statistics for one frame.
+struct DecoderFrameStats {
+  int32 num_toks;  // Number of tokens active on the previous frame.
+  int32 num_toks_expanded;  // Number of those that were within the cutoff, so
+                            // their emitting arcs were expanded.
+  int32 num_emitting_arcs;  // Number of emitting arcs that survived pruning.
+  int32 num_nonemitting_arcs;  // Number of nonemitting arcs that survived
+                               // pruning (possibly counting some twice, if
+                               // their source state was re-visited).
+  BaseFloat adaptive_beam;  // The beam after applying max-active and
+                            // min-active; infinite if there were fewer than
+                            // min-active tokens.
+  int32 num_prune_passes;  // 1 if we pruned the lattice (PruneActiveTokens())
+                           // before this frame, else 0.
+  int32 num_toks_pruned;  // Number of tokens that pruning removed.
+  BaseFloat prune_time;  // Time in seconds taken by pruning.
+  BaseFloat emitting_time;  // Time taken by the emitting arcs (including the
+                            // acoustic likelihoods, if computed on demand).
+  BaseFloat nonemitting_time;  // Time taken by the nonemitting arcs.
+  // The following are about the pruning cutoffs (see the decoders'
+  // GetCutoff()); they are mainly for tuning --max-active and for checking
+  // the accuracy of --max-active-histogram-bins.  With the exact cutoffs, the
+  // number of tokens expanded on frames limited by max-active is max-active
+  // plus one (apart from ties), and the approximation should stay close to
+  // that.
+  int32 num_approx_cutoffs;  // 1 if the cutoffs came from the histogram
+                             // (--max-active-histogram-bins), else 0.
+  int32 num_max_active_limited;  // 1 if max-active gave the tightest cutoff,
+                                 // else 0.
+  int32 max_active_excess;  // If num_max_active_limited is 1,
+                            // num_toks_expanded minus (max-active + 1); else 0.
+
+  /// The number of fields above; they are numbered in the order above for
+  /// GetValues() and FieldName().
+  static const int32 kNumFields = 13;
+
+  DecoderFrameStats() { Reset(); }
+  void Reset();
+  /// Outputs the fields as an array of size kNumFields.
+  void GetValues(double *values) const;
+  /// Returns the name of field i (e.g. "num_toks"), as used in the JSON
+  /// output.
+  static const char *FieldName(int32 i);
+};
+
+
+class DecoderStats {
+ public:
+  DecoderStats();
+
+  /// Called from the decoders' InitDecoding(): clears the per-frame stats of
+  /// the previous utterance, and increments NumUtterances().
+  void StartUtterance();
+
+  /// Called by the decoders at the end of each frame.
+  void AddFrame(const DecoderFrameStats &frame_stats);
+
+  /// The per-frame stats of the current (or most recent) utterance.
+  const std::vector<DecoderFrameStats> &UtteranceFrames() const {
+    return frames_;
+  }
+
+  /// Outputs the per-frame stats of the current utterance as a matrix with
+  /// one row per frame and DecoderFrameStats::kNumFields columns.
+  void GetUtteranceMatrix(Matrix<BaseFloat> *mat) const;
+
+  /// Outputs the sums of the per-frame stats of the current utterance,
+  /// indexed as in DecoderFrameStats::GetValues(), and the number of frames
+  /// whose adaptive beam was finite; only those are included in the sum of
+  /// adaptive beams.
+  void GetUtteranceTotals(std::vector<double> *totals,
+                          int64 *num_finite_beam_frames) const;
+
+  /// Adds the frames of the current utterance of 'other' to our totals (not
+  /// to UtteranceFrames()), as one utterance.
+  void AddUtterance(const DecoderStats &other);
+
+  /// Adds the totals of 'other' to ours; e.g. for combining the stats of
+  /// decoders that ran in different threads.
+  void Add(const DecoderStats &other);
+
+  int32 NumUtterances() const { return num_utterances_; }
+  int64 NumFrames() const { return num_frames_; }
+  /// The sums over all frames, indexed as in DecoderFrameStats::GetValues();
+  /// the adaptive beam is only summed over NumFiniteBeamFrames() frames.
+  const std::vector<double> &Totals() const { return totals_; }
+  int64 NumFiniteBeamFrames() const { return num_finite_beam_frames_; }
+
+  /// Returns a summary of the totals, e.g. for logging.
+  std::string Info() const;
+
+ private:
+  std::vector<DecoderFrameStats> frames_;
+  std::vector<double> totals_;
+  int64 num_frames_;
+  int64 num_finite_beam_frames_;
+  int32 num_utterances_;
+};
+
+
+struct DecoderStatsOptions {
+  std::string wspecifier;
+  std::string json_wxfilename;
+
+  void Register(OptionsItf *opts) {
+    opts->Register("decoder-stats-wspecifier", &wspecifier, "If supplied, "
+                   "write per-frame decoder statistics to this table, as a "
+                   "matrix per utterance with a row for each frame and "
+                   "columns: num_toks, num_toks_expanded, num_emitting_arcs, "
+                   "num_nonemitting_arcs, adaptive_beam, num_prune_passes, "
+                   "num_toks_pruned, prune_time, emitting_time, "
+                   "nonemitting_time (times in seconds), num_approx_cutoffs, "
+                   "num_max_active_limited, max_active_excess.");
+    opts->Register("decoder-stats-json", &json_wxfilename, "If supplied, "
+                   "write a summary of the decoder statistics for each "
+                   "utterance and for all of them, in JSON format, to this "
+                   "file.");
+  }
+};
+
+
+/// This class writes the decoder stats for each utterance, as requested by
+/// DecoderStatsOptions, and logs a summary at the end.
+class DecoderStatsWriter {
+ public:
+  explicit DecoderStatsWriter(const DecoderStatsOptions &opts);
+
+  /// Returns true if any output was requested; if not, you don't need to
+  /// collect stats at all.
+  bool IsOpen() const { return open_; }
+
+  /// Writes the stats for the current utterance of 'stats' (see
+  /// DecoderStats::UtteranceFrames()) and adds them to the totals.
+  void Write(const std::string &utt, const DecoderStats &stats);
+
+  /// Writes the JSON file, if requested, and logs a summary of the totals.
+  /// Dies on error (e.g. if a file can't be written).  Called by the
+  /// destructor if you don't call it, but then errors only produce a warning.
+  void Close();
+
+  ~DecoderStatsWriter();
+
+ private:
+  DecoderStatsOptions opts_;
+  bool open_;
+  BaseFloatMatrixWriter matrix_writer_;
+  std::ostringstream json_utterances_;  // The JSON objects for the utterances
+                                        // written so far.
+  DecoderStats totals_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecoderStatsWriter);
+};
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_DECODER_STATS_H_
@@ -44,7 +44,8 @@ DecodeUtteranceLatticeFasterClass::DecodeUtteranceLatticeFasterClass(
     int64 *frame_sum, // on success, adds #frames to this.
     int32 *num_done, // on success (including partial decode), increments this.
     int32 *num_err,  // on failure, increments this.
-    int32 *num_partial):  // If partial decode (final-state not reached), increments this.
+    int32 *num_partial,  // If partial decode (final-state not reached), increments this.
+    DecoderStatsWriter *stats_writer):
     decoder_(decoder), decodable_(decodable), trans_model_(&trans_model),
     word_syms_(word_syms), utt_(utt), acoustic_scale_(acoustic_scale),
     determinize_(determinize), allow_partial_(allow_partial),
@@ -54,9 +55,12 @@ DecodeUtteranceLatticeFasterClass::DecodeUtteranceLatticeFasterClass(
     lattice_writer_(lattice_writer),
     like_sum_(like_sum), frame_sum_(frame_sum),
     num_done_(num_done), num_err_(num_err),
-    num_partial_(num_partial),
+    num_partial_(num_partial), stats_writer_(stats_writer),
     computed_(false), success_(false), partial_(false),
-    clat_(NULL), lat_(NULL) { }
+    clat_(NULL), lat_(NULL) {
+  if (stats_writer_ != NULL)
+    decoder_->SetStats(&stats_);
+}
 
 
 void DecodeUtteranceLatticeFasterClass::operator () () {
@@ -115,6 +119,8 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
   if (!computed_)
     KALDI_ERR << "Destructor called without operator (), error in calling code.";
 
+  if (stats_writer_ != NULL)
+    stats_writer_->Write(utt_, stats_);
   if (!success_) {
     if (num_err_ != NULL) (*num_err_)++;
   } else { // successful decode.
@@ -208,10 +214,19 @@ bool DecodeUtteranceLatticeFaster(
     Int32VectorWriter *words_writer,
     CompactLatticeWriter *compact_lattice_writer,
     LatticeWriter *lattice_writer,
-    double *like_ptr) { // puts utterance's like in like_ptr on success.
+    double *like_ptr, // puts utterance's like in like_ptr on success.
+    DecoderStatsWriter *stats_writer) {
   using fst::VectorFst;
 
-  if (!decoder.Decode(&decodable)) {
+  DecoderStats stats;
+  if (stats_writer != NULL)
+    decoder.SetStats(&stats);
+  bool decoded = decoder.Decode(&decodable);
+  if (stats_writer != NULL) {
+    decoder.SetStats(NULL);
+    stats_writer->Write(utt, stats);
+  }
+  if (!decoded) {
     KALDI_WARN << "Failed to decode file " << utt;
     return false;
   }
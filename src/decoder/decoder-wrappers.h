@@ -108,7 +108,9 @@ bool DecodeUtteranceLatticeFaster(
     Int32VectorWriter *words_writer,
     CompactLatticeWriter *compact_lattice_writer,
     LatticeWriter *lattice_writer,
-    double *like_ptr);  // puts utterance's likelihood in like_ptr on success.
+    double *like_ptr,  // puts utterance's likelihood in like_ptr on success.
+    DecoderStatsWriter *stats_writer = NULL);  // if non-NULL, writes the
+                                               // decoder stats to this.
 
 /// This class basically does the same job as the function
 /// DecodeUtteranceLatticeFaster, but in a way that allows us
@@ -137,7 +139,10 @@ class DecodeUtteranceLatticeFasterClass {
       int64 *frame_sum, // on success, adds #frames to this.
       int32 *num_done, // on success (including partial decode), increments this.
       int32 *num_err,  // on failure, increments this.
-      int32 *num_partial);  // If partial decode (final-state not reached), increments this.
+      int32 *num_partial,  // If partial decode (final-state not reached), increments this.
+      DecoderStatsWriter *stats_writer = NULL);  // If non-NULL, collect
+                                                 // per-frame decoder stats
+                                                 // and write them to this.
   void operator () (); // The decoding happens here.
   ~DecodeUtteranceLatticeFasterClass(); // Output happens here.
  private:
@@ -159,6 +164,7 @@ class DecodeUtteranceLatticeFasterClass {
   int32 *num_done_;
   int32 *num_err_;
   int32 *num_partial_;
+  DecoderStatsWriter *stats_writer_;
 
   // The following variables are stored by the computation.
   bool computed_; // operator ()  was called.
@@ -166,6 +172,7 @@ class DecodeUtteranceLatticeFasterClass {
   bool partial_; // decoding was partial.
   CompactLattice *clat_; // Stored output, if determinize_ == true.
   Lattice *lat_; // Stored output, if determinize_ == false.
+  DecoderStats stats_; // Used if stats_writer_ != NULL.
 };
 
 // This function DecodeUtteranceLatticeSimple is used in several decoders, and
@@ -25,57 +25,84 @@
 // after committing the changes to this file, using the command
 // svn merge ^/sandbox/online/src/decoder/lattice-faster-decoder.cc lattice-faster-online-decoder.cc
 
+#include <type_traits>
 #include "decoder/lattice-faster-decoder.h"
 #include "lat/lattice-functions.h"
+#include "base/timer.h"
 
 namespace kaldi {
 
+// See ProcessEmitting().
+static const size_t kMinTokensPerEmittingThread = 500;
+
 // instantiate this class once for each thing you have to decode.
-LatticeFasterDecoder::LatticeFasterDecoder(const fst::Fst<fst::StdArc> &fst,
-                                           const LatticeFasterDecoderConfig &config):
-    fst_(fst), delete_fst_(false), config_(config), num_toks_(0) {
+template <template <class, class> class HashType>
+LatticeFasterDecoderTpl<HashType>::LatticeFasterDecoderTpl(
+    const fst::Fst<fst::StdArc> &fst,
+    const LatticeFasterDecoderConfig &config):
+    emitting_thread_pool_(NULL), fst_(fst), delete_fst_(false), config_(config),
+    num_toks_(0), num_toks_created_(0),
+    best_cost_estimate_(std::numeric_limits<BaseFloat>::infinity()),
+    max_active_limited_(false), stats_(NULL),
+    use_memory_pool_(config.use_memory_pool) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
 
 
-LatticeFasterDecoder::LatticeFasterDecoder(const LatticeFasterDecoderConfig &config,
-                                           fst::Fst<fst::StdArc> *fst):
-    fst_(*fst), delete_fst_(true), config_(config), num_toks_(0) {
+template <template <class, class> class HashType>
+LatticeFasterDecoderTpl<HashType>::LatticeFasterDecoderTpl(
+    const LatticeFasterDecoderConfig &config,
+    fst::Fst<fst::StdArc> *fst):
+    emitting_thread_pool_(NULL), fst_(*fst), delete_fst_(true), config_(config),
+    num_toks_(0), num_toks_created_(0),
+    best_cost_estimate_(std::numeric_limits<BaseFloat>::infinity()),
+    max_active_limited_(false), stats_(NULL),
+    use_memory_pool_(config.use_memory_pool) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
 
 
-LatticeFasterDecoder::~LatticeFasterDecoder() {
+template <template <class, class> class HashType>
+LatticeFasterDecoderTpl<HashType>::~LatticeFasterDecoderTpl() {
   DeleteElems(toks_.Clear());
   ClearActiveTokens();
+  delete emitting_thread_pool_;
   if (delete_fst_) delete &(fst_);
 }
 
-void LatticeFasterDecoder::InitDecoding() {
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::InitDecoding() {
   // clean up from last time:
   DeleteElems(toks_.Clear());
   cost_offsets_.clear();
   ClearActiveTokens();
+  use_memory_pool_ = config_.use_memory_pool;
   warned_ = false;
   num_toks_ = 0;
+  num_toks_created_ = 0;
+  best_cost_estimate_ = std::numeric_limits<BaseFloat>::infinity();
   decoding_finalized_ = false;
+  if (stats_ != NULL)
+    stats_->StartUtterance();
   final_costs_.clear();
   StateId start_state = fst_.Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL);
+  Token *start_tok = NewToken(0.0, 0.0, NULL, NULL);
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
+  num_toks_created_++;
   ProcessNonemittingWrapper(config_.beam);
 }
 
 // Returns true if any kind of traceback is available (not necessarily from
 // a final state).  It should only very rarely return false; this indicates
 // an unusual search error.
-bool LatticeFasterDecoder::Decode(DecodableInterface *decodable) {
+template <template <class, class> class HashType>
+bool LatticeFasterDecoderTpl<HashType>::Decode(DecodableInterface *decodable) {
   InitDecoding();
 
   // We use 1-based indexing for frames in this decoder (if you view it in
@@ -83,10 +110,7 @@ bool LatticeFasterDecoder::Decode(DecodableInterface *decodable) {
   // numbering, which we have to correct for when we call it.
 
   while (!decodable->IsLastFrame(NumFramesDecoded() - 1)) {
-    if (NumFramesDecoded() % config_.prune_interval == 0)
-      PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
-    BaseFloat cost_cutoff = ProcessEmittingWrapper(decodable);
-    ProcessNonemittingWrapper(cost_cutoff);
+    DecodeOneFrame(decodable);
   }
   FinalizeDecoding();
 
@@ -97,8 +121,9 @@ bool LatticeFasterDecoder::Decode(DecodableInterface *decodable) {
 
 
 // Outputs an FST corresponding to the single best path through the lattice.
-bool LatticeFasterDecoder::GetBestPath(Lattice *olat,
-                                       bool use_final_probs) const {
+template <template <class, class> class HashType>
+bool LatticeFasterDecoderTpl<HashType>::GetBestPath(Lattice *olat,
+                                                    bool use_final_probs) const {
   Lattice raw_lat;
   GetRawLattice(&raw_lat, use_final_probs);
   ShortestPath(raw_lat, olat);
@@ -107,8 +132,9 @@ bool LatticeFasterDecoder::GetBestPath(Lattice *olat,
 
 // Outputs an FST corresponding to the raw, state-level
 // tracebacks.
-bool LatticeFasterDecoder::GetRawLattice(Lattice *ofst,
-                                         bool use_final_probs) const {
+template <template <class, class> class HashType>
+bool LatticeFasterDecoderTpl<HashType>::GetRawLattice(Lattice *ofst,
+                                                      bool use_final_probs) const {
   typedef LatticeArc Arc;
   typedef Arc::StateId StateId;
   typedef Arc::Weight Weight;
@@ -162,7 +188,7 @@ bool LatticeFasterDecoder::GetRawLattice(Lattice *ofst,
       for (ForwardLink *l = tok->links;
            l != NULL;
            l = l->next) {
-        unordered_map<Token*, StateId>::const_iterator iter =
+        typename unordered_map<Token*, StateId>::const_iterator iter =
             tok_map.find(l->next_tok);
         StateId nextstate = iter->second;
         KALDI_ASSERT(iter != tok_map.end());
@@ -178,7 +204,7 @@ bool LatticeFasterDecoder::GetRawLattice(Lattice *ofst,
       }
       if (f == num_frames) {
         if (use_final_probs && !final_costs.empty()) {
-          unordered_map<Token*, BaseFloat>::const_iterator iter =
+          typename unordered_map<Token*, BaseFloat>::const_iterator iter =
               final_costs.find(tok);
           if (iter != final_costs.end())
             ofst->SetFinal(cur_state, LatticeWeight(iter->second, 0));
@@ -195,8 +221,9 @@ bool LatticeFasterDecoder::GetRawLattice(Lattice *ofst,
 // This function is now deprecated, since now we do determinization from outside
 // the LatticeFasterDecoder class.  Outputs an FST corresponding to the
 // lattice-determinized lattice (one path per word sequence).
-bool LatticeFasterDecoder::GetLattice(CompactLattice *ofst,
-                                      bool use_final_probs) const {
+template <template <class, class> class HashType>
+bool LatticeFasterDecoderTpl<HashType>::GetLattice(CompactLattice *ofst,
+                                                   bool use_final_probs) const {
   Lattice raw_fst;
   GetRawLattice(&raw_fst, use_final_probs);
   Invert(&raw_fst);  // make it so word labels are on the input.
@@ -217,7 +244,8 @@ bool LatticeFasterDecoder::GetLattice(CompactLattice *ofst,
   return (ofst->NumStates() != 0);
 }
 
-void LatticeFasterDecoder::PossiblyResizeHash(size_t num_toks) {
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::PossiblyResizeHash(size_t num_toks) {
   size_t new_sz = static_cast<size_t>(static_cast<BaseFloat>(num_toks)
                                       * config_.hash_ratio);
   if (new_sz > toks_.Size()) {
@@ -256,7 +284,9 @@ void LatticeFasterDecoder::PossiblyResizeHash(size_t num_toks) {
 // for the current frame.  [note: it's inserted if necessary into hash toks_
 // and also into the singly linked list of tokens active on this frame
 // (whose head is at active_toks_[frame]).
-inline LatticeFasterDecoder::Token *LatticeFasterDecoder::FindOrAddToken(
+template <template <class, class> class HashType>
+inline typename LatticeFasterDecoderTpl<HashType>::Token *
+LatticeFasterDecoderTpl<HashType>::FindOrAddToken(
     StateId state, int32 frame_plus_one, BaseFloat tot_cost, bool *changed) {
   // Returns the Token pointer.  Sets "changed" (if non-NULL) to true
   // if the token was newly created or the cost changed.
@@ -268,10 +298,11 @@ inline LatticeFasterDecoder::Token *LatticeFasterDecoder::FindOrAddToken(
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks);
+    Token *new_tok = NewToken(tot_cost, extra_cost, NULL, toks);
     // NULL: no forward links yet
     toks = new_tok;
     num_toks_++;
+    num_toks_created_++;
     toks_.Insert(state, new_tok);
     if (changed) *changed = true;
     return new_tok;
@@ -297,7 +328,8 @@ inline LatticeFasterDecoder::Token *LatticeFasterDecoder::FindOrAddToken(
 // prunes outgoing links for all tokens in active_toks_[frame]
 // it's called by PruneActiveTokens
 // all links, that have link_extra_cost > lattice_beam are pruned
-void LatticeFasterDecoder::PruneForwardLinks(
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::PruneForwardLinks(
     int32 frame_plus_one, bool *extra_costs_changed,
     bool *links_pruned, BaseFloat delta) {
   // delta is the amount by which the extra_costs must change
@@ -341,7 +373,7 @@ void LatticeFasterDecoder::PruneForwardLinks(
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          DeleteForwardLink(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -373,14 +405,15 @@ void LatticeFasterDecoder::PruneForwardLinks(
 // PruneForwardLinksFinal is a version of PruneForwardLinks that we call
 // on the final frame.  If there are final tokens active, it uses
 // the final-probs for pruning, otherwise it treats all tokens as final.
-void LatticeFasterDecoder::PruneForwardLinksFinal() {
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::PruneForwardLinksFinal() {
   KALDI_ASSERT(!active_toks_.empty());
   int32 frame_plus_one = active_toks_.size() - 1;
 
   if (active_toks_[frame_plus_one].toks == NULL)  // empty list; should not happen.
     KALDI_WARN << "No tokens alive at end of file";
 
-  typedef unordered_map<Token*, BaseFloat>::const_iterator IterType;
+  typedef typename unordered_map<Token*, BaseFloat>::const_iterator IterType;
   ComputeFinalCosts(&final_costs_, &final_relative_cost_, &final_best_cost_);
   decoding_finalized_ = true;
   // We call DeleteElems() as a nicety, not because it's really necessary;
@@ -428,7 +461,7 @@ void LatticeFasterDecoder::PruneForwardLinksFinal() {
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          DeleteForwardLink(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -457,7 +490,8 @@ void LatticeFasterDecoder::PruneForwardLinksFinal() {
   } // while changed
 }
 
-BaseFloat LatticeFasterDecoder::FinalRelativeCost() const {
+template <template <class, class> class HashType>
+BaseFloat LatticeFasterDecoderTpl<HashType>::FinalRelativeCost() const {
   if (!decoding_finalized_) {
     BaseFloat relative_cost;
     ComputeFinalCosts(NULL, &relative_cost, NULL);
@@ -474,7 +508,9 @@ BaseFloat LatticeFasterDecoder::FinalRelativeCost() const {
 // [we don't do this in PruneForwardLinks because it would give us
 // a problem with dangling pointers].
 // It's called by PruneActiveTokens if any forward links have been pruned
-void LatticeFasterDecoder::PruneTokensForFrame(int32 frame_plus_one) {
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::PruneTokensForFrame(
+    int32 frame_plus_one) {
   KALDI_ASSERT(frame_plus_one >= 0 && frame_plus_one < active_toks_.size());
   Token *&toks = active_toks_[frame_plus_one].toks;
   if (toks == NULL)
@@ -487,7 +523,7 @@ void LatticeFasterDecoder::PruneTokensForFrame(int32 frame_plus_one) {
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      DeleteToken(tok);
       num_toks_--;
     } else {  // fetch next Token
       prev_tok = tok;
@@ -500,7 +536,8 @@ void LatticeFasterDecoder::PruneTokensForFrame(int32 frame_plus_one) {
 // that.  We go backwards through the frames and stop when we reach a point
 // where the delta-costs are not changing (and the delta controls when we consider
 // a cost to have "not changed").
-void LatticeFasterDecoder::PruneActiveTokens(BaseFloat delta) {
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::PruneActiveTokens(BaseFloat delta) {
   int32 cur_frame_plus_one = NumFramesDecoded();
   int32 num_toks_begin = num_toks_;
   // The index "f" below represents a "frame plus one", i.e. you'd have to subtract
@@ -529,7 +566,8 @@ void LatticeFasterDecoder::PruneActiveTokens(BaseFloat delta) {
                 << " to " << num_toks_;
 }
 
-void LatticeFasterDecoder::ComputeFinalCosts(
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::ComputeFinalCosts(
     unordered_map<Token*, BaseFloat> *final_costs,
     BaseFloat *final_relative_cost,
     BaseFloat *final_best_cost) const {
@@ -571,8 +609,9 @@ void LatticeFasterDecoder::ComputeFinalCosts(
   }
 }
 
-void LatticeFasterDecoder::AdvanceDecoding(DecodableInterface *decodable,
-                                             int32 max_num_frames) {
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::AdvanceDecoding(
+    DecodableInterface *decodable, int32 max_num_frames) {
   KALDI_ASSERT(!active_toks_.empty() && !decoding_finalized_ &&
                "You must call InitDecoding() before AdvanceDecoding");
   int32 num_frames_ready = decodable->NumFramesReady();
@@ -586,18 +625,15 @@ void LatticeFasterDecoder::AdvanceDecoding(DecodableInterface *decodable,
     target_frames_decoded = std::min(target_frames_decoded,
                                      NumFramesDecoded() + max_num_frames);
   while (NumFramesDecoded() < target_frames_decoded) {
-    if (NumFramesDecoded() % config_.prune_interval == 0) {
-      PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
-    }
-    BaseFloat cost_cutoff = ProcessEmittingWrapper(decodable);
-    ProcessNonemittingWrapper(cost_cutoff);
+    DecodeOneFrame(decodable);
   }
 }
 
 // FinalizeDecoding() is a version of PruneActiveTokens that we call
 // (optionally) on the final frame.  Takes into account the final-prob of
 // tokens.  This function used to be called PruneActiveTokensFinal().
-void LatticeFasterDecoder::FinalizeDecoding() {
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::FinalizeDecoding() {
   int32 final_frame_plus_one = NumFramesDecoded();
   int32 num_toks_begin = num_toks_;
   // PruneForwardLinksFinal() prunes final frame (with final-probs), and
@@ -615,11 +651,14 @@ void LatticeFasterDecoder::FinalizeDecoding() {
 }
 
 /// Gets the weight cutoff.  Also counts the active tokens.
-BaseFloat LatticeFasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
-                                          BaseFloat *adaptive_beam, Elem **best_elem) {
+template <template <class, class> class HashType>
+BaseFloat LatticeFasterDecoderTpl<HashType>::GetCutoff(
+    Elem *list_head, size_t *tok_count,
+    BaseFloat *adaptive_beam, Elem **best_elem) {
   BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity();
   // positive == high cost == bad.
   size_t count = 0;
+  max_active_limited_ = false;
   if (config_.max_active == std::numeric_limits<int32>::max() &&
       config_.min_active == 0) {
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
@@ -633,6 +672,14 @@ BaseFloat LatticeFasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
     if (adaptive_beam != NULL) *adaptive_beam = config_.beam;
     return best_weight + config_.beam;
   } else {
+    BaseFloat cutoff;
+    if (config_.max_active_histogram_bins > 0 &&
+        KALDI_ISFINITE(best_cost_estimate_) &&
+        GetCutoffApprox(list_head, tok_count, adaptive_beam, best_elem,
+                        &cutoff)) {
+      frame_stats_.num_approx_cutoffs = 1;
+      return cutoff;
+    }
     tmp_array_.clear();
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
       BaseFloat w = e->val->tot_cost;
@@ -658,6 +705,7 @@ BaseFloat LatticeFasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
       max_active_cutoff = tmp_array_[config_.max_active];
     }
     if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
+      max_active_limited_ = true;
       if (adaptive_beam)
         *adaptive_beam = max_active_cutoff - best_weight + config_.beam_delta;
       return max_active_cutoff;
@@ -684,8 +732,189 @@ BaseFloat LatticeFasterDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
   }
 }
 
+template <template <class, class> class HashType>
+bool LatticeFasterDecoderTpl<HashType>::GetCutoffApprox(
+    Elem *list_head, size_t *tok_count,
+    BaseFloat *adaptive_beam, Elem **best_elem, BaseFloat *cutoff) {
+  int32 num_bins = config_.max_active_histogram_bins;
+  BaseFloat lower = best_cost_estimate_,
+      bin_width = config_.beam / num_bins,
+      inv_bin_width = 1.0 / bin_width;
+  histogram_.assign(num_bins, 0);
+  BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity();
+  size_t count = 0, num_below = 0;
+  // Tokens above the range of the histogram are more than the beam from the
+  // estimated best cost, so normally outside the beam; we don't count them.
+  for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
+    BaseFloat w = e->val->tot_cost;
+    if (w < best_weight) {
+      best_weight = w;
+      if (best_elem) *best_elem = e;
+    }
+    BaseFloat pos = (w - lower) * inv_bin_width;
+    if (pos < 0.0) {
+      histogram_[0]++;
+      num_below++;
+    } else if (pos < num_bins) {
+      histogram_[static_cast<int32>(pos)]++;
+    }
+  }
+  if (tok_count != NULL) *tok_count = count;
+
+  BaseFloat beam_cutoff = best_weight + config_.beam,
+      min_active_cutoff = std::numeric_limits<BaseFloat>::infinity(),
+      max_active_cutoff = std::numeric_limits<BaseFloat>::infinity();
+  bool ok = true;
+  if (count > static_cast<size_t>(config_.max_active))
+    max_active_cutoff = std::max(
+        best_weight, HistogramCutoff(config_.max_active, lower, bin_width,
+                                     num_below, &ok));
+  if (!ok) return false;
+  if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
+    max_active_limited_ = true;
+    if (adaptive_beam)
+      *adaptive_beam = max_active_cutoff - best_weight + config_.beam_delta;
+    *cutoff = max_active_cutoff;
+    return true;
+  }
+  if (count > static_cast<size_t>(config_.min_active)) {
+    if (config_.min_active == 0) {
+      min_active_cutoff = best_weight;
+    } else {
+      min_active_cutoff = HistogramCutoff(config_.min_active, lower,
+                                          bin_width, num_below, &ok);
+      // If fewer than min_active tokens are in the histogram's range, we
+      // can't tell what the cutoff is.
+      if (min_active_cutoff == std::numeric_limits<BaseFloat>::infinity())
+        ok = false;
+      min_active_cutoff = std::max(best_weight, min_active_cutoff);
+    }
+  }
+  if (!ok) return false;
+  if (min_active_cutoff > beam_cutoff) { // min_active is looser than beam.
+    if (adaptive_beam)
+      *adaptive_beam = min_active_cutoff - best_weight + config_.beam_delta;
+    *cutoff = min_active_cutoff;
+  } else {
+    if (adaptive_beam)
+      *adaptive_beam = config_.beam;
+    *cutoff = beam_cutoff;
+  }
+  return true;
+}
+
+template <template <class, class> class HashType>
+BaseFloat LatticeFasterDecoderTpl<HashType>::HistogramCutoff(
+    size_t n, BaseFloat lower, BaseFloat bin_width, size_t num_below,
+    bool *ok) const {
+  size_t num_bins = histogram_.size(), count = 0;
+  for (size_t i = 0; i < num_bins; i++) {
+    size_t bin_count = histogram_[i];
+    if (count + bin_count > n) {
+      if (i == 0 && num_below > 0) {
+        *ok = false;
+        return std::numeric_limits<BaseFloat>::infinity();
+      }
+      // Assume the costs in the bin are evenly spread; we want the cost of
+      // the (n - count)'th one, and the tokens up to and including it.
+      BaseFloat frac = (n - count + 1) / static_cast<BaseFloat>(bin_count);
+      return lower + bin_width * (i + frac);
+    }
+    count += bin_count;
+  }
+  return std::numeric_limits<BaseFloat>::infinity();
+}
+
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::DecodeOneFrame(
+    DecodableInterface *decodable) {
+  if (stats_ == NULL) {
+    if (NumFramesDecoded() % config_.prune_interval == 0)
+      PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+    BaseFloat cost_cutoff = ProcessEmittingWrapper(decodable);
+    ProcessNonemittingWrapper(cost_cutoff);
+    return;
+  }
+  // The counts are set by ProcessEmitting() and ProcessNonemitting().
+  frame_stats_.Reset();
+  Timer timer;
+  if (NumFramesDecoded() % config_.prune_interval == 0) {
+    int32 num_toks_begin = num_toks_;
+    PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+    frame_stats_.num_prune_passes = 1;
+    frame_stats_.num_toks_pruned = num_toks_begin - num_toks_;
+  }
+  double prune_end = timer.Elapsed();
+  BaseFloat cost_cutoff = ProcessEmittingWrapper(decodable);
+  double emitting_end = timer.Elapsed();
+  ProcessNonemittingWrapper(cost_cutoff);
+  frame_stats_.prune_time = prune_end;
+  frame_stats_.emitting_time = emitting_end - prune_end;
+  frame_stats_.nonemitting_time = timer.Elapsed() - emitting_end;
+  stats_->AddFrame(frame_stats_);
+}
+
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::SetCutoffFrameStats(
+    size_t tok_count, size_t num_expanded) {
+  frame_stats_.num_toks = tok_count;
+  frame_stats_.num_toks_expanded = num_expanded;
+  if (max_active_limited_) {
+    frame_stats_.num_max_active_limited = 1;
+    frame_stats_.max_active_excess =
+        static_cast<int32>(num_expanded) - (config_.max_active + 1);
+  }
+}
+
+template <template <class, class> class HashType>
+inline void LatticeFasterDecoderTpl<HashType>::AddNeededLabel(Label ilabel) {
+  if (static_cast<size_t>(ilabel) >= label_needed_.size()) {
+    label_needed_.resize(ilabel + 1, 0);
+    frame_loglikes_.resize(ilabel + 1);
+  }
+  if (!label_needed_[ilabel]) {
+    label_needed_[ilabel] = 1;
+    needed_labels_.push_back(ilabel);
+  }
+}
+
+template <template <class, class> class HashType>
+template <typename FstType>
+const BaseFloat* LatticeFasterDecoderTpl<HashType>::GetFrameLogLikelihoods(
+    const FstType &fst, DecodableInterface *decodable, int32 frame,
+    int32 num_buffers, const Elem *best_elem, BaseFloat cutoff) {
+  KALDI_ASSERT(needed_labels_.empty());
+  for (int32 t = 0; t < num_buffers; t++) {
+    const std::vector<Label> &labels = emitting_arcs_[t].labels;
+    for (size_t i = 0; i < labels.size(); i++)
+      AddNeededLabel(labels[i]);
+  }
+  // The best token is normally within the cutoff, but if not, ProcessEmitting()
+  // still needs the log-likelihoods of its arcs.
+  if (best_elem != NULL && best_elem->val->tot_cost > cutoff) {
+    for (fst::ArcIterator<FstType> aiter(fst, best_elem->key);
+         !aiter.Done();
+         aiter.Next()) {
+      Label ilabel = aiter.Value().ilabel;
+      if (ilabel != 0)
+        AddNeededLabel(ilabel);
+    }
+  }
+  decodable->LogLikelihoods(frame, needed_labels_, &needed_loglikes_);
+  KALDI_ASSERT(needed_loglikes_.size() == needed_labels_.size());
+  for (size_t i = 0; i < needed_labels_.size(); i++) {
+    int32 ilabel = needed_labels_[i];
+    frame_loglikes_[ilabel] = needed_loglikes_[i];
+    label_needed_[ilabel] = 0;
+  }
+  needed_labels_.clear();
+  return (frame_loglikes_.empty() ? NULL : &(frame_loglikes_[0]));
+}
+
+template <template <class, class> class HashType>
 template <typename FstType>
-BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
+BaseFloat LatticeFasterDecoderTpl<HashType>::ProcessEmitting(
+    DecodableInterface *decodable) {
   KALDI_ASSERT(active_toks_.size() > 0);
   int32 frame = active_toks_.size() - 1; // frame is the frame-index
                                          // (zero-based) used to get likelihoods
@@ -711,6 +940,48 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
   // dynamic range.
   const FstType &fst = dynamic_cast<const FstType&>(fst_);
 
+  // Expand the emitting arcs of the tokens within the cutoff into
+  // emitting_arcs_, noting their input labels as we go, so that we can get all
+  // the log-likelihoods we need on this frame with one call to the decodable
+  // object; we can only prune the arcs after that.
+  emitting_elems_.clear();
+  for (Elem *e = final_toks; e != NULL; e = e->tail)
+    if (e->val->tot_cost <= cur_cutoff)
+      emitting_elems_.push_back(e);
+  size_t num_expanded = emitting_elems_.size();
+  // Don't use more threads than would give each of them
+  // kMinTokensPerEmittingThread tokens; below that, the overhead of waking
+  // the threads is greater than the gain.
+  int32 num_threads = std::min<int32>(
+      config_.num_emitting_threads, num_expanded / kMinTokensPerEmittingThread);
+  // We only use threads for the FST types that are known to be safe to
+  // iterate over from several threads at once (see ProcessEmittingWrapper());
+  // lazy FSTs such as ComposeFst, which reach here as fst::Fst<Arc>, modify
+  // their caches while being read.
+  if (num_threads < 1 || std::is_same<FstType, fst::Fst<Arc> >::value)
+    num_threads = 1;
+  if (emitting_arcs_.size() < static_cast<size_t>(num_threads))
+    emitting_arcs_.resize(num_threads);
+  Elem *const *elems = (num_expanded == 0 ? NULL : &(emitting_elems_[0]));
+  if (num_threads == 1) {
+    ExpandEmittingArcs<FstType>(fst, elems, num_expanded, &(emitting_arcs_[0]));
+  } else {
+    // Each thread expands a contiguous range of the tokens, so that the arcs
+    // in emitting_arcs_[0], emitting_arcs_[1] and so on are in the same order
+    // as if one thread had done them all.
+    if (emitting_thread_pool_ == NULL)
+      emitting_thread_pool_ = new ThreadPool(config_.num_emitting_threads);
+    emitting_thread_pool_->Run(num_threads, [&](int32 t) {
+        size_t begin = num_expanded * t / num_threads,
+            end = num_expanded * (t + 1) / num_threads;
+        ExpandEmittingArcs<FstType>(fst, elems + begin, end - begin,
+                                    &(emitting_arcs_[t]));
+      });
+  }
+  const BaseFloat *loglikes = GetFrameLogLikelihoods(fst, decodable, frame,
+                                                     num_threads, best_elem,
+                                                     cur_cutoff);
+
   // First process the best token to get a hopefully
   // reasonably tight bound on the next cutoff.  The only
   // products of the next block are "next_cutoff" and "cost_offset".
@@ -723,8 +994,8 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
          aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) {  // propagate..
-        BaseFloat new_weight = arc.weight.Value() + cost_offset - 
-            decodable->LogLikelihood(frame, arc.ilabel) + tok->tot_cost;
+        BaseFloat new_weight = arc.weight.Value() + cost_offset -
+            loglikes[arc.ilabel] + tok->tot_cost;
         if (new_weight + adaptive_beam < next_cutoff)
           next_cutoff = new_weight + adaptive_beam;
       }
@@ -737,64 +1008,103 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
   cost_offsets_.resize(frame + 1, 0.0);
   cost_offsets_[frame] = cost_offset;
 
-  // the tokens are now owned here, in final_toks, and the hash is empty.
-  // 'owned' is a complex thing here; the point is we need to call DeleteElem
-  // on each elem 'e' to let toks_ know we're done with them.
-  for (Elem *e = final_toks, *e_tail; e != NULL; e = e_tail) {
-    // loop this way because we delete "e" as we go.
-    StateId state = e->key;
-    Token *tok = e->val;
-    if (tok->tot_cost <= cur_cutoff) {
-      for (fst::ArcIterator<FstType> aiter(fst, state);
-           !aiter.Done();
-           aiter.Next()) {
-        const Arc &arc = aiter.Value();
-        if (arc.ilabel != 0) {  // propagate..
-          BaseFloat ac_cost = cost_offset -
-              decodable->LogLikelihood(frame, arc.ilabel),
-              graph_cost = arc.weight.Value(),
-              cur_cost = tok->tot_cost,
-              tot_cost = cur_cost + ac_cost + graph_cost;
-          if (tot_cost > next_cutoff) continue;
-          else if (tot_cost + adaptive_beam < next_cutoff)
-            next_cutoff = tot_cost + adaptive_beam; // prune by best current token
-          // Note: the frame indexes into active_toks_ are one-based,
-          // hence the + 1.
-          Token *next_tok = FindOrAddToken(arc.nextstate,
-                                           frame + 1, tot_cost, NULL);
-          // NULL: no change indicator needed
-
-          // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLink(next_tok, arc.ilabel, arc.olabel,
-                                       graph_cost, ac_cost, tok->links);
-        }
-      } // for all arcs
+  int32 num_links = 0;
+  for (int32 t = 0; t < num_threads; t++) {
+    typename std::vector<EmittingArc>::const_iterator
+        iter = emitting_arcs_[t].arcs.begin(),
+        end = emitting_arcs_[t].arcs.end();
+    for (; iter != end; ++iter) {
+      Token *tok = iter->tok;
+      BaseFloat ac_cost = cost_offset - loglikes[iter->ilabel],
+          graph_cost = iter->graph_cost,
+          cur_cost = tok->tot_cost,
+          tot_cost = cur_cost + ac_cost + graph_cost;
+      if (tot_cost > next_cutoff) continue;
+      else if (tot_cost + adaptive_beam < next_cutoff)
+        next_cutoff = tot_cost + adaptive_beam; // prune by best current token
+      // Note: the frame indexes into active_toks_ are one-based,
+      // hence the + 1.
+      Token *next_tok = FindOrAddToken(iter->nextstate,
+                                       frame + 1, tot_cost, NULL);
+      // NULL: no change indicator needed
+
+      // Add ForwardLink from tok to next_tok (put on head of list tok->links)
+      tok->links = NewForwardLink(next_tok, iter->ilabel, iter->olabel,
+                                  graph_cost, ac_cost, tok->links);
+      num_links++;
     }
-    e_tail = e->tail;
-    toks_.Delete(e); // delete Elem
   }
+  // the tokens are now owned here, in final_toks, and the hash no longer
+  // indexes them; we need to call toks_.Delete() on each of them.
+  DeleteElems(final_toks);
+  SetCutoffFrameStats(tok_cnt, num_expanded);
+  frame_stats_.num_emitting_arcs = num_links;
+  frame_stats_.adaptive_beam = adaptive_beam;
+  // The best token on the next frame will probably have a cost close to
+  // this; GetCutoffApprox() uses it to place its histogram.  (It's
+  // infinity if no arc was within the beam, in which case it isn't used.)
+  best_cost_estimate_ = next_cutoff - adaptive_beam;
   return next_cutoff;
 }
 
-template BaseFloat LatticeFasterDecoder::ProcessEmitting<fst::ConstFst<fst::StdArc>>(
-        DecodableInterface *decodable);
-template BaseFloat LatticeFasterDecoder::ProcessEmitting<fst::VectorFst<fst::StdArc>>(
-        DecodableInterface *decodable);
-template BaseFloat LatticeFasterDecoder::ProcessEmitting<fst::Fst<fst::StdArc>>(
-        DecodableInterface *decodable);
+template <template <class, class> class HashType>
+template <typename FstType>
+void LatticeFasterDecoderTpl<HashType>::ExpandEmittingArcs(
+    const FstType &fst, Elem *const *elems, size_t num_elems,
+    EmittingArcs *out) {
+  out->arcs.clear();
+  for (size_t i = 0; i < out->labels.size(); i++)
+    out->label_seen[out->labels[i]] = 0;
+  out->labels.clear();
+  for (size_t i = 0; i < num_elems; i++) {
+    Token *tok = elems[i]->val;
+    for (fst::ArcIterator<FstType> aiter(fst, elems[i]->key);
+         !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel != 0) {
+        EmittingArc emitting_arc;
+        emitting_arc.tok = tok;
+        emitting_arc.nextstate = arc.nextstate;
+        emitting_arc.ilabel = arc.ilabel;
+        emitting_arc.olabel = arc.olabel;
+        emitting_arc.graph_cost = arc.weight.Value();
+        out->arcs.push_back(emitting_arc);
+        if (static_cast<size_t>(arc.ilabel) >= out->label_seen.size())
+          out->label_seen.resize(arc.ilabel + 1, 0);
+        if (!out->label_seen[arc.ilabel]) {
+          out->label_seen[arc.ilabel] = 1;
+          out->labels.push_back(arc.ilabel);
+        }
+      }
+    }
+  }
+}
 
-BaseFloat LatticeFasterDecoder::ProcessEmittingWrapper(DecodableInterface *decodable) {
+template <template <class, class> class HashType>
+BaseFloat LatticeFasterDecoderTpl<HashType>::ProcessEmittingWrapper(
+    DecodableInterface *decodable) {
   if (fst_.Type() == "const") {
-    return LatticeFasterDecoder::ProcessEmitting<fst::ConstFst<Arc>>(decodable);
+    return ProcessEmitting<fst::ConstFst<Arc>>(decodable);
   } else if (fst_.Type() == "vector") {
-    return LatticeFasterDecoder::ProcessEmitting<fst::VectorFst<Arc>>(decodable);
+    return ProcessEmitting<fst::VectorFst<Arc>>(decodable);
+  } else if (fst_.Type() == "mapped") {
+    return ProcessEmitting<fst::MappedFst<Arc>>(decodable);
   } else {
-    return LatticeFasterDecoder::ProcessEmitting<fst::Fst<Arc>>(decodable);
+    static bool warned = false;
+    if (config_.num_emitting_threads > 1 && !warned) {
+      warned = true;
+      KALDI_WARN << "Ignoring --num-emitting-threads for FST of type "
+                 << fst_.Type() << "; only const, vector and mapped FSTs "
+                 << "are supported.";
+    }
+    return ProcessEmitting<fst::Fst<Arc>>(decodable);
   }
 }
 
-template <typename FstType> 
-void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
+template <template <class, class> class HashType>
+template <typename FstType>
+void LatticeFasterDecoderTpl<HashType>::ProcessNonemitting(BaseFloat cutoff) {
   KALDI_ASSERT(!active_toks_.empty());
   int32 frame = static_cast<int32>(active_toks_.size()) - 2;
   // Note: "frame" is the time-index we just processed, or -1 if
@@ -809,6 +1119,7 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
   // problem did not improve overall speed.
 
   KALDI_ASSERT(queue_.empty());
+  int32 num_links = 0;
   for (const Elem *e = toks_.GetList(); e != NULL;  e = e->tail)
     queue_.push_back(e->key);
   if (queue_.empty()) {
@@ -830,8 +1141,7 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
     // because we're about to regenerate them.  This is a kind
     // of non-optimality (remember, this is the simple decoder),
     // but since most states are emitting it's not a huge issue.
-    tok->DeleteForwardLinks(); // necessary when re-visiting
-    tok->links = NULL;
+    DeleteForwardLinks(tok); // necessary when re-visiting
     for (fst::ArcIterator<FstType> aiter(fst, state);
          !aiter.Done();
          aiter.Next()) {
@@ -845,8 +1155,9 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
           Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           &changed);
 
-          tok->links = new ForwardLink(new_tok, 0, arc.olabel,
-                                       graph_cost, 0, tok->links);
+          tok->links = NewForwardLink(new_tok, 0, arc.olabel,
+                                      graph_cost, 0, tok->links);
+          num_links++;
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -855,40 +1166,41 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
       }
     } // for all arcs
   } // while queue not empty
+  frame_stats_.num_nonemitting_arcs += num_links;
 }
 
-template void LatticeFasterDecoder::ProcessNonemitting<fst::ConstFst<fst::StdArc>>(
-        BaseFloat cutoff);
-template void LatticeFasterDecoder::ProcessNonemitting<fst::VectorFst<fst::StdArc>>(
-        BaseFloat cutoff);
-template void LatticeFasterDecoder::ProcessNonemitting<fst::Fst<fst::StdArc>>(
-        BaseFloat cutoff);
-
-void LatticeFasterDecoder::ProcessNonemittingWrapper(BaseFloat cost_cutoff) {
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::ProcessNonemittingWrapper(
+    BaseFloat cost_cutoff) {
   if (fst_.Type() == "const") {
-    return LatticeFasterDecoder::ProcessNonemitting<fst::ConstFst<Arc>>(cost_cutoff);
+    return ProcessNonemitting<fst::ConstFst<Arc>>(cost_cutoff);
   } else if (fst_.Type() == "vector") {
-    return LatticeFasterDecoder::ProcessNonemitting<fst::VectorFst<Arc>>(cost_cutoff);
+    return ProcessNonemitting<fst::VectorFst<Arc>>(cost_cutoff);
+  } else if (fst_.Type() == "mapped") {
+    return ProcessNonemitting<fst::MappedFst<Arc>>(cost_cutoff);
   } else {
-    return LatticeFasterDecoder::ProcessNonemitting<fst::Fst<Arc>>(cost_cutoff);
+    return ProcessNonemitting<fst::Fst<Arc>>(cost_cutoff);
   }
 }
 
-void LatticeFasterDecoder::DeleteElems(Elem *list) {
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::DeleteElems(Elem *list) {
   for (Elem *e = list, *e_tail; e != NULL; e = e_tail) {
     e_tail = e->tail;
     toks_.Delete(e);
   }
 }
 
-void LatticeFasterDecoder::ClearActiveTokens() { // a cleanup routine, at utt end/begin
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::ClearActiveTokens() {
+  // a cleanup routine, at utt end/begin
   for (size_t i = 0; i < active_toks_.size(); i++) {
     // Delete all tokens alive on this frame, and any forward
     // links they may have.
     for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-      tok->DeleteForwardLinks();
+      DeleteForwardLinks(tok);
       Token *next_tok = tok->next;
-      delete tok;
+      DeleteToken(tok);
       num_toks_--;
       tok = next_tok;
     }
@@ -898,10 +1210,11 @@ void LatticeFasterDecoder::ClearActiveTokens() { // a cleanup routine, at utt en
 }
 
 // static
-void LatticeFasterDecoder::TopSortTokens(Token *tok_list,
-                                         std::vector<Token*> *topsorted_list) {
+template <template <class, class> class HashType>
+void LatticeFasterDecoderTpl<HashType>::TopSortTokens(
+    Token *tok_list, std::vector<Token*> *topsorted_list) {
   unordered_map<Token*, int32> token2pos;
-  typedef unordered_map<Token*, int32>::iterator IterType;
+  typedef typename unordered_map<Token*, int32>::iterator IterType;
   int32 num_toks = 0;
   for (Token *tok = tok_list; tok != NULL; tok = tok->next)
     num_toks++;
@@ -915,9 +1228,11 @@ void LatticeFasterDecoder::TopSortTokens(Token *tok_list,
 
   unordered_set<Token*> reprocess;
 
-  for (IterType iter = token2pos.begin(); iter != token2pos.end(); ++iter) {
-    Token *tok = iter->first;
-    int32 pos = iter->second;
+  // Note: we iterate over the list rather than over token2pos, and we sort the
+  // tokens to reprocess below, so that the order of the output (and hence the
+  // state numbering of lattices) doesn't depend on the addresses of the tokens.
+  for (Token *tok = tok_list; tok != NULL; tok = tok->next) {
+    int32 pos = token2pos[tok];
     for (ForwardLink *link = tok->links; link != NULL; link = link->next) {
       if (link->ilabel == 0) {
         // We only need to consider epsilon links, since non-epsilon links
@@ -942,14 +1257,17 @@ void LatticeFasterDecoder::TopSortTokens(Token *tok_list,
   size_t max_loop = 1000000, loop_count; // max_loop is to detect epsilon cycles.
   for (loop_count = 0;
        !reprocess.empty() && loop_count < max_loop; ++loop_count) {
-    std::vector<Token*> reprocess_vec;
-    for (unordered_set<Token*>::iterator iter = reprocess.begin();
+    // pairs of (position, token), sorted on position.
+    std::vector<std::pair<int32, Token*> > reprocess_vec;
+    for (typename unordered_set<Token*>::iterator iter = reprocess.begin();
          iter != reprocess.end(); ++iter)
-      reprocess_vec.push_back(*iter);
+      reprocess_vec.push_back(std::make_pair(token2pos[*iter], *iter));
+    std::sort(reprocess_vec.begin(), reprocess_vec.end());
     reprocess.clear();
-    for (std::vector<Token*>::iterator iter = reprocess_vec.begin();
+    for (typename std::vector<std::pair<int32, Token*> >::iterator iter =
+             reprocess_vec.begin();
          iter != reprocess_vec.end(); ++iter) {
-      Token *tok = *iter;
+      Token *tok = iter->second;
       int32 pos = token2pos[tok];
       // Repeat the processing we did above (for comments, see above).
       for (ForwardLink *link = tok->links; link != NULL; link = link->next) {
@@ -975,4 +1293,8 @@ void LatticeFasterDecoder::TopSortTokens(Token *tok_list,
     (*topsorted_list)[iter->second] = iter->first;
 }
 
+// Instantiate the template for the hash types we use.
+template class LatticeFasterDecoderTpl<HashList>;
+template class LatticeFasterDecoderTpl<OpenHashList>;
+
 } // end namespace kaldi.
@@ -30,11 +30,15 @@
 
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
+#include "util/open-hash-list.h"
+#include "util/memory-pool.h"
+#include "util/kaldi-thread.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
 #include "lat/determinize-lattice-pruned.h"
 #include "lat/kaldi-lattice.h"
+#include "decoder/decoder-stats.h"
 
 namespace kaldi {
 
@@ -51,6 +55,14 @@ struct LatticeFasterDecoderConfig {
   BaseFloat prune_scale;   // Note: we don't make this configurable on the command line,
                            // it's not a very important parameter.  It affects the
                            // algorithm that prunes the tokens as we go.
+  bool use_memory_pool;  // If true, Tokens and ForwardLinks are allocated from
+                         // per-decoder pools rather than the global heap.
+  int32 num_emitting_threads;  // Number of threads used to expand emitting
+                               // arcs within a frame; output does not depend
+                               // on it.
+  int32 max_active_histogram_bins;  // If >0, approximate the max-active and
+                                    // min-active cutoffs with a histogram of
+                                    // this many bins (see GetCutoff()).
   // Most of the options inside det_opts are not actually queried by the
   // LatticeFasterDecoder class itself, but by the code that calls it, for
   // example in the function DecodeUtteranceLatticeFaster.
@@ -64,7 +76,10 @@ struct LatticeFasterDecoderConfig {
                                 determinize_lattice(true),
                                 beam_delta(0.5),
                                 hash_ratio(2.0),
-                                prune_scale(0.1) { }
+                                prune_scale(0.1),
+                                use_memory_pool(true),
+                                num_emitting_threads(1),
+                                max_active_histogram_bins(0) { }
   void Register(OptionsItf *opts) {
     det_opts.Register(opts);
     opts->Register("beam", &beam, "Decoding beam.  Larger->slower, more accurate.");
@@ -83,11 +98,33 @@ struct LatticeFasterDecoderConfig {
                    "max-active constraint is applied.  Larger is more accurate.");
     opts->Register("hash-ratio", &hash_ratio, "Setting used in decoder to "
                    "control hash behavior");
+    opts->Register("use-memory-pool", &use_memory_pool, "If true, allocate "
+                   "the decoder's tokens and links from a per-decoder memory "
+                   "pool that is reused across utterances, instead of from the "
+                   "global heap (reduces malloc contention in multi-threaded "
+                   "decoding).");
+    opts->Register("num-emitting-threads", &num_emitting_threads, "Number of "
+                   "threads used to expand the emitting arcs of the active "
+                   "tokens on each frame, to reduce the latency of decoding "
+                   "one utterance; the output is identical for any value.  "
+                   "Only supported by LatticeFasterDecoder, and only for "
+                   "graphs of type const, vector or mapped (other FST types "
+                   "may not be safe to read from several threads).");
+    opts->Register("max-active-histogram-bins", &max_active_histogram_bins,
+                   "If >0, compute the max-active and min-active cutoffs "
+                   "approximately, from a histogram with this many bins over "
+                   "the beam that is centered using the previous frame's "
+                   "best cost, instead of with a partial sort of the token "
+                   "costs.  Faster with large --max-active; 100 or more is "
+                   "reasonable.  Use a verbose level of 1 or more to see how "
+                   "accurate it is.");
   }
   void Check() const {
     KALDI_ASSERT(beam > 0.0 && max_active > 1 && lattice_beam > 0.0
                  && prune_interval > 0 && beam_delta > 0.0 && hash_ratio >= 1.0
-                 && prune_scale > 0.0 && prune_scale < 1.0);
+                 && prune_scale > 0.0 && prune_scale < 1.0
+                 && num_emitting_threads > 0
+                 && max_active_histogram_bins >= 0);
   }
 };
 
@@ -95,8 +132,16 @@ struct LatticeFasterDecoderConfig {
 /** A bit more optimized version of the lattice decoder.
    See \ref lattices_generation \ref decoders_faster and \ref decoders_simple
     for more information.
+
+   The template argument HashType is the type of the hash that maps graph
+   states to the tokens active on the current frame; it must have the interface
+   of HashList (see ../util/hash-list.h), which is the default.  OpenHashList
+   (see ../util/open-hash-list.h) is an open-addressing alternative that is
+   often faster for large graphs and beams.  Most code should use the typedef
+   LatticeFasterDecoder below.
  */
-class LatticeFasterDecoder {
+template <template <class, class> class HashType = HashList>
+class LatticeFasterDecoderTpl {
  public:
   typedef fst::StdArc Arc;
   typedef Arc::Label Label;
@@ -104,13 +149,13 @@ class LatticeFasterDecoder {
   typedef Arc::Weight Weight;
 
   // instantiate this class once for each thing you have to decode.
-  LatticeFasterDecoder(const fst::Fst<fst::StdArc> &fst,
-                       const LatticeFasterDecoderConfig &config);
+  LatticeFasterDecoderTpl(const fst::Fst<fst::StdArc> &fst,
+                          const LatticeFasterDecoderConfig &config);
 
   // This version of the initializer "takes ownership" of the fst,
   // and will delete it when this object is destroyed.
-  LatticeFasterDecoder(const LatticeFasterDecoderConfig &config,
-                       fst::Fst<fst::StdArc> *fst);
+  LatticeFasterDecoderTpl(const LatticeFasterDecoderConfig &config,
+                          fst::Fst<fst::StdArc> *fst);
 
 
   void SetOptions(const LatticeFasterDecoderConfig &config) {
@@ -121,7 +166,7 @@ class LatticeFasterDecoder {
     return config_;
   }
 
-  ~LatticeFasterDecoder();
+  ~LatticeFasterDecoderTpl();
 
   /// Decodes until there are no more frames left in the "decodable" object..
   /// note, this may block waiting for input if the "decodable" object blocks.
@@ -207,6 +252,21 @@ class LatticeFasterDecoder {
   // whenever we call ProcessEmitting().
   inline int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
 
+  // Returns the number of tokens created since InitDecoding() was called,
+  // including ones that were later pruned away.  This is for diagnostics and
+  // benchmarking.
+  inline int64 NumTokensCreated() const { return num_toks_created_; }
+
+  /// Attaches a DecoderStats object to which per-frame statistics (numbers of
+  /// tokens and arcs, the adaptive beam and pruning cutoffs, timings) will be
+  /// added, or detaches it if NULL.  It is not owned here.  InitDecoding()
+  /// calls its StartUtterance(), and so does this function if we haven't
+  /// decoded any frames yet.
+  void SetStats(DecoderStats *stats) {
+    stats_ = stats;
+    if (stats_ != NULL && active_toks_.size() == 1) stats_->StartUtterance();
+  }
+
  private:
   // ForwardLinks are the links from a token to a token on the next frame.
   // or sometimes on the current frame (for input-epsilon links).
@@ -244,15 +304,6 @@ class LatticeFasterDecoder {
     inline Token(BaseFloat tot_cost, BaseFloat extra_cost, ForwardLink *links,
                  Token *next):
         tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next) { }
-    inline void DeleteForwardLinks() {
-      ForwardLink *l = links, *m;
-      while (l != NULL) {
-        m = l->next;
-        delete l;
-        l = m;
-      }
-      links = NULL;
-    }
   };
 
   // head of per-frame list of Tokens (list is in topological order),
@@ -265,7 +316,48 @@ class LatticeFasterDecoder {
                  must_prune_tokens(true) { }
   };
 
-  typedef HashList<StateId, Token*>::Elem Elem;
+  typedef typename HashType<StateId, Token*>::Elem Elem;
+
+  // The following four functions are used for all allocation and deallocation
+  // of Tokens and ForwardLinks.  Depending on use_memory_pool_ they use the
+  // pools token_pool_ and link_pool_, or plain new and delete.
+  inline Token *NewToken(BaseFloat tot_cost, BaseFloat extra_cost,
+                         ForwardLink *links, Token *next) {
+    if (use_memory_pool_)
+      return token_pool_.New(tot_cost, extra_cost, links, next);
+    else
+      return new Token(tot_cost, extra_cost, links, next);
+  }
+  inline void DeleteToken(Token *tok) {
+    if (use_memory_pool_) token_pool_.Delete(tok);
+    else delete tok;
+  }
+  inline ForwardLink *NewForwardLink(Token *next_tok, Label ilabel,
+                                     Label olabel, BaseFloat graph_cost,
+                                     BaseFloat acoustic_cost,
+                                     ForwardLink *next) {
+    if (use_memory_pool_)
+      return link_pool_.New(next_tok, ilabel, olabel, graph_cost,
+                            acoustic_cost, next);
+    else
+      return new ForwardLink(next_tok, ilabel, olabel, graph_cost,
+                             acoustic_cost, next);
+  }
+  inline void DeleteForwardLink(ForwardLink *link) {
+    if (use_memory_pool_) link_pool_.Delete(link);
+    else delete link;
+  }
+
+  // Deletes all the forward links of token "tok" and sets tok->links to NULL.
+  inline void DeleteForwardLinks(Token *tok) {
+    ForwardLink *l = tok->links, *m;
+    while (l != NULL) {
+      m = l->next;
+      DeleteForwardLink(l);
+      l = m;
+    }
+    tok->links = NULL;
+  }
 
   void PossiblyResizeHash(size_t num_toks);
 
@@ -338,11 +430,81 @@ class LatticeFasterDecoder {
   BaseFloat GetCutoff(Elem *list_head, size_t *tok_count,
                       BaseFloat *adaptive_beam, Elem **best_elem);
 
+  /// Called from GetCutoff() if config_.max_active_histogram_bins > 0: does
+  /// the same thing, except that the max-active and min-active cutoffs are
+  /// interpolated from a histogram of the token costs, whose range is the beam
+  /// starting from best_cost_estimate_.  Returns false (and the caller must
+  /// fall back to the exact method) if the cutoff falls in the first bin but
+  /// there were tokens below its range.
+  bool GetCutoffApprox(Elem *list_head, size_t *tok_count,
+                       BaseFloat *adaptive_beam, Elem **best_elem,
+                       BaseFloat *cutoff);
+
+  /// Used by GetCutoffApprox(): returns the approximate cost of the token
+  /// with zero-based rank n (in order of increasing cost) from histogram_,
+  /// whose bins start at 'lower' and are 'bin_width' wide, or infinity if
+  /// there are no more than n tokens in the histogram.  If the answer is in
+  /// the first bin and num_below > 0 tokens were put in that bin because they
+  /// were below its range, sets *ok to false.
+  BaseFloat HistogramCutoff(size_t n, BaseFloat lower, BaseFloat bin_width,
+                            size_t num_below, bool *ok) const;
+
+  /// Prunes the tokens if it is time to, and processes the emitting and
+  /// nonemitting arcs for one frame; also collects stats if stats_ != NULL.
+  void DecodeOneFrame(DecodableInterface *decodable);
+
+  /// Sets the token counts and cutoff stats in frame_stats_ at the end of
+  /// ProcessEmitting().
+  void SetCutoffFrameStats(size_t tok_count, size_t num_expanded);
+
+  /// Gets from the decodable object, with a single call to its
+  /// LogLikelihoods() function, the log-likelihoods on this frame of all the
+  /// input labels in the first 'num_buffers' elements of emitting_arcs_, and
+  /// of the arcs out of 'best_elem' if its cost is above 'cutoff' (so that
+  /// they were not expanded).  Returns an array indexed by input label, which
+  /// is only valid for those labels (and until the next call).  Called from
+  /// ProcessEmitting().
+  template <typename FstType>
+  const BaseFloat *GetFrameLogLikelihoods(const FstType &fst,
+                                          DecodableInterface *decodable,
+                                          int32 frame, int32 num_buffers,
+                                          const Elem *best_elem,
+                                          BaseFloat cutoff);
+
+  /// Adds 'ilabel' to needed_labels_ if it is not already there.
+  inline void AddNeededLabel(Label ilabel);
+
   /// Processes emitting arcs for one frame.  Propagates from prev_toks_ to cur_toks_.
   /// Returns the cost cutoff for subsequent ProcessNonemitting() to use.
   /// Templated on FST type for speed; called via ProcessEmittingWrapper().
   template <typename FstType> BaseFloat ProcessEmitting(DecodableInterface *decodable);
 
+  // An emitting arc out of a token on the previous frame, as expanded by
+  // ExpandEmittingArcs() before we have the acoustic log-likelihoods.
+  struct EmittingArc {
+    Token *tok;  // the token the arc leaves.
+    StateId nextstate;
+    Label ilabel;
+    Label olabel;
+    BaseFloat graph_cost;
+  };
+
+  // The emitting arcs out of a contiguous range of the previous frame's
+  // tokens, and their input labels, as output by ExpandEmittingArcs().
+  struct EmittingArcs {
+    std::vector<EmittingArc> arcs;
+    std::vector<Label> labels;  // The distinct input labels of 'arcs'.
+    std::vector<char> label_seen;  // Indexed by input label; nonzero for the
+                                   // labels in 'labels'.
+  };
+
+  // Called by ProcessEmitting(), possibly in several threads at once, each
+  // with its own 'out'.  Sets 'out' to the emitting arcs out of the
+  // 'num_elems' tokens in 'elems', in order, and their input labels.
+  template <typename FstType>
+  static void ExpandEmittingArcs(const FstType &fst, Elem *const *elems,
+                                 size_t num_elems, EmittingArcs *out);
+
   BaseFloat ProcessEmittingWrapper(DecodableInterface *decodable);
 
   /// Processes nonemitting (epsilon) arcs for one frame.  Called after
@@ -353,21 +515,40 @@ class LatticeFasterDecoder {
 
   void ProcessNonemittingWrapper(BaseFloat cost_cutoff);
 
-  // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
+  // HashType is HashList (defined in ../util/hash-list.h) or something with
+  // the same interface.  It actually allows us to maintain
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.  It is indexed by frame-index
   // plus one, where the frame-index is zero-based, as used in decodable object.
   // That is, the emitting probs of frame t are accounted for in tokens at
   // toks_[t+1].  The zeroth frame is for nonemitting transition at the start of
   // the graph.
-  HashList<StateId, Token*> toks_;
+  HashType<StateId, Token*> toks_;
 
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
+  std::vector<int32> histogram_;  // used in GetCutoffApprox().
   // make it class member to avoid internal new/delete.
+  // The next two are used in ProcessEmitting(): the previous frame's Elems
+  // that are within the cutoff, in list order, and the buffers of expanded
+  // arcs (one per thread).
+  std::vector<Elem*> emitting_elems_;
+  std::vector<EmittingArcs> emitting_arcs_;
+  // The threads used by ProcessEmitting(); owned here, and created on first
+  // use, so that we don't start threads on every frame.
+  ThreadPool *emitting_thread_pool_;
+  // The next four are used in GetFrameLogLikelihoods(): the log-likelihoods
+  // indexed by input label; for each input label, nonzero if it's in
+  // needed_labels_ (they are all zero between calls); and the input labels
+  // whose log-likelihoods we need on the current frame, and those
+  // log-likelihoods.
+  std::vector<BaseFloat> frame_loglikes_;
+  std::vector<char> label_needed_;
+  std::vector<int32> needed_labels_;
+  std::vector<BaseFloat> needed_loglikes_;
   const fst::Fst<fst::StdArc> &fst_;
   bool delete_fst_;
   std::vector<BaseFloat> cost_offsets_; // This contains, for each
@@ -376,6 +557,23 @@ class LatticeFasterDecoder {
   // zero, to reduce roundoff errors.
   LatticeFasterDecoderConfig config_;
   int32 num_toks_; // current total #toks allocated...
+  int64 num_toks_created_;  // total #toks created since InitDecoding().
+  // An estimate of the best token cost on the current frame, from the cutoff
+  // of the previous frame's ProcessEmitting(); not finite if none.  It is where
+  // the histogram in GetCutoffApprox() starts.
+  BaseFloat best_cost_estimate_;
+  bool max_active_limited_;  // True if max-active gave the tightest cutoff in
+                             // the last call to GetCutoff().
+  DecoderStats *stats_;  // Not owned; NULL if we're not collecting stats.
+  DecoderFrameStats frame_stats_;  // The stats for the current frame.
+  // use_memory_pool_ is a copy of config_.use_memory_pool, taken when there are
+  // no tokens allocated (in the constructor and in InitDecoding()), so that a
+  // call to SetOptions() can't make us free an object with the wrong method.
+  bool use_memory_pool_;
+  MemoryPool<Token> token_pool_;  // Tokens are allocated from here if
+                                  // use_memory_pool_ is true.
+  MemoryPool<ForwardLink> link_pool_;  // ForwardLinks are allocated from here
+                                       // if use_memory_pool_ is true.
   bool warned_;
 
   /// decoding_finalized_ is true if someone called FinalizeDecoding().  [note,
@@ -416,9 +614,11 @@ class LatticeFasterDecoder {
 
   void ClearActiveTokens();
 
-  KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterDecoder);
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterDecoderTpl);
 };
 
+typedef LatticeFasterDecoderTpl<HashList> LatticeFasterDecoder;
+
 
 
 } // end namespace kaldi.
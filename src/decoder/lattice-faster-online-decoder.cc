@@ -26,46 +26,81 @@
 
 #include "decoder/lattice-faster-online-decoder.h"
 #include "lat/lattice-functions.h"
+#include "base/timer.h"
 
 namespace kaldi {
 
+// This decoder expands emitting arcs on a single thread; warn once if the
+// config asks for more, since the option would otherwise be silently ignored.
+static void WarnIfThreaded(const LatticeFasterDecoderConfig &config) {
+  static bool warned = false;
+  if (config.num_emitting_threads > 1 && !warned) {
+    warned = true;
+    KALDI_WARN << "Ignoring --num-emitting-threads="
+               << config.num_emitting_threads
+               << ": LatticeFasterOnlineDecoder uses a single thread.";
+  }
+}
+
 // instantiate this class once for each thing you have to decode.
-LatticeFasterOnlineDecoder::LatticeFasterOnlineDecoder(
+template <template <class, class> class HashType>
+LatticeFasterOnlineDecoderTpl<HashType>::LatticeFasterOnlineDecoderTpl(
     const fst::Fst<fst::StdArc> &fst,
     const LatticeFasterDecoderConfig &config):
-    fst_(fst), delete_fst_(false), config_(config), num_toks_(0) {
+    fst_(fst), delete_fst_(false), config_(config), num_toks_(0),
+    frozen_frame_(0), chunk_frame_(0),
+    best_cost_estimate_(std::numeric_limits<BaseFloat>::infinity()),
+    max_active_limited_(false), stats_(NULL),
+    use_memory_pool_(config.use_memory_pool) {
   config.Check();
+  WarnIfThreaded(config);
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
 
 
-LatticeFasterOnlineDecoder::LatticeFasterOnlineDecoder(const LatticeFasterDecoderConfig &config,
-                                                       fst::Fst<fst::StdArc> *fst):
-    fst_(*fst), delete_fst_(true), config_(config), num_toks_(0) {
+template <template <class, class> class HashType>
+LatticeFasterOnlineDecoderTpl<HashType>::LatticeFasterOnlineDecoderTpl(
+    const LatticeFasterDecoderConfig &config,
+    fst::Fst<fst::StdArc> *fst):
+    fst_(*fst), delete_fst_(true), config_(config), num_toks_(0),
+    frozen_frame_(0), chunk_frame_(0),
+    best_cost_estimate_(std::numeric_limits<BaseFloat>::infinity()),
+    max_active_limited_(false), stats_(NULL),
+    use_memory_pool_(config.use_memory_pool) {
   config.Check();
+  WarnIfThreaded(config);
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
 
 
-LatticeFasterOnlineDecoder::~LatticeFasterOnlineDecoder() {
+template <template <class, class> class HashType>
+LatticeFasterOnlineDecoderTpl<HashType>::~LatticeFasterOnlineDecoderTpl() {
   DeleteElems(toks_.Clear());
   ClearActiveTokens();
   if (delete_fst_) delete &(fst_);
 }
 
-void LatticeFasterOnlineDecoder::InitDecoding() {
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::InitDecoding() {
   // clean up from last time:
   DeleteElems(toks_.Clear());
   cost_offsets_.clear();
   ClearActiveTokens();
+  use_memory_pool_ = config_.use_memory_pool;
   warned_ = false;
   num_toks_ = 0;
+  frozen_frame_ = 0;
+  chunk_frame_ = 0;
+  chunk_token_index_.clear();
+  best_cost_estimate_ = std::numeric_limits<BaseFloat>::infinity();
   decoding_finalized_ = false;
+  if (stats_ != NULL)
+    stats_->StartUtterance();
   final_costs_.clear();
   StateId start_state = fst_.Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL, NULL);
+  Token *start_tok = NewToken(0.0, 0.0, NULL, NULL, NULL);
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
@@ -75,7 +110,9 @@ void LatticeFasterOnlineDecoder::InitDecoding() {
 // Returns true if any kind of traceback is available (not necessarily from
 // a final state).  It should only very rarely return false; this indicates
 // an unusual search error.
-bool LatticeFasterOnlineDecoder::Decode(DecodableInterface *decodable) {
+template <template <class, class> class HashType>
+bool LatticeFasterOnlineDecoderTpl<HashType>::Decode(
+    DecodableInterface *decodable) {
   InitDecoding();
 
   // We use 1-based indexing for frames in this decoder (if you view it in
@@ -83,10 +120,7 @@ bool LatticeFasterOnlineDecoder::Decode(DecodableInterface *decodable) {
   // numbering, which we have to correct for when we call it.
 
   while (!decodable->IsLastFrame(NumFramesDecoded() - 1)) {
-    if (NumFramesDecoded() % config_.prune_interval == 0)
-      PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
-    BaseFloat cost_cutoff = ProcessEmittingWrapper(decodable);  // Note: the value returned by
-    ProcessNonemittingWrapper(cost_cutoff);
+    DecodeOneFrame(decodable);
   }
   FinalizeDecoding();
 
@@ -99,7 +133,9 @@ bool LatticeFasterOnlineDecoder::Decode(DecodableInterface *decodable) {
 
 
 
-bool LatticeFasterOnlineDecoder::TestGetBestPath(bool use_final_probs) const {
+template <template <class, class> class HashType>
+bool LatticeFasterOnlineDecoderTpl<HashType>::TestGetBestPath(
+    bool use_final_probs) const {
   Lattice lat1;
   {
     Lattice raw_lat;
@@ -120,8 +156,9 @@ bool LatticeFasterOnlineDecoder::TestGetBestPath(bool use_final_probs) const {
 
 
 // Outputs an FST corresponding to the single best path through the lattice.
-bool LatticeFasterOnlineDecoder::GetBestPath(Lattice *olat,
-                                             bool use_final_probs) const {
+template <template <class, class> class HashType>
+bool LatticeFasterOnlineDecoderTpl<HashType>::GetBestPath(
+    Lattice *olat, bool use_final_probs) const {
   olat->DeleteStates();
   BaseFloat final_graph_cost;
   BestPathIterator iter = BestPathEnd(use_final_probs, &final_graph_cost);
@@ -144,8 +181,9 @@ bool LatticeFasterOnlineDecoder::GetBestPath(Lattice *olat,
 
 // Outputs an FST corresponding to the raw, state-level
 // tracebacks.
-bool LatticeFasterOnlineDecoder::GetRawLattice(Lattice *ofst,
-                                               bool use_final_probs) const {
+template <template <class, class> class HashType>
+bool LatticeFasterOnlineDecoderTpl<HashType>::GetRawLattice(
+    Lattice *ofst, bool use_final_probs) const {
   typedef LatticeArc Arc;
   typedef Arc::StateId StateId;
   typedef Arc::Weight Weight;
@@ -172,9 +210,33 @@ bool LatticeFasterOnlineDecoder::GetRawLattice(Lattice *ofst,
   KALDI_ASSERT(num_frames > 0);
   const int32 bucket_count = num_toks_/2 + 3;
   unordered_map<Token*, StateId> tok_map(bucket_count);
+  if (!CreateRawLattice(frozen_frame_, num_frames, ofst, &tok_map))
+    return false;
+  for (Token *tok = active_toks_[num_frames].toks; tok != NULL;
+       tok = tok->next) {
+    StateId cur_state = tok_map[tok];
+    if (use_final_probs && !final_costs.empty()) {
+      typename unordered_map<Token*, BaseFloat>::const_iterator iter =
+          final_costs.find(tok);
+      if (iter != final_costs.end())
+        ofst->SetFinal(cur_state, LatticeWeight(iter->second, 0));
+    } else {
+      ofst->SetFinal(cur_state, LatticeWeight::One());
+    }
+  }
+  return (ofst->NumStates() > 0);
+}
+
+
+template <template <class, class> class HashType>
+bool LatticeFasterOnlineDecoderTpl<HashType>::CreateRawLattice(
+    int32 begin_frame, int32 end_frame, Lattice *ofst,
+    unordered_map<Token*, StateId> *tok_map) const {
+  typedef LatticeArc Arc;
+  typedef Arc::Weight Weight;
   // First create all states.
   std::vector<Token*> token_list;
-  for (int32 f = 0; f <= num_frames; f++) {
+  for (int32 f = begin_frame; f <= end_frame; f++) {
     if (active_toks_[f].toks == NULL) {
       KALDI_WARN << "GetRawLattice: no tokens active on frame " << f
                  << ": not producing lattice.\n";
@@ -183,26 +245,31 @@ bool LatticeFasterOnlineDecoder::GetRawLattice(Lattice *ofst,
     TopSortTokens(active_toks_[f].toks, &token_list);
     for (size_t i = 0; i < token_list.size(); i++)
       if (token_list[i] != NULL)
-        tok_map[token_list[i]] = ofst->AddState();    
+        (*tok_map)[token_list[i]] = ofst->AddState();
   }
   // The next statement sets the start state of the output FST.  Because we
   // topologically sorted the tokens, state zero must be the start-state.
   ofst->SetStart(0);
-  
+
   KALDI_VLOG(4) << "init:" << num_toks_/2 + 3 << " buckets:"
-                << tok_map.bucket_count() << " load:" << tok_map.load_factor()
-                << " max:" << tok_map.max_load_factor();
+                << tok_map->bucket_count() << " load:"
+                << tok_map->load_factor() << " max:"
+                << tok_map->max_load_factor();
   // Now create all arcs.
-  for (int32 f = 0; f <= num_frames; f++) {
+  for (int32 f = begin_frame; f <= end_frame; f++) {
     for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
-      StateId cur_state = tok_map[tok];
+      StateId cur_state = (*tok_map)[tok];
       for (ForwardLink *l = tok->links;
            l != NULL;
            l = l->next) {
-        unordered_map<Token*, StateId>::const_iterator iter =
-            tok_map.find(l->next_tok);
+        typename unordered_map<Token*, StateId>::const_iterator iter =
+            tok_map->find(l->next_tok);
+        if (iter == tok_map->end()) {
+          // Links from the last frame to the next one are not output.
+          KALDI_ASSERT(f == end_frame && l->ilabel != 0);
+          continue;
+        }
         StateId nextstate = iter->second;
-        KALDI_ASSERT(iter != tok_map.end());
         BaseFloat cost_offset = 0.0;
         if (l->ilabel != 0) {  // emitting..
           KALDI_ASSERT(f >= 0 && f < cost_offsets_.size());
@@ -213,22 +280,13 @@ bool LatticeFasterOnlineDecoder::GetRawLattice(Lattice *ofst,
                 nextstate);
         ofst->AddArc(cur_state, arc);
       }
-      if (f == num_frames) {
-        if (use_final_probs && !final_costs.empty()) {
-          unordered_map<Token*, BaseFloat>::const_iterator iter =
-              final_costs.find(tok);
-          if (iter != final_costs.end())
-            ofst->SetFinal(cur_state, LatticeWeight(iter->second, 0));
-        } else {
-          ofst->SetFinal(cur_state, LatticeWeight::One());
-        }
-      }
     }
   }
-  return (ofst->NumStates() > 0);
+  return true;
 }
 
-bool LatticeFasterOnlineDecoder::GetRawLatticePruned(
+template <template <class, class> class HashType>
+bool LatticeFasterOnlineDecoderTpl<HashType>::GetRawLatticePruned(
     Lattice *ofst,
     bool use_final_probs,
     BaseFloat beam) const {
@@ -256,7 +314,7 @@ bool LatticeFasterOnlineDecoder::GetRawLatticePruned(
   // an extra frame for the start-state).
   int32 num_frames = active_toks_.size() - 1;
   KALDI_ASSERT(num_frames > 0);
-  for (int32 f = 0; f <= num_frames; f++) {
+  for (int32 f = frozen_frame_; f <= num_frames; f++) {
     if (active_toks_[f].toks == NULL) {
       KALDI_WARN << "GetRawLattice: no tokens active on frame " << f
                  << ": not producing lattice.\n";
@@ -267,12 +325,13 @@ bool LatticeFasterOnlineDecoder::GetRawLatticePruned(
   unordered_map<Token*, StateId> tok_map;
   std::queue<std::pair<Token*, int32> > tok_queue;
   // First initialize the queue and states.  Put the initial state on the queue;
-  // this is the last token in the list active_toks_[0].toks.
-  for (Token *tok = active_toks_[0].toks; tok != NULL; tok = tok->next) {
+  // this is the last token in the list active_toks_[frozen_frame_].toks.
+  for (Token *tok = active_toks_[frozen_frame_].toks; tok != NULL;
+       tok = tok->next) {
     if (tok->next == NULL) {
       tok_map[tok] = ofst->AddState();
       ofst->SetStart(tok_map[tok]);
-      std::pair<Token*, int32> tok_pair(tok, 0);  // #frame = 0
+      std::pair<Token*, int32> tok_pair(tok, frozen_frame_);
       tok_queue.push(tok_pair);
     }
   }  
@@ -285,7 +344,7 @@ bool LatticeFasterOnlineDecoder::GetRawLatticePruned(
     int32 cur_frame = cur_tok_pair.second;
     KALDI_ASSERT(cur_frame >= 0 && cur_frame <= cost_offsets_.size());
     
-    unordered_map<Token*, StateId>::const_iterator iter =
+    typename unordered_map<Token*, StateId>::const_iterator iter =
         tok_map.find(cur_tok);
     KALDI_ASSERT(iter != tok_map.end());
     StateId cur_state = iter->second;
@@ -313,7 +372,7 @@ bool LatticeFasterOnlineDecoder::GetRawLatticePruned(
     }
     if (cur_frame == num_frames) {
       if (use_final_probs && !final_costs.empty()) {
-        unordered_map<Token*, BaseFloat>::const_iterator iter =
+        typename unordered_map<Token*, BaseFloat>::const_iterator iter =
             final_costs.find(cur_tok);
         if (iter != final_costs.end())
           ofst->SetFinal(cur_state, LatticeWeight(iter->second, 0));
@@ -326,7 +385,244 @@ bool LatticeFasterOnlineDecoder::GetRawLatticePruned(
 }
 
 
-void LatticeFasterOnlineDecoder::PossiblyResizeHash(size_t num_toks) {
+template <template <class, class> class HashType>
+typename LatticeFasterOnlineDecoderTpl<HashType>::Token *
+LatticeFasterOnlineDecoderTpl<HashType>::FrozenToken(
+    int32 frame_plus_one, unordered_set<Token*> *traceback_toks) const {
+  unordered_set<Token*> frame_toks;
+  for (Token *tok = active_toks_[frame_plus_one].toks; tok != NULL;
+       tok = tok->next)
+    frame_toks.insert(tok);
+  traceback_toks->clear();
+  Token *ans = NULL;
+  for (Token *tok = active_toks_[frame_plus_one + 1].toks; tok != NULL;
+       tok = tok->next) {
+    // Tokens with infinite extra_cost have not been pruned yet but have no
+    // forward links left; their backpointers may be invalid.
+    if (tok->extra_cost == std::numeric_limits<BaseFloat>::infinity())
+      continue;
+    Token *t = tok;
+    while (frame_toks.count(t) == 0) {  // go back to frame frame_plus_one.
+      t = t->backpointer;
+      KALDI_ASSERT(t != NULL);
+    }
+    // Now go back to the first token of the traceback on this frame.
+    traceback_toks->insert(t);
+    while (t->backpointer != NULL && frame_toks.count(t->backpointer) != 0) {
+      t = t->backpointer;
+      traceback_toks->insert(t);
+    }
+    if (ans == NULL) ans = t;
+    else if (ans != t) return NULL;
+  }
+  return ans;
+}
+
+
+template <template <class, class> class HashType>
+bool LatticeFasterOnlineDecoderTpl<HashType>::GetFrozenRawLattice(
+    int32 max_num_frames, Lattice *ofst) {
+  KALDI_ASSERT(!decoding_finalized_ &&
+               "You cannot call GetFrozenRawLattice() after FinalizeDecoding()");
+  KALDI_ASSERT(chunk_frame_ == 0 &&
+               "You cannot use both GetFrozenRawLattice() and GetRawLatticeChunk()");
+  ofst->DeleteStates();
+  // Pruning first makes it more likely that the tracebacks meet, and removes
+  // the tokens with no forward links.
+  PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+  int32 end_frame = std::min(max_num_frames, NumFramesDecoded() - 1);
+  Token *frozen_tok = NULL;
+  unordered_set<Token*> traceback_toks;
+  for (; end_frame > frozen_frame_; end_frame--) {
+    if ((frozen_tok = FrozenToken(end_frame, &traceback_toks)) != NULL)
+      break;
+  }
+  if (frozen_tok == NULL)
+    return false;
+
+  unordered_map<Token*, StateId> tok_map(num_toks_/2 + 3);
+  if (!CreateRawLattice(frozen_frame_, end_frame, ofst, &tok_map))
+    return false;
+  ofst->SetFinal(tok_map[frozen_tok], LatticeWeight::One());
+  fst::Connect(ofst);
+
+  // Delete the tokens before end_frame, and their forward links.
+  for (int32 f = frozen_frame_; f < end_frame; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; ) {
+      DeleteForwardLinks(tok);
+      Token *next_tok = tok->next;
+      DeleteToken(tok);
+      num_toks_--;
+      tok = next_tok;
+    }
+    active_toks_[f].toks = NULL;
+  }
+  // On end_frame, keep only the tokens on the tracebacks, with frozen_tok at
+  // the end of the list so that it will be the start state of the lattices
+  // we output later.  Links from the tokens we keep to the tokens we delete
+  // (which can only be epsilon links) are deleted too.
+  Token *kept_toks = NULL;
+  for (Token *tok = active_toks_[end_frame].toks; tok != NULL; ) {
+    Token *next_tok = tok->next;
+    if (traceback_toks.count(tok) == 0) {
+      DeleteForwardLinks(tok);
+      DeleteToken(tok);
+      num_toks_--;
+    } else if (tok != frozen_tok) {
+      tok->next = kept_toks;
+      kept_toks = tok;
+    }
+    tok = next_tok;
+  }
+  for (typename unordered_set<Token*>::const_iterator iter =
+           traceback_toks.begin(); iter != traceback_toks.end(); ++iter) {
+    Token *tok = *iter;
+    ForwardLink *prev_link = NULL;
+    for (ForwardLink *link = tok->links; link != NULL; ) {
+      ForwardLink *next_link = link->next;
+      if (link->ilabel == 0 && traceback_toks.count(link->next_tok) == 0) {
+        if (prev_link != NULL) prev_link->next = next_link;
+        else tok->links = next_link;
+        DeleteForwardLink(link);
+      } else {
+        prev_link = link;
+      }
+      link = next_link;
+    }
+  }
+  // The list kept_toks was reversed; reverse it back, and append frozen_tok.
+  Token *toks = frozen_tok;
+  frozen_tok->next = NULL;
+  frozen_tok->backpointer = NULL;
+  while (kept_toks != NULL) {
+    Token *next_tok = kept_toks->next;
+    kept_toks->next = toks;
+    toks = kept_toks;
+    kept_toks = next_tok;
+  }
+  active_toks_[end_frame].toks = toks;
+  active_toks_[end_frame].must_prune_forward_links = true;
+  active_toks_[end_frame].must_prune_tokens = true;
+  frozen_frame_ = end_frame;
+  return true;
+}
+
+
+template <template <class, class> class HashType>
+bool LatticeFasterOnlineDecoderTpl<HashType>::CreateRawLatticeChunk(
+    int32 end_frame, Lattice *ofst, std::vector<StateId> *initial_states,
+    unordered_map<Token*, StateId> *tok_map) const {
+  ofst->DeleteStates();
+  initial_states->clear();
+  if (!CreateRawLattice(chunk_frame_, end_frame, ofst, tok_map))
+    return false;
+  if (chunk_frame_ == 0)
+    return true;  // The first chunk, which starts at the start token.
+  ofst->SetStart(fst::kNoStateId);
+  initial_states->resize(chunk_token_index_.size(), fst::kNoStateId);
+  // CreateRawLattice() numbers the states in order of frame, so the states
+  // for the tokens on the first frame are 0 ... num_initial_states - 1.
+  StateId num_initial_states = 0;
+  for (Token *tok = active_toks_[chunk_frame_].toks; tok != NULL;
+       tok = tok->next, num_initial_states++) {
+    typename unordered_map<Token*, int32>::const_iterator iter =
+        chunk_token_index_.find(tok);
+    if (iter != chunk_token_index_.end())
+      (*initial_states)[iter->second] = (*tok_map)[tok];
+  }
+  // Remove the epsilon arcs between them.
+  std::vector<LatticeArc> arcs;
+  for (StateId s = 0; s < num_initial_states; s++) {
+    arcs.clear();
+    for (fst::ArcIterator<Lattice> aiter(*ofst, s); !aiter.Done();
+         aiter.Next()) {
+      const LatticeArc &arc = aiter.Value();
+      if (arc.ilabel != 0 || arc.nextstate >= num_initial_states)
+        arcs.push_back(arc);
+    }
+    if (arcs.size() != ofst->NumArcs(s)) {
+      ofst->DeleteArcs(s);
+      for (size_t i = 0; i < arcs.size(); i++)
+        ofst->AddArc(s, arcs[i]);
+    }
+  }
+  return true;
+}
+
+template <template <class, class> class HashType>
+bool LatticeFasterOnlineDecoderTpl<HashType>::GetRawLatticeChunk(
+    int32 end_frame, Lattice *ofst, std::vector<StateId> *initial_states,
+    std::vector<StateId> *final_states) {
+  KALDI_ASSERT(!decoding_finalized_ && frozen_frame_ == 0 &&
+               end_frame > chunk_frame_ && end_frame <= NumFramesDecoded());
+  // This sets the extra_costs, from which we estimate the costs to the end.
+  PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+  unordered_map<Token*, StateId> tok_map(num_toks_/2 + 3);
+  final_states->clear();
+  if (!CreateRawLatticeChunk(end_frame, ofst, initial_states, &tok_map))
+    return false;
+
+  // The cost to the end of the best path through a token is its extra_cost
+  // minus its tot_cost, plus a constant (the best path's cost), for which we
+  // use the best tot_cost on the frame so the numbers stay small.
+  const BaseFloat infinity = std::numeric_limits<BaseFloat>::infinity();
+  BaseFloat best_cost = infinity;
+  for (Token *tok = active_toks_[end_frame].toks; tok != NULL;
+       tok = tok->next)
+    best_cost = std::min(best_cost, tok->tot_cost);
+  chunk_token_index_.clear();
+  for (Token *tok = active_toks_[end_frame].toks; tok != NULL;
+       tok = tok->next) {
+    // Tokens with infinite extra_cost will be pruned away.
+    if (tok->extra_cost == infinity)
+      continue;
+    StateId state = tok_map[tok];
+    chunk_token_index_[tok] = final_states->size();
+    final_states->push_back(state);
+    ofst->SetFinal(state, LatticeWeight(
+        tok->extra_cost + best_cost - tok->tot_cost, 0.0));
+  }
+  chunk_frame_ = end_frame;
+  return true;
+}
+
+template <template <class, class> class HashType>
+bool LatticeFasterOnlineDecoderTpl<HashType>::GetLastRawLatticeChunk(
+    bool use_final_probs, Lattice *ofst,
+    std::vector<StateId> *initial_states) const {
+  if (decoding_finalized_ && !use_final_probs)
+    KALDI_ERR << "You cannot call FinalizeDecoding() and then call "
+              << "GetLastRawLatticeChunk() with use_final_probs == false";
+  unordered_map<Token*, BaseFloat> final_costs_local;
+  const unordered_map<Token*, BaseFloat> &final_costs =
+      (decoding_finalized_ ? final_costs_ : final_costs_local);
+  if (!decoding_finalized_ && use_final_probs)
+    ComputeFinalCosts(&final_costs_local, NULL, NULL);
+
+  int32 num_frames = NumFramesDecoded();
+  KALDI_ASSERT(num_frames > 0 && frozen_frame_ == 0);
+  unordered_map<Token*, StateId> tok_map(num_toks_/2 + 3);
+  if (!CreateRawLatticeChunk(num_frames, ofst, initial_states, &tok_map))
+    return false;
+  for (Token *tok = active_toks_[num_frames].toks; tok != NULL;
+       tok = tok->next) {
+    StateId state = tok_map[tok];
+    if (use_final_probs && !final_costs.empty()) {
+      typename unordered_map<Token*, BaseFloat>::const_iterator iter =
+          final_costs.find(tok);
+      if (iter != final_costs.end())
+        ofst->SetFinal(state, LatticeWeight(iter->second, 0));
+    } else {
+      ofst->SetFinal(state, LatticeWeight::One());
+    }
+  }
+  return true;
+}
+
+
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::PossiblyResizeHash(
+    size_t num_toks) {
   size_t new_sz = static_cast<size_t>(static_cast<BaseFloat>(num_toks)
                                       * config_.hash_ratio);
   if (new_sz > toks_.Size()) {
@@ -339,7 +635,9 @@ void LatticeFasterOnlineDecoder::PossiblyResizeHash(size_t num_toks) {
 // for the current frame.  [note: it's inserted if necessary into hash toks_
 // and also into the singly linked list of tokens active on this frame
 // (whose head is at active_toks_[frame]).
-inline LatticeFasterOnlineDecoder::Token *LatticeFasterOnlineDecoder::FindOrAddToken(
+template <template <class, class> class HashType>
+inline typename LatticeFasterOnlineDecoderTpl<HashType>::Token *
+LatticeFasterOnlineDecoderTpl<HashType>::FindOrAddToken(
     StateId state, int32 frame_plus_one, BaseFloat tot_cost,
     Token *backpointer, bool *changed) {
   // Returns the Token pointer.  Sets "changed" (if non-NULL) to true
@@ -352,7 +650,7 @@ inline LatticeFasterOnlineDecoder::Token *LatticeFasterOnlineDecoder::FindOrAddT
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks, backpointer);
+    Token *new_tok = NewToken(tot_cost, extra_cost, NULL, toks, backpointer);
     // NULL: no forward links yet
     toks = new_tok;
     num_toks_++;
@@ -382,7 +680,8 @@ inline LatticeFasterOnlineDecoder::Token *LatticeFasterOnlineDecoder::FindOrAddT
 // prunes outgoing links for all tokens in active_toks_[frame]
 // it's called by PruneActiveTokens
 // all links, that have link_extra_cost > lattice_beam are pruned
-void LatticeFasterOnlineDecoder::PruneForwardLinks(
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::PruneForwardLinks(
     int32 frame_plus_one, bool *extra_costs_changed,
     bool *links_pruned, BaseFloat delta) {
   // delta is the amount by which the extra_costs must change
@@ -426,7 +725,7 @@ void LatticeFasterOnlineDecoder::PruneForwardLinks(
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          DeleteForwardLink(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -458,14 +757,15 @@ void LatticeFasterOnlineDecoder::PruneForwardLinks(
 // PruneForwardLinksFinal is a version of PruneForwardLinks that we call
 // on the final frame.  If there are final tokens active, it uses
 // the final-probs for pruning, otherwise it treats all tokens as final.
-void LatticeFasterOnlineDecoder::PruneForwardLinksFinal() {
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::PruneForwardLinksFinal() {
   KALDI_ASSERT(!active_toks_.empty());
   int32 frame_plus_one = active_toks_.size() - 1;
 
   if (active_toks_[frame_plus_one].toks == NULL )  // empty list; should not happen.
     KALDI_WARN << "No tokens alive at end of file\n";
 
-  typedef unordered_map<Token*, BaseFloat>::const_iterator IterType;
+  typedef typename unordered_map<Token*, BaseFloat>::const_iterator IterType;
   ComputeFinalCosts(&final_costs_, &final_relative_cost_, &final_best_cost_);
   decoding_finalized_ = true;
   // We call DeleteElems() as a nicety, not because it's really necessary;
@@ -513,7 +813,7 @@ void LatticeFasterOnlineDecoder::PruneForwardLinksFinal() {
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          DeleteForwardLink(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -543,7 +843,8 @@ void LatticeFasterOnlineDecoder::PruneForwardLinksFinal() {
 
 }
 
-BaseFloat LatticeFasterOnlineDecoder::FinalRelativeCost() const {
+template <template <class, class> class HashType>
+BaseFloat LatticeFasterOnlineDecoderTpl<HashType>::FinalRelativeCost() const {
   if (!decoding_finalized_) {
     BaseFloat relative_cost;
     ComputeFinalCosts(NULL, &relative_cost, NULL);
@@ -560,7 +861,9 @@ BaseFloat LatticeFasterOnlineDecoder::FinalRelativeCost() const {
 // [we don't do this in PruneForwardLinks because it would give us
 // a problem with dangling pointers].
 // It's called by PruneActiveTokens if any forward links have been pruned
-void LatticeFasterOnlineDecoder::PruneTokensForFrame(int32 frame_plus_one) {
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::PruneTokensForFrame(
+    int32 frame_plus_one) {
   KALDI_ASSERT(frame_plus_one >= 0 && frame_plus_one < active_toks_.size());
   Token *&toks = active_toks_[frame_plus_one].toks;
   if (toks == NULL)
@@ -573,7 +876,7 @@ void LatticeFasterOnlineDecoder::PruneTokensForFrame(int32 frame_plus_one) {
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      DeleteToken(tok);
       num_toks_--;
     } else {  // fetch next Token
       prev_tok = tok;
@@ -586,12 +889,14 @@ void LatticeFasterOnlineDecoder::PruneTokensForFrame(int32 frame_plus_one) {
 // that.  We go backwards through the frames and stop when we reach a point
 // where the delta-costs are not changing (and the delta controls when we consider
 // a cost to have "not changed").
-void LatticeFasterOnlineDecoder::PruneActiveTokens(BaseFloat delta) {
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::PruneActiveTokens(
+    BaseFloat delta) {
   int32 cur_frame_plus_one = NumFramesDecoded();
   int32 num_toks_begin = num_toks_;
   // The index "f" below represents a "frame plus one", i.e. you'd have to subtract
   // one to get the corresponding index for the decodable object.
-  for (int32 f = cur_frame_plus_one - 1; f >= 0; f--) {
+  for (int32 f = cur_frame_plus_one - 1; f >= frozen_frame_; f--) {
     // Reason why we need to prune forward links in this situation:
     // (1) we have never pruned them (new TokenList)
     // (2) we have not yet pruned the forward links to the next f,
@@ -599,7 +904,8 @@ void LatticeFasterOnlineDecoder::PruneActiveTokens(BaseFloat delta) {
     if (active_toks_[f].must_prune_forward_links) {
       bool extra_costs_changed = false, links_pruned = false;
       PruneForwardLinks(f, &extra_costs_changed, &links_pruned, delta);
-      if (extra_costs_changed && f > 0) // any token has changed extra_cost
+      // if any token has changed extra_cost:
+      if (extra_costs_changed && f > frozen_frame_)
         active_toks_[f-1].must_prune_forward_links = true;
       if (links_pruned) // any link was pruned
         active_toks_[f].must_prune_tokens = true;
@@ -615,7 +921,8 @@ void LatticeFasterOnlineDecoder::PruneActiveTokens(BaseFloat delta) {
                 << " to " << num_toks_;
 }
 
-void LatticeFasterOnlineDecoder::ComputeFinalCosts(
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::ComputeFinalCosts(
     unordered_map<Token*, BaseFloat> *final_costs,
     BaseFloat *final_relative_cost,
     BaseFloat *final_best_cost) const {
@@ -658,7 +965,9 @@ void LatticeFasterOnlineDecoder::ComputeFinalCosts(
 }
 
 
-LatticeFasterOnlineDecoder::BestPathIterator LatticeFasterOnlineDecoder::BestPathEnd(
+template <template <class, class> class HashType>
+typename LatticeFasterOnlineDecoderTpl<HashType>::BestPathIterator
+LatticeFasterOnlineDecoderTpl<HashType>::BestPathEnd(
     bool use_final_probs,
     BaseFloat *final_cost_out) const {
   if (decoding_finalized_ && !use_final_probs)
@@ -684,7 +993,8 @@ LatticeFasterOnlineDecoder::BestPathIterator LatticeFasterOnlineDecoder::BestPat
     if (use_final_probs && !final_costs.empty()) {
       // if we are instructed to use final-probs, and any final tokens were
       // active on final frame, include the final-prob in the cost of the token.
-      unordered_map<Token*, BaseFloat>::const_iterator iter = final_costs.find(tok);
+      typename unordered_map<Token*, BaseFloat>::const_iterator iter =
+          final_costs.find(tok);
       if (iter != final_costs.end()) {
         final_cost = iter->second;
         cost += final_cost;
@@ -709,7 +1019,9 @@ LatticeFasterOnlineDecoder::BestPathIterator LatticeFasterOnlineDecoder::BestPat
 }
 
 
-LatticeFasterOnlineDecoder::BestPathIterator LatticeFasterOnlineDecoder::TraceBackBestPath(
+template <template <class, class> class HashType>
+typename LatticeFasterOnlineDecoderTpl<HashType>::BestPathIterator
+LatticeFasterOnlineDecoderTpl<HashType>::TraceBackBestPath(
     BestPathIterator iter, LatticeArc *oarc) const {
   KALDI_ASSERT(!iter.Done() && oarc != NULL);
   Token *tok = static_cast<Token*>(iter.tok);
@@ -745,8 +1057,9 @@ LatticeFasterOnlineDecoder::BestPathIterator LatticeFasterOnlineDecoder::TraceBa
 }
 
 
-void LatticeFasterOnlineDecoder::AdvanceDecoding(DecodableInterface *decodable,
-                                                   int32 max_num_frames) {
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::AdvanceDecoding(
+    DecodableInterface *decodable, int32 max_num_frames) {
   KALDI_ASSERT(!active_toks_.empty() && !decoding_finalized_ &&
                "You must call InitDecoding() before AdvanceDecoding");
   int32 num_frames_ready = decodable->NumFramesReady();
@@ -760,12 +1073,7 @@ void LatticeFasterOnlineDecoder::AdvanceDecoding(DecodableInterface *decodable,
     target_frames_decoded = std::min(target_frames_decoded,
                                      NumFramesDecoded() + max_num_frames);
   while (NumFramesDecoded() < target_frames_decoded) {
-    if (NumFramesDecoded() % config_.prune_interval == 0) {
-      PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
-    }
-    // note: ProcessEmitting() increments NumFramesDecoded().
-    BaseFloat cost_cutoff = ProcessEmittingWrapper(decodable);
-    ProcessNonemittingWrapper(cost_cutoff);
+    DecodeOneFrame(decodable);
   }
 }
 
@@ -773,29 +1081,33 @@ void LatticeFasterOnlineDecoder::AdvanceDecoding(DecodableInterface *decodable,
 // FinalizeDecoding() is a version of PruneActiveTokens that we call
 // (optionally) on the final frame.  Takes into account the final-prob of
 // tokens.  This function used to be called PruneActiveTokensFinal().
-void LatticeFasterOnlineDecoder::FinalizeDecoding() {
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::FinalizeDecoding() {
   int32 final_frame_plus_one = NumFramesDecoded();
   int32 num_toks_begin = num_toks_;
   // PruneForwardLinksFinal() prunes final frame (with final-probs), and
   // sets decoding_finalized_.
   PruneForwardLinksFinal();
-  for (int32 f = final_frame_plus_one - 1; f >= 0; f--) {
+  for (int32 f = final_frame_plus_one - 1; f >= frozen_frame_; f--) {
     bool b1, b2; // values not used.
     BaseFloat dontcare = 0.0; // delta of zero means we must always update
     PruneForwardLinks(f, &b1, &b2, dontcare);
     PruneTokensForFrame(f + 1);
   }
-  PruneTokensForFrame(0);
+  PruneTokensForFrame(frozen_frame_);
   KALDI_VLOG(4) << "pruned tokens from " << num_toks_begin
                 << " to " << num_toks_;
 }
 
 /// Gets the weight cutoff.  Also counts the active tokens.
-BaseFloat LatticeFasterOnlineDecoder::GetCutoff(Elem *list_head, size_t *tok_count,
-                                                BaseFloat *adaptive_beam, Elem **best_elem) {
+template <template <class, class> class HashType>
+BaseFloat LatticeFasterOnlineDecoderTpl<HashType>::GetCutoff(
+    Elem *list_head, size_t *tok_count,
+    BaseFloat *adaptive_beam, Elem **best_elem) {
   BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity();
   // positive == high cost == bad.
   size_t count = 0;
+  max_active_limited_ = false;
   if (config_.max_active == std::numeric_limits<int32>::max() &&
       config_.min_active == 0) {
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
@@ -809,6 +1121,14 @@ BaseFloat LatticeFasterOnlineDecoder::GetCutoff(Elem *list_head, size_t *tok_cou
     if (adaptive_beam != NULL) *adaptive_beam = config_.beam;
     return best_weight + config_.beam;
   } else {
+    BaseFloat cutoff;
+    if (config_.max_active_histogram_bins > 0 &&
+        KALDI_ISFINITE(best_cost_estimate_) &&
+        GetCutoffApprox(list_head, tok_count, adaptive_beam, best_elem,
+                        &cutoff)) {
+      frame_stats_.num_approx_cutoffs = 1;
+      return cutoff;
+    }
     tmp_array_.clear();
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
       BaseFloat w = e->val->tot_cost;
@@ -834,6 +1154,7 @@ BaseFloat LatticeFasterOnlineDecoder::GetCutoff(Elem *list_head, size_t *tok_cou
       max_active_cutoff = tmp_array_[config_.max_active];
     }
     if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
+      max_active_limited_ = true;
       if (adaptive_beam)
         *adaptive_beam = max_active_cutoff - best_weight + config_.beam_delta;
       return max_active_cutoff;
@@ -862,8 +1183,184 @@ BaseFloat LatticeFasterOnlineDecoder::GetCutoff(Elem *list_head, size_t *tok_cou
 }
 
 
+template <template <class, class> class HashType>
+bool LatticeFasterOnlineDecoderTpl<HashType>::GetCutoffApprox(
+    Elem *list_head, size_t *tok_count,
+    BaseFloat *adaptive_beam, Elem **best_elem, BaseFloat *cutoff) {
+  int32 num_bins = config_.max_active_histogram_bins;
+  BaseFloat lower = best_cost_estimate_,
+      bin_width = config_.beam / num_bins,
+      inv_bin_width = 1.0 / bin_width;
+  histogram_.assign(num_bins, 0);
+  BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity();
+  size_t count = 0, num_below = 0;
+  // Tokens above the range of the histogram are more than the beam from the
+  // estimated best cost, so normally outside the beam; we don't count them.
+  for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
+    BaseFloat w = e->val->tot_cost;
+    if (w < best_weight) {
+      best_weight = w;
+      if (best_elem) *best_elem = e;
+    }
+    BaseFloat pos = (w - lower) * inv_bin_width;
+    if (pos < 0.0) {
+      histogram_[0]++;
+      num_below++;
+    } else if (pos < num_bins) {
+      histogram_[static_cast<int32>(pos)]++;
+    }
+  }
+  if (tok_count != NULL) *tok_count = count;
+
+  BaseFloat beam_cutoff = best_weight + config_.beam,
+      min_active_cutoff = std::numeric_limits<BaseFloat>::infinity(),
+      max_active_cutoff = std::numeric_limits<BaseFloat>::infinity();
+  bool ok = true;
+  if (count > static_cast<size_t>(config_.max_active))
+    max_active_cutoff = std::max(
+        best_weight, HistogramCutoff(config_.max_active, lower, bin_width,
+                                     num_below, &ok));
+  if (!ok) return false;
+  if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
+    max_active_limited_ = true;
+    if (adaptive_beam)
+      *adaptive_beam = max_active_cutoff - best_weight + config_.beam_delta;
+    *cutoff = max_active_cutoff;
+    return true;
+  }
+  if (count > static_cast<size_t>(config_.min_active)) {
+    if (config_.min_active == 0) {
+      min_active_cutoff = best_weight;
+    } else {
+      min_active_cutoff = HistogramCutoff(config_.min_active, lower,
+                                          bin_width, num_below, &ok);
+      // If fewer than min_active tokens are in the histogram's range, we
+      // can't tell what the cutoff is.
+      if (min_active_cutoff == std::numeric_limits<BaseFloat>::infinity())
+        ok = false;
+      min_active_cutoff = std::max(best_weight, min_active_cutoff);
+    }
+  }
+  if (!ok) return false;
+  if (min_active_cutoff > beam_cutoff) { // min_active is looser than beam.
+    if (adaptive_beam)
+      *adaptive_beam = min_active_cutoff - best_weight + config_.beam_delta;
+    *cutoff = min_active_cutoff;
+  } else {
+    if (adaptive_beam)
+      *adaptive_beam = config_.beam;
+    *cutoff = beam_cutoff;
+  }
+  return true;
+}
+
+template <template <class, class> class HashType>
+BaseFloat LatticeFasterOnlineDecoderTpl<HashType>::HistogramCutoff(
+    size_t n, BaseFloat lower, BaseFloat bin_width, size_t num_below,
+    bool *ok) const {
+  size_t num_bins = histogram_.size(), count = 0;
+  for (size_t i = 0; i < num_bins; i++) {
+    size_t bin_count = histogram_[i];
+    if (count + bin_count > n) {
+      if (i == 0 && num_below > 0) {
+        *ok = false;
+        return std::numeric_limits<BaseFloat>::infinity();
+      }
+      // Assume the costs in the bin are evenly spread; we want the cost of
+      // the (n - count)'th one, and the tokens up to and including it.
+      BaseFloat frac = (n - count + 1) / static_cast<BaseFloat>(bin_count);
+      return lower + bin_width * (i + frac);
+    }
+    count += bin_count;
+  }
+  return std::numeric_limits<BaseFloat>::infinity();
+}
+
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::DecodeOneFrame(
+    DecodableInterface *decodable) {
+  if (stats_ == NULL) {
+    if (NumFramesDecoded() % config_.prune_interval == 0)
+      PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+    // note: ProcessEmitting() increments NumFramesDecoded().
+    BaseFloat cost_cutoff = ProcessEmittingWrapper(decodable);
+    ProcessNonemittingWrapper(cost_cutoff);
+    return;
+  }
+  // The counts are set by ProcessEmitting() and ProcessNonemitting().
+  frame_stats_.Reset();
+  Timer timer;
+  if (NumFramesDecoded() % config_.prune_interval == 0) {
+    int32 num_toks_begin = num_toks_;
+    PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+    frame_stats_.num_prune_passes = 1;
+    frame_stats_.num_toks_pruned = num_toks_begin - num_toks_;
+  }
+  double prune_end = timer.Elapsed();
+  BaseFloat cost_cutoff = ProcessEmittingWrapper(decodable);
+  double emitting_end = timer.Elapsed();
+  ProcessNonemittingWrapper(cost_cutoff);
+  frame_stats_.prune_time = prune_end;
+  frame_stats_.emitting_time = emitting_end - prune_end;
+  frame_stats_.nonemitting_time = timer.Elapsed() - emitting_end;
+  stats_->AddFrame(frame_stats_);
+}
+
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::SetCutoffFrameStats(
+    size_t tok_count, size_t num_expanded) {
+  frame_stats_.num_toks = tok_count;
+  frame_stats_.num_toks_expanded = num_expanded;
+  if (max_active_limited_) {
+    frame_stats_.num_max_active_limited = 1;
+    frame_stats_.max_active_excess =
+        static_cast<int32>(num_expanded) - (config_.max_active + 1);
+  }
+}
+
+template <template <class, class> class HashType>
+inline void LatticeFasterOnlineDecoderTpl<HashType>::AddNeededLabel(
+    Label ilabel) {
+  if (static_cast<size_t>(ilabel) >= label_needed_.size()) {
+    label_needed_.resize(ilabel + 1, 0);
+    frame_loglikes_.resize(ilabel + 1);
+  }
+  if (!label_needed_[ilabel]) {
+    label_needed_[ilabel] = 1;
+    needed_labels_.push_back(ilabel);
+  }
+}
+
+template <template <class, class> class HashType>
 template <typename FstType>
-BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
+const BaseFloat* LatticeFasterOnlineDecoderTpl<HashType>::GetFrameLogLikelihoods(
+    const FstType &fst, DecodableInterface *decodable, int32 frame,
+    const Elem *best_elem, BaseFloat cutoff) {
+  // The best token is normally within the cutoff, but if not, ProcessEmitting()
+  // still needs the log-likelihoods of its arcs.
+  if (best_elem != NULL && best_elem->val->tot_cost > cutoff) {
+    for (fst::ArcIterator<FstType> aiter(fst, best_elem->key);
+         !aiter.Done();
+         aiter.Next()) {
+      Label ilabel = aiter.Value().ilabel;
+      if (ilabel != 0)
+        AddNeededLabel(ilabel);
+    }
+  }
+  decodable->LogLikelihoods(frame, needed_labels_, &needed_loglikes_);
+  KALDI_ASSERT(needed_loglikes_.size() == needed_labels_.size());
+  for (size_t i = 0; i < needed_labels_.size(); i++) {
+    int32 ilabel = needed_labels_[i];
+    frame_loglikes_[ilabel] = needed_loglikes_[i];
+    label_needed_[ilabel] = 0;
+  }
+  needed_labels_.clear();
+  return (frame_loglikes_.empty() ? NULL : &(frame_loglikes_[0]));
+}
+
+template <template <class, class> class HashType>
+template <typename FstType>
+BaseFloat LatticeFasterOnlineDecoderTpl<HashType>::ProcessEmitting(
     DecodableInterface *decodable) {
   KALDI_ASSERT(active_toks_.size() > 0);
   int32 frame = active_toks_.size() - 1; // frame is the frame-index
@@ -887,6 +1384,37 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
   // dynamic range.
   const FstType &fst = dynamic_cast<const FstType&>(fst_);
 
+  // Expand the emitting arcs of the tokens within the cutoff into
+  // emitting_arcs_, noting their input labels as we go, so that we can get all
+  // the log-likelihoods we need on this frame with one call to the decodable
+  // object; we can only prune the arcs after that.
+  KALDI_ASSERT(needed_labels_.empty());
+  emitting_arcs_.clear();
+  size_t num_expanded = 0;
+  for (Elem *e = final_toks; e != NULL; e = e->tail) {
+    Token *tok = e->val;
+    if (tok->tot_cost <= cur_cutoff) {
+      num_expanded++;
+      for (fst::ArcIterator<FstType> aiter(fst, e->key);
+           !aiter.Done();
+           aiter.Next()) {
+        const Arc &arc = aiter.Value();
+        if (arc.ilabel != 0) {
+          EmittingArc emitting_arc;
+          emitting_arc.tok = tok;
+          emitting_arc.nextstate = arc.nextstate;
+          emitting_arc.ilabel = arc.ilabel;
+          emitting_arc.olabel = arc.olabel;
+          emitting_arc.graph_cost = arc.weight.Value();
+          emitting_arcs_.push_back(emitting_arc);
+          AddNeededLabel(arc.ilabel);
+        }
+      }
+    }
+  }
+  const BaseFloat *loglikes = GetFrameLogLikelihoods(fst, decodable, frame,
+                                                     best_elem, cur_cutoff);
+
   // First process the best token to get a hopefully
   // reasonably tight bound on the next cutoff.  The only
   // products of the next block are "next_cutoff" and "cost_offset".
@@ -899,8 +1427,8 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
          aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) {  // propagate..
-        BaseFloat new_weight = arc.weight.Value() + cost_offset - 
-            decodable->LogLikelihood(frame, arc.ilabel) + tok->tot_cost;
+        BaseFloat new_weight = arc.weight.Value() + cost_offset -
+            loglikes[arc.ilabel] + tok->tot_cost;
         if (new_weight + adaptive_beam < next_cutoff)
           next_cutoff = new_weight + adaptive_beam;
       }
@@ -913,68 +1441,60 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
   cost_offsets_.resize(frame + 1, 0.0);
   cost_offsets_[frame] = cost_offset;
 
-  // the tokens are now owned here, in final_toks, and the hash is empty.
-  // 'owned' is a complex thing here; the point is we need to call DeleteElem
-  // on each elem 'e' to let toks_ know we're done with them.
-  for (Elem *e = final_toks, *e_tail; e != NULL; e = e_tail) {
-    // loop this way because we delete "e" as we go.
-    StateId state = e->key;
-    Token *tok = e->val;
-    if (tok->tot_cost <= cur_cutoff) {
-      for (fst::ArcIterator<FstType> aiter(fst, state);
-           !aiter.Done();
-           aiter.Next()) {
-        const Arc &arc = aiter.Value();
-        if (arc.ilabel != 0) {  // propagate..
-          BaseFloat ac_cost = cost_offset -
-              decodable->LogLikelihood(frame, arc.ilabel),
-              graph_cost = arc.weight.Value(),
-              cur_cost = tok->tot_cost,
-              tot_cost = cur_cost + ac_cost + graph_cost;
-          if (tot_cost > next_cutoff) continue;
-          else if (tot_cost + adaptive_beam < next_cutoff)
-            next_cutoff = tot_cost + adaptive_beam; // prune by best current token
-          // Note: the frame indexes into active_toks_ are one-based,
-          // hence the + 1.
-          Token *next_tok = FindOrAddToken(arc.nextstate,
-                                           frame + 1, tot_cost, tok, NULL);
-          // NULL: no change indicator needed
-
-          // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLink(next_tok, arc.ilabel, arc.olabel,
-                                       graph_cost, ac_cost, tok->links);
-        }
-      } // for all arcs
-    }
-    e_tail = e->tail;
-    toks_.Delete(e); // delete Elem
+  int32 num_links = 0;
+  typename std::vector<EmittingArc>::const_iterator
+      iter = emitting_arcs_.begin(), end = emitting_arcs_.end();
+  for (; iter != end; ++iter) {
+    Token *tok = iter->tok;
+    BaseFloat ac_cost = cost_offset - loglikes[iter->ilabel],
+        graph_cost = iter->graph_cost,
+        cur_cost = tok->tot_cost,
+        tot_cost = cur_cost + ac_cost + graph_cost;
+    if (tot_cost > next_cutoff) continue;
+    else if (tot_cost + adaptive_beam < next_cutoff)
+      next_cutoff = tot_cost + adaptive_beam; // prune by best current token
+    // Note: the frame indexes into active_toks_ are one-based,
+    // hence the + 1.
+    Token *next_tok = FindOrAddToken(iter->nextstate,
+                                     frame + 1, tot_cost, tok, NULL);
+    // NULL: no change indicator needed
+
+    // Add ForwardLink from tok to next_tok (put on head of list tok->links)
+    tok->links = NewForwardLink(next_tok, iter->ilabel, iter->olabel,
+                                graph_cost, ac_cost, tok->links);
+    num_links++;
   }
+  // the tokens are now owned here, in final_toks, and the hash no longer
+  // indexes them; we need to call toks_.Delete() on each of them.
+  DeleteElems(final_toks);
+  SetCutoffFrameStats(tok_cnt, num_expanded);
+  frame_stats_.num_emitting_arcs = num_links;
+  frame_stats_.adaptive_beam = adaptive_beam;
+  // The best token on the next frame will probably have a cost close to
+  // this; GetCutoffApprox() uses it to place its histogram.  (It's
+  // infinity if no arc was within the beam, in which case it isn't used.)
+  best_cost_estimate_ = next_cutoff - adaptive_beam;
   return next_cutoff;
 }
 
-template BaseFloat LatticeFasterOnlineDecoder::
-    ProcessEmitting<fst::ConstFst<fst::StdArc>>(DecodableInterface *decodable);
-template BaseFloat LatticeFasterOnlineDecoder::
-    ProcessEmitting<fst::VectorFst<fst::StdArc>>(DecodableInterface *decodable);
-template BaseFloat LatticeFasterOnlineDecoder::
-    ProcessEmitting<fst::Fst<fst::StdArc>>(DecodableInterface *decodable);
-
-BaseFloat LatticeFasterOnlineDecoder::ProcessEmittingWrapper(
-        DecodableInterface *decodable) {
+template <template <class, class> class HashType>
+BaseFloat LatticeFasterOnlineDecoderTpl<HashType>::ProcessEmittingWrapper(
+    DecodableInterface *decodable) {
   if (fst_.Type() == "const") {
-    return LatticeFasterOnlineDecoder::
-        ProcessEmitting<fst::ConstFst<Arc>>(decodable);
+    return ProcessEmitting<fst::ConstFst<Arc>>(decodable);
   } else if (fst_.Type() == "vector") {
-    return LatticeFasterOnlineDecoder::
-        ProcessEmitting<fst::VectorFst<Arc>>(decodable);
+    return ProcessEmitting<fst::VectorFst<Arc>>(decodable);
+  } else if (fst_.Type() == "mapped") {
+    return ProcessEmitting<fst::MappedFst<Arc>>(decodable);
   } else {
-    return LatticeFasterOnlineDecoder::
-        ProcessEmitting<fst::Fst<Arc>>(decodable);
+    return ProcessEmitting<fst::Fst<Arc>>(decodable);
   }
 }
 
-template <typename FstType> 
-void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
+template <template <class, class> class HashType>
+template <typename FstType>
+void LatticeFasterOnlineDecoderTpl<HashType>::ProcessNonemitting(
+    BaseFloat cutoff) {
   KALDI_ASSERT(!active_toks_.empty());
   int32 frame = static_cast<int32>(active_toks_.size()) - 2;
   // Note: "frame" is the time-index we just processed, or -1 if
@@ -989,6 +1509,7 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
   // problem did not improve overall speed.
 
   KALDI_ASSERT(queue_.empty());
+  int32 num_links = 0;
   for (const Elem *e = toks_.GetList(); e != NULL;  e = e->tail)
     queue_.push_back(e->key);
   if (queue_.empty()) {
@@ -1010,8 +1531,7 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
     // because we're about to regenerate them.  This is a kind
     // of non-optimality (remember, this is the simple decoder),
     // but since most states are emitting it's not a huge issue.
-    tok->DeleteForwardLinks(); // necessary when re-visiting
-    tok->links = NULL;
+    DeleteForwardLinks(tok); // necessary when re-visiting
     for (fst::ArcIterator<FstType> aiter(fst, state);
          !aiter.Done();
          aiter.Next()) {
@@ -1025,8 +1545,9 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
           Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           tok, &changed);
 
-          tok->links = new ForwardLink(new_tok, 0, arc.olabel,
-                                       graph_cost, 0, tok->links);
+          tok->links = NewForwardLink(new_tok, 0, arc.olabel,
+                                      graph_cost, 0, tok->links);
+          num_links++;
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -1035,30 +1556,25 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
       }
     } // for all arcs
   } // while queue not empty
+  frame_stats_.num_nonemitting_arcs += num_links;
 }
 
-template void LatticeFasterOnlineDecoder::
-    ProcessNonemitting<fst::ConstFst<fst::StdArc>>(BaseFloat cutoff);
-template void LatticeFasterOnlineDecoder::
-    ProcessNonemitting<fst::VectorFst<fst::StdArc>>(BaseFloat cutoff);
-template void LatticeFasterOnlineDecoder::
-    ProcessNonemitting<fst::Fst<fst::StdArc>>(BaseFloat cutoff);
-
-void LatticeFasterOnlineDecoder::ProcessNonemittingWrapper(
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::ProcessNonemittingWrapper(
         BaseFloat cost_cutoff) {
   if (fst_.Type() == "const") {
-    return LatticeFasterOnlineDecoder::
-        ProcessNonemitting<fst::ConstFst<Arc>>(cost_cutoff);
+    return ProcessNonemitting<fst::ConstFst<Arc>>(cost_cutoff);
   } else if (fst_.Type() == "vector") {
-    return LatticeFasterOnlineDecoder::
-        ProcessNonemitting<fst::VectorFst<Arc>>(cost_cutoff);
+    return ProcessNonemitting<fst::VectorFst<Arc>>(cost_cutoff);
+  } else if (fst_.Type() == "mapped") {
+    return ProcessNonemitting<fst::MappedFst<Arc>>(cost_cutoff);
   } else {
-    return LatticeFasterOnlineDecoder::
-        ProcessNonemitting<fst::Fst<Arc>>(cost_cutoff);
+    return ProcessNonemitting<fst::Fst<Arc>>(cost_cutoff);
   }
 }
 
-void LatticeFasterOnlineDecoder::DeleteElems(Elem *list) {
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::DeleteElems(Elem *list) {
   for (Elem *e = list, *e_tail; e != NULL; e = e_tail) {
     // Token::TokenDelete(e->val);
     e_tail = e->tail;
@@ -1066,14 +1582,16 @@ void LatticeFasterOnlineDecoder::DeleteElems(Elem *list) {
   }
 }
 
-void LatticeFasterOnlineDecoder::ClearActiveTokens() { // a cleanup routine, at utt end/begin
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::ClearActiveTokens() {
+  // a cleanup routine, at utt end/begin
   for (size_t i = 0; i < active_toks_.size(); i++) {
     // Delete all tokens alive on this frame, and any forward
     // links they may have.
     for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-      tok->DeleteForwardLinks();
+      DeleteForwardLinks(tok);
       Token *next_tok = tok->next;
-      delete tok;
+      DeleteToken(tok);
       num_toks_--;
       tok = next_tok;
     }
@@ -1083,10 +1601,11 @@ void LatticeFasterOnlineDecoder::ClearActiveTokens() { // a cleanup routine, at
 }
 
 // static
-void LatticeFasterOnlineDecoder::TopSortTokens(Token *tok_list,
-                                               std::vector<Token*> *topsorted_list) {
+template <template <class, class> class HashType>
+void LatticeFasterOnlineDecoderTpl<HashType>::TopSortTokens(
+    Token *tok_list, std::vector<Token*> *topsorted_list) {
   unordered_map<Token*, int32> token2pos;
-  typedef unordered_map<Token*, int32>::iterator IterType;
+  typedef typename unordered_map<Token*, int32>::iterator IterType;
   int32 num_toks = 0;
   for (Token *tok = tok_list; tok != NULL; tok = tok->next)
     num_toks++;
@@ -1100,9 +1619,11 @@ void LatticeFasterOnlineDecoder::TopSortTokens(Token *tok_list,
 
   unordered_set<Token*> reprocess;
 
-  for (IterType iter = token2pos.begin(); iter != token2pos.end(); ++iter) {
-    Token *tok = iter->first;
-    int32 pos = iter->second;
+  // Note: we iterate over the list rather than over token2pos, and we sort the
+  // tokens to reprocess below, so that the order of the output (and hence the
+  // state numbering of lattices) doesn't depend on the addresses of the tokens.
+  for (Token *tok = tok_list; tok != NULL; tok = tok->next) {
+    int32 pos = token2pos[tok];
     for (ForwardLink *link = tok->links; link != NULL; link = link->next) {
       if (link->ilabel == 0) {
         // We only need to consider epsilon links, since non-epsilon links
@@ -1127,14 +1648,17 @@ void LatticeFasterOnlineDecoder::TopSortTokens(Token *tok_list,
   size_t max_loop = 1000000, loop_count; // max_loop is to detect epsilon cycles.
   for (loop_count = 0;
        !reprocess.empty() && loop_count < max_loop; ++loop_count) {
-    std::vector<Token*> reprocess_vec;
-    for (unordered_set<Token*>::iterator iter = reprocess.begin();
+    // pairs of (position, token), sorted on position.
+    std::vector<std::pair<int32, Token*> > reprocess_vec;
+    for (typename unordered_set<Token*>::iterator iter = reprocess.begin();
          iter != reprocess.end(); ++iter)
-      reprocess_vec.push_back(*iter);
+      reprocess_vec.push_back(std::make_pair(token2pos[*iter], *iter));
+    std::sort(reprocess_vec.begin(), reprocess_vec.end());
     reprocess.clear();
-    for (std::vector<Token*>::iterator iter = reprocess_vec.begin();
+    for (typename std::vector<std::pair<int32, Token*> >::iterator iter =
+             reprocess_vec.begin();
          iter != reprocess_vec.end(); ++iter) {
-      Token *tok = *iter;
+      Token *tok = iter->second;
       int32 pos = token2pos[tok];
       // Repeat the processing we did above (for comments, see above).
       for (ForwardLink *link = tok->links; link != NULL; link = link->next) {
@@ -1160,7 +1684,9 @@ void LatticeFasterOnlineDecoder::TopSortTokens(Token *tok_list,
     (*topsorted_list)[iter->second] = iter->first;
 }
 
-
+// Instantiate the template for the hash types we use.
+template class LatticeFasterOnlineDecoderTpl<HashList>;
+template class LatticeFasterOnlineDecoderTpl<OpenHashList>;
 
 
 } // end namespace kaldi.
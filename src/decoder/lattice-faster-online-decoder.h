@@ -29,11 +29,14 @@
 
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
+#include "util/open-hash-list.h"
+#include "util/memory-pool.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
 #include "lat/determinize-lattice-pruned.h"
 #include "lat/kaldi-lattice.h"
+#include "decoder/decoder-stats.h"
 // Use the same configuration class as LatticeFasterDecoder.
 #include "decoder/lattice-faster-decoder.h"
 
@@ -43,9 +46,12 @@ namespace kaldi {
 
 /** LatticeFasterOnlineDecoder is as LatticeFasterDecoder but also supports an
     efficient way to get the best path (see the function BestPathEnd()), which
-    is useful in endpointing.
+    is useful in endpointing.  As for LatticeFasterDecoderTpl, the template
+    argument is the type of the token hash (HashList or OpenHashList); most
+    code should use the typedef LatticeFasterOnlineDecoder below.
  */
-class LatticeFasterOnlineDecoder {
+template <template <class, class> class HashType = HashList>
+class LatticeFasterOnlineDecoderTpl {
  public:
   typedef fst::StdArc Arc;
   typedef Arc::Label Label;
@@ -65,13 +71,15 @@ class LatticeFasterOnlineDecoder {
   };
 
   // instantiate this class once for each thing you have to decode.
-  LatticeFasterOnlineDecoder(const fst::Fst<fst::StdArc> &fst,
-                             const LatticeFasterDecoderConfig &config);
+  // config.num_emitting_threads is not supported by this decoder; a value
+  // greater than 1 is ignored with a warning.
+  LatticeFasterOnlineDecoderTpl(const fst::Fst<fst::StdArc> &fst,
+                                const LatticeFasterDecoderConfig &config);
 
   // This version of the initializer "takes ownership" of the fst,
   // and will delete it when this object is destroyed.
-  LatticeFasterOnlineDecoder(const LatticeFasterDecoderConfig &config,
-                             fst::Fst<fst::StdArc> *fst);
+  LatticeFasterOnlineDecoderTpl(const LatticeFasterDecoderConfig &config,
+                                fst::Fst<fst::StdArc> *fst);
 
 
   void SetOptions(const LatticeFasterDecoderConfig &config) {
@@ -82,7 +90,7 @@ class LatticeFasterOnlineDecoder {
     return config_;
   }
 
-  ~LatticeFasterOnlineDecoder();
+  ~LatticeFasterOnlineDecoderTpl();
 
   /// Decodes until there are no more frames left in the "decodable" object..
   /// note, this may block waiting for input if the "decodable" object blocks.
@@ -154,6 +162,78 @@ class LatticeFasterOnlineDecoder {
                            BaseFloat beam) const;
 
 
+  /// This function is for streaming lattice output from long utterances (e.g.
+  /// hours of audio), where keeping all the tokens until the end would take
+  /// too much memory.  It looks for the latest "frozen" frame: a frame f,
+  /// after the previous frozen frame and with f <= max_num_frames and f <
+  /// NumFramesDecoded(), such that the best-path tracebacks from all the
+  /// tokens active on frame f + 1 all pass through the same token on frame f.
+  /// (The best path up to that token will never change, whatever the future
+  /// input.)  If
+  /// it finds one, it outputs the raw lattice for the frames since the
+  /// previous frozen frame (or the start of the utterance), with that token as
+  /// its only final state (with final-cost zero), and then frees all tokens
+  /// before frame f, and the tokens on frame f that are not on those
+  /// tracebacks.  Frame indexes are the same as for NumFramesDecoded(), i.e.
+  /// "frame f" means "after decoding f frames".
+  ///
+  /// After this, GetRawLattice(), GetBestPath() and the functions related to
+  /// them output the part of the lattice or traceback that starts at the
+  /// frozen token, so if you concatenate the lattices output by this function
+  /// and the one from GetRawLattice() at the end of the utterance (or their
+  /// determinized versions) you get the whole utterance's lattice.  This loses
+  /// the (normally few) lattice paths that cross frame f through other tokens.
+  /// Returns true if it froze a frame and output a lattice, false if it could
+  /// not find a frame to freeze.  It prunes the tokens first, like
+  /// AdvanceDecoding() does periodically.  You must not call it after
+  /// FinalizeDecoding().
+  ///
+  /// Note: code that traces back the best path, such as the endpointing code
+  /// in online2/, can only see the frames since the last frozen frame; use
+  /// max_num_frames to keep enough of them.
+  bool GetFrozenRawLattice(int32 max_num_frames, Lattice *ofst);
+
+  /// Returns the frame up to which the lattice has been frozen and output by
+  /// GetFrozenRawLattice(), or zero if it was never called.
+  int32 NumFramesFrozen() const { return frozen_frame_; }
+
+  /// This is for incremental lattice determinization (see class
+  /// LatticeIncrementalDeterminizer in lat/determinize-lattice-incremental.h),
+  /// which determinizes the lattice in chunks as we decode.  It outputs the
+  /// raw lattice chunk for frames NumFramesInRawLatticeChunks() ...
+  /// end_frame, where NumFramesInRawLatticeChunks() < end_frame <=
+  /// NumFramesDecoded().  (As elsewhere, "frame f" means "after decoding f
+  /// frames".)  The live tokens on frame end_frame, which we call the
+  /// boundary tokens, are numbered 0, 1, ...: the state for boundary token i
+  /// is output as (*final_states)[i], and its final-cost is an estimate of the
+  /// cost from there to the end of the best path through it (from the
+  /// tokens' extra_costs).  If this is not the first chunk, the lattice has
+  /// no start state; the boundary tokens of the previous chunk have no arcs
+  /// into them, and the state for boundary token i of the previous chunk is
+  /// output as (*initial_states)[i], or kNoStateId if that token has been
+  /// pruned away since.  The epsilon arcs between those tokens (on the
+  /// previous chunk's last frame) are left out, since they were in the
+  /// previous chunk.  For the first chunk, 'initial_states' is empty and the
+  /// start state is the start token's.  Returns false if a frame had no
+  /// tokens.  It prunes the tokens first, like GetFrozenRawLattice().  You
+  /// can't use this together with GetFrozenRawLattice().
+  bool GetRawLatticeChunk(int32 end_frame, Lattice *ofst,
+                          std::vector<StateId> *initial_states,
+                          std::vector<StateId> *final_states);
+
+  /// This outputs the last raw lattice chunk for incremental lattice
+  /// determinization, i.e. the chunk from frame NumFramesInRawLatticeChunks()
+  /// to NumFramesDecoded(), which has final-probs as for GetRawLattice(); see
+  /// GetRawLatticeChunk() for what 'initial_states' means.  It doesn't change
+  /// anything, so you can call it (e.g. to get partial results) and carry on
+  /// decoding.
+  bool GetLastRawLatticeChunk(bool use_final_probs, Lattice *ofst,
+                              std::vector<StateId> *initial_states) const;
+
+  /// Returns the last frame of the last chunk output by GetRawLatticeChunk()
+  /// (the frame its boundary tokens are on), or zero if it was never called.
+  int32 NumFramesInRawLatticeChunks() const { return chunk_frame_; }
+
   /// InitDecoding initializes the decoding, and should only be used if you
   /// intend to call AdvanceDecoding().  If you call Decode(), you don't need to
   /// call this.  You can also call InitDecoding if you have already decoded an
@@ -194,6 +274,16 @@ class LatticeFasterOnlineDecoder {
   // whenever we call ProcessEmitting().
   inline int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
 
+  /// Attaches a DecoderStats object to which per-frame statistics (numbers of
+  /// tokens and arcs, the adaptive beam and pruning cutoffs, timings) will be
+  /// added, or detaches it if NULL.  It is not owned here.  InitDecoding()
+  /// calls its StartUtterance(), and so does this function if we haven't
+  /// decoded any frames yet.
+  void SetStats(DecoderStats *stats) {
+    stats_ = stats;
+    if (stats_ != NULL && active_toks_.size() == 1) stats_->StartUtterance();
+  }
+
  private:
   // ForwardLinks are the links from a token to a token on the next frame.
   // or sometimes on the current frame (for input-epsilon links).
@@ -241,15 +331,6 @@ class LatticeFasterOnlineDecoder {
                  Token *next, Token *backpointer):
         tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next),
         backpointer(backpointer) { }
-    inline void DeleteForwardLinks() {
-      ForwardLink *l = links, *m;
-      while (l != NULL) {
-        m = l->next;
-        delete l;
-        l = m;
-      }
-      links = NULL;
-    }
   };
 
   // head of per-frame list of Tokens (list is in topological order),
@@ -262,10 +343,76 @@ class LatticeFasterOnlineDecoder {
                  must_prune_tokens(true) { }
   };
 
-  typedef HashList<StateId, Token*>::Elem Elem;
+  typedef typename HashType<StateId, Token*>::Elem Elem;
+
+  // The following four functions are used for all allocation and deallocation
+  // of Tokens and ForwardLinks.  Depending on use_memory_pool_ they use the
+  // pools token_pool_ and link_pool_, or plain new and delete.
+  inline Token *NewToken(BaseFloat tot_cost, BaseFloat extra_cost,
+                         ForwardLink *links, Token *next,
+                         Token *backpointer) {
+    if (use_memory_pool_)
+      return token_pool_.New(tot_cost, extra_cost, links, next, backpointer);
+    else
+      return new Token(tot_cost, extra_cost, links, next, backpointer);
+  }
+  inline void DeleteToken(Token *tok) {
+    if (use_memory_pool_) token_pool_.Delete(tok);
+    else delete tok;
+  }
+  inline ForwardLink *NewForwardLink(Token *next_tok, Label ilabel,
+                                     Label olabel, BaseFloat graph_cost,
+                                     BaseFloat acoustic_cost,
+                                     ForwardLink *next) {
+    if (use_memory_pool_)
+      return link_pool_.New(next_tok, ilabel, olabel, graph_cost,
+                            acoustic_cost, next);
+    else
+      return new ForwardLink(next_tok, ilabel, olabel, graph_cost,
+                             acoustic_cost, next);
+  }
+  inline void DeleteForwardLink(ForwardLink *link) {
+    if (use_memory_pool_) link_pool_.Delete(link);
+    else delete link;
+  }
+
+  // Deletes all the forward links of token "tok" and sets tok->links to NULL.
+  inline void DeleteForwardLinks(Token *tok) {
+    ForwardLink *l = tok->links, *m;
+    while (l != NULL) {
+      m = l->next;
+      DeleteForwardLink(l);
+      l = m;
+    }
+    tok->links = NULL;
+  }
 
   void PossiblyResizeHash(size_t num_toks);
 
+  // Creates a state in 'ofst' (which should be empty) for each token on
+  // frames begin_frame through end_frame (these are frame-plus-one indexes),
+  // in topological order, and the arcs for the forward links between them;
+  // links from end_frame to the following frame are not output.  Outputs the
+  // state for each token to 'tok_map'.  Does not set final-probs.  Returns
+  // false (with a warning) if a frame has no tokens.
+  bool CreateRawLattice(int32 begin_frame, int32 end_frame, Lattice *ofst,
+                        unordered_map<Token*, StateId> *tok_map) const;
+
+  // Creates the raw lattice for frames chunk_frame_ ... end_frame for
+  // GetRawLatticeChunk() and GetLastRawLatticeChunk(), without final-probs.
+  bool CreateRawLatticeChunk(int32 end_frame, Lattice *ofst,
+                             std::vector<StateId> *initial_states,
+                             unordered_map<Token*, StateId> *tok_map) const;
+
+  // If the best-path tracebacks from all the live tokens on frame
+  // frame_plus_one + 1 pass through the same token on frame frame_plus_one,
+  // returns the earliest such token (the one whose backpointer is on the
+  // previous frame), else returns NULL.  If it returns a token, it outputs to
+  // 'traceback_toks' all the tokens on frame frame_plus_one that are on those
+  // tracebacks.  Called from GetFrozenRawLattice().
+  Token *FrozenToken(int32 frame_plus_one,
+                     unordered_set<Token*> *traceback_toks) const;
+
   // FindOrAddToken either locates a token in hash of toks_, or if necessary
   // inserts a new, empty token (i.e. with no forward links) for the current
   // frame.  [note: it's inserted if necessary into hash toks_ and also into the
@@ -336,6 +483,59 @@ class LatticeFasterOnlineDecoder {
   BaseFloat GetCutoff(Elem *list_head, size_t *tok_count,
                       BaseFloat *adaptive_beam, Elem **best_elem);
 
+  /// Called from GetCutoff() if config_.max_active_histogram_bins > 0: does
+  /// the same thing, except that the max-active and min-active cutoffs are
+  /// interpolated from a histogram of the token costs, whose range is the beam
+  /// starting from best_cost_estimate_.  Returns false (and the caller must
+  /// fall back to the exact method) if the cutoff falls in the first bin but
+  /// there were tokens below its range.
+  bool GetCutoffApprox(Elem *list_head, size_t *tok_count,
+                       BaseFloat *adaptive_beam, Elem **best_elem,
+                       BaseFloat *cutoff);
+
+  /// Used by GetCutoffApprox(): returns the approximate cost of the token
+  /// with zero-based rank n (in order of increasing cost) from histogram_,
+  /// whose bins start at 'lower' and are 'bin_width' wide, or infinity if
+  /// there are no more than n tokens in the histogram.  If the answer is in
+  /// the first bin and num_below > 0 tokens were put in that bin because they
+  /// were below its range, sets *ok to false.
+  BaseFloat HistogramCutoff(size_t n, BaseFloat lower, BaseFloat bin_width,
+                            size_t num_below, bool *ok) const;
+
+  /// Prunes the tokens if it is time to, and processes the emitting and
+  /// nonemitting arcs for one frame; also collects stats if stats_ != NULL.
+  void DecodeOneFrame(DecodableInterface *decodable);
+
+  /// Sets the token counts and cutoff stats in frame_stats_ at the end of
+  /// ProcessEmitting().
+  void SetCutoffFrameStats(size_t tok_count, size_t num_expanded);
+
+  /// Gets from the decodable object, with a single call to its
+  /// LogLikelihoods() function, the log-likelihoods on this frame of the
+  /// input labels in needed_labels_, to which ProcessEmitting() adds the input
+  /// labels of the arcs it expands, and of the arcs out of 'best_elem' if its
+  /// cost is above 'cutoff' (so that they were not expanded).  Returns an array
+  /// indexed by input label, which is only valid for those labels (and until
+  /// the next call).
+  template <typename FstType>
+  const BaseFloat *GetFrameLogLikelihoods(const FstType &fst,
+                                          DecodableInterface *decodable,
+                                          int32 frame, const Elem *best_elem,
+                                          BaseFloat cutoff);
+
+  /// Adds 'ilabel' to needed_labels_ if it is not already there.
+  inline void AddNeededLabel(Label ilabel);
+
+  // An emitting arc out of a token on the previous frame, as expanded by
+  // ProcessEmitting() before we have the acoustic log-likelihoods.
+  struct EmittingArc {
+    Token *tok;  // the token the arc leaves.
+    StateId nextstate;
+    Label ilabel;
+    Label olabel;
+    BaseFloat graph_cost;
+  };
+
   /// Processes emitting arcs for one frame.  Propagates from prev_toks_ to cur_toks_.
   /// Returns the cost cutoff for subsequent ProcessNonemitting() to use.
   /// Templated on FST type for speed; called via ProcessEmittingWrapper().
@@ -351,20 +551,33 @@ class LatticeFasterOnlineDecoder {
 
   void ProcessNonemittingWrapper(BaseFloat cost_cutoff);
 
-  // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
+  // HashType is HashList (defined in ../util/hash-list.h) or something with
+  // the same interface.  It actually allows us to maintain
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.  It is indexed by frame-index
   // plus one, where the frame-index is zero-based, as used in decodable object.
   // That is, the emitting probs of frame t are accounted for in tokens at
   // toks_[t+1].  The zeroth frame is for nonemitting transition at the start of
   // the graph.
-  HashList<StateId, Token*> toks_;
+  HashType<StateId, Token*> toks_;
 
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
+  std::vector<int32> histogram_;  // used in GetCutoffApprox().
+  // used in ProcessEmitting(): the arcs out of the tokens within the cutoff.
+  std::vector<EmittingArc> emitting_arcs_;
+  // The next four are used in GetFrameLogLikelihoods(): the log-likelihoods
+  // indexed by input label; for each input label, nonzero if it's in
+  // needed_labels_ (they are all zero between calls); and the input labels
+  // whose log-likelihoods we need on the current frame, and those
+  // log-likelihoods.
+  std::vector<BaseFloat> frame_loglikes_;
+  std::vector<char> label_needed_;
+  std::vector<int32> needed_labels_;
+  std::vector<BaseFloat> needed_loglikes_;
   // make it class member to avoid internal new/delete.
   const fst::Fst<fst::StdArc> &fst_;
   bool delete_fst_;
@@ -374,6 +587,32 @@ class LatticeFasterOnlineDecoder {
   // zero, to reduce roundoff errors.
   LatticeFasterDecoderConfig config_;
   int32 num_toks_; // current total #toks allocated...
+  int32 frozen_frame_;  // The frame-plus-one index of the first frame whose
+                        // tokens we still have (see GetFrozenRawLattice()).
+                        // Zero unless we have frozen part of the lattice.
+  int32 chunk_frame_;  // The frame-plus-one index of the boundary tokens of
+                       // the last chunk output by GetRawLatticeChunk(), or
+                       // zero.
+  // The numbers of the boundary tokens of that chunk.  Tokens that have been
+  // deleted since may still be in here, but we only look up the tokens still
+  // on frame chunk_frame_.
+  unordered_map<Token*, int32> chunk_token_index_;
+  // An estimate of the best token cost on the current frame, from the cutoff
+  // of the previous frame's ProcessEmitting(); not finite if none.  It is where
+  // the histogram in GetCutoffApprox() starts.
+  BaseFloat best_cost_estimate_;
+  bool max_active_limited_;  // True if max-active gave the tightest cutoff in
+                             // the last call to GetCutoff().
+  DecoderStats *stats_;  // Not owned; NULL if we're not collecting stats.
+  DecoderFrameStats frame_stats_;  // The stats for the current frame.
+  // use_memory_pool_ is a copy of config_.use_memory_pool, taken when there are
+  // no tokens allocated (in the constructor and in InitDecoding()), so that a
+  // call to SetOptions() can't make us free an object with the wrong method.
+  bool use_memory_pool_;
+  MemoryPool<Token> token_pool_;  // Tokens are allocated from here if
+                                  // use_memory_pool_ is true.
+  MemoryPool<ForwardLink> link_pool_;  // ForwardLinks are allocated from here
+                                       // if use_memory_pool_ is true.
   bool warned_;
 
   /// decoding_finalized_ is true if someone called FinalizeDecoding().  [note,
@@ -415,9 +654,11 @@ class LatticeFasterOnlineDecoder {
   void ClearActiveTokens();
 
 
-  KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterOnlineDecoder);
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterOnlineDecoderTpl);
 };
 
+typedef LatticeFasterOnlineDecoderTpl<HashList> LatticeFasterOnlineDecoder;
+
 
 
 } // end namespace kaldi.
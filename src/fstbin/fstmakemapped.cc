@@ -0,0 +1,83 @@
+// fstbin/fstmakemapped.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/kaldi-io.h"
+#include "util/parse-options.h"
+#include "fst/fstlib.h"
+#include "fstext/kaldi-fst-io.h"
+#include "fstext/mapped-fst.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+    using kaldi::int32;
+
+    const char *usage =
+        "Converts an FST (e.g. a decoding graph HCLG.fst) to the memory-mapped\n"
+        "format, which programs that read FSTs with ReadFstKaldiGeneric() (e.g.\n"
+        "the lattice-generating decoders) map into memory instead of reading,\n"
+        "so that loading is instantaneous and processes on the same machine\n"
+        "share one copy of the graph.  The format is specific to Kaldi and to\n"
+        "the machine's byte order, and is not readable by OpenFst tools.\n"
+        "\n"
+        "Usage:  fstmakemapped [options] <fst-in> <mapped-fst-out>\n"
+        "e.g.: fstmakemapped exp/tri1/graph/HCLG.fst exp/tri1/graph/HCLG.mapped\n";
+
+    bool verify = true;
+
+    ParseOptions po(usage);
+    po.Register("verify", &verify, "If true, map the output file after "
+                "writing it and check its checksum and structure (only if it "
+                "is a file).");
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string fst_rxfilename = po.GetArg(1),
+        mapped_fst_wxfilename = po.GetArg(2);
+
+    Fst<StdArc> *fst = ReadFstKaldiGeneric(fst_rxfilename);
+    {
+      Output ko(mapped_fst_wxfilename, true, false);
+      WriteMappedFst(*fst, ko.Stream());
+    }
+
+    if (verify &&
+        ClassifyWxfilename(mapped_fst_wxfilename) == kFileOutput) {
+      MappedFst<StdArc> *mapped_fst =
+          MappedFst<StdArc>::Read(mapped_fst_wxfilename, true);
+      KALDI_ASSERT(mapped_fst->NumStates() == CountStates(*fst) &&
+                   mapped_fst->Start() == fst->Start());
+      delete mapped_fst;
+    }
+    KALDI_LOG << "Wrote mapped FST with " << CountStates(*fst)
+              << " states to " << PrintableWxfilename(mapped_fst_wxfilename);
+    delete fst;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
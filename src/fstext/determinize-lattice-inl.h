@@ -59,10 +59,9 @@ template<class IntType> class LatticeStringRepository {
 
     std::pair<typename SetType::iterator, bool> pr = set_.insert(new_entry_);
     if (pr.second) { // Was successfully inserted (was not there).  We need to
-                     // replace the element we inserted, which resides on the
-                     // stack, with one from the heap.
+                     // replace the element we inserted with a new one.
       const Entry *ans = new_entry_;
-      new_entry_ = new Entry();
+      new_entry_ = NewEntry();
       return ans;
     } else { // Was not inserted because an equivalent Entry already
              // existed.
@@ -166,19 +165,20 @@ template<class IntType> class LatticeStringRepository {
     return e;
   }
 
-  LatticeStringRepository() { new_entry_ = new Entry; }
+  LatticeStringRepository(): free_list_(NULL), block_pos_(kBlockSize) {
+    new_entry_ = NewEntry();
+  }
 
   void Destroy() {
-    for (typename SetType::iterator iter = set_.begin();
-         iter != set_.end();
-         ++iter)
-      delete *iter;
     SetType tmp;
     tmp.swap(set_);
-    if (new_entry_) {
-      delete new_entry_;
-      new_entry_ = NULL;
-    }
+    for (size_t i = 0; i < blocks_.size(); i++)
+      delete [] blocks_[i];
+    std::vector<Entry*> tmp_blocks;
+    tmp_blocks.swap(blocks_);
+    block_pos_ = kBlockSize;
+    free_list_ = NULL;
+    new_entry_ = NULL;
   }
 
   // Rebuild will rebuild this object, guaranteeing only
@@ -191,11 +191,11 @@ template<class IntType> class LatticeStringRepository {
              iter = to_keep.begin();
          iter != to_keep.end(); ++iter)
       RebuildHelper(*iter, &tmp_set);
-    // Now delete all elems not in tmp_set.
+    // Now free all elems not in tmp_set.
     for (typename SetType::iterator iter = set_.begin();
          iter != set_.end(); ++iter) {
       if (tmp_set.count(*iter) == 0)
-        delete (*iter); // delete the Entry; not needed.
+        FreeEntry(const_cast<Entry*>(*iter)); // the Entry is not needed.
     }
     set_.swap(tmp_set);
   }
@@ -235,10 +235,35 @@ template<class IntType> class LatticeStringRepository {
     }
   }
 
+  // The Entries are allocated from blocks of kBlockSize, which are only freed
+  // by Destroy(); those freed by Rebuild() go on a free list, linked through
+  // their 'parent' pointers, and are reused first.  This is much faster than
+  // allocating them one by one, and they take less memory.
+  Entry *NewEntry() {
+    if (free_list_ != NULL) {
+      Entry *ans = free_list_;
+      free_list_ = const_cast<Entry*>(ans->parent);
+      return ans;
+    }
+    if (block_pos_ == kBlockSize) {
+      blocks_.push_back(new Entry[kBlockSize]);
+      block_pos_ = 0;
+    }
+    return blocks_.back() + block_pos_++;
+  }
+  void FreeEntry(Entry *entry) {
+    entry->parent = free_list_;
+    free_list_ = entry;
+  }
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeStringRepository);
+  static const size_t kBlockSize = 4096;
   Entry *new_entry_; // We always have a pre-allocated Entry ready to use,
                      // to avoid unnecessary news and deletes.
   SetType set_;
+  std::vector<Entry*> blocks_;
+  Entry *free_list_;
+  size_t block_pos_;  // The number of Entries used in blocks_.back().
 
 };
 
@@ -33,4 +33,6 @@
 #include "fstext/determinize-lattice.h"
 #include "fstext/deterministic-fst.h"
 #include "fstext/kaldi-fst-io.h"
+#include "fstext/mapped-fst.h"
+#include "fstext/lookahead-compose-fst.h"
 #endif
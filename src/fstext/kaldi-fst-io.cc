@@ -20,6 +20,7 @@
 // limitations under the License.
 
 #include "fstext/kaldi-fst-io.h"
+#include "fstext/mapped-fst.h"
 #include "base/kaldi-error.h"
 #include "base/kaldi-math.h"
 #include "util/kaldi-io.h"
@@ -45,6 +46,19 @@ VectorFst<StdArc> *ReadFstKaldi(std::string rxfilename) {
 Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err) {
   if (rxfilename == "") rxfilename = "-"; // interpret "" as stdin,
   // for compatibility with OpenFst conventions.
+  // Mapped FSTs (see mapped-fst.h) are not read but mapped into memory, which
+  // is only possible for actual files.
+  if (kaldi::ClassifyRxfilename(rxfilename) == kaldi::kFileInput &&
+      IsMappedFstFile(rxfilename)) {
+    try {
+      return MappedFst<StdArc>::Read(rxfilename);
+    } catch(const std::exception &e) {
+      if (throw_on_err) throw;
+      KALDI_WARN << "Could not map fst from " << rxfilename
+                 << ". A NULL pointer is returned.";
+      return NULL;
+    }
+  }
   kaldi::Input ki(rxfilename);
   fst::FstHeader hdr;
   // Read FstHeader which contains the type of FST
@@ -92,9 +106,11 @@ Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err) {
 }
 
 VectorFst<StdArc> *CastOrConvertToVectorFst(Fst<StdArc> *fst) {
-  // This version currently supports ConstFst<StdArc> or VectorFst<StdArc>         
+  // This version currently supports ConstFst<StdArc>, MappedFst<StdArc> or
+  // VectorFst<StdArc>.
   std::string real_type = fst->Type();
-  KALDI_ASSERT(real_type == "vector" || real_type == "const");
+  KALDI_ASSERT(real_type == "vector" || real_type == "const" ||
+               real_type == "mapped");
   if (real_type == "vector") {
     return dynamic_cast<VectorFst<StdArc> *>(fst);
   } else {
@@ -45,8 +45,9 @@ VectorFst<StdArc> *ReadFstKaldi(std::string rxfilename);
 // If it can't read the FST, if throw_on_err == true it throws using KALDI_ERR;
 // otherwise it prints a warning and returns. Note:this
 // doesn't support the text-mode option that we generally like to support.
-// This version currently supports ConstFst<StdArc> or VectorFst<StdArc>
-// (const-fst can give better performance for decoding).
+// This version currently supports ConstFst<StdArc>, VectorFst<StdArc> or
+// (if rxfilename is a file) MappedFst<StdArc> (const-fst can give better
+// performance for decoding, and mapped-fst loads instantly; see mapped-fst.h).
 Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename,
                                  bool throw_on_err = true);
 
@@ -0,0 +1,211 @@
+// fstext/lookahead-compose-fst-inl.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FSTEXT_LOOKAHEAD_COMPOSE_FST_INL_H_
+#define KALDI_FSTEXT_LOOKAHEAD_COMPOSE_FST_INL_H_
+
+#include <functional>
+#include <limits>
+#include <queue>
+#include "base/kaldi-common.h"
+
+namespace fst {
+// Do not include this file directly.  It is included by
+// lookahead-compose-fst.h.
+
+template<class Arc>
+LookaheadComposeFst<Arc>::LookaheadComposeFst(
+    const Fst<Arc> &hcl, DeterministicOnDemandFst<Arc> *g,
+    const std::vector<float> *word_costs, size_t max_cached_arcs):
+    hcl_(hcl), g_(g), max_cached_arcs_(max_cached_arcs),
+    start_(kNoStateId), num_cached_arcs_(0) {
+  ComputePotentials(word_costs);
+  StateId hcl_start = hcl_.Start();
+  if (hcl_start != kNoStateId &&
+      potentials_[hcl_start] != std::numeric_limits<float>::infinity())
+    start_ = FindState(hcl_start, g_->Start());
+  else
+    KALDI_WARN << "The composed FST is empty: no word or final state can be "
+               << "reached from the start state of HCL.";
+}
+
+template<class Arc>
+LookaheadComposeFst<Arc>::LookaheadComposeFst(
+    const LookaheadComposeFst<Arc> &other, bool safe):
+    hcl_(other.hcl_), g_(other.g_), max_cached_arcs_(other.max_cached_arcs_),
+    potentials_(other.potentials_), start_(other.start_),
+    state_pairs_(other.state_pairs_), state_map_(other.state_map_),
+    states_(other.state_pairs_.size()), num_cached_arcs_(0) { }
+
+template<class Arc>
+void LookaheadComposeFst<Arc>::ComputePotentials(
+    const std::vector<float> *word_costs) {
+  const float inf = std::numeric_limits<float>::infinity();
+  StateId num_states = CountStates(hcl_);
+  potentials_.assign(num_states, inf);
+
+  // The lookahead cost of each word, computed the first time we see it.
+  unordered_map<Label, float> word_cost_map;
+  // For each HCL state s, the states with an arc to s that has no word label,
+  // stored as arrays indexed [pred_begin[s] ... pred_begin[s+1]-1] into
+  // 'preds'; we'll propagate the potentials backwards along these arcs.
+  std::vector<size_t> pred_begin(num_states + 1, 0);
+  for (StateId s = 0; s < num_states; s++) {
+    if (hcl_.Final(s) != Weight::Zero())
+      potentials_[s] = 0.0;  // We don't look ahead to the final-probs of G.
+    for (ArcIterator<Fst<Arc> > aiter(hcl_, s); !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.olabel == 0) {
+        pred_begin[arc.nextstate + 1]++;
+        continue;
+      }
+      typename unordered_map<Label, float>::iterator iter =
+          word_cost_map.find(arc.olabel);
+      float cost;
+      if (iter != word_cost_map.end()) {
+        cost = iter->second;
+      } else {
+        if (word_costs != NULL) {
+          cost = (static_cast<size_t>(arc.olabel) < word_costs->size() ?
+                  (*word_costs)[arc.olabel] : 0.0);
+        } else {
+          Arc g_arc;
+          cost = (g_->GetArc(g_->Start(), arc.olabel, &g_arc) ?
+                  g_arc.weight.Value() : inf);
+        }
+        word_cost_map[arc.olabel] = cost;
+      }
+      if (cost < potentials_[s])
+        potentials_[s] = cost;
+    }
+  }
+  for (StateId s = 0; s < num_states; s++)
+    pred_begin[s + 1] += pred_begin[s];
+  std::vector<StateId> preds(pred_begin[num_states]);
+  {
+    std::vector<size_t> pred_end(pred_begin.begin(), pred_begin.end() - 1);
+    for (StateId s = 0; s < num_states; s++)
+      for (ArcIterator<Fst<Arc> > aiter(hcl_, s); !aiter.Done(); aiter.Next())
+        if (aiter.Value().olabel == 0)
+          preds[pred_end[aiter.Value().nextstate]++] = s;
+  }
+
+  // phi(s) is the min of its own value and phi(s') over the arcs s -> s' with
+  // no word label.  This is a shortest-path problem on the reversed arcs (with
+  // zero costs), so we process the states in order of increasing potential,
+  // as in Dijkstra's algorithm, and each is finalized when it's popped.
+  typedef std::pair<float, StateId> QueueElem;
+  std::priority_queue<QueueElem, std::vector<QueueElem>,
+                      std::greater<QueueElem> > queue;
+  for (StateId s = 0; s < num_states; s++)
+    if (potentials_[s] != inf)
+      queue.push(QueueElem(potentials_[s], s));
+  while (!queue.empty()) {
+    QueueElem elem = queue.top();
+    queue.pop();
+    StateId s = elem.second;
+    float phi = elem.first;
+    if (phi != potentials_[s])
+      continue;  // A stale entry; s was improved after we pushed this.
+    for (size_t i = pred_begin[s]; i < pred_begin[s + 1]; i++) {
+      StateId p = preds[i];
+      if (phi < potentials_[p]) {
+        potentials_[p] = phi;
+        queue.push(QueueElem(phi, p));
+      }
+    }
+  }
+}
+
+template<class Arc>
+typename Arc::StateId LookaheadComposeFst<Arc>::FindState(
+    StateId hcl_state, StateId g_state) const {
+  StatePair pr(hcl_state, g_state);
+  std::pair<typename StateMap::iterator, bool> ret =
+      state_map_.insert(std::make_pair(pr, static_cast<StateId>(
+          state_pairs_.size())));
+  if (ret.second) {
+    state_pairs_.push_back(pr);
+    states_.push_back(ExpandedState());
+  }
+  return ret.first->second;
+}
+
+template<class Arc>
+void LookaheadComposeFst<Arc>::Expand(StateId s) const {
+  const float inf = std::numeric_limits<float>::infinity();
+  StateId hcl_state = state_pairs_[s].first,
+      g_state = state_pairs_[s].second;
+  float phi = potentials_[hcl_state];
+  // FindState() adds to states_, which is a deque, so this reference stays
+  // valid.
+  ExpandedState &state = states_[s];
+  KALDI_ASSERT(!state.expanded);
+
+  Weight hcl_final = hcl_.Final(hcl_state);
+  if (hcl_final != Weight::Zero()) {
+    Weight g_final = g_->Final(g_state);
+    if (g_final != Weight::Zero())
+      state.final = Weight(hcl_final.Value() + g_final.Value() - phi +
+                           potentials_[hcl_.Start()]);
+  }
+  for (ArcIterator<Fst<Arc> > aiter(hcl_, hcl_state); !aiter.Done();
+       aiter.Next()) {
+    const Arc &arc = aiter.Value();
+    float next_phi = potentials_[arc.nextstate];
+    if (next_phi == inf)
+      continue;  // A dead end.
+    float cost = arc.weight.Value() + next_phi - phi;
+    StateId next_g_state = g_state;
+    if (arc.olabel != 0) {
+      Arc g_arc;
+      if (!g_->GetArc(g_state, arc.olabel, &g_arc))
+        continue;
+      cost += g_arc.weight.Value();
+      next_g_state = g_arc.nextstate;
+    }
+    state.arcs.push_back(Arc(arc.ilabel, arc.olabel, Weight(cost),
+                             FindState(arc.nextstate, next_g_state)));
+    if (arc.ilabel == 0)
+      state.num_input_epsilons++;
+    if (arc.olabel == 0)
+      state.num_output_epsilons++;
+  }
+  state.expanded = true;
+  num_cached_arcs_ += state.arcs.size();
+}
+
+template<class Arc>
+bool LookaheadComposeFst<Arc>::TrimCache() {
+  if (num_cached_arcs_ <= max_cached_arcs_)
+    return false;
+  KALDI_VLOG(2) << "Clearing the cache of " << state_pairs_.size()
+                << " composed states and " << num_cached_arcs_ << " arcs.";
+  state_pairs_.clear();
+  state_map_.clear();
+  states_.clear();
+  num_cached_arcs_ = 0;
+  if (start_ != kNoStateId)
+    start_ = FindState(hcl_.Start(), g_->Start());
+  return true;
+}
+
+}  // namespace fst
+
+#endif  // KALDI_FSTEXT_LOOKAHEAD_COMPOSE_FST_INL_H_
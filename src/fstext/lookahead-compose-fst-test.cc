@@ -0,0 +1,139 @@
+// fstext/lookahead-compose-fst-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fstext/lookahead-compose-fst.h"
+#include "fstext/fst-test-utils.h"
+#include "base/kaldi-math.h"
+
+namespace fst {
+
+// Returns a backoff language model on the words 1 ... num_words, as an FST
+// with epsilon backoff arcs: state 0 is the unigram state and state w is the
+// history state for word w.
+static StdVectorFst *CreateBackoffLm(int32 num_words) {
+  StdVectorFst *lm = new StdVectorFst();
+  lm->AddState();
+  lm->SetStart(0);
+  lm->SetFinal(0, 1.0);
+  for (int32 w = 1; w <= num_words; w++) {
+    lm->AddState();
+    lm->AddArc(0, StdArc(w, w, 0.5 * w, w));
+  }
+  for (int32 h = 1; h <= num_words; h++) {
+    lm->AddArc(h, StdArc(0, 0, 0.7, 0));  // Backoff arc.
+    if (kaldi::Rand() % 2 == 0)
+      lm->SetFinal(h, 0.2);
+    for (int32 w = 1; w <= num_words; w++)
+      if (kaldi::Rand() % 3 == 0)
+        lm->AddArc(h, StdArc(w, w, 0.1 * (kaldi::Rand() % 10), w));
+  }
+  ArcSort(lm, StdILabelCompare());
+  return lm;
+}
+
+// Copies the part of 'fst' that is reachable from the start state to 'ofst',
+// which expands all those states.
+static void ExpandReachable(const Fst<StdArc> &fst, StdVectorFst *ofst) {
+  ofst->DeleteStates();
+  if (fst.Start() == kNoStateId)
+    return;
+  std::vector<StdArc::StateId> queue(1, fst.Start());
+  std::vector<bool> seen;
+  while (!queue.empty()) {
+    StdArc::StateId s = queue.back();
+    queue.pop_back();
+    if (seen.size() <= static_cast<size_t>(s))
+      seen.resize(s + 1, false);
+    if (seen[s])
+      continue;
+    seen[s] = true;
+    while (ofst->NumStates() <= s)
+      ofst->AddState();
+    ofst->SetFinal(s, fst.Final(s));
+    for (ArcIterator<Fst<StdArc> > aiter(fst, s); !aiter.Done(); aiter.Next()) {
+      const StdArc &arc = aiter.Value();
+      while (ofst->NumStates() <= arc.nextstate)
+        ofst->AddState();
+      ofst->AddArc(s, arc);
+      queue.push_back(arc.nextstate);
+    }
+  }
+  ofst->SetStart(fst.Start());
+}
+
+static void TestLookaheadComposeFst() {
+  int32 num_words = 1 + kaldi::Rand() % 5;
+  RandFstOptions opts;
+  opts.n_syms = num_words + 1;  // The labels are 0 ... num_words.
+  opts.acyclic = (kaldi::Rand() % 2 == 0);
+  opts.allow_empty = false;
+  StdVectorFst *hcl = RandFst<StdArc>(opts);
+  StdVectorFst *lm = CreateBackoffLm(num_words);
+
+  BackoffDeterministicOnDemandFst<StdArc> g(*lm);
+  StdVectorFst composed;
+  ComposeDeterministicOnDemand(*hcl, &g, &composed);
+  Connect(&composed);
+
+  std::vector<float> unigram_costs(num_words + 1, 0.0);
+  for (int32 w = 1; w <= num_words; w++)
+    unigram_costs[w] = 0.5 * w;
+  bool use_unigram_costs = (kaldi::Rand() % 2 == 0);
+  LookaheadComposeFst<StdArc> lookahead_fst(
+      *hcl, &g, (use_unigram_costs ? &unigram_costs : NULL),
+      kaldi::Rand() % 20);
+
+  for (int32 i = 0; i < 2; i++) {
+    StdVectorFst expanded;
+    ExpandReachable(lookahead_fst, &expanded);
+    Connect(&expanded);
+    KALDI_ASSERT(expanded.NumStates() != 0 || composed.NumStates() == 0);
+    KALDI_ASSERT(composed.NumStates() != 0 || expanded.NumStates() == 0);
+    if (composed.NumStates() != 0) {
+      // The paths and their costs should be the same; the potentials only
+      // move the costs along the paths.
+      KALDI_ASSERT(RandEquivalent(composed, expanded, 5 /*paths*/,
+                                  0.01 /*delta*/, kaldi::Rand() /*seed*/,
+                                  100 /*max path length*/));
+      KALDI_ASSERT(ApproxEqual(ShortestDistance(composed),
+                               ShortestDistance(expanded)));
+    }
+    // A copy starts with the same states, so expanding it should give the
+    // same state ids.
+    LookaheadComposeFst<StdArc> *copy = lookahead_fst.Copy();
+    StdVectorFst expanded_copy;
+    ExpandReachable(*copy, &expanded_copy);
+    KALDI_ASSERT(copy->NumStatesCreated() == lookahead_fst.NumStatesCreated());
+    delete copy;
+    // The second time around, we check that the results are the same after
+    // (possibly) clearing the cache.
+    bool cleared = lookahead_fst.TrimCache();
+    KALDI_ASSERT(!cleared || lookahead_fst.NumCachedArcs() == 0);
+  }
+  delete hcl;
+  delete lm;
+}
+
+}  // namespace fst
+
+int main() {
+  for (int32 i = 0; i < 20; i++)
+    fst::TestLookaheadComposeFst();
+  std::cout << "Test OK\n";
+}
@@ -0,0 +1,225 @@
+// fstext/lookahead-compose-fst.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FSTEXT_LOOKAHEAD_COMPOSE_FST_H_
+#define KALDI_FSTEXT_LOOKAHEAD_COMPOSE_FST_H_
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fst/fstlib.h>
+#include <fst/fst-decl.h>
+
+#include "util/stl-utils.h"
+#include "fstext/deterministic-fst.h"
+
+namespace fst {
+
+/**
+   LookaheadComposeFst is the composition HCL o G of a static decoding graph
+   without the grammar (HCL, whose output labels are words) with a grammar G
+   that is accessed through the DeterministicOnDemandFst interface (e.g. a
+   ConstArpaLmDeterministicFst, or a BackoffDeterministicOnDemandFst wrapping
+   G.fst).  It is an ordinary Fst, so the decoders can use it in place of
+   HCLG.fst; this avoids building HCLG, which for large language models can
+   take far more time and memory than HCL and G together.
+
+   The states of the composed FST are pairs (HCL state, G state), which are
+   given ids as they are first reached, and their arcs are computed the first
+   time they are needed (e.g. by the decoder's ArcIterator).  The states and
+   their arcs are kept after decoding an utterance, so the next utterances
+   reuse them; call TrimCache() between utterances to bound the memory used.
+
+   Because the word labels in HCL tend to come some way into the words (after
+   determinization they are delayed until the word is distinct from the other
+   words with the same prefix), the grammar cost would be applied late, which
+   makes the beam pruning less effective than with HCLG, where the weights are
+   pushed.  To compensate we do language-model lookahead with "potentials": for
+   each HCL state s, phi(s) is the lowest LM cost of any word that can be the
+   next word label after s (from 'word_costs', which would normally be the
+   unigram costs), and each composed arc from (s, g) to (s', g') gets the cost
+   w + lm_cost + phi(s') - phi(s), where lm_cost is the cost of the arc's word
+   in G, if any.  Final-probs get -phi(s) + phi(start).  This leaves the cost
+   of each complete path unchanged, so the lattices are the same as with the
+   static composition (up to roundoff and pruning), but the LM costs are seen
+   earlier.  Arcs to HCL states from which no word label or final state can be
+   reached (phi(s) = infinity) are left out, since they are dead ends.
+   (We don't use OpenFst's lookahead matchers because our OpenFst is not built
+   with the lookahead-fst extensions, and they would not let us cache the
+   composed states across utterances.)
+
+   Requirements: the arc type must have a tropical-like weight with a Value()
+   that is a cost; HCL's output labels must be words (or zero), i.e. with no
+   disambiguation symbols; and HCL's states must be numbered 0 ... N-1, as in
+   any expanded FST.  The state iterator only visits the states created so far.
+
+   This class is not thread-safe, even for const operations (since G isn't,
+   and the arcs are computed on demand), so a decoder that uses it must run in
+   a single thread (e.g. --num-emitting-threads=1).  Copies share HCL and G
+   but not the cached arcs.
+ */
+template<class A>
+class LookaheadComposeFst: public Fst<A> {
+ public:
+  typedef A Arc;
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+  typedef typename Arc::Label Label;
+
+  /// Constructor.  We don't take ownership of 'hcl' or 'g', which must exist
+  /// for the lifetime of this object.  If 'word_costs' is non-NULL, the
+  /// lookahead cost of word w is (*word_costs)[w], or zero for words outside
+  /// the vector; if it is NULL, it is the cost of w from the start state of
+  /// 'g'.  If more than 'max_cached_arcs' arcs have been expanded, TrimCache()
+  /// will clear the cache.
+  LookaheadComposeFst(const Fst<Arc> &hcl,
+                      DeterministicOnDemandFst<Arc> *g,
+                      const std::vector<float> *word_costs = NULL,
+                      size_t max_cached_arcs = 10000000);
+
+  LookaheadComposeFst(const LookaheadComposeFst<Arc> &other,
+                      bool safe = false);
+
+  StateId Start() const override { return start_; }
+
+  Weight Final(StateId s) const override {
+    return GetState(s).final;
+  }
+
+  size_t NumArcs(StateId s) const override {
+    return GetState(s).arcs.size();
+  }
+
+  size_t NumInputEpsilons(StateId s) const override {
+    return GetState(s).num_input_epsilons;
+  }
+
+  size_t NumOutputEpsilons(StateId s) const override {
+    return GetState(s).num_output_epsilons;
+  }
+
+  uint64 Properties(uint64 mask, bool test) const override {
+    return 0;
+  }
+
+  const string &Type() const override {
+    static const string *const type = new string("lookahead-compose");
+    return *type;
+  }
+
+  LookaheadComposeFst<Arc> *Copy(bool safe = false) const override {
+    return new LookaheadComposeFst<Arc>(*this, safe);
+  }
+
+  const SymbolTable *InputSymbols() const override {
+    return hcl_.InputSymbols();
+  }
+
+  const SymbolTable *OutputSymbols() const override {
+    return hcl_.OutputSymbols();
+  }
+
+  void InitStateIterator(StateIteratorData<Arc> *data) const override {
+    data->base = NULL;
+    data->nstates = state_pairs_.size();
+  }
+
+  /// The arcs stay valid until TrimCache() is called.
+  void InitArcIterator(StateId s, ArcIteratorData<Arc> *data) const override {
+    const ExpandedState &state = GetState(s);
+    data->base = NULL;
+    data->arcs = (state.arcs.empty() ? NULL : &(state.arcs[0]));
+    data->narcs = state.arcs.size();
+    data->ref_count = NULL;
+  }
+
+  /// Clears the cached states and arcs if more than max_cached_arcs arcs have
+  /// been expanded.  This changes the state ids, so call it only between
+  /// utterances (e.g. just before the decoder's InitDecoding()).  Returns true
+  /// if it cleared the cache.
+  bool TrimCache();
+
+  /// Returns the number of composed states created so far.
+  StateId NumStatesCreated() const { return state_pairs_.size(); }
+
+  /// Returns the number of arcs currently cached.
+  size_t NumCachedArcs() const { return num_cached_arcs_; }
+
+  /// Returns the lookahead potential phi(s) of HCL state s; exposed for
+  /// testing.
+  float Potential(StateId hcl_state) const { return potentials_[hcl_state]; }
+
+ private:
+  struct ExpandedState {
+    bool expanded;
+    Weight final;
+    size_t num_input_epsilons;
+    size_t num_output_epsilons;
+    std::vector<Arc> arcs;
+    ExpandedState(): expanded(false), final(Weight::Zero()),
+                     num_input_epsilons(0), num_output_epsilons(0) { }
+  };
+  typedef std::pair<StateId, StateId> StatePair;  // (HCL state, G state).
+  typedef unordered_map<StatePair, StateId,
+                        kaldi::PairHasher<StateId> > StateMap;
+
+  // Computes potentials_, see the comment above the class.
+  void ComputePotentials(const std::vector<float> *word_costs);
+
+  // Returns the composed state for this pair, creating it if necessary.
+  StateId FindState(StateId hcl_state, StateId g_state) const;
+
+  // Returns composed state s, expanding it if it was not already expanded.
+  inline const ExpandedState &GetState(StateId s) const {
+    KALDI_PARANOID_ASSERT(static_cast<size_t>(s) < states_.size());
+    if (!states_[s].expanded)
+      Expand(s);
+    return states_[s];
+  }
+
+  // Computes the final-prob and arcs of composed state s.
+  void Expand(StateId s) const;
+
+  const Fst<Arc> &hcl_;
+  DeterministicOnDemandFst<Arc> *g_;
+  size_t max_cached_arcs_;
+  // The lookahead potential of each HCL state; infinity if no word label or
+  // final state can be reached from it.
+  std::vector<float> potentials_;
+  StateId start_;
+
+  // The rest is the cache.  It is mutable because it is filled in on demand
+  // from const functions.
+  mutable std::vector<StatePair> state_pairs_;  // Indexed by composed state.
+  mutable StateMap state_map_;  // The inverse of state_pairs_.
+  // Indexed by composed state; a deque so that the arcs don't move when
+  // states are added while the decoder is iterating over them.
+  mutable std::deque<ExpandedState> states_;
+  mutable size_t num_cached_arcs_;
+
+  LookaheadComposeFst<Arc> &operator = (const LookaheadComposeFst<Arc> &);
+};
+
+}  // namespace fst
+
+#include "fstext/lookahead-compose-fst-inl.h"
+
+#endif  // KALDI_FSTEXT_LOOKAHEAD_COMPOSE_FST_H_
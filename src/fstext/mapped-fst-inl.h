@@ -0,0 +1,176 @@
+// fstext/mapped-fst-inl.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FSTEXT_MAPPED_FST_INL_H_
+#define KALDI_FSTEXT_MAPPED_FST_INL_H_
+
+// Do not include this file directly.  It is included by mapped-fst.h
+
+#include <cstring>
+#include <vector>
+
+namespace fst {
+
+template <class Arc>
+MappedFst<Arc>::MappedFst(std::shared_ptr<kaldi::MemoryMappedFile> file,
+                          const MappedFstHeader &header):
+    file_(file),
+    states_(reinterpret_cast<const State*>(file->Data() +
+                                           header.states_offset)),
+    arcs_(reinterpret_cast<const Arc*>(file->Data() + header.arcs_offset)),
+    num_states_(header.num_states), num_arcs_(header.num_arcs),
+    start_(header.start), properties_(header.properties) { }
+
+template <class Arc>
+MappedFst<Arc> *MappedFst<Arc>::Read(const std::string &filename,
+                                     bool verify_checksum) {
+  std::shared_ptr<kaldi::MemoryMappedFile> file(
+      new kaldi::MemoryMappedFile(filename));
+  if (file->Size() < sizeof(MappedFstHeader))
+    KALDI_ERR << "File " << filename << " is too small to be a mapped FST";
+  // The header is at offset zero, and mmap() returns page-aligned addresses.
+  const MappedFstHeader &header =
+      *reinterpret_cast<const MappedFstHeader*>(file->Data());
+  CheckMappedFstHeader(header, filename, file->Size(), Arc::Type(),
+                       sizeof(Arc), sizeof(State));
+  MappedFst<Arc> *ans = new MappedFst<Arc>(file, header);
+  if (verify_checksum) {
+    uint64 checksum = MappedFstChecksum(
+        ans->states_, sizeof(State) * ans->num_states_, 0);
+    checksum = MappedFstChecksum(ans->arcs_, sizeof(Arc) * ans->num_arcs_,
+                                 checksum);
+    if (checksum != header.data_checksum) {
+      delete ans;
+      KALDI_ERR << "Checksum mismatch in mapped FST " << filename
+                << ": the file is corrupted.";
+    }
+    ans->CheckStates();
+  }
+  return ans;
+}
+
+template <class Arc>
+void MappedFst<Arc>::CheckStates() const {
+  for (StateId s = 0; s < num_states_; s++) {
+    const State &state = states_[s];
+    if (state.arcs_begin > num_arcs_ ||
+        state.num_arcs > num_arcs_ - state.arcs_begin)
+      KALDI_ERR << "Invalid arcs for state " << s << " in mapped FST "
+                << file_->Filename();
+    size_t num_input_epsilons = 0, num_output_epsilons = 0;
+    const Arc *arcs = arcs_ + state.arcs_begin;
+    for (uint32 i = 0; i < state.num_arcs; i++) {
+      if (arcs[i].ilabel == 0) num_input_epsilons++;
+      if (arcs[i].olabel == 0) num_output_epsilons++;
+      if (arcs[i].nextstate < 0 || arcs[i].nextstate >= num_states_)
+        KALDI_ERR << "Invalid next-state for state " << s
+                  << " in mapped FST " << file_->Filename();
+    }
+    if (num_input_epsilons != state.num_input_epsilons ||
+        num_output_epsilons != state.num_output_epsilons)
+      KALDI_ERR << "Invalid epsilon counts for state " << s
+                << " in mapped FST " << file_->Filename();
+  }
+}
+
+
+// Writes 'num_bytes' zero bytes to 'os'.
+inline void WriteMappedFstPadding(std::ostream &os, uint64 num_bytes) {
+  static const char zeros[kMappedFstAlignment] = { 0 };
+  KALDI_ASSERT(num_bytes < kMappedFstAlignment);
+  os.write(zeros, num_bytes);
+}
+
+template <class Arc>
+void WriteMappedFst(const Fst<Arc> &fst, std::ostream &os) {
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+  typedef MappedFstState<Weight> State;
+
+  // The first pass works out the states, so that we can write the header
+  // (which contains the checksum) without keeping all the arcs in memory.
+  StateId num_states = CountStates(fst);
+  std::vector<State> states(num_states);
+  // Zero the states, including any padding, so the checksum is well defined.
+  if (num_states > 0)
+    memset(static_cast<void*>(&(states[0])), 0, sizeof(State) * num_states);
+  uint64 num_arcs = 0;
+  for (StateId s = 0; s < num_states; s++) {
+    State &state = states[s];
+    state.arcs_begin = num_arcs;
+    state.final = fst.Final(s);
+    for (ArcIterator<Fst<Arc> > aiter(fst, s); !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel == 0) state.num_input_epsilons++;
+      if (arc.olabel == 0) state.num_output_epsilons++;
+      state.num_arcs++;
+    }
+    num_arcs += state.num_arcs;
+  }
+  uint64 data_checksum = 0;
+  if (num_states > 0)
+    data_checksum = MappedFstChecksum(&(states[0]),
+                                      sizeof(State) * num_states, 0);
+  for (StateId s = 0; s < num_states; s++)
+    for (ArcIterator<Fst<Arc> > aiter(fst, s); !aiter.Done(); aiter.Next())
+      data_checksum = MappedFstChecksum(&(aiter.Value()), sizeof(Arc),
+                                        data_checksum);
+
+  MappedFstHeader header;
+  memset(static_cast<void*>(&header), 0, sizeof(header));
+  memcpy(header.magic, kMappedFstMagic, sizeof(header.magic));
+  header.version = kMappedFstVersion;
+  header.arc_size = sizeof(Arc);
+  KALDI_ASSERT(Arc::Type().size() < sizeof(header.arc_type));
+  strncpy(header.arc_type, Arc::Type().c_str(), sizeof(header.arc_type));
+  header.num_states = num_states;
+  header.num_arcs = num_arcs;
+  header.start = fst.Start();
+  // As for ConstFst, the properties are worked out now and stored.
+  header.properties = fst.Properties(kCopyProperties, true) | kExpanded;
+  header.states_offset = (sizeof(header) + kMappedFstAlignment - 1) /
+      kMappedFstAlignment * kMappedFstAlignment;
+  uint64 states_end = header.states_offset + sizeof(State) * num_states;
+  header.arcs_offset = (states_end + kMappedFstAlignment - 1) /
+      kMappedFstAlignment * kMappedFstAlignment;
+  header.data_checksum = data_checksum;
+  header.header_checksum = MappedFstHeaderChecksum(header);
+
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  WriteMappedFstPadding(os, header.states_offset - sizeof(header));
+  if (num_states > 0)
+    os.write(reinterpret_cast<const char*>(&(states[0])),
+             sizeof(State) * num_states);
+  WriteMappedFstPadding(os, header.arcs_offset - states_end);
+  std::vector<Arc> arcs;
+  for (StateId s = 0; s < num_states; s++) {
+    arcs.clear();
+    for (ArcIterator<Fst<Arc> > aiter(fst, s); !aiter.Done(); aiter.Next())
+      arcs.push_back(aiter.Value());
+    if (!arcs.empty())
+      os.write(reinterpret_cast<const char*>(&(arcs[0])),
+               sizeof(Arc) * arcs.size());
+  }
+  if (!os.good())
+    KALDI_ERR << "Error writing mapped FST";
+}
+
+}  // namespace fst
+
+#endif  // KALDI_FSTEXT_MAPPED_FST_INL_H_
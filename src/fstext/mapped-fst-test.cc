@@ -0,0 +1,135 @@
+// fstext/mapped-fst-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <fstream>
+#include "fstext/mapped-fst.h"
+#include "fstext/kaldi-fst-io.h"
+#include "fstext/rand-fst.h"
+#include "base/kaldi-math.h"
+
+namespace fst {
+
+static void WriteMappedFstToFile(const Fst<StdArc> &fst,
+                                 const std::string &filename) {
+  std::ofstream os(filename.c_str(), std::ios::out | std::ios::binary);
+  WriteMappedFst(fst, os);
+}
+
+// Flips a bit of the byte at 'offset' in the file.
+static void CorruptFile(const std::string &filename, size_t offset) {
+  std::fstream fs(filename.c_str(),
+                  std::ios::in | std::ios::out | std::ios::binary);
+  fs.seekg(offset);
+  char c = fs.get();
+  fs.seekp(offset);
+  fs.put(c ^ 1);
+  KALDI_ASSERT(fs.good());
+}
+
+static bool ReadMappedFstThrows(const std::string &filename,
+                                bool verify_checksum) {
+  try {
+    delete MappedFst<StdArc>::Read(filename, verify_checksum);
+    return false;
+  } catch(const std::exception &e) {
+    return true;
+  }
+}
+
+static void TestMappedFst() {
+  typedef StdArc::StateId StateId;
+  std::string filename = "tmp.mapped";
+  VectorFst<StdArc> *fst = RandFst<StdArc>();
+  WriteMappedFstToFile(*fst, filename);
+  KALDI_ASSERT(IsMappedFstFile(filename));
+
+  MappedFst<StdArc> *mapped_fst = MappedFst<StdArc>::Read(filename, true);
+  KALDI_ASSERT(mapped_fst->Type() == "mapped");
+  KALDI_ASSERT(Equal(*fst, *mapped_fst));
+  KALDI_ASSERT(mapped_fst->Start() == fst->Start() &&
+               mapped_fst->NumStates() == fst->NumStates());
+  for (StateId s = 0; s < fst->NumStates(); s++) {
+    KALDI_ASSERT(mapped_fst->NumArcs(s) == fst->NumArcs(s) &&
+                 mapped_fst->NumInputEpsilons(s) == fst->NumInputEpsilons(s) &&
+                 mapped_fst->NumOutputEpsilons(s) ==
+                 fst->NumOutputEpsilons(s));
+    // Check the specialized arc iterator against the generic one.
+    ArcIterator<MappedFst<StdArc> > aiter(*mapped_fst, s);
+    ArcIterator<Fst<StdArc> > aiter2(*fst, s);
+    for (; !aiter.Done(); aiter.Next(), aiter2.Next()) {
+      const StdArc &arc = aiter.Value(), &arc2 = aiter2.Value();
+      KALDI_ASSERT(arc.ilabel == arc2.ilabel && arc.olabel == arc2.olabel &&
+                   arc.nextstate == arc2.nextstate &&
+                   arc.weight == arc2.weight);
+    }
+    KALDI_ASSERT(aiter2.Done());
+  }
+  // Copies share the mapping and outlive the original.
+  Fst<StdArc> *copy = mapped_fst->Copy();
+  delete mapped_fst;
+  KALDI_ASSERT(Equal(*fst, *copy));
+  delete copy;
+
+  // ReadFstKaldiGeneric() recognizes mapped FSTs.
+  Fst<StdArc> *generic_fst = ReadFstKaldiGeneric(filename);
+  KALDI_ASSERT(generic_fst->Type() == "mapped" && Equal(*fst, *generic_fst));
+  delete generic_fst;
+
+  if (fst->NumStates() > 0) {
+    // Corrupting the data is only detected if we verify the checksum.
+    MappedFstHeader header;
+    {
+      std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+      is.read(reinterpret_cast<char*>(&header), sizeof(header));
+    }
+    CorruptFile(filename, header.num_arcs > 0 ? header.arcs_offset :
+                header.states_offset);
+    KALDI_ASSERT(ReadMappedFstThrows(filename, true));
+    KALDI_ASSERT(!ReadMappedFstThrows(filename, false));
+  }
+  // Corrupting the header is always detected.
+  WriteMappedFstToFile(*fst, filename);
+  CorruptFile(filename, offsetof(MappedFstHeader, num_arcs));
+  KALDI_ASSERT(ReadMappedFstThrows(filename, false));
+  std::remove(filename.c_str());
+  delete fst;
+}
+
+static void TestIsMappedFstFile() {
+  std::string filename = "tmp.mapped";
+  {
+    std::ofstream os(filename.c_str(), std::ios::out | std::ios::binary);
+    os << "not a mapped FST";
+  }
+  KALDI_ASSERT(!IsMappedFstFile(filename));
+  KALDI_ASSERT(ReadMappedFstThrows(filename, false));
+  std::remove(filename.c_str());
+  KALDI_ASSERT(!IsMappedFstFile(filename));
+}
+
+}  // namespace fst
+
+int main() {
+  using namespace fst;
+  for (int i = 0; i < 25; i++)
+    TestMappedFst();
+  TestIsMappedFstFile();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,91 @@
+// fstext/mapped-fst.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fstext/mapped-fst.h"
+#include <cstddef>
+#include <fstream>
+
+namespace fst {
+
+uint64 MappedFstChecksum(const void *data, size_t num_bytes,
+                         uint64 checksum) {
+  // This is FNV-1a on 32-bit words rather than bytes, which is about four
+  // times faster and is good enough to detect corruption.
+  KALDI_ASSERT(num_bytes % 4 == 0);
+  const char *ptr = static_cast<const char*>(data),
+      *end = ptr + num_bytes;
+  for (; ptr != end; ptr += 4) {
+    uint32 word;
+    memcpy(&word, ptr, 4);
+    checksum = (checksum ^ word) * 1099511628211ull;
+  }
+  return checksum;
+}
+
+uint64 MappedFstHeaderChecksum(const MappedFstHeader &header) {
+  return MappedFstChecksum(&header, offsetof(MappedFstHeader, header_checksum),
+                           0);
+}
+
+bool IsMappedFstFile(const std::string &filename) {
+  std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(kMappedFstMagic)];
+  if (!is.read(magic, sizeof(magic)))
+    return false;
+  return memcmp(magic, kMappedFstMagic, sizeof(magic)) == 0;
+}
+
+void CheckMappedFstHeader(const MappedFstHeader &header,
+                          const std::string &filename, size_t file_size,
+                          const std::string &arc_type, size_t arc_size,
+                          size_t state_size) {
+  if (memcmp(header.magic, kMappedFstMagic, sizeof(header.magic)) != 0)
+    KALDI_ERR << "File " << filename << " is not a mapped FST.";
+  if (header.version != kMappedFstVersion)
+    KALDI_ERR << "Mapped FST " << filename << " has version "
+              << header.version << ", expected " << kMappedFstVersion
+              << " (or it was written on a machine with a different "
+              << "byte order).";
+  if (MappedFstHeaderChecksum(header) != header.header_checksum)
+    KALDI_ERR << "Checksum mismatch in header of mapped FST " << filename
+              << ": the file is corrupted.";
+  if (strncmp(header.arc_type, arc_type.c_str(), sizeof(header.arc_type))
+      != 0 || header.arc_size != static_cast<int32>(arc_size))
+    KALDI_ERR << "Mapped FST " << filename << " has arc type "
+              << std::string(header.arc_type,
+                             strnlen(header.arc_type, sizeof(header.arc_type)))
+              << ", expected " << arc_type;
+  if (header.num_states < 0 || header.num_arcs < 0 ||
+      header.start < kNoStateId || header.start >= header.num_states ||
+      header.states_offset % kMappedFstAlignment != 0 ||
+      header.arcs_offset % kMappedFstAlignment != 0 ||
+      header.states_offset < sizeof(header) ||
+      header.states_offset > file_size ||
+      static_cast<uint64>(header.num_states) >
+      (file_size - header.states_offset) / state_size ||
+      header.arcs_offset < header.states_offset +
+      static_cast<uint64>(header.num_states) * state_size ||
+      header.arcs_offset > file_size ||
+      static_cast<uint64>(header.num_arcs) >
+      (file_size - header.arcs_offset) / arc_size)
+    KALDI_ERR << "Mapped FST " << filename << " has an invalid header or "
+              << "is truncated.";
+}
+
+}  // namespace fst
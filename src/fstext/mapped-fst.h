@@ -0,0 +1,282 @@
+// fstext/mapped-fst.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_FSTEXT_MAPPED_FST_H_
+#define KALDI_FSTEXT_MAPPED_FST_H_
+
+#include <fst/fstlib.h>
+#include <fst/fst-decl.h>
+#include <memory>
+#include <ostream>
+#include <string>
+#include "base/kaldi-common.h"
+#include "util/memory-mapped-file.h"
+
+/* This header defines MappedFst, a read-only FST that is used in place from a
+   memory-mapped file.  Reading a large decoding graph (HCLG) as a ConstFst
+   means reading and copying gigabytes; a MappedFst is "loaded" in constant
+   time, the operating system pages it in as the decoder touches it, and
+   several decoding processes on the same machine share a single copy of it in
+   the page cache.
+
+   The file format is Kaldi's own (it is not readable by OpenFst binaries):
+   a fixed-size header (MappedFstHeader), then the array of states, then the
+   array of arcs, each starting at an offset that is a multiple of
+   kMappedFstAlignment.  The arcs of each state are contiguous and the arcs
+   are stored exactly as in memory, so the arc iterator just returns pointers
+   into the mapping, like ConstFst's.  As with ConstFst, numbers are stored in
+   the native byte order, so the files are not portable between machines of
+   different endianness (the header check will fail if you try).
+
+   The header has a version number, the sizes of the arrays and two checksums:
+   one of the header itself, which is always checked, and one of the state and
+   arc data, which is only checked if you ask for it because it requires
+   reading the whole file.  Use fstmakemapped to create these files.
+   ReadFstKaldiGeneric() recognizes them, so most programs that read decoding
+   graphs accept them.
+*/
+
+namespace fst {
+
+/// \addtogroup mapped_fst_group "The memory-mapped, read-only FST type"
+/// @{
+
+static const char kMappedFstMagic[8] = { 'K', 'A', 'L', 'D', 'I', 'M', 'F',
+                                         'S' };
+static const int32 kMappedFstVersion = 1;
+static const uint64 kMappedFstAlignment = 64;
+
+/// This is the header at the start of a MappedFst file.
+struct MappedFstHeader {
+  char magic[8];           // kMappedFstMagic.
+  int32 version;           // kMappedFstVersion.
+  int32 arc_size;          // sizeof(Arc).
+  char arc_type[32];       // Arc::Type(), null-terminated.
+  int64 num_states;
+  int64 num_arcs;
+  int64 start;             // Start state, or kNoStateId if the FST is empty.
+  uint64 properties;       // The FST's properties, as stored by Properties().
+  uint64 states_offset;    // Offset of the array of states, in bytes.
+  uint64 arcs_offset;      // Offset of the array of arcs, in bytes.
+  uint64 data_checksum;    // Checksum of the arrays of states and arcs.
+  uint64 header_checksum;  // Checksum of the preceding members.
+};
+
+/// This is the type of the elements of the array of states in a MappedFst
+/// file.
+template <class Weight>
+struct MappedFstState {
+  uint64 arcs_begin;       // Index of this state's first arc.
+  uint32 num_arcs;
+  uint32 num_input_epsilons;
+  uint32 num_output_epsilons;
+  Weight final;
+};
+
+/// Updates the checksum 'checksum' with the data [data, data + num_bytes);
+/// num_bytes must be a multiple of 4.  The checksum of a sequence of blocks is
+/// the same as the checksum of their concatenation.  Start with checksum 0.
+uint64 MappedFstChecksum(const void *data, size_t num_bytes,
+                         uint64 checksum);
+
+/// Returns the checksum of the header, excluding its header_checksum member.
+uint64 MappedFstHeaderChecksum(const MappedFstHeader &header);
+
+/// Returns true if 'filename' is a file (not a pipe or other rxfilename) that
+/// starts with the MappedFst magic string.  Does not throw.
+bool IsMappedFstFile(const std::string &filename);
+
+/// Checks that 'header' is a valid header for a MappedFst file of 'file_size'
+/// bytes with the arc type 'arc_type' and arc size 'arc_size' and states of
+/// 'state_size' bytes; throws (KALDI_ERR) if not.
+void CheckMappedFstHeader(const MappedFstHeader &header,
+                          const std::string &filename, size_t file_size,
+                          const std::string &arc_type, size_t arc_size,
+                          size_t state_size);
+
+
+template <class A> class MappedFst;
+template <class A> class ArcIterator<MappedFst<A> >;
+template <class A> class StateIterator<MappedFst<A> >;
+
+/// MappedFst is a read-only ExpandedFst whose states and arcs are in a
+/// memory-mapped file; see the comment at the top of this file.  Copies share
+/// the mapping, which is released when the last one is destroyed.  It has no
+/// symbol tables.
+template <class A>
+class MappedFst : public ExpandedFst<A> {
+ public:
+  typedef A Arc;
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+  typedef MappedFstState<Weight> State;
+
+  friend class ArcIterator<MappedFst<Arc> >;
+  friend class StateIterator<MappedFst<Arc> >;
+
+  /// Maps the file 'filename', which must have been written by
+  /// WriteMappedFst().  The header is always checked; if verify_checksum is
+  /// true the data is checked too, which reads the whole file.  Throws
+  /// (KALDI_ERR) on error.
+  static MappedFst<Arc> *Read(const std::string &filename,
+                              bool verify_checksum = false);
+
+  MappedFst(const MappedFst<Arc> &other, bool safe = false):
+      file_(other.file_), states_(other.states_), arcs_(other.arcs_),
+      num_states_(other.num_states_), num_arcs_(other.num_arcs_),
+      start_(other.start_), properties_(other.properties_) { }
+
+  StateId Start() const override { return start_; }
+
+  Weight Final(StateId s) const override { return states_[s].final; }
+
+  StateId NumStates() const override { return num_states_; }
+
+  size_t NumArcs(StateId s) const override { return states_[s].num_arcs; }
+
+  size_t NumInputEpsilons(StateId s) const override {
+    return states_[s].num_input_epsilons;
+  }
+
+  size_t NumOutputEpsilons(StateId s) const override {
+    return states_[s].num_output_epsilons;
+  }
+
+  uint64 Properties(uint64 mask, bool test) const override {
+    return properties_ & mask;
+  }
+
+  const string &Type() const override {
+    static const string *const type = new string("mapped");
+    return *type;
+  }
+
+  MappedFst<Arc> *Copy(bool safe = false) const override {
+    return new MappedFst<Arc>(*this, safe);
+  }
+
+  const SymbolTable *InputSymbols() const override { return NULL; }
+
+  const SymbolTable *OutputSymbols() const override { return NULL; }
+
+  void InitStateIterator(StateIteratorData<Arc> *data) const override {
+    data->base = NULL;
+    data->nstates = num_states_;
+  }
+
+  void InitArcIterator(StateId s, ArcIteratorData<Arc> *data) const override {
+    data->base = NULL;
+    data->arcs = arcs_ + states_[s].arcs_begin;
+    data->narcs = states_[s].num_arcs;
+    data->ref_count = NULL;
+  }
+
+ private:
+  MappedFst(std::shared_ptr<kaldi::MemoryMappedFile> file,
+            const MappedFstHeader &header);
+
+  // Checks that the arcs of each state are inside the array of arcs and the
+  // stored epsilon counts; called by Read() if verify_checksum == true.
+  void CheckStates() const;
+
+  std::shared_ptr<kaldi::MemoryMappedFile> file_;
+  const State *states_;  // Points into the mapping.
+  const Arc *arcs_;      // Points into the mapping.
+  StateId num_states_;
+  size_t num_arcs_;
+  StateId start_;
+  uint64 properties_;
+
+  MappedFst<Arc> &operator = (const MappedFst<Arc> &other);  // Disallow.
+};
+
+
+/// Specialization of ArcIterator for MappedFst, which (like the one for
+/// ConstFst) avoids virtual function calls.
+template <class A>
+class ArcIterator<MappedFst<A> > {
+ public:
+  typedef A Arc;
+  typedef typename Arc::StateId StateId;
+
+  ArcIterator(const MappedFst<Arc> &fst, StateId s):
+      arcs_(fst.arcs_ + fst.states_[s].arcs_begin),
+      narcs_(fst.states_[s].num_arcs), i_(0) { }
+
+  bool Done() const { return i_ >= narcs_; }
+
+  const Arc &Value() const { return arcs_[i_]; }
+
+  void Next() { ++i_; }
+
+  size_t Position() const { return i_; }
+
+  void Reset() { i_ = 0; }
+
+  void Seek(size_t a) { i_ = a; }
+
+  uint32 Flags() const { return kArcValueFlags; }
+
+  void SetFlags(uint32 flags, uint32 mask) { }
+
+ private:
+  const Arc *arcs_;
+  size_t narcs_;
+  size_t i_;
+};
+
+
+/// Specialization of StateIterator for MappedFst.
+template <class A>
+class StateIterator<MappedFst<A> > {
+ public:
+  typedef A Arc;
+  typedef typename Arc::StateId StateId;
+
+  explicit StateIterator(const MappedFst<Arc> &fst):
+      nstates_(fst.num_states_), s_(0) { }
+
+  bool Done() const { return s_ >= nstates_; }
+
+  StateId Value() const { return s_; }
+
+  void Next() { ++s_; }
+
+  void Reset() { s_ = 0; }
+
+ private:
+  StateId nstates_;
+  StateId s_;
+};
+
+
+/// Writes 'fst' to 'os' in the MappedFst format (the stream must be binary).
+/// The states of 'fst' must be numbered from zero, as for expanded FSTs.
+/// Arc must be plain-old-data without padding, like StdArc, as the arcs are
+/// written as raw bytes.  Throws (KALDI_ERR) on error.
+template <class Arc>
+void WriteMappedFst(const Fst<Arc> &fst, std::ostream &os);
+
+/// @} end "addtogroup mapped_fst_group"
+
+}  // namespace fst
+
+#include "fstext/mapped-fst-inl.h"
+
+#endif  // KALDI_FSTEXT_MAPPED_FST_H_
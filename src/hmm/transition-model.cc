@@ -777,6 +777,26 @@ int32 TransitionModel::TransitionIdToPhone(int32 trans_id) const {
   return tuples_[trans_state-1].phone;
 }
 
+void TransitionModel::TransitionIdsToPdfValues(
+    const BaseFloat *pdf_values, const std::vector<int32> &trans_ids,
+    std::vector<BaseFloat> *values) const {
+  size_t num_ids = trans_ids.size();
+  values->resize(num_ids);
+  if (num_ids == 0)
+    return;
+  const int32 *ids = &(trans_ids[0]), *id2pdf = &(id2pdf_id_[0]);
+  // Check the range first so that the loop below has no branches and can be
+  // vectorized (as a gather).
+  uint32 max_id = 0;
+  for (size_t i = 0; i < num_ids; i++)
+    max_id = std::max(max_id, static_cast<uint32>(ids[i]));
+  KALDI_ASSERT(max_id < id2pdf_id_.size() &&
+               "Likely graph/model mismatch (graph built from wrong model?)");
+  BaseFloat *out = &((*values)[0]);
+  for (size_t i = 0; i < num_ids; i++)
+    out[i] = pdf_values[id2pdf[ids[i]]];
+}
+
 int32 TransitionModel::TransitionIdToPdfClass(int32 trans_id) const {
   KALDI_ASSERT(trans_id != 0 && static_cast<size_t>(trans_id) < id2state_.size());
   int32 trans_state = id2state_[trans_id];
@@ -156,6 +156,13 @@ class TransitionModel {
   // this state doesn't have a self-loop.
 
   inline int32 TransitionIdToPdf(int32 trans_id) const;
+  /// Sets (*values)[i] = pdf_values[TransitionIdToPdf(trans_ids[i])] for each
+  /// i, where 'pdf_values' is indexed by pdf-id (e.g. a row of a matrix of
+  /// log-likelihoods); 'values' is resized to the size of 'trans_ids'.  This
+  /// is for decodable objects, in DecodableInterface::LogLikelihoods().
+  void TransitionIdsToPdfValues(const BaseFloat *pdf_values,
+                                const std::vector<int32> &trans_ids,
+                                std::vector<BaseFloat> *values) const;
   int32 TransitionIdToPhone(int32 trans_id) const;
   int32 TransitionIdToPdfClass(int32 trans_id) const;
   int32 TransitionIdToHmmState(int32 trans_id) const;
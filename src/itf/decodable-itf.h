@@ -87,6 +87,22 @@ class DecodableInterface {
   /// returns false before calling this.
   virtual BaseFloat LogLikelihood(int32 frame, int32 index) = 0;
 
+  /// Outputs the log likelihoods for a number of indexes on the same frame,
+  /// i.e. sets (*log_likes)[i] = LogLikelihood(frame, indexes[i]) for each i;
+  /// 'log_likes' is resized to the size of 'indexes'.  The decoders call this
+  /// once per frame, with all the indexes they will need for that frame,
+  /// instead of calling LogLikelihood() once per arc.  This default
+  /// implementation just calls LogLikelihood(); decodable objects that have
+  /// the likelihoods for the whole frame in memory should override it, doing
+  /// the lookup without a virtual function call per index.
+  virtual void LogLikelihoods(int32 frame, const std::vector<int32> &indexes,
+                              std::vector<BaseFloat> *log_likes) {
+    size_t num_indexes = indexes.size();
+    log_likes->resize(num_indexes);
+    for (size_t i = 0; i < num_indexes; i++)
+      (*log_likes)[i] = LogLikelihood(frame, indexes[i]);
+  }
+
   /// Returns true if this is the last frame.  Frames are zero-based, so the
   /// first frame is zero.  IsLastFrame(-1) will return false, unless the file
   /// is empty (which is a case that I'm not sure all the code will handle, so
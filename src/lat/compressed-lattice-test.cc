@@ -0,0 +1,129 @@
+// lat/compressed-lattice-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lat/compressed-lattice.h"
+#include "fstext/rand-fst.h"
+
+namespace kaldi {
+
+static CompactLattice *RandCompactLattice() {
+  Lattice *fst = fst::RandPairFst<LatticeArc>();
+  CompactLattice *cfst = new CompactLattice;
+  ConvertLattice(*fst, cfst);
+  delete fst;
+  return cfst;
+}
+
+// Checks that 'clat2' is the same as 'clat1' except that the total cost of each
+// weight may differ by up to 'delta'.
+static void AssertSameLattice(const CompactLattice &clat1,
+                              const CompactLattice &clat2,
+                              BaseFloat delta) {
+  typedef CompactLattice::StateId StateId;
+  KALDI_ASSERT(clat1.Start() == clat2.Start() &&
+               clat1.NumStates() == clat2.NumStates());
+  for (StateId s = 0; s < clat1.NumStates(); s++) {
+    KALDI_ASSERT(clat1.NumArcs(s) == clat2.NumArcs(s));
+    KALDI_ASSERT(ApproxEqual(clat1.Final(s), clat2.Final(s), delta));
+    fst::ArcIterator<CompactLattice> aiter1(clat1, s), aiter2(clat2, s);
+    for (; !aiter1.Done(); aiter1.Next(), aiter2.Next()) {
+      const CompactLatticeArc &arc1 = aiter1.Value(), &arc2 = aiter2.Value();
+      KALDI_ASSERT(arc1.nextstate == arc2.nextstate &&
+                   arc1.ilabel == arc2.ilabel &&
+                   arc1.olabel == arc2.olabel &&
+                   ApproxEqual(arc1.weight, arc2.weight, delta));
+    }
+  }
+}
+
+static void TestCompressedLatticeIo() {
+  CompactLattice *clat = RandCompactLattice();
+  if (RandInt(0, 1) == 0 && clat->NumStates() > 0) {
+    // make it a transducer.
+    fst::MutableArcIterator<CompactLattice> aiter(clat, clat->Start());
+    if (!aiter.Done()) {
+      CompactLatticeArc arc = aiter.Value();
+      arc.olabel = arc.ilabel + 1;
+      aiter.SetValue(arc);
+    }
+  }
+  BaseFloat weight_quantum = (RandInt(0, 1) == 0 ? 0.0 : 0.01);
+  std::ostringstream os;
+  KALDI_ASSERT(WriteCompressedLattice(os, *clat, weight_quantum));
+  os << "foo";  // check that it reads exactly what was written.
+
+  std::istringstream is(os.str());
+  KALDI_ASSERT(IsCompressedLattice(is));
+  CompactLattice clat2;
+  KALDI_ASSERT(ReadCompressedLattice(is, &clat2));
+  std::string foo;
+  is >> foo;
+  KALDI_ASSERT(foo == "foo");
+  if (weight_quantum == 0.0)
+    KALDI_ASSERT(fst::Equal(*clat, clat2));
+  // each of the two costs may be off by up to half the quantum.
+  AssertSameLattice(*clat, clat2, weight_quantum + 1.0e-04);
+
+  // Corrupted data should be detected.
+  std::string str = os.str();
+  str.resize(str.size() - 4);
+  std::istringstream is2(str);
+  KALDI_ASSERT(!ReadCompressedLattice(is2, &clat2));
+  delete clat;
+}
+
+// Checks that the table readers detect the compressed format.
+static void TestCompressedLatticeTable() {
+  CompressedLatticeOptions opts;
+  opts.write_compressed = true;
+  SetCompressedLatticeOptions(opts);
+  int32 n = 10;
+  std::vector<CompactLattice*> lats(n);
+  {
+    CompactLatticeWriter writer("ark:tmpf");
+    for (int32 i = 0; i < n; i++) {
+      lats[i] = RandCompactLattice();
+      writer.Write("key" + std::to_string(i), *(lats[i]));
+    }
+  }
+  SequentialCompactLatticeReader clat_reader("ark:tmpf");
+  RandomAccessLatticeReader lat_reader("ark:tmpf");
+  for (int32 i = 0; i < n; i++, clat_reader.Next()) {
+    std::string key = "key" + std::to_string(i);
+    KALDI_ASSERT(!clat_reader.Done() && clat_reader.Key() == key);
+    KALDI_ASSERT(fst::Equal(clat_reader.Value(), *(lats[i])));
+    CompactLattice clat;
+    ConvertLattice(lat_reader.Value(key), &clat);
+    KALDI_ASSERT(fst::Equal(clat, *(lats[i])));
+    delete lats[i];
+  }
+  KALDI_ASSERT(clat_reader.Done());
+  SetCompressedLatticeOptions(CompressedLatticeOptions());
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 100; i++)
+    TestCompressedLatticeIo();
+  TestCompressedLatticeTable();
+  unlink("tmpf");
+  std::cout << "Test OK\n";
+}
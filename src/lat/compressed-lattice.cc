@@ -0,0 +1,369 @@
+// lat/compressed-lattice.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <cstring>
+#include "lat/compressed-lattice.h"
+
+namespace kaldi {
+
+// The layout of the data that follows the "<CLat>" token and the byte count
+// (all integers are varints unless stated otherwise):
+//
+//   flags (1 byte): kQuantized | kHasOLabels
+//   [ weight quantum (float), if kQuantized ]
+//   num-states, zigzag(start-state)
+//   for each state s:
+//     is-final; [ final weight, final string, if is-final ]
+//     num-arcs
+//     for each arc: zigzag(nextstate - s), ilabel, [ olabel, if
+//                   kHasOLabels ], weight, string
+//
+// where a weight is two costs (graph, acoustic), each a raw float, or if
+// kQuantized, 2 * zigzag(round(cost / quantum)), or 1 followed by a raw
+// float for costs that cannot be quantized (e.g. infinity); and a string is
+// num-runs, then (transition-id, count) for each run.
+
+static const char *kCompressedLatticeToken = "<CLat>";
+
+// The largest size in bytes of a compressed lattice that we write or read; it
+// is far more than any real lattice needs, and stops a corrupted size from
+// making us try to allocate a huge buffer.
+static const int64 kMaxCompressedLatticeSize = static_cast<int64>(1) << 32;
+
+enum CompressedLatticeFlags {
+  kQuantized = 1,  // the costs are quantized.
+  kHasOLabels = 2  // the output labels are stored (not all equal to the input
+                   // labels).
+};
+
+static inline uint64 ZigZagEncode(int64 i) {
+  return (static_cast<uint64>(i) << 1) ^ static_cast<uint64>(i >> 63);
+}
+
+static inline int64 ZigZagDecode(uint64 u) {
+  return static_cast<int64>(u >> 1) ^ -static_cast<int64>(u & 1);
+}
+
+namespace {
+
+class CompressedLatticeEncoder {
+ public:
+  CompressedLatticeEncoder(BaseFloat weight_quantum, std::string *buf):
+      quantum_(weight_quantum), buf_(buf) { }
+
+  void Encode(const CompactLattice &clat) {
+    typedef CompactLattice::StateId StateId;
+    StateId num_states = clat.NumStates();
+    bool has_olabels = false;
+    for (StateId s = 0; s < num_states && !has_olabels; s++)
+      for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+           aiter.Next())
+        if (aiter.Value().ilabel != aiter.Value().olabel)
+          has_olabels = true;
+    unsigned char flags = (quantum_ > 0.0 ? kQuantized : 0) |
+        (has_olabels ? kHasOLabels : 0);
+    buf_->push_back(static_cast<char>(flags));
+    if (quantum_ > 0.0)
+      WriteFloat(quantum_);
+    WriteVarint(num_states);
+    WriteVarint(ZigZagEncode(clat.Start()));
+    for (StateId s = 0; s < num_states; s++) {
+      const CompactLatticeWeight &final_weight = clat.Final(s);
+      if (final_weight == CompactLatticeWeight::Zero()) {
+        WriteVarint(0);
+      } else {
+        WriteVarint(1);
+        WriteWeight(final_weight);
+      }
+      WriteVarint(clat.NumArcs(s));
+      for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+           aiter.Next()) {
+        const CompactLatticeArc &arc = aiter.Value();
+        WriteVarint(ZigZagEncode(static_cast<int64>(arc.nextstate) - s));
+        WriteVarint(static_cast<uint32>(arc.ilabel));
+        if (has_olabels)
+          WriteVarint(static_cast<uint32>(arc.olabel));
+        WriteWeight(arc.weight);
+      }
+    }
+  }
+
+ private:
+  void WriteVarint(uint64 u) {
+    while (u >= 0x80) {
+      buf_->push_back(static_cast<char>((u & 0x7F) | 0x80));
+      u >>= 7;
+    }
+    buf_->push_back(static_cast<char>(u));
+  }
+
+  void WriteFloat(float f) {
+    char bytes[sizeof(f)];
+    std::memcpy(bytes, &f, sizeof(f));
+    buf_->append(bytes, sizeof(f));
+  }
+
+  void WriteCost(float cost) {
+    if (quantum_ > 0.0) {
+      double q = std::floor(cost / quantum_ + 0.5);
+      // The test also excludes infinities and NaN's.
+      if (std::abs(q) < static_cast<double>(int64(1) << 40)) {
+        WriteVarint(ZigZagEncode(static_cast<int64>(q)) << 1);
+        return;
+      }
+      WriteVarint(1);
+    }
+    WriteFloat(cost);
+  }
+
+  void WriteWeight(const CompactLatticeWeight &weight) {
+    WriteCost(weight.Weight().Value1());
+    WriteCost(weight.Weight().Value2());
+    const std::vector<int32> &str = weight.String();
+    size_t num_runs = 0;
+    for (size_t i = 0; i < str.size(); i++)
+      if (i == 0 || str[i] != str[i - 1])
+        num_runs++;
+    WriteVarint(num_runs);
+    for (size_t i = 0; i < str.size(); ) {
+      size_t j = i + 1;
+      while (j < str.size() && str[j] == str[i])
+        j++;
+      WriteVarint(static_cast<uint32>(str[i]));
+      WriteVarint(j - i);
+      i = j;
+    }
+  }
+
+  BaseFloat quantum_;
+  std::string *buf_;
+};
+
+
+class CompressedLatticeDecoder {
+ public:
+  CompressedLatticeDecoder(const char *begin, const char *end):
+      pos_(begin), end_(end), quantum_(0.0) { }
+
+  // Returns false on error.
+  bool Decode(CompactLattice *clat) {
+    typedef CompactLattice::StateId StateId;
+    clat->DeleteStates();
+    if (pos_ == end_)
+      return false;
+    unsigned char flags = static_cast<unsigned char>(*(pos_++));
+    if ((flags & ~(kQuantized | kHasOLabels)) != 0)
+      return false;
+    if ((flags & kQuantized) && !(ReadFloat(&quantum_) && quantum_ > 0.0))
+      return false;
+    bool has_olabels = ((flags & kHasOLabels) != 0);
+    uint64 num_states, start_code;
+    // Each state takes at least two bytes, which stops us allocating a huge
+    // amount of memory for corrupted data.
+    if (!ReadVarint(&num_states) || !ReadVarint(&start_code) ||
+        num_states > static_cast<uint64>(end_ - pos_) / 2)
+      return false;
+    int64 start = ZigZagDecode(start_code);
+    if (start < -1 || start >= static_cast<int64>(num_states) ||
+        (start == -1 && num_states != 0))
+      return false;
+    clat->ReserveStates(num_states);
+    for (uint64 s = 0; s < num_states; s++)
+      clat->AddState();
+    if (start >= 0)
+      clat->SetStart(start);
+
+    CompactLatticeArc arc;
+    for (StateId s = 0; s < static_cast<StateId>(num_states); s++) {
+      uint64 is_final, num_arcs;
+      if (!ReadVarint(&is_final) || is_final > 1)
+        return false;
+      if (is_final) {
+        CompactLatticeWeight final_weight;
+        if (!ReadWeight(&final_weight))
+          return false;
+        clat->SetFinal(s, final_weight);
+      }
+      if (!ReadVarint(&num_arcs) ||
+          num_arcs > static_cast<uint64>(end_ - pos_))
+        return false;
+      clat->ReserveArcs(s, num_arcs);
+      for (uint64 a = 0; a < num_arcs; a++) {
+        uint64 delta, ilabel, olabel;
+        if (!ReadVarint(&delta) || !ReadVarint(&ilabel))
+          return false;
+        int64 nextstate = s + ZigZagDecode(delta);
+        if (nextstate < 0 || nextstate >= static_cast<int64>(num_states))
+          return false;
+        if (has_olabels) {
+          if (!ReadVarint(&olabel))
+            return false;
+        } else {
+          olabel = ilabel;
+        }
+        arc.nextstate = nextstate;
+        arc.ilabel = static_cast<int32>(static_cast<uint32>(ilabel));
+        arc.olabel = static_cast<int32>(static_cast<uint32>(olabel));
+        if (!ReadWeight(&arc.weight))
+          return false;
+        clat->AddArc(s, arc);
+      }
+    }
+    return (pos_ == end_);
+  }
+
+ private:
+  bool ReadVarint(uint64 *u) {
+    uint64 ans = 0;
+    for (int32 shift = 0; shift < 64 && pos_ != end_; shift += 7) {
+      unsigned char c = static_cast<unsigned char>(*(pos_++));
+      ans |= static_cast<uint64>(c & 0x7F) << shift;
+      if ((c & 0x80) == 0) {
+        *u = ans;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ReadFloat(float *f) {
+    if (end_ - pos_ < static_cast<ptrdiff_t>(sizeof(*f)))
+      return false;
+    std::memcpy(f, pos_, sizeof(*f));
+    pos_ += sizeof(*f);
+    return true;
+  }
+
+  bool ReadCost(float *cost) {
+    if (quantum_ > 0.0) {
+      uint64 code;
+      if (!ReadVarint(&code))
+        return false;
+      if ((code & 1) == 0) {
+        *cost = static_cast<float>(ZigZagDecode(code >> 1) *
+                                   static_cast<double>(quantum_));
+        return true;
+      } else if (code != 1) {
+        return false;
+      }
+    }
+    return ReadFloat(cost);
+  }
+
+  bool ReadWeight(CompactLatticeWeight *weight) {
+    float graph_cost, acoustic_cost;
+    uint64 num_runs;
+    if (!ReadCost(&graph_cost) || !ReadCost(&acoustic_cost) ||
+        !ReadVarint(&num_runs) ||
+        num_runs > static_cast<uint64>(end_ - pos_) / 2)
+      return false;
+    str_.clear();
+    for (uint64 r = 0; r < num_runs; r++) {
+      uint64 tid, count;
+      if (!ReadVarint(&tid) || !ReadVarint(&count) || count == 0 ||
+          count > (1 << 30) - str_.size())
+        return false;
+      str_.insert(str_.end(), count,
+                  static_cast<int32>(static_cast<uint32>(tid)));
+    }
+    weight->SetWeight(LatticeWeight(graph_cost, acoustic_cost));
+    weight->SetString(str_);
+    return true;
+  }
+
+  const char *pos_;
+  const char *end_;
+  float quantum_;
+  std::vector<int32> str_;  // temporary used in ReadWeight().
+};
+
+}  // namespace
+
+
+bool WriteCompressedLattice(std::ostream &os, const CompactLattice &clat,
+                            BaseFloat weight_quantum) {
+  KALDI_ASSERT(weight_quantum >= 0.0);
+  std::string buf;
+  CompressedLatticeEncoder encoder(weight_quantum, &buf);
+  encoder.Encode(clat);
+  if (static_cast<int64>(buf.size()) > kMaxCompressedLatticeSize) {
+    KALDI_WARN << "Compressed lattice is too large to write: " << buf.size()
+               << " bytes.";
+    return false;
+  }
+  try {
+    WriteToken(os, true, kCompressedLatticeToken);
+    WriteBasicType(os, true, static_cast<int64>(buf.size()));
+    os.write(buf.data(), buf.size());
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Exception caught writing compressed lattice. " << e.what();
+    return false;
+  }
+  return os.good();
+}
+
+bool ReadCompressedLattice(std::istream &is, CompactLattice *clat) {
+  int64 size;
+  try {
+    std::string token;
+    ReadToken(is, true, &token);
+    if (token != kCompressedLatticeToken) {
+      KALDI_WARN << "Reading compressed lattice: expected token "
+                 << kCompressedLatticeToken << ", got " << token;
+      return false;
+    }
+    ReadBasicType(is, true, &size);
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Exception caught reading compressed lattice. " << e.what();
+    return false;
+  }
+  if (size <= 0 || size > kMaxCompressedLatticeSize)
+    KALDI_ERR << "Reading compressed lattice: invalid size " << size
+              << " bytes (must be between 1 and " << kMaxCompressedLatticeSize
+              << "); the archive is probably corrupted.";
+  // We read all the data in one go, which is much faster than reading it a
+  // byte at a time from the stream.
+  std::vector<char> buf(size);
+  if (!is.read(&(buf[0]), size)) {
+    KALDI_WARN << "Reading compressed lattice: unexpected end of stream.";
+    return false;
+  }
+  CompressedLatticeDecoder decoder(&(buf[0]), &(buf[0]) + size);
+  if (!decoder.Decode(clat)) {
+    KALDI_WARN << "Reading compressed lattice: the data is corrupted.";
+    clat->DeleteStates();
+    return false;
+  }
+  return true;
+}
+
+static CompressedLatticeOptions compressed_lattice_opts;
+
+void SetCompressedLatticeOptions(const CompressedLatticeOptions &opts) {
+  if (opts.weight_quantum < 0.0)
+    KALDI_ERR << "Invalid --lattice-weight-quantum " << opts.weight_quantum;
+  compressed_lattice_opts = opts;
+}
+
+const CompressedLatticeOptions &GetCompressedLatticeOptions() {
+  return compressed_lattice_opts;
+}
+
+}  // namespace kaldi
@@ -0,0 +1,105 @@
+// lat/compressed-lattice.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LAT_COMPRESSED_LATTICE_H_
+#define KALDI_LAT_COMPRESSED_LATTICE_H_
+
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+/**
+   This header provides a Kaldi-specific binary format for CompactLattice that
+   is a good deal smaller, and faster to read and write, than OpenFst's
+   generic binary format (which stores fixed-size fields for every arc, and
+   the transition-id strings one int32 per frame).  In the compressed format:
+
+     - the next-state of each arc is stored as the difference from the
+       state it leaves, which is small for topologically sorted lattices;
+     - the labels, and the differences, are stored as variable-length
+       integers ("varints", 7 bits per byte);
+     - the transition-id strings are run-length encoded, as a sequence of
+       (transition-id, count) pairs, since each transition-id normally
+       repeats for several frames;
+     - the weights are stored exactly as floats, or, if you ask for it with
+       --lattice-weight-quantum, rounded to a multiple of the quantum and
+       stored as varints.  This is lossy so it is not the default.
+
+   The format begins with the token "<CLat>", so it can be distinguished from
+   the OpenFst binary format (whose first byte is 214) and from the text format
+   (which begins with whitespace).  The functions ReadCompactLattice() and
+   ReadLattice() in kaldi-lattice.h, and so all the lattice table readers,
+   detect it automatically.
+
+   The table writers write compressed lattices only if the program calls
+   SetCompressedLatticeOptions() with write_compressed == true (see
+   lattice-copy --write-compressed).  Note that the result cannot be read by
+   OpenFst or by older versions of Kaldi.
+*/
+
+struct CompressedLatticeOptions {
+  bool write_compressed;
+  BaseFloat weight_quantum;
+
+  CompressedLatticeOptions(): write_compressed(false), weight_quantum(0.0) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("write-compressed", &write_compressed, "If true, write "
+                   "binary CompactLattices in the compressed lattice format "
+                   "(smaller and faster to read, but not readable by OpenFst "
+                   "or by older versions of Kaldi).");
+    opts->Register("lattice-weight-quantum", &weight_quantum, "If >0 and "
+                   "--write-compressed=true, the lattice weights (graph and "
+                   "acoustic costs) are rounded to a multiple of this value, "
+                   "e.g. 0.001, which makes the lattices smaller.  Caution: "
+                   "this is lossy.");
+  }
+};
+
+/// Writes 'clat' in the compressed lattice format.  If weight_quantum > 0.0,
+/// the finite costs are rounded to multiples of it.  Returns false on stream
+/// failure.
+bool WriteCompressedLattice(std::ostream &os, const CompactLattice &clat,
+                            BaseFloat weight_quantum = 0.0);
+
+/// Reads a lattice written by WriteCompressedLattice() (including the
+/// "<CLat>" token) into *clat.  Returns false, with a warning, on error;
+/// dies if the stored size is implausible, which means the data is corrupted.
+bool ReadCompressedLattice(std::istream &is, CompactLattice *clat);
+
+/// Returns true if the stream appears to be positioned at the start of a
+/// lattice in the compressed format (it checks the first character only).
+inline bool IsCompressedLattice(std::istream &is) {
+  return is.peek() == '<';
+}
+
+/// Sets the options that the CompactLattice table writers (more precisely,
+/// CompactLatticeHolder::Write()) use when writing in binary mode.  Programs
+/// that support this should register a CompressedLatticeOptions object and
+/// call this after reading the command line.
+void SetCompressedLatticeOptions(const CompressedLatticeOptions &opts);
+
+/// Returns the options set by SetCompressedLatticeOptions().
+const CompressedLatticeOptions &GetCompressedLatticeOptions();
+
+}  // namespace kaldi
+
+#endif  // KALDI_LAT_COMPRESSED_LATTICE_H_
@@ -20,6 +20,7 @@
 #include "lat/confidence.h"
 #include "lat/lattice-functions.h"
 #include "lat/determinize-lattice-pruned.h"
+#include "lat/lattice-nbest.h"
 
 namespace kaldi {
 
@@ -27,36 +28,31 @@ BaseFloat SentenceLevelConfidence(const CompactLattice &clat,
                                   int32 *num_paths,
                                   std::vector<int32> *best_sentence,
                                   std::vector<int32> *second_best_sentence) {
-  /* It may seem strange that the first thing we do is to convert the
-     CompactLattice to a Lattice, given that we may have just created the
-     CompactLattice by determinizing a Lattice.  However, this is not just
-     a circular conversion; "lat" will have the property that distinct
-     paths have distinct word sequences.
-     Below, we could run NbestAsFsts on a CompactLattice, but the time
-     taken would be quadratic in the length in words of the CompactLattice,
-     because of the alignment information getting appended as vectors.
-     That's why we convert back to Lattice.
+  /* We assume that distinct paths through "clat" have distinct word
+     sequences, which will be true if it was created by determinization.
+     We get the two best paths directly from the CompactLattice with
+     CompactLatticeNbest; note, we don't use GetLinearSymbolSequence() on
+     them as the time would be quadratic in the number of words, because
+     of the alignment information getting appended as vectors.
   */
-  Lattice lat;
-  ConvertLattice(clat, &lat);
-  
-  std::vector<Lattice> lats;
-  NbestAsFsts(lat, 2, &lats);
-  int32 n = lats.size();
-  KALDI_ASSERT(n >= 0 && n <= 2);
+  CompactLatticeNbest nbest_computer(clat);
+  std::vector<int32> *sentences[2] = { best_sentence, second_best_sentence };
+  double costs[2];
+  int32 n = 0;
+  CompactLattice path;
+  for (; n < 2 && nbest_computer.Next(&path, &costs[n]); n++) {
+    if (sentences[n] == NULL) continue;
+    sentences[n]->clear();
+    for (CompactLatticeArc::StateId s = path.Start(); path.NumArcs(s) != 0; ) {
+      fst::ArcIterator<CompactLattice> aiter(path, s);
+      if (aiter.Value().olabel != 0)
+        sentences[n]->push_back(aiter.Value().olabel);
+      s = aiter.Value().nextstate;
+    }
+  }
   if (num_paths != NULL) *num_paths = n;
-  if (best_sentence != NULL) best_sentence->clear();
-  if (second_best_sentence != NULL) second_best_sentence->clear();
-
-  LatticeWeight weight1, weight2;
-  if (n >= 1)
-    fst::GetLinearSymbolSequence<LatticeArc,int32>(lats[0], NULL,
-                                                   best_sentence,
-                                                   &weight1);
-  if (n >= 2)
-    fst::GetLinearSymbolSequence<LatticeArc,int32>(lats[1], NULL,
-                                                   second_best_sentence,
-                                                   &weight2);
+  for (int32 i = n; i < 2; i++)
+    if (sentences[i] != NULL) sentences[i]->clear();
 
   if (n == 0) {
     return 0; // this seems most appropriate because it will be interpreted as
@@ -67,8 +63,7 @@ BaseFloat SentenceLevelConfidence(const CompactLattice &clat,
     // being perfect confidence
     return std::numeric_limits<BaseFloat>::infinity();
   } else {
-    BaseFloat best_cost = ConvertToCost(weight1),
-        second_best_cost = ConvertToCost(weight2);
+    BaseFloat best_cost = costs[0], second_best_cost = costs[1];
     BaseFloat ans = second_best_cost - best_cost;
     if (!(ans >= -0.001 * (fabs(best_cost) + fabs(second_best_cost)))) {
       // Answer should be positive.  Make sure it's at at least not
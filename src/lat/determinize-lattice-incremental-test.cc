@@ -0,0 +1,224 @@
+// lat/determinize-lattice-incremental-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lat/determinize-lattice-incremental.h"
+#include "hmm/hmm-test-utils.h"
+
+namespace kaldi {
+
+// A link in a random "decoder" lattice: the tokens are numbered in frame
+// order, and the links go from a token to a later token on the same frame
+// (without a transition-id) or to a token on the next frame.
+struct TestLink {
+  int32 from, to, tid, word;
+  BaseFloat graph_cost, acoustic_cost;
+};
+
+// For each word sequence in the (acyclic) lattice, the best cost and the
+// transition-ids on the best path.
+typedef std::map<std::vector<int32>,
+                 std::pair<double, std::vector<int32> > > WordSeqMap;
+
+static void GetWordSeqs(const CompactLattice &clat,
+                        CompactLattice::StateId s,
+                        double cost,
+                        std::vector<int32> *words,
+                        std::vector<int32> *tids,
+                        WordSeqMap *word_seqs) {
+  CompactLatticeWeight final_weight = clat.Final(s);
+  if (final_weight != CompactLatticeWeight::Zero()) {
+    double final_cost = cost + final_weight.Weight().Value1() +
+        final_weight.Weight().Value2();
+    std::vector<int32> final_tids(*tids);
+    final_tids.insert(final_tids.end(), final_weight.String().begin(),
+                      final_weight.String().end());
+    WordSeqMap::iterator iter = word_seqs->find(*words);
+    if (iter == word_seqs->end() || final_cost < iter->second.first)
+      (*word_seqs)[*words] = std::make_pair(final_cost, final_tids);
+  }
+  std::set<int32> labels;
+  for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+       aiter.Next()) {
+    const CompactLatticeArc &arc = aiter.Value();
+    // The output must be deterministic.
+    KALDI_ASSERT(labels.insert(arc.ilabel).second);
+    size_t num_tids = tids->size();
+    tids->insert(tids->end(), arc.weight.String().begin(),
+                 arc.weight.String().end());
+    if (arc.ilabel != 0)
+      words->push_back(arc.ilabel);
+    GetWordSeqs(clat, arc.nextstate,
+                cost + arc.weight.Weight().Value1() +
+                arc.weight.Weight().Value2(), words, tids, word_seqs);
+    if (arc.ilabel != 0)
+      words->pop_back();
+    tids->resize(num_tids);
+  }
+}
+
+static void GetWordSeqs(const CompactLattice &clat, WordSeqMap *word_seqs) {
+  word_seqs->clear();
+  std::vector<int32> words, tids;
+  if (clat.Start() != fst::kNoStateId)
+    GetWordSeqs(clat, clat.Start(), 0.0, &words, &tids, word_seqs);
+}
+
+void TestLatticeIncrementalDeterminizer() {
+  ContextDependency *ctx_dep;
+  TransitionModel *trans_model = GenRandTransitionModel(&ctx_dep);
+  int32 num_tids = trans_model->NumTransitionIds(),
+      num_frames = RandInt(2, 20);
+
+  std::vector<std::vector<int32> > frame_toks(num_frames + 1);
+  std::vector<int32> tok_frame;
+  for (int32 t = 0; t <= num_frames; t++) {
+    int32 num_toks = (t == 0 ? 1 : RandInt(1, 4));
+    for (int32 i = 0; i < num_toks; i++) {
+      frame_toks[t].push_back(tok_frame.size());
+      tok_frame.push_back(t);
+    }
+  }
+  std::vector<TestLink> links;
+  for (int32 t = 0; t <= num_frames; t++) {
+    for (size_t i = 0; i < frame_toks[t].size(); i++) {
+      for (size_t j = i + 1; j < frame_toks[t].size(); j++) {
+        if (RandInt(0, 3) == 0) {
+          TestLink link = { frame_toks[t][i], frame_toks[t][j], 0,
+                            (RandInt(0, 1) == 0 ? RandInt(1, 3) : 0),
+                            RandUniform(), 0.0 };
+          links.push_back(link);
+        }
+      }
+      if (t == num_frames)
+        continue;
+      for (size_t j = 0; j < frame_toks[t + 1].size(); j++) {
+        if (j == 0 || RandInt(0, 1) == 0) {
+          TestLink link = { frame_toks[t][i], frame_toks[t + 1][j],
+                            RandInt(1, num_tids),
+                            (RandInt(0, 3) == 0 ? RandInt(1, 3) : 0),
+                            RandUniform(), RandUniform() };
+          links.push_back(link);
+        }
+      }
+    }
+  }
+  std::vector<BaseFloat> final_costs(frame_toks[num_frames].size());
+  for (size_t i = 0; i < final_costs.size(); i++)
+    final_costs[i] = RandUniform();
+
+  // The beam is large enough that nothing is pruned, so the results should
+  // be the same.
+  BaseFloat beam = 1000.0;
+  fst::DeterminizeLatticePhonePrunedOptions opts;
+
+  Lattice lat;
+  for (size_t i = 0; i < tok_frame.size(); i++)
+    lat.AddState();
+  lat.SetStart(0);
+  for (size_t i = 0; i < links.size(); i++) {
+    const TestLink &link = links[i];
+    lat.AddArc(link.from, LatticeArc(link.tid, link.word,
+                                     LatticeWeight(link.graph_cost,
+                                                   link.acoustic_cost),
+                                     link.to));
+  }
+  for (size_t i = 0; i < final_costs.size(); i++)
+    lat.SetFinal(frame_toks[num_frames][i], LatticeWeight(final_costs[i], 0));
+  CompactLattice clat;
+  DeterminizeLatticePhonePrunedWrapper(*trans_model, &lat, beam, &clat, opts);
+
+  // Now do it in chunks, with the conventions of
+  // LatticeFasterOnlineDecoder::GetRawLatticeChunk().
+  LatticeIncrementalDeterminizer determinizer(*trans_model, beam, opts);
+  // The numbers of the boundary tokens of the last chunk.
+  std::map<int32, int32> tok_index;
+  for (int32 begin_frame = 0; begin_frame < num_frames; ) {
+    int32 end_frame = std::min(begin_frame + RandInt(1, 4), num_frames);
+    Lattice chunk;
+    std::map<int32, LatticeArc::StateId> state_map;
+    for (int32 t = begin_frame; t <= end_frame; t++)
+      for (size_t i = 0; i < frame_toks[t].size(); i++)
+        state_map[frame_toks[t][i]] = chunk.AddState();
+    for (size_t i = 0; i < links.size(); i++) {
+      const TestLink &link = links[i];
+      if (state_map.count(link.from) == 0 || state_map.count(link.to) == 0 ||
+          (begin_frame > 0 && tok_frame[link.to] == begin_frame))
+        continue;
+      chunk.AddArc(state_map[link.from],
+                   LatticeArc(link.tid, link.word,
+                              LatticeWeight(link.graph_cost,
+                                            link.acoustic_cost),
+                              state_map[link.to]));
+    }
+    std::vector<LatticeArc::StateId> initial_states(tok_index.size()),
+        final_states;
+    if (begin_frame == 0)
+      chunk.SetStart(0);
+    for (std::map<int32, int32>::iterator iter = tok_index.begin();
+         iter != tok_index.end(); ++iter)
+      initial_states[iter->second] = state_map[iter->first];
+    tok_index.clear();
+    if (end_frame == num_frames) {
+      for (size_t i = 0; i < final_costs.size(); i++)
+        chunk.SetFinal(state_map[frame_toks[num_frames][i]],
+                       LatticeWeight(final_costs[i], 0));
+    } else {
+      // The boundary tokens are numbered in random order, and their
+      // final-costs (the estimates of the cost to the end) are random; they
+      // only affect the pruning.
+      std::vector<int32> toks(frame_toks[end_frame]);
+      std::random_shuffle(toks.begin(), toks.end());
+      for (size_t i = 0; i < toks.size(); i++) {
+        tok_index[toks[i]] = i;
+        final_states.push_back(state_map[toks[i]]);
+        chunk.SetFinal(state_map[toks[i]],
+                       LatticeWeight(3.0 * RandUniform(), 0));
+      }
+    }
+    determinizer.AcceptRawLatticeChunk(&chunk, initial_states, final_states);
+    begin_frame = end_frame;
+  }
+  CompactLattice clat_incremental;
+  determinizer.GetLattice(&clat_incremental);
+
+  WordSeqMap word_seqs, word_seqs_incremental;
+  GetWordSeqs(clat, &word_seqs);
+  GetWordSeqs(clat_incremental, &word_seqs_incremental);
+  KALDI_ASSERT(word_seqs.size() == word_seqs_incremental.size());
+  for (WordSeqMap::iterator iter = word_seqs.begin();
+       iter != word_seqs.end(); ++iter) {
+    WordSeqMap::iterator iter2 = word_seqs_incremental.find(iter->first);
+    KALDI_ASSERT(iter2 != word_seqs_incremental.end());
+    KALDI_ASSERT(ApproxEqual(iter->second.first, iter2->second.first, 1.0e-04));
+    KALDI_ASSERT(iter->second.second == iter2->second.second);
+  }
+  KALDI_VLOG(2) << "Lattice has " << word_seqs.size() << " word sequences, "
+                << clat.NumStates() << " states determinized at once and "
+                << clat_incremental.NumStates() << " incrementally.";
+  delete trans_model;
+  delete ctx_dep;
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 50; i++)
+    kaldi::TestLatticeIncrementalDeterminizer();
+  std::cout << "Test OK\n";
+}
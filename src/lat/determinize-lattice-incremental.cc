@@ -0,0 +1,314 @@
+// lat/determinize-lattice-incremental.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+#include "lat/determinize-lattice-incremental.h"
+#include "lat/lattice-functions.h"
+#include "lat/minimize-lattice.h"
+#include "lat/push-lattice.h"
+
+namespace kaldi {
+
+const LatticeIncrementalDeterminizer::Label
+LatticeIncrementalDeterminizer::kStateLabelOffset;
+const LatticeIncrementalDeterminizer::Label
+LatticeIncrementalDeterminizer::kTokenLabelOffset;
+
+LatticeIncrementalDeterminizer::LatticeIncrementalDeterminizer(
+    const TransitionModel &trans_model,
+    BaseFloat lattice_beam,
+    const fst::DeterminizeLatticePhonePrunedOptions &opts):
+    trans_model_(trans_model), lattice_beam_(lattice_beam), opts_(opts) {
+  Init();
+}
+
+void LatticeIncrementalDeterminizer::Init() {
+  clat_.DeleteStates();
+  forward_costs_.clear();
+  token_arc_states_.clear();
+  token_weights_.clear();
+  num_chunks_ = 0;
+  last_chunk_done_ = false;
+}
+
+bool LatticeIncrementalDeterminizer::AcceptRawLatticeChunk(
+    Lattice *chunk,
+    const std::vector<StateId> &initial_states,
+    const std::vector<StateId> &final_states) {
+  KALDI_ASSERT(!last_chunk_done_ &&
+               "You cannot accept more chunks after the last one.");
+  bool first_chunk = (num_chunks_ == 0);
+  KALDI_ASSERT(first_chunk == (chunk->Start() != fst::kNoStateId));
+
+  std::vector<StateId> redet_states;
+  if (!first_chunk) {
+    GetRedeterminizedStates(&redet_states);
+    AddRedeterminizedStates(redet_states, initial_states, chunk);
+  }
+  // Give each boundary token an arc with its token label to a superfinal
+  // state, whose weight is the token's final-cost.
+  std::vector<LatticeWeight> token_weights(final_states.size());
+  if (!final_states.empty()) {
+    StateId superfinal = chunk->AddState();
+    chunk->SetFinal(superfinal, LatticeWeight::One());
+    for (size_t i = 0; i < final_states.size(); i++) {
+      StateId s = final_states[i];
+      token_weights[i] = chunk->Final(s);
+      KALDI_ASSERT(token_weights[i] != LatticeWeight::Zero());
+      chunk->AddArc(s, LatticeArc(0, kTokenLabelOffset + i, token_weights[i],
+                                  superfinal));
+      chunk->SetFinal(s, LatticeWeight::Zero());
+    }
+  }
+
+  // Pushing and minimization (if requested) are done once, in GetLattice().
+  fst::DeterminizeLatticePhonePrunedOptions opts(opts_);
+  opts.minimize = false;
+  CompactLattice det_chunk;
+  bool ans = fst::DeterminizeLatticePhonePrunedWrapper(
+      trans_model_, chunk, lattice_beam_, &det_chunk, opts);
+  SpliceChunk(redet_states, &det_chunk);
+
+  token_weights_.swap(token_weights);
+  num_chunks_++;
+  last_chunk_done_ = final_states.empty();
+  KALDI_VLOG(3) << "Determinized lattice chunk " << num_chunks_ << " with "
+                << redet_states.size() << " redeterminized states; the "
+                << "lattice so far has " << clat_.NumStates() << " states.";
+  return ans;
+}
+
+void LatticeIncrementalDeterminizer::GetRedeterminizedStates(
+    std::vector<StateId> *redet_states) const {
+  unordered_set<StateId> seen(token_arc_states_.begin(),
+                              token_arc_states_.end());
+  std::vector<StateId> queue(token_arc_states_);
+  while (!queue.empty()) {
+    StateId s = queue.back();
+    queue.pop_back();
+    for (fst::ArcIterator<CompactLattice> aiter(clat_, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      if (arc.ilabel < kTokenLabelOffset && seen.insert(arc.nextstate).second)
+        queue.push_back(arc.nextstate);
+    }
+  }
+  redet_states->assign(seen.begin(), seen.end());
+  std::sort(redet_states->begin(), redet_states->end());
+}
+
+void LatticeIncrementalDeterminizer::AddRedeterminizedStates(
+    const std::vector<StateId> &redet_states,
+    const std::vector<StateId> &initial_states,
+    Lattice *chunk) const {
+  KALDI_ASSERT(initial_states.size() == token_weights_.size());
+  StateId start = chunk->AddState();
+  chunk->SetStart(start);
+  unordered_map<StateId, StateId> state_map;
+  for (size_t i = 0; i < redet_states.size(); i++) {
+    StateId s = redet_states[i], chunk_state = chunk->AddState();
+    KALDI_ASSERT(s < kTokenLabelOffset - kStateLabelOffset);
+    state_map[s] = chunk_state;
+    chunk->AddArc(start, LatticeArc(0, kStateLabelOffset + s,
+                                    LatticeWeight(forward_costs_[s], 0.0),
+                                    chunk_state));
+  }
+  for (size_t i = 0; i < redet_states.size(); i++) {
+    StateId s = redet_states[i], chunk_state = state_map[s];
+    // Only the states after the token-label arcs are final.
+    KALDI_ASSERT(clat_.Final(s) == CompactLatticeWeight::Zero());
+    for (fst::ArcIterator<CompactLattice> aiter(clat_, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      if (arc.ilabel >= kTokenLabelOffset) {
+        size_t token = arc.ilabel - kTokenLabelOffset;
+        KALDI_ASSERT(token < initial_states.size());
+        if (initial_states[token] == fst::kNoStateId)
+          continue;  // The decoder has pruned the token away.
+        // Take the token's final-cost out of the weight.
+        const LatticeWeight &weight = arc.weight.Weight(),
+            &token_weight = token_weights_[token];
+        CompactLatticeWeight new_weight(
+            LatticeWeight(weight.Value1() - token_weight.Value1(),
+                          weight.Value2() - token_weight.Value2()),
+            arc.weight.String());
+        AddCompactArc(chunk_state, 0, new_weight, initial_states[token],
+                      chunk);
+      } else {
+        unordered_map<StateId, StateId>::const_iterator iter =
+            state_map.find(arc.nextstate);
+        KALDI_ASSERT(iter != state_map.end());
+        AddCompactArc(chunk_state, arc.ilabel, arc.weight, iter->second,
+                      chunk);
+      }
+    }
+  }
+}
+
+void LatticeIncrementalDeterminizer::AddCompactArc(
+    StateId state, Label word, const CompactLatticeWeight &weight,
+    StateId nextstate, Lattice *chunk) {
+  const std::vector<int32> &string = weight.String();
+  if (string.empty()) {
+    chunk->AddArc(state, LatticeArc(0, word, weight.Weight(), nextstate));
+    return;
+  }
+  // The word and the weight go on the first arc, as in ConvertLattice().
+  StateId cur_state = state;
+  for (size_t i = 0; i < string.size(); i++) {
+    StateId next_state = (i + 1 == string.size() ? nextstate :
+                          chunk->AddState());
+    chunk->AddArc(cur_state,
+                  LatticeArc(string[i], (i == 0 ? word : 0),
+                             (i == 0 ? weight.Weight() : LatticeWeight::One()),
+                             next_state));
+    cur_state = next_state;
+  }
+}
+
+void LatticeIncrementalDeterminizer::SpliceChunk(
+    const std::vector<StateId> &redet_states,
+    CompactLattice *det_chunk) {
+  const BaseFloat inf = std::numeric_limits<BaseFloat>::infinity();
+  bool first_chunk = (num_chunks_ == 0);
+  // Take out the old contents of the redeterminized states; the states after
+  // their token-label arcs are no longer final.
+  for (size_t i = 0; i < redet_states.size(); i++) {
+    StateId s = redet_states[i];
+    for (fst::ArcIterator<CompactLattice> aiter(clat_, s); !aiter.Done();
+         aiter.Next())
+      if (aiter.Value().ilabel >= kTokenLabelOffset)
+        clat_.SetFinal(aiter.Value().nextstate, CompactLatticeWeight::Zero());
+    clat_.DeleteArcs(s);
+  }
+  token_arc_states_.clear();
+  StateId det_start = det_chunk->Start();
+  if (det_start == fst::kNoStateId) {
+    KALDI_WARN << "Determinized lattice chunk is empty.";
+    return;
+  }
+  if (!fst::TopSort(det_chunk))
+    KALDI_ERR << "Topological sorting of determinized lattice chunk failed.";
+  det_start = det_chunk->Start();
+  StateId num_det_states = det_chunk->NumStates();
+
+  // The state of clat_ for each state of det_chunk.  The state after the arc
+  // with the state label of redeterminized state s takes the place of s.  The
+  // weight of that arc is the forward cost of s we put on it times whatever
+  // the determinization moved onto it from the state's arcs (the weight and
+  // transition-ids common to them); if there is any of the latter, or if two
+  // such arcs go to the same state (which is possible when the states
+  // differed only in their token-label arcs), s instead gets a copy of the
+  // state's arcs and final-prob with that put back on them.  'copies'
+  // contains the tuples (s, det_state, weight to put back) for those.
+  std::vector<StateId> state_map(num_det_states, fst::kNoStateId);
+  std::vector<std::pair<std::pair<StateId, StateId>,
+                        CompactLatticeWeight> > copies;
+  if (first_chunk) {
+    KALDI_ASSERT(clat_.NumStates() == 0);
+    state_map[det_start] = clat_.AddState();
+    clat_.SetStart(state_map[det_start]);
+  } else {
+    for (fst::ArcIterator<CompactLattice> aiter(*det_chunk, det_start);
+         !aiter.Done(); aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      KALDI_ASSERT(arc.ilabel >= kStateLabelOffset &&
+                   arc.ilabel < kTokenLabelOffset);
+      StateId s = arc.ilabel - kStateLabelOffset;
+      const LatticeWeight &weight = arc.weight.Weight();
+      CompactLatticeWeight residual(
+          LatticeWeight(weight.Value1() - forward_costs_[s], weight.Value2()),
+          arc.weight.String());
+      if (residual == CompactLatticeWeight::One() &&
+          state_map[arc.nextstate] == fst::kNoStateId)
+        state_map[arc.nextstate] = s;
+      else
+        copies.push_back(std::make_pair(std::make_pair(s, arc.nextstate),
+                                        residual));
+    }
+  }
+  for (StateId d = 0; d < num_det_states; d++)
+    if (state_map[d] == fst::kNoStateId && (first_chunk || d != det_start))
+      state_map[d] = clat_.AddState();
+  forward_costs_.resize(clat_.NumStates(), inf);
+
+  // det_chunk is topologically sorted, so we can compute the forward costs as
+  // we go.  Those from the start state's arcs include the forward costs of
+  // the redeterminized states.
+  std::vector<BaseFloat> det_forward_costs(num_det_states, inf);
+  std::vector<bool> has_token_arc(num_det_states, false);
+  det_forward_costs[det_start] = 0.0;
+  for (StateId d = 0; d < num_det_states; d++) {
+    BaseFloat forward_cost = det_forward_costs[d];
+    StateId s = state_map[d];
+    if (s != fst::kNoStateId) {
+      clat_.SetFinal(s, det_chunk->Final(d));
+      forward_costs_[s] = forward_cost;
+    }
+    for (fst::ArcIterator<CompactLattice> aiter(*det_chunk, d); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      const LatticeWeight &weight = arc.weight.Weight();
+      BaseFloat next_cost = forward_cost + weight.Value1() + weight.Value2();
+      if (next_cost < det_forward_costs[arc.nextstate])
+        det_forward_costs[arc.nextstate] = next_cost;
+      if (s == fst::kNoStateId)
+        continue;  // The start state, whose arcs have state labels.
+      clat_.AddArc(s, CompactLatticeArc(arc.ilabel, arc.olabel, arc.weight,
+                                        state_map[arc.nextstate]));
+      if (arc.ilabel >= kTokenLabelOffset)
+        has_token_arc[d] = true;
+    }
+    if (has_token_arc[d])
+      token_arc_states_.push_back(s);
+  }
+  for (size_t i = 0; i < copies.size(); i++) {
+    StateId s = copies[i].first.first, d = copies[i].first.second,
+        orig_s = state_map[d];
+    const CompactLatticeWeight &residual = copies[i].second;
+    clat_.SetFinal(s, fst::Times(residual, clat_.Final(orig_s)));
+    for (fst::ArcIterator<CompactLattice> aiter(clat_, orig_s); !aiter.Done();
+         aiter.Next()) {
+      CompactLatticeArc arc = aiter.Value();
+      arc.weight = fst::Times(residual, arc.weight);
+      clat_.AddArc(s, arc);
+    }
+    // The forward cost of s is unchanged.
+    if (has_token_arc[d])
+      token_arc_states_.push_back(s);
+  }
+}
+
+void LatticeIncrementalDeterminizer::GetLattice(CompactLattice *clat) const {
+  KALDI_ASSERT(last_chunk_done_ &&
+               "You must accept the last chunk before getting the lattice.");
+  *clat = clat_;
+  // This removes the redeterminized states that were pruned away, and the
+  // states that were after the token-label arcs of the earlier chunks.
+  fst::Connect(clat);
+  if (opts_.minimize) {
+    fst::PushCompactLatticeStrings<LatticeWeight, int32>(clat);
+    fst::PushCompactLatticeWeights<LatticeWeight, int32>(clat);
+    fst::MinimizeCompactLattice<LatticeWeight, int32>(clat);
+  }
+  TopSortCompactLatticeIfNeeded(clat);
+}
+
+}  // namespace kaldi
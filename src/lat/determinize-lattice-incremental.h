@@ -0,0 +1,174 @@
+// lat/determinize-lattice-incremental.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LAT_DETERMINIZE_LATTICE_INCREMENTAL_H_
+#define KALDI_LAT_DETERMINIZE_LATTICE_INCREMENTAL_H_
+
+#include <vector>
+#include "base/kaldi-common.h"
+#include "hmm/transition-model.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/determinize-lattice-pruned.h"
+
+namespace kaldi {
+
+/**
+   LatticeIncrementalDeterminizer determinizes the lattice of an utterance
+   in chunks of frames as the decoder produces them, so that at the end of
+   the utterance only the last chunk has to be determinized, rather than the
+   whole lattice as with DeterminizeLatticePhonePrunedWrapper().  The result
+   is equivalent to determinizing the whole raw lattice at once: it has the
+   same word sequences, each with the same best cost and alignment (up to
+   the differences in pruning and ties).
+
+   The raw lattice chunks come from
+   LatticeFasterOnlineDecoder::GetRawLatticeChunk(), which defines the
+   conventions (see there); briefly, chunk n covers frames t_{n-1} ... t_n
+   of the decoder, and the tokens on frame t_n ("the boundary tokens") are
+   numbered 0, 1, ...  In chunk n they are final, with an estimate of the
+   cost from there to the end of the utterance as final-cost, and in chunk
+   n+1 the states for those of them that are still alive have no arcs into
+   them, and are identified by their numbers.  The last chunk has the real
+   final-probs.
+
+   How it works: we keep the determinized lattice so far, clat_, in which
+   each boundary token is represented by a "token label" on an arc to a
+   final state.  These are the arcs we get by determinizing a chunk in which
+   each boundary token has an arc with its own token label to a superfinal
+   state; the token labels are treated like words, so the determinization
+   keeps them separate, and the path up to each token-label arc is the
+   determinized version of the raw paths up to that token.  The states of
+   clat_ that are affected by the next chunk are those with token-label arcs
+   and the states after them (the ones reachable from them by arcs without
+   token labels); we call these the redeterminized states.  To process the
+   next chunk, we make a raw lattice consisting of the chunk and the
+   redeterminized states (with the compact lattice's arcs expanded into
+   ordinary arcs), where each token-label arc becomes an epsilon arc to the
+   state for that token in the chunk, and the new start state has an arc to
+   each redeterminized state with a "state label" that identifies it.  When
+   we determinize that, each redeterminized state s comes out as the state
+   after the arc with s's state label from the start state, so we replace
+   the contents (arcs and final-prob) of s in clat_ with those of that state
+   and add the other states to clat_.  The states of clat_ that are not
+   redeterminized are never visited again, so the work per chunk depends on
+   the size of the chunk and of the last few words of the lattice, not on
+   the length of the utterance.  The determinization may move some weight
+   or transition-ids onto the arc with s's state label, or take several
+   redeterminized states to the same state; in those cases s becomes a copy
+   of that state with the remainder put back on its arcs and final-prob.
+
+   The arcs with state labels from the start state have the best cost of
+   getting to their state in clat_ as weight, and the token-label arcs have
+   the decoder's cost estimate for the rest of the utterance; these are
+   removed after determinization and are there only so that the pruning in
+   the determinization is done as it would be on the whole lattice.
+
+   The labels we use for tokens and states are above kStateLabelOffset, so
+   the words must be smaller than that.  If opts.minimize is true, we push
+   and minimize the whole lattice in GetLattice(), not each chunk.
+*/
+class LatticeIncrementalDeterminizer {
+ public:
+  typedef LatticeArc::StateId StateId;
+  typedef LatticeArc::Label Label;
+
+  /// The labels for states of clat_ start at kStateLabelOffset, and those for
+  /// the tokens at kTokenLabelOffset.
+  static const Label kStateLabelOffset = 100000000;
+  static const Label kTokenLabelOffset = 200000000;
+
+  /// 'lattice_beam' and 'opts' are as for DeterminizeLatticePhonePrunedWrapper
+  /// (e.g. the decoder's --lattice-beam and det_opts).  We keep a reference
+  /// to 'trans_model'.
+  LatticeIncrementalDeterminizer(
+      const TransitionModel &trans_model,
+      BaseFloat lattice_beam,
+      const fst::DeterminizeLatticePhonePrunedOptions &opts);
+
+  /// Starts a new utterance, discarding the lattice so far.  You don't need
+  /// to call this for the first utterance.
+  void Init();
+
+  /// Determinizes raw lattice chunk 'chunk' (it is destroyed in the process)
+  /// and adds it to the lattice so far.  See
+  /// LatticeFasterOnlineDecoder::GetRawLatticeChunk() for what
+  /// 'initial_states' and 'final_states' mean; 'final_states' should be
+  /// empty for the last chunk, which must have the real final-probs.  Returns
+  /// false if the determinization hit its memory limit, in which case it will
+  /// have been done with a smaller beam (as for
+  /// DeterminizeLatticePhonePrunedWrapper()).
+  bool AcceptRawLatticeChunk(Lattice *chunk,
+                             const std::vector<StateId> &initial_states,
+                             const std::vector<StateId> &final_states);
+
+  /// Outputs the determinized lattice for the whole utterance, which is
+  /// topologically sorted.  You must have called AcceptRawLatticeChunk()
+  /// with the last chunk.
+  void GetLattice(CompactLattice *clat) const;
+
+  /// Returns the number of chunks accepted since Init().
+  int32 NumChunks() const { return num_chunks_; }
+
+ private:
+  // Outputs the redeterminized states (see the comment above the class), in
+  // increasing order; they are the states of clat_ with token-label arcs and
+  // those reachable from them by other arcs.
+  void GetRedeterminizedStates(std::vector<StateId> *redet_states) const;
+
+  // Adds to 'chunk' the states for the redeterminized states, and the new
+  // start state with arcs to them, as described above the class.
+  // 'initial_states' is as given to AcceptRawLatticeChunk().
+  void AddRedeterminizedStates(const std::vector<StateId> &redet_states,
+                               const std::vector<StateId> &initial_states,
+                               Lattice *chunk) const;
+
+  // Adds an arc or a chain of arcs to 'chunk' from 'state' to 'nextstate',
+  // with the word 'word' and the transition-ids and weight in 'weight'.
+  static void AddCompactArc(StateId state, Label word,
+                            const CompactLatticeWeight &weight,
+                            StateId nextstate, Lattice *chunk);
+
+  // Replaces the redeterminized states in clat_ by the determinized chunk
+  // 'det_chunk' and updates forward_costs_ and token_arc_states_.
+  void SpliceChunk(const std::vector<StateId> &redet_states,
+                   CompactLattice *det_chunk);
+
+  const TransitionModel &trans_model_;
+  BaseFloat lattice_beam_;
+  fst::DeterminizeLatticePhonePrunedOptions opts_;
+
+  // The determinized lattice so far.  Unless the last chunk has been
+  // accepted, the only final states are those after the token-label arcs.
+  // The redeterminized states that were pruned away in the last chunk are
+  // left in it with no arcs.
+  CompactLattice clat_;
+  // The best cost of getting to each state of clat_ (for pruning only).
+  std::vector<BaseFloat> forward_costs_;
+  // The states of clat_ with token-label arcs.
+  std::vector<StateId> token_arc_states_;
+  // The final-costs of the boundary tokens of the last chunk, indexed by
+  // token number, which are included in the weights of the token-label arcs.
+  std::vector<LatticeWeight> token_weights_;
+  int32 num_chunks_;
+  bool last_chunk_done_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_LAT_DETERMINIZE_LATTICE_INCREMENTAL_H_
@@ -189,7 +189,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                             DeterminizeLatticePrunedOptions opts):
       num_arcs_(0), num_elems_(0), ifst_(ifst.Copy()), beam_(beam), opts_(opts),
       equal_(opts_.delta), determinized_(false),
-      minimal_hash_(3, hasher_, equal_), initial_hash_(3, hasher_, equal_) {
+      minimal_hash_(3, hasher_, equal_), initial_hash_(3, hasher_, equal_),
+      subset_block_next_(NULL), subset_block_remaining_(0) {
     KALDI_ASSERT(Weight::Properties() & kIdempotent); // this algorithm won't
     // work correctly otherwise.
   }
@@ -209,21 +210,16 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       ifst_ = NULL;
     }
     { MinimalSubsetHash tmp; tmp.swap(minimal_hash_); }
-
-    for (size_t i = 0; i < output_states_.size(); i++) {
-      vector<Element> empty_subset;
-      empty_subset.swap(output_states_[i]->minimal_subset);
-    }
-
-    for (typename InitialSubsetHash::iterator iter = initial_hash_.begin();
-         iter != initial_hash_.end(); ++iter)
-      delete iter->first;
     { InitialSubsetHash tmp; tmp.swap(initial_hash_); }
-    for (size_t i = 0; i < output_states_.size(); i++) {
-      vector<Element> tmp;
-      tmp.swap(output_states_[i]->minimal_subset);
-    }
+    // This frees the memory of all the subsets, including the minimal_subset
+    // of each OutputState, which we must not access after this.
+    for (size_t i = 0; i < subset_blocks_.size(); i++)
+      delete [] subset_blocks_[i];
+    { vector<Element*> tmp; tmp.swap(subset_blocks_); }
+    subset_block_next_ = NULL;
+    subset_block_remaining_ = 0;
     { vector<char> tmp;  tmp.swap(isymbol_or_final_); }
+    { vector<int32> tmp;  tmp.swap(closure_index_); }
     { // Free up the queue.  I'm not sure how to make sure all
       // the memory is really freed (no swap() function)... doesn't really
       // matter much though.
@@ -249,7 +245,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // to clean the repository.
     std::vector<StringId> needed_strings;
     for (size_t i = 0; i < output_states_.size(); i++) {
-      AddStrings(output_states_[i]->minimal_subset, &needed_strings);
+      const Subset &subset = output_states_[i]->minimal_subset;
+      AddStrings(subset.elems, subset.elems + subset.size, &needed_strings);
       for (size_t j = 0; j < output_states_[i]->arcs.size(); j++)
         needed_strings.push_back(output_states_[i]->arcs[j].string);
     }
@@ -261,7 +258,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
         Task *task = queue_.top();
         queue_.pop();
         tasks.push_back(task);
-        AddStrings(task->subset, &needed_strings);
+        AddStrings(task->subset.data(),
+                   task->subset.data() + task->subset.size(),
+                   &needed_strings);
       }
       for (size_t i = 0; i < tasks.size(); i++)
         queue_.push(tasks[i]);
@@ -271,9 +270,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     for (typename InitialSubsetHash::const_iterator
              iter = initial_hash_.begin();
          iter != initial_hash_.end(); ++iter) {
-      const vector<Element> &vec = *(iter->first);
+      const Subset &subset = iter->first;
       Element elem = iter->second;
-      AddStrings(vec, &needed_strings);
+      AddStrings(subset.elems, subset.elems + subset.size, &needed_strings);
       needed_strings.push_back(elem.string);
     }
     std::sort(needed_strings.begin(), needed_strings.end());
@@ -416,9 +415,18 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     Weight weight;
   };
 
+  // A subset of states, as an array of Elements.  The Elements are in sorted
+  // order on state id, and without repeated states.  The keys of the hashes
+  // below point into subset_blocks_, where we store the subsets contiguously
+  // (they are never freed individually); for lookups, they can also point to
+  // the data of a vector.  The hash value is computed once, by MakeSubset().
+  struct Subset {
+    const Element *elems;
+    size_t size;
+    size_t hash;
+  };
+
   // Hashing function used in hash of subsets.
-  // A subset is a pointer to vector<Element>.
-  // The Elements are in sorted order on state id, and without repeated states.
   // Because the order of Elements is fixed, we can use a hashing function that is
   // order-dependent.  However the weights are not included in the hashing function--
   // we hash subsets that differ only in weight to the same key.  This is not optimal
@@ -431,9 +439,11 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
   class SubsetKey {
    public:
-    size_t operator ()(const vector<Element> * subset) const {  // hashes only the state and string.
+    size_t operator ()(const Subset &subset) const { return subset.hash; }
+    // hashes only the state and string.
+    static size_t Hash(const Element *elems, size_t size) {
       size_t hash = 0, factor = 1;
-      for (typename vector<Element>::const_iterator iter= subset->begin(); iter != subset->end(); ++iter) {
+      for (const Element *iter = elems; iter != elems + size; ++iter) {
         hash *= factor;
         hash += iter->state + reinterpret_cast<size_t>(iter->string);
         factor *= 23531;  // these numbers are primes.
@@ -446,12 +456,10 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // and string, and approximate match on weights.
   class SubsetEqual {
    public:
-    bool operator ()(const vector<Element> * s1, const vector<Element> * s2) const {
-      size_t sz = s1->size();
-      KALDI_ASSERT(sz>=0);
-      if (sz != s2->size()) return false;
-      typename vector<Element>::const_iterator iter1 = s1->begin(),
-          iter1_end = s1->end(), iter2=s2->begin();
+    bool operator ()(const Subset &s1, const Subset &s2) const {
+      if (s1.hash != s2.hash || s1.size != s2.size) return false;
+      const Element *iter1 = s1.elems, *iter1_end = s1.elems + s1.size,
+          *iter2 = s2.elems;
       for (; iter1 < iter1_end; ++iter1, ++iter2) {
         if (iter1->state != iter2->state ||
            iter1->string != iter2->string ||
@@ -483,7 +491,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
   // Define the hash type we use to map subsets (in minimal
   // representation) to OutputStateId.
-  typedef unordered_map<const vector<Element>*, OutputStateId,
+  typedef unordered_map<Subset, OutputStateId,
                         SubsetKey, SubsetEqual> MinimalSubsetHash;
 
   // Define the hash type we use to map subsets (in initial
@@ -491,9 +499,37 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // extra weight. [note: we interpret the Element.state in here
   // as an OutputStateId even though it's declared as InputStateId;
   // these types are the same anyway].
-  typedef unordered_map<const vector<Element>*, Element,
+  typedef unordered_map<Subset, Element,
                         SubsetKey, SubsetEqual> InitialSubsetHash;
 
+  // Returns a Subset that points to the data of 'vec', for lookups.
+  static Subset MakeSubset(const vector<Element> &vec) {
+    Subset ans;
+    ans.elems = vec.data();
+    ans.size = vec.size();
+    ans.hash = SubsetKey::Hash(ans.elems, ans.size);
+    return ans;
+  }
+
+  // Returns a copy of 'subset' stored in subset_blocks_.
+  Subset StoreSubset(const Subset &subset) {
+    if (subset.size > subset_block_remaining_) {
+      size_t block_size = kSubsetBlockSize;
+      if (subset.size > block_size)
+        block_size = subset.size;
+      subset_blocks_.push_back(new Element[block_size]);
+      subset_block_next_ = subset_blocks_.back();
+      subset_block_remaining_ = block_size;
+    }
+    Element *elems = subset_block_next_;
+    std::copy(subset.elems, subset.elems + subset.size, elems);
+    subset_block_next_ += subset.size;
+    subset_block_remaining_ -= subset.size;
+    Subset ans(subset);
+    ans.elems = elems;
+    return ans;
+  }
+
 
   // converts the representation of the subset from canonical (all states) to
   // minimal (only states with output symbols on arcs leaving them, and final
@@ -519,8 +555,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // transitions.
   OutputStateId MinimalToStateId(const vector<Element> &subset,
                                  const double forward_cost) {
-    typename MinimalSubsetHash::const_iterator iter
-        = minimal_hash_.find(&subset);
+    Subset key = MakeSubset(subset);
+    typename MinimalSubsetHash::const_iterator iter = minimal_hash_.find(key);
     if (iter != minimal_hash_.end()) { // Found a matching subset.
       OutputStateId state_id = iter->second;
       const OutputState &state = *(output_states_[state_id]);
@@ -534,8 +570,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       return state_id;
     }
     OutputStateId state_id = static_cast<OutputStateId>(output_states_.size());
-    OutputState *new_state = new OutputState(subset, forward_cost);
-    minimal_hash_[&(new_state->minimal_subset)] = state_id;
+    key = StoreSubset(key);
+    OutputState *new_state = new OutputState(key, forward_cost);
+    minimal_hash_[key] = state_id;
     output_states_.push_back(new_state);
     num_elems_ += subset.size();
     // Note: in the previous algorithm, we pushed the new state-id onto the queue
@@ -553,8 +590,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                                  double forward_cost,
                                  Weight *remaining_weight,
                                  StringId *common_prefix) {
+    Subset initial_key = MakeSubset(subset_in);
     typename InitialSubsetHash::const_iterator iter
-        = initial_hash_.find(&subset_in);
+        = initial_hash_.find(initial_key);
     if (iter != initial_hash_.end()) { // Found a matching subset.
       const Element &elem = iter->second;
       *remaining_weight = elem.weight;
@@ -588,10 +626,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // Before returning "ans", add the initial subset to the hash,
     // so that we can bypass the epsilon-closure etc., next time
     // we process the same initial subset.
-    vector<Element> *initial_subset_ptr = new vector<Element>(subset_in);
     elem.state = ans;
-    initial_hash_[initial_subset_ptr] = elem;
-    num_elems_ += initial_subset_ptr->size(); // keep track of memory usage.
+    initial_hash_[StoreSubset(initial_key)] = elem;
+    num_elems_ += subset_in.size(); // keep track of memory usage.
     return ans;
   }
 
@@ -636,13 +673,15 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // subset accordingly.
 
     std::priority_queue<Element, vector<Element>, greater<Element> > queue;
-    unordered_map<InputStateId, Element> cur_subset;
-    typedef typename unordered_map<InputStateId, Element>::iterator MapIter;
-    typedef typename vector<Element>::const_iterator VecIter;
-
-    for (VecIter iter = subset->begin(); iter != subset->end(); ++iter) {
-      queue.push(*iter);
-      cur_subset[iter->state] = *iter;
+    // We add the states we reach to "cur_subset", and use closure_index_
+    // (rather than a hash) to find the Element for a state in it.
+    vector<Element> &cur_subset = *subset;
+    if (closure_index_.size() < static_cast<size_t>(ifst_->NumStates()))
+      closure_index_.resize(ifst_->NumStates(), -1);
+
+    for (size_t i = 0; i < cur_subset.size(); i++) {
+      queue.push(cur_subset[i]);
+      closure_index_[cur_subset[i].state] = i;
     }
 
     // find whether input fst is known to be sorted on input label.
@@ -661,7 +700,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       // both the new (optimal) and old (less-optimal) Element will still be in
       // "queue".  The next if-statement stops us from wasting compute by
       // processing the old Element.
-      if (replaced_elems && cur_subset[elem.state] != elem)
+      if (replaced_elems && cur_subset[closure_index_[elem.state]] != elem)
         continue;
       if (opts_.max_loop > 0 && counter++ > opts_.max_loop) {
         KALDI_ERR << "Lattice determinization aborted since looped more than "
@@ -680,31 +719,33 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
           // next_elem.string is not set up yet... create it only
           // when we know we need it (this is an optimization)
 
-          MapIter iter = cur_subset.find(next_elem.state);
-          if (iter == cur_subset.end()) {
+          int32 &index = closure_index_[next_elem.state];
+          if (index == -1) {
             // was no such StateId: insert and add to queue.
             next_elem.string = (arc.olabel == 0 ? elem.string :
                                 repository_.Successor(elem.string, arc.olabel));
-            cur_subset[next_elem.state] = next_elem;
+            index = cur_subset.size();
+            cur_subset.push_back(next_elem);
             queue.push(next_elem);
           } else {
+            Element &cur_elem = cur_subset[index];
             // was not inserted because one already there.  In normal
             // determinization we'd add the weights.  Here, we find which one
             // has the better weight, and keep its corresponding string.
-            int comp = fst::Compare(next_elem.weight, iter->second.weight);
+            int comp = fst::Compare(next_elem.weight, cur_elem.weight);
             if (comp == 0) { // A tie on weights.  This should be a rare case;
                              // we don't optimize for it.
               next_elem.string = (arc.olabel == 0 ? elem.string :
                                   repository_.Successor(elem.string,
                                                         arc.olabel));
               comp = Compare(next_elem.weight, next_elem.string,
-                             iter->second.weight, iter->second.string);
+                             cur_elem.weight, cur_elem.string);
             }
             if(comp == 1) { // next_elem is better, so use its (weight, string)
               next_elem.string = (arc.olabel == 0 ? elem.string :
                                   repository_.Successor(elem.string, arc.olabel));
-              iter->second.string = next_elem.string;
-              iter->second.weight = next_elem.weight;
+              cur_elem.string = next_elem.string;
+              cur_elem.weight = next_elem.weight;
               queue.push(next_elem);
               replaced_elems = true;
             }
@@ -714,14 +755,10 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       }
     }
 
-    { // copy cur_subset to subset.
-      subset->clear();
-      subset->reserve(cur_subset.size());
-      MapIter iter = cur_subset.begin(), end = cur_subset.end();
-      for (; iter != end; ++iter) subset->push_back(iter->second);
-      // sort by state ID, because the subset hash function is order-dependent(see SubsetKey)
-      std::sort(subset->begin(), subset->end());
-    }
+    for (size_t i = 0; i < cur_subset.size(); i++)
+      closure_index_[cur_subset[i].state] = -1;
+    // sort by state ID, because the subset hash function is order-dependent(see SubsetKey)
+    std::sort(subset->begin(), subset->end());
   }
 
 
@@ -732,7 +769,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
   void ProcessFinal(OutputStateId output_state_id) {
     OutputState &state = *(output_states_[output_state_id]);
-    const vector<Element> &minimal_subset = state.minimal_subset;
+    const Subset &minimal_subset = state.minimal_subset;
     // processes final-weights for this subset.  state.minimal_subset_ may be
     // empty if the graphs is not connected/trimmed, I think, do don't check
     // that it's nonempty.
@@ -740,7 +777,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // compiler happy; if it doesn't get set in the loop, we won't use the value anyway.
     Weight final_weight = Weight::Zero();
     bool is_final = false;
-    typename vector<Element>::const_iterator iter = minimal_subset.begin(), end = minimal_subset.end();
+    const Element *iter = minimal_subset.elems,
+        *end = minimal_subset.elems + minimal_subset.size;
     for (; iter != end; ++iter) {
       const Element &elem = *iter;
       Weight this_final_weight = Times(elem.weight, ifst_->Final(elem.state));
@@ -900,7 +938,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // the information we need to process the transition.
 
   void ProcessTransitions(OutputStateId output_state_id) {
-    const vector<Element> &minimal_subset = output_states_[output_state_id]->minimal_subset;
+    const Subset &minimal_subset = output_states_[output_state_id]->minimal_subset;
     // it's possible that minimal_subset could be empty if there are
     // unreachable parts of the graph, so don't check that it's nonempty.
     vector<pair<Label, Element> > &all_elems(all_elems_tmp_); // use class member
@@ -908,7 +946,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     {
       // Push back into "all_elems", elements corresponding to all
       // non-epsilon-input transitions out of all states in "minimal_subset".
-      typename vector<Element>::const_iterator iter = minimal_subset.begin(), end = minimal_subset.end();
+      const Element *iter = minimal_subset.elems,
+          *end = minimal_subset.elems + minimal_subset.size;
       for (;iter != end; ++iter) {
         const Element &elem = *iter;
         for (ArcIterator<ExpandedFst<Arc> > aiter(*ifst_, elem.state); ! aiter.Done(); aiter.Next()) {
@@ -1077,12 +1116,13 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       // Weight::One() is the "forward-weight" of this determinized state...
       // i.e. the minimal cost from the start of the determinized FST to this
       // state [One() because it's the start state].
-      OutputState *initial_state = new OutputState(subset, 0);
+      Subset key = StoreSubset(MakeSubset(subset));
+      OutputState *initial_state = new OutputState(key, 0);
       KALDI_ASSERT(output_states_.empty());
       output_states_.push_back(initial_state);
       num_elems_ += subset.size();
       OutputStateId initial_state_id = 0;
-      minimal_hash_[&(initial_state->minimal_subset)] = initial_state_id;
+      minimal_hash_[key] = initial_state_id;
       ProcessFinal(initial_state_id);
       ProcessTransitions(initial_state_id); // this will add tasks to
       // the queue, which we'll start processing in Determinize().
@@ -1092,7 +1132,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeDeterminizerPruned);
 
   struct OutputState {
-    vector<Element> minimal_subset;
+    Subset minimal_subset;  // Points into subset_blocks_.
     vector<TempArc> arcs; // arcs out of the state-- those that have been processed.
     // Note: the final-weight is included here with kNoStateId as the state id.  We
     // always process the final-weight regardless of the beam; when producing the
@@ -1102,7 +1142,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // Note: we know this minimal cost from when we first create the OutputState;
     // this is because of the priority-queue we use, that ensures that the
     // "best" path into the state will be expanded first.
-    OutputState(const vector<Element> &minimal_subset,
+    OutputState(const Subset &minimal_subset,
                 double forward_cost): minimal_subset(minimal_subset),
                                       forward_cost(forward_cost) { }
   };
@@ -1130,8 +1170,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // sure this object is used correctly.
   MinimalSubsetHash minimal_hash_;  // hash from Subset to OutputStateId.  Subset is "minimal
                                     // representation" (only include final and states and states with
-                                    // nonzero ilabel on arc out of them.  Owns the pointers
-                                    // in its keys.
+                                    // nonzero ilabel on arc out of them.
   InitialSubsetHash initial_hash_;   // hash from Subset to Element, which
                                      // represents the OutputStateId together
                                      // with an extra weight and string.  Subset
@@ -1139,8 +1178,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                                      // weight and string is needed because after
                                      // we convert to minimal representation and
                                      // normalize, there may be an extra weight
-                                     // and string.  Owns the pointers
-                                     // in its keys.
+                                     // and string.
 
   struct Task {
     OutputStateId state; // State from which we're processing the transition.
@@ -1176,10 +1214,22 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   LatticeStringRepository<IntType> repository_;  // defines a compact and fast way of
   // storing sequences of labels.
 
-  void AddStrings(const vector<Element> &vec,
+  // The storage for the subsets in minimal_hash_ and initial_hash_: blocks of
+  // kSubsetBlockSize Elements (or more, for larger subsets), of which
+  // subset_block_remaining_, starting at subset_block_next_, are not yet used
+  // in the last one.
+  static const size_t kSubsetBlockSize = 4096;
+  vector<Element*> subset_blocks_;
+  Element *subset_block_next_;
+  size_t subset_block_remaining_;
+
+  // Used in EpsilonClosure(): for each input state, the index of its Element
+  // in the subset, or -1.  We reset it to -1 afterwards.
+  vector<int32> closure_index_;
+
+  void AddStrings(const Element *begin, const Element *end,
                   vector<StringId> *needed_strings) {
-    for (typename std::vector<Element>::const_iterator iter = vec.begin();
-         iter != vec.end(); ++iter)
+    for (const Element *iter = begin; iter != end; ++iter)
       needed_strings->push_back(iter->string);
   }
 };
@@ -0,0 +1,146 @@
+// lat/flat-lattice-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lat/flat-lattice.h"
+#include "lat/lattice-functions.h"
+#include "fstext/rand-fst.h"
+
+namespace kaldi {
+
+// Returns a random acyclic, topologically sorted lattice.
+static Lattice *RandTopSortedLattice() {
+  fst::RandFstOptions opts;
+  opts.acyclic = true;
+  Lattice *lat = fst::RandPairFst<LatticeArc>(opts);
+  TopSortLatticeIfNeeded(lat);
+  return lat;
+}
+
+static void TestFlatLatticeStructure() {
+  Lattice *lat = RandTopSortedLattice();
+  CompactLattice clat;
+  ConvertLattice(*lat, &clat);
+  TopSortCompactLatticeIfNeeded(&clat);
+
+  FlatLattice flat_lat(*lat);
+  KALDI_ASSERT(!flat_lat.IsCompact() && flat_lat.Start() == lat->Start() &&
+               flat_lat.NumStates() == lat->NumStates());
+  int32 a = 0;
+  for (LatticeArc::StateId s = 0; s < lat->NumStates(); s++) {
+    KALDI_ASSERT(flat_lat.ArcBegin(s) == a);
+    for (fst::ArcIterator<Lattice> aiter(*lat, s); !aiter.Done();
+         aiter.Next(), a++) {
+      const LatticeArc &arc = aiter.Value();
+      KALDI_ASSERT(flat_lat.NextState(a) == arc.nextstate &&
+                   flat_lat.ILabel(a) == arc.ilabel &&
+                   flat_lat.GraphCost(a) == arc.weight.Value1() &&
+                   flat_lat.AcousticCost(a) == arc.weight.Value2() &&
+                   flat_lat.Cost(a) == ConvertToCost(arc.weight) &&
+                   flat_lat.Length(a) == (arc.ilabel != 0 ? 1 : 0));
+    }
+    KALDI_ASSERT(flat_lat.ArcEnd(s) == a);
+    LatticeWeight final_weight = lat->Final(s);
+    KALDI_ASSERT(flat_lat.IsFinal(s) ==
+                 (final_weight != LatticeWeight::Zero()) &&
+                 flat_lat.FinalCost(s) == ConvertToCost(final_weight) &&
+                 flat_lat.FinalLength(s) == 0);
+  }
+  KALDI_ASSERT(flat_lat.NumArcs() == a);
+
+  FlatLattice flat_clat;
+  flat_clat.Init(clat);
+  KALDI_ASSERT(flat_clat.IsCompact() && flat_clat.Start() == clat.Start() &&
+               flat_clat.NumStates() == clat.NumStates());
+  a = 0;
+  for (CompactLatticeArc::StateId s = 0; s < clat.NumStates(); s++) {
+    KALDI_ASSERT(flat_clat.ArcBegin(s) == a);
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next(), a++) {
+      const CompactLatticeArc &arc = aiter.Value();
+      KALDI_ASSERT(flat_clat.NextState(a) == arc.nextstate &&
+                   flat_clat.ILabel(a) == arc.ilabel &&
+                   flat_clat.Cost(a) == ConvertToCost(arc.weight) &&
+                   flat_clat.Length(a) == arc.weight.String().size());
+    }
+    KALDI_ASSERT(flat_clat.ArcEnd(s) == a);
+    CompactLatticeWeight final_weight = clat.Final(s);
+    KALDI_ASSERT(flat_clat.IsFinal(s) ==
+                 (final_weight != CompactLatticeWeight::Zero()) &&
+                 flat_clat.FinalCost(s) == ConvertToCost(final_weight) &&
+                 flat_clat.FinalLength(s) == final_weight.String().size());
+  }
+  KALDI_ASSERT(flat_clat.NumArcs() == a);
+  delete lat;
+}
+
+// Checks the alphas and betas against a straightforward computation on the
+// CompactLattice.
+static void TestFlatLatticeAlphasAndBetas() {
+  Lattice *lat = RandTopSortedLattice();
+  CompactLattice clat;
+  ConvertLattice(*lat, &clat);
+  TopSortCompactLatticeIfNeeded(&clat);
+  delete lat;
+  if (clat.Start() != 0)
+    return;
+
+  int32 num_states = clat.NumStates();
+  std::vector<double> ref_alpha(num_states, kLogZeroDouble),
+      ref_beta(num_states, kLogZeroDouble);
+  ref_alpha[0] = 0.0;
+  for (int32 s = 0; s < num_states; s++) {
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      ref_alpha[arc.nextstate] = LogAdd(ref_alpha[arc.nextstate],
+                                        ref_alpha[s] -
+                                        ConvertToCost(arc.weight));
+    }
+  }
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    ref_beta[s] = -ConvertToCost(clat.Final(s));
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      ref_beta[s] = LogAdd(ref_beta[s], ref_beta[arc.nextstate] -
+                           ConvertToCost(arc.weight));
+    }
+  }
+
+  FlatLattice flat_clat(clat);
+  std::vector<double> alpha, beta, alpha2, beta2;
+  KALDI_ASSERT(ComputeCompactLatticeAlphas(flat_clat, &alpha) &&
+               ComputeCompactLatticeBetas(flat_clat, &beta));
+  ComputeLatticeAlphasAndBetas(flat_clat, false, &alpha2, &beta2);
+  for (int32 s = 0; s < num_states; s++) {
+    KALDI_ASSERT(ApproxEqual(alpha[s], ref_alpha[s], 1.0e-04) &&
+                 ApproxEqual(beta[s], ref_beta[s], 1.0e-04));
+    KALDI_ASSERT(alpha2[s] == ref_alpha[s] && beta2[s] == ref_beta[s]);
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 100; i++) {
+    kaldi::TestFlatLatticeStructure();
+    kaldi::TestFlatLatticeAlphasAndBetas();
+  }
+  std::cout << "Test OK\n";
+}
@@ -0,0 +1,135 @@
+// lat/flat-lattice.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "lat/flat-lattice.h"
+
+namespace kaldi {
+
+template<class LatticeType>
+void FlatLattice::Resize(const LatticeType &lat) {
+  StateId num_states = lat.NumStates();
+  int32 num_arcs = 0;
+  for (StateId s = 0; s < num_states; s++)
+    num_arcs += lat.NumArcs(s);
+  arc_begin_.resize(num_states + 1);
+  nextstate_.resize(num_arcs);
+  ilabel_.resize(num_arcs);
+  graph_cost_.resize(num_arcs);
+  acoustic_cost_.resize(num_arcs);
+  length_.resize(num_arcs);
+  final_graph_cost_.resize(num_states);
+  final_acoustic_cost_.resize(num_states);
+  final_length_.resize(num_states);
+}
+
+void FlatLattice::Init(const Lattice &lat) {
+  start_ = lat.Start();
+  compact_ = false;
+  StateId num_states = lat.NumStates();
+  Resize(lat);
+  int32 a = 0;
+  for (StateId s = 0; s < num_states; s++) {
+    arc_begin_[s] = a;
+    for (fst::ArcIterator<Lattice> aiter(lat, s); !aiter.Done();
+         aiter.Next(), a++) {
+      const LatticeArc &arc = aiter.Value();
+      nextstate_[a] = arc.nextstate;
+      ilabel_[a] = arc.ilabel;
+      graph_cost_[a] = arc.weight.Value1();
+      acoustic_cost_[a] = arc.weight.Value2();
+      length_[a] = (arc.ilabel != 0 ? 1 : 0);
+    }
+    LatticeWeight final_weight = lat.Final(s);
+    final_graph_cost_[s] = final_weight.Value1();
+    final_acoustic_cost_[s] = final_weight.Value2();
+    final_length_[s] = 0;
+  }
+  arc_begin_[num_states] = a;
+}
+
+void FlatLattice::Init(const CompactLattice &clat) {
+  start_ = clat.Start();
+  compact_ = true;
+  StateId num_states = clat.NumStates();
+  Resize(clat);
+  int32 a = 0;
+  for (StateId s = 0; s < num_states; s++) {
+    arc_begin_[s] = a;
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next(), a++) {
+      const CompactLatticeArc &arc = aiter.Value();
+      nextstate_[a] = arc.nextstate;
+      ilabel_[a] = arc.ilabel;
+      graph_cost_[a] = arc.weight.Weight().Value1();
+      acoustic_cost_[a] = arc.weight.Weight().Value2();
+      length_[a] = static_cast<int32>(arc.weight.String().size());
+    }
+    const CompactLatticeWeight &final_weight = clat.Final(s);
+    final_graph_cost_[s] = final_weight.Weight().Value1();
+    final_acoustic_cost_[s] = final_weight.Weight().Value2();
+    final_length_[s] = static_cast<int32>(final_weight.String().size());
+  }
+  arc_begin_[num_states] = a;
+}
+
+int32 FlatLattice::StateTimes(std::vector<int32> *times) const {
+  KALDI_ASSERT(start_ == 0);
+  StateId num_states = NumStates();
+  times->clear();
+  times->resize(num_states, -1);
+  int32 *state_times = &((*times)[0]);
+  state_times[0] = 0;
+  for (StateId s = 0; s < num_states; s++) {
+    int32 cur_time = state_times[s];
+    for (int32 a = arc_begin_[s], end = arc_begin_[s + 1]; a < end; a++) {
+      int32 next_time = cur_time + length_[a];
+      int32 &t = state_times[nextstate_[a]];
+      if (t == -1)
+        t = next_time;
+      else
+        KALDI_ASSERT(t == next_time);
+    }
+  }
+  if (!compact_)
+    return *std::max_element(times->begin(), times->end());
+
+  // For the CompactLattice, the length of the utterance is worked out from
+  // the final-probs as in CompactLatticeStateTimes().
+  int32 utt_len = -1;
+  for (StateId s = 0; s < num_states; s++) {
+    if (IsFinal(s)) {
+      int32 this_utt_len = state_times[s] + final_length_[s];
+      if (utt_len == -1) {
+        utt_len = this_utt_len;
+      } else if (this_utt_len != utt_len) {
+        KALDI_WARN << "Utterance does not "
+            "seem to have a consistent length.";
+        utt_len = std::max(utt_len, this_utt_len);
+      }
+    }
+  }
+  if (utt_len == -1) {
+    KALDI_WARN << "Utterance does not have a final-state.";
+    return 0;
+  }
+  return utt_len;
+}
+
+}  // namespace kaldi
@@ -0,0 +1,141 @@
+// lat/flat-lattice.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LAT_FLAT_LATTICE_H_
+#define KALDI_LAT_FLAT_LATTICE_H_
+
+#include <limits>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+/**
+   FlatLattice is a read-only copy of a Lattice or CompactLattice in a flat
+   layout that is faster to iterate over than the VectorFst: the arcs of all
+   the states are stored contiguously in state order (the "compressed sparse
+   row" layout), with each field of the arcs in a separate array.  The
+   forward-backward type of computations in lattice-functions.h, which visit
+   every arc once or twice in state order, are done on this; the versions
+   that take a Lattice or CompactLattice make a FlatLattice first, and if you
+   need several of them for the same lattice you can make it yourself and
+   call the FlatLattice versions.
+
+   The states are numbered as in the original lattice; most of the functions
+   that use this require it to have been topologically sorted with start
+   state 0, as for the Lattice and CompactLattice versions.
+
+   The labels stored are the input labels: the words for a CompactLattice,
+   and the transition-ids for a Lattice.  The length of an arc or final-prob
+   is the number of frames it covers: for a CompactLattice, the length of its
+   string of transition-ids (which is not stored), and for a Lattice, 1 for
+   arcs with a transition-id and 0 otherwise.
+*/
+class FlatLattice {
+ public:
+  typedef LatticeArc::StateId StateId;
+  typedef LatticeArc::Label Label;
+
+  FlatLattice(): start_(fst::kNoStateId), compact_(false), arc_begin_(1, 0) { }
+
+  explicit FlatLattice(const Lattice &lat) { Init(lat); }
+
+  explicit FlatLattice(const CompactLattice &clat) { Init(clat); }
+
+  void Init(const Lattice &lat);
+
+  void Init(const CompactLattice &clat);
+
+  /// Returns true if it was initialized from a CompactLattice.
+  bool IsCompact() const { return compact_; }
+
+  StateId Start() const { return start_; }
+
+  StateId NumStates() const {
+    return static_cast<StateId>(final_length_.size());
+  }
+
+  int32 NumArcs() const { return static_cast<int32>(nextstate_.size()); }
+
+  /// The arcs leaving state s are numbered ArcBegin(s) ... ArcEnd(s) - 1.
+  int32 ArcBegin(StateId s) const { return arc_begin_[s]; }
+  int32 ArcEnd(StateId s) const { return arc_begin_[s + 1]; }
+
+  StateId NextState(int32 a) const { return nextstate_[a]; }
+  Label ILabel(int32 a) const { return ilabel_[a]; }
+  BaseFloat GraphCost(int32 a) const { return graph_cost_[a]; }
+  BaseFloat AcousticCost(int32 a) const { return acoustic_cost_[a]; }
+  /// The cost of arc a, as ConvertToCost() of its weight.
+  double Cost(int32 a) const {
+    return static_cast<double>(graph_cost_[a]) +
+        static_cast<double>(acoustic_cost_[a]);
+  }
+  int32 Length(int32 a) const { return length_[a]; }
+
+  /// Returns true unless the final-prob of s is Zero().
+  bool IsFinal(StateId s) const {
+    return !(final_graph_cost_[s] == std::numeric_limits<BaseFloat>::infinity()
+             && final_acoustic_cost_[s] ==
+             std::numeric_limits<BaseFloat>::infinity() &&
+             final_length_[s] == 0);
+  }
+  BaseFloat FinalGraphCost(StateId s) const { return final_graph_cost_[s]; }
+  BaseFloat FinalAcousticCost(StateId s) const {
+    return final_acoustic_cost_[s];
+  }
+  /// The final-cost of s, as ConvertToCost() of its final-prob.
+  double FinalCost(StateId s) const {
+    return static_cast<double>(final_graph_cost_[s]) +
+        static_cast<double>(final_acoustic_cost_[s]);
+  }
+  int32 FinalLength(StateId s) const { return final_length_[s]; }
+
+  /// Outputs the time (frame index) of each state, and returns the same as
+  /// LatticeStateTimes() or CompactLatticeStateTimes() would for the lattice
+  /// it was initialized from (the maximum time for a Lattice; the length of
+  /// the utterance in frames for a CompactLattice).  Requires that the
+  /// lattice be topologically sorted with start state 0.
+  int32 StateTimes(std::vector<int32> *times) const;
+
+ private:
+  // Sets the sizes of the arrays for 'lat'.
+  template<class LatticeType>
+  void Resize(const LatticeType &lat);
+
+  StateId start_;
+  bool compact_;
+  // Indexed by state, plus one at the end: the index of the first arc
+  // leaving each state.
+  std::vector<int32> arc_begin_;
+  // The following are indexed by arc.
+  std::vector<StateId> nextstate_;
+  std::vector<Label> ilabel_;
+  std::vector<BaseFloat> graph_cost_;
+  std::vector<BaseFloat> acoustic_cost_;
+  std::vector<int32> length_;
+  // The following are indexed by state.
+  std::vector<BaseFloat> final_graph_cost_;
+  std::vector<BaseFloat> final_acoustic_cost_;
+  std::vector<int32> final_length_;
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_LAT_FLAT_LATTICE_H_
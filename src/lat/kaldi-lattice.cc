@@ -20,6 +20,7 @@
 
 
 #include "lat/kaldi-lattice.h"
+#include "lat/compressed-lattice.h"
 #include "fst/script/print-impl.h"
 
 namespace kaldi {
@@ -304,7 +305,15 @@ Lattice *ReadLatticeText(std::istream &is) {
 bool ReadCompactLattice(std::istream &is, bool binary,
                         CompactLattice **clat) {
   KALDI_ASSERT(*clat == NULL);
-  if (binary) {
+  if (binary && IsCompressedLattice(is)) {
+    CompactLattice *ans = new CompactLattice();
+    if (!ReadCompressedLattice(is, ans)) {  // it will have warned.
+      delete ans;
+      return false;
+    }
+    *clat = ans;
+    return true;
+  } else if (binary) {
     fst::FstHeader hdr;
     if (!hdr.Read(is, "<unknown>")) {
       KALDI_WARN << "Reading compact lattice: error reading FST header.";
@@ -363,6 +372,17 @@ bool ReadCompactLattice(std::istream &is, bool binary,
 }
 
 
+bool CompactLatticeHolder::Write(std::ostream &os, bool binary,
+                                 const CompactLattice &t) {
+  const CompressedLatticeOptions &opts = GetCompressedLatticeOptions();
+  if (binary && opts.write_compressed)
+    return WriteCompressedLattice(os, t, opts.weight_quantum);
+  // Note: we don't include the binary-mode header when writing
+  // this object to disk; this ensures that if we write to single
+  // files, the result can be read by OpenFst.
+  return WriteCompactLattice(os, binary, t);
+}
+
 bool CompactLatticeHolder::Read(std::istream &is) {
   Clear(); // in case anything currently stored.
   int c = is.peek();
@@ -374,6 +394,9 @@ bool CompactLatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadCompactLattice(is, false, &t_);
+  } else if (IsCompressedLattice(is)) {  // the compressed format; see
+    // compressed-lattice.h.
+    return ReadCompactLattice(is, true, &t_);
   } else if (c != 214) { // 214 is first char of FST magic number,
     // on little-endian machines which is all we support (\326 octal)
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
@@ -417,7 +440,16 @@ bool WriteLattice(std::ostream &os, bool binary, const Lattice &t) {
 bool ReadLattice(std::istream &is, bool binary,
                  Lattice **lat) {
   KALDI_ASSERT(*lat == NULL);
-  if (binary) {
+  if (binary && IsCompressedLattice(is)) {
+    CompactLattice *clat = new CompactLattice();
+    if (!ReadCompressedLattice(is, clat)) {  // it will have warned.
+      delete clat;
+      return false;
+    }
+    // note: ConvertToLattice frees its input.
+    *lat = ConvertToLattice(clat);
+    return true;
+  } else if (binary) {
     fst::FstHeader hdr;
     if (!hdr.Read(is, "<unknown>")) {
       KALDI_WARN << "Reading lattice: error reading FST header.";
@@ -490,6 +522,9 @@ bool LatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadLattice(is, false, &t_);
+  } else if (IsCompressedLattice(is)) {  // the compressed format; see
+    // compressed-lattice.h.
+    return ReadLattice(is, true, &t_);
   } else if (c != 214) { // 214 is first char of FST magic number,
     // on little-endian machines which is all we support (\326 octal)
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
@@ -72,12 +72,10 @@ class CompactLatticeHolder {
 
   CompactLatticeHolder() { t_ = NULL; }
 
-  static bool Write(std::ostream &os, bool binary, const T &t) {
-    // Note: we don't include the binary-mode header when writing
-    // this object to disk; this ensures that if we write to single
-    // files, the result can be read by OpenFst.
-    return WriteCompactLattice(os, binary, t);
-  }
+  // In binary mode this writes the compressed lattice format if the program
+  // asked for it with SetCompressedLatticeOptions() (see
+  // compressed-lattice.h); otherwise, OpenFst's binary format.
+  static bool Write(std::ostream &os, bool binary, const T &t);
 
   bool Read(std::istream &is);
 
@@ -149,18 +149,19 @@ int32 CompactLatticeStateTimes(const CompactLattice &lat, vector<int32> *times)
 
 bool ComputeCompactLatticeAlphas(const CompactLattice &clat,
                                  vector<double> *alpha) {
-  using namespace fst;
-
-  // typedef the arc, weight types
-  typedef CompactLattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
-
   //Make sure the lattice is topologically sorted.
   if (clat.Properties(fst::kTopSorted, true) == 0) {
     KALDI_WARN << "Input lattice must be topologically sorted.";
     return false;
   }
+  FlatLattice flat_clat(clat);
+  return ComputeCompactLatticeAlphas(flat_clat, alpha);
+}
+
+bool ComputeCompactLatticeAlphas(const FlatLattice &clat,
+                                 vector<double> *alpha) {
+  typedef FlatLattice::StateId StateId;
+  KALDI_ASSERT(clat.IsCompact());
   if (clat.Start() != 0) {
     KALDI_WARN << "Input lattice must start from state 0.";
     return false;
@@ -172,13 +173,14 @@ bool ComputeCompactLatticeAlphas(const CompactLattice &clat,
 
   // Now propagate alphas forward. Note that we don't acount the weight of the
   // final state to alpha[final_state] -- we acount it to beta[final_state];
+  // Note: the graph and acoustic costs are added in float, not double.
   (*alpha)[0] = 0.0;
   for (StateId s = 0; s < num_states; s++) {
     double this_alpha = (*alpha)[s];
-    for (ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -(arc.weight.Weight().Value1() + arc.weight.Weight().Value2());
-      (*alpha)[arc.nextstate] = LogAdd((*alpha)[arc.nextstate], this_alpha + arc_like);
+    for (int32 a = clat.ArcBegin(s), end = clat.ArcEnd(s); a < end; a++) {
+      double arc_like = -(clat.GraphCost(a) + clat.AcousticCost(a));
+      double &next_alpha = (*alpha)[clat.NextState(a)];
+      next_alpha = LogAdd(next_alpha, this_alpha + arc_like);
     }
   }
 
@@ -187,18 +189,19 @@ bool ComputeCompactLatticeAlphas(const CompactLattice &clat,
 
 bool ComputeCompactLatticeBetas(const CompactLattice &clat,
                                 vector<double> *beta) {
-  using namespace fst;
-
-  // typedef the arc, weight types
-  typedef CompactLattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
-
   // Make sure the lattice is topologically sorted.
   if (clat.Properties(fst::kTopSorted, true) == 0) {
     KALDI_WARN << "Input lattice must be topologically sorted.";
     return false;
   }
+  FlatLattice flat_clat(clat);
+  return ComputeCompactLatticeBetas(flat_clat, beta);
+}
+
+bool ComputeCompactLatticeBetas(const FlatLattice &clat,
+                                vector<double> *beta) {
+  typedef FlatLattice::StateId StateId;
+  KALDI_ASSERT(clat.IsCompact());
   if (clat.Start() != 0) {
     KALDI_WARN << "Input lattice must start from state 0.";
     return false;
@@ -211,12 +214,10 @@ bool ComputeCompactLatticeBetas(const CompactLattice &clat,
   // Now propagate betas backward. Note that beta[final_state] contains the
   // weight of the final state in the lattice -- compare that with alpha.
   for (StateId s = num_states-1; s >= 0; s--) {
-    Weight f = clat.Final(s);
-    double this_beta = -(f.Weight().Value1()+f.Weight().Value2());
-    for (ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -(arc.weight.Weight().Value1()+arc.weight.Weight().Value2());
-      double arc_beta = (*beta)[arc.nextstate] + arc_like;
+    double this_beta = -(clat.FinalGraphCost(s) + clat.FinalAcousticCost(s));
+    for (int32 a = clat.ArcBegin(s), end = clat.ArcEnd(s); a < end; a++) {
+      double arc_like = -(clat.GraphCost(a) + clat.AcousticCost(a));
+      double arc_beta = (*beta)[clat.NextState(a)] + arc_like;
       this_beta = LogAdd(this_beta, arc_beta);
     }
     (*beta)[s] = this_beta;
@@ -313,24 +314,27 @@ template bool PruneLattice(BaseFloat beam, CompactLattice *lat);
 
 BaseFloat LatticeForwardBackward(const Lattice &lat, Posterior *post,
                                  double *acoustic_like_sum) {
+  // Make sure the lattice is topologically sorted.
+  if (lat.Properties(fst::kTopSorted, true) == 0)
+    KALDI_ERR << "Input lattice must be topologically sorted.";
+  FlatLattice flat_lat(lat);
+  return LatticeForwardBackward(flat_lat, post, acoustic_like_sum);
+}
+
+BaseFloat LatticeForwardBackward(const FlatLattice &lat, Posterior *post,
+                                 double *acoustic_like_sum) {
   // Note, Posterior is defined as follows:  Indexed [frame], then a list
   // of (transition-id, posterior-probability) pairs.
   // typedef std::vector<std::vector<std::pair<int32, BaseFloat> > > Posterior;
-  using namespace fst;
-  typedef Lattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
+  typedef FlatLattice::StateId StateId;
 
   if (acoustic_like_sum) *acoustic_like_sum = 0.0;
 
-  // Make sure the lattice is topologically sorted.
-  if (lat.Properties(fst::kTopSorted, true) == 0)
-    KALDI_ERR << "Input lattice must be topologically sorted.";
-  KALDI_ASSERT(lat.Start() == 0);
+  KALDI_ASSERT(!lat.IsCompact() && lat.Start() == 0);
 
   int32 num_states = lat.NumStates();
   vector<int32> state_times;
-  int32 max_time = LatticeStateTimes(lat, &state_times);
+  int32 max_time = lat.StateTimes(&state_times);
   std::vector<double> alpha(num_states, kLogZeroDouble);
   std::vector<double> &beta(alpha); // we re-use the same memory for
   // this, but it's semantically distinct so we name it differently.
@@ -340,31 +344,30 @@ BaseFloat LatticeForwardBackward(const Lattice &lat, Posterior *post,
   post->resize(max_time);
 
   alpha[0] = 0.0;
-  // Propagate alphas forward.
+  // Propagate alphas forward.  (The final-costs are added in float, not
+  // double, unlike the arc costs).
   for (StateId s = 0; s < num_states; s++) {
     double this_alpha = alpha[s];
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      alpha[arc.nextstate] = LogAdd(alpha[arc.nextstate], this_alpha + arc_like);
+    for (int32 a = lat.ArcBegin(s), end = lat.ArcEnd(s); a < end; a++) {
+      double arc_like = -lat.Cost(a);
+      double &next_alpha = alpha[lat.NextState(a)];
+      next_alpha = LogAdd(next_alpha, this_alpha + arc_like);
     }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - (f.Value1() + f.Value2());
+    if (lat.IsFinal(s)) {
+      double final_like = this_alpha -
+          (lat.FinalGraphCost(s) + lat.FinalAcousticCost(s));
       tot_forward_prob = LogAdd(tot_forward_prob, final_like);
       KALDI_ASSERT(state_times[s] == max_time &&
                    "Lattice is inconsistent (final-prob not at max_time)");
     }
   }
   for (StateId s = num_states-1; s >= 0; s--) {
-    Weight f = lat.Final(s);
-    double this_beta = -(f.Value1() + f.Value2());
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = beta[arc.nextstate] + arc_like;
+    double this_beta = -(lat.FinalGraphCost(s) + lat.FinalAcousticCost(s));
+    for (int32 a = lat.ArcBegin(s), end = lat.ArcEnd(s); a < end; a++) {
+      double arc_like = -lat.Cost(a),
+          arc_beta = beta[lat.NextState(a)] + arc_like;
       this_beta = LogAdd(this_beta, arc_beta);
-      int32 transition_id = arc.ilabel;
+      int32 transition_id = lat.ILabel(a);
 
       // The following "if" is an optimization to avoid un-needed exp().
       if (transition_id != 0 || acoustic_like_sum != NULL) {
@@ -374,13 +377,13 @@ BaseFloat LatticeForwardBackward(const Lattice &lat, Posterior *post,
           (*post)[state_times[s]].push_back(std::make_pair(transition_id,
                                                            static_cast<kaldi::BaseFloat>(posterior)));
         if (acoustic_like_sum != NULL)
-          *acoustic_like_sum -= posterior * arc.weight.Value2();
+          *acoustic_like_sum -= posterior * lat.AcousticCost(a);
       }
     }
-    if (acoustic_like_sum != NULL && f != Weight::Zero()) {
-      double final_logprob = - ConvertToCost(f),
+    if (acoustic_like_sum != NULL && lat.IsFinal(s)) {
+      double final_logprob = - lat.FinalCost(s),
           posterior = Exp(alpha[s] + final_logprob - tot_forward_prob);
-      *acoustic_like_sum -= posterior * f.Value2();
+      *acoustic_like_sum -= posterior * lat.FinalAcousticCost(s);
     }
     beta[s] = this_beta;
   }
@@ -453,12 +456,18 @@ double ComputeLatticeAlphasAndBetas(const LatticeType &lat,
                                     bool viterbi,
                                     vector<double> *alpha,
                                     vector<double> *beta) {
-  typedef typename LatticeType::Arc Arc;
-  typedef typename Arc::Weight Weight;
-  typedef typename Arc::StateId StateId;
+  KALDI_ASSERT(lat.Properties(fst::kTopSorted, true) == fst::kTopSorted);
+  FlatLattice flat_lat(lat);
+  return ComputeLatticeAlphasAndBetas(flat_lat, viterbi, alpha, beta);
+}
+
+double ComputeLatticeAlphasAndBetas(const FlatLattice &lat,
+                                    bool viterbi,
+                                    vector<double> *alpha,
+                                    vector<double> *beta) {
+  typedef FlatLattice::StateId StateId;
 
   StateId num_states = lat.NumStates();
-  KALDI_ASSERT(lat.Properties(fst::kTopSorted, true) == fst::kTopSorted);
   KALDI_ASSERT(lat.Start() == 0);
   alpha->clear();
   beta->clear();
@@ -470,26 +479,21 @@ double ComputeLatticeAlphasAndBetas(const LatticeType &lat,
   // Propagate alphas forward.
   for (StateId s = 0; s < num_states; s++) {
     double this_alpha = (*alpha)[s];
-    for (fst::ArcIterator<LatticeType> aiter(lat, s); !aiter.Done();
-         aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      (*alpha)[arc.nextstate] = LogAddOrMax(viterbi, (*alpha)[arc.nextstate],
-                                                this_alpha + arc_like);
+    for (int32 a = lat.ArcBegin(s), end = lat.ArcEnd(s); a < end; a++) {
+      double arc_like = -lat.Cost(a);
+      double &next_alpha = (*alpha)[lat.NextState(a)];
+      next_alpha = LogAddOrMax(viterbi, next_alpha, this_alpha + arc_like);
     }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - ConvertToCost(f);
+    if (lat.IsFinal(s)) {
+      double final_like = this_alpha - lat.FinalCost(s);
       tot_forward_prob = LogAddOrMax(viterbi, tot_forward_prob, final_like);
     }
   }
   for (StateId s = num_states-1; s >= 0; s--) { // it's guaranteed signed.
-    double this_beta = -ConvertToCost(lat.Final(s));
-    for (fst::ArcIterator<LatticeType> aiter(lat, s); !aiter.Done();
-         aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = (*beta)[arc.nextstate] + arc_like;
+    double this_beta = -lat.FinalCost(s);
+    for (int32 a = lat.ArcBegin(s), end = lat.ArcEnd(s); a < end; a++) {
+      double arc_like = -lat.Cost(a),
+          arc_beta = (*beta)[lat.NextState(a)] + arc_like;
       this_beta = LogAddOrMax(viterbi, this_beta, arc_beta);
     }
     (*beta)[s] = this_beta;
@@ -627,7 +631,7 @@ void TopSortLatticeIfNeeded(Lattice *lat) {
 /// Requires that input is topologically sorted.
 BaseFloat CompactLatticeDepth(const CompactLattice &clat,
                               int32 *num_frames) {
-  typedef CompactLattice::Arc::StateId StateId;
+  typedef FlatLattice::StateId StateId;
   if (clat.Properties(fst::kTopSorted, true) == 0) {
     KALDI_ERR << "Lattice input to CompactLatticeDepth was not topologically "
               << "sorted.";
@@ -636,29 +640,26 @@ BaseFloat CompactLatticeDepth(const CompactLattice &clat,
     *num_frames = 0;
     return 1.0;
   }
+  FlatLattice flat_clat(clat);
   size_t num_arc_frames = 0;
   int32 t;
   {
     vector<int32> state_times;
-    t = CompactLatticeStateTimes(clat, &state_times);
+    t = flat_clat.StateTimes(&state_times);
   }
   if (num_frames != NULL)
     *num_frames = t;
-  for (StateId s = 0; s < clat.NumStates(); s++) {
-    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
-         aiter.Next()) {
-      const CompactLatticeArc &arc = aiter.Value();
-      num_arc_frames += arc.weight.String().size();
-    }
-    num_arc_frames += clat.Final(s).String().size();
-  }
+  for (int32 a = 0; a < flat_clat.NumArcs(); a++)
+    num_arc_frames += flat_clat.Length(a);
+  for (StateId s = 0; s < flat_clat.NumStates(); s++)
+    num_arc_frames += flat_clat.FinalLength(s);
   return num_arc_frames / static_cast<BaseFloat>(t);
 }
 
 
 void CompactLatticeDepthPerFrame(const CompactLattice &clat,
                                  std::vector<int32> *depth_per_frame) {
-  typedef CompactLattice::Arc::StateId StateId;
+  typedef FlatLattice::StateId StateId;
   if (clat.Properties(fst::kTopSorted, true) == 0) {
     KALDI_ERR << "Lattice input to CompactLatticeDepthPerFrame was not "
               << "topologically sorted.";
@@ -667,26 +668,26 @@ void CompactLatticeDepthPerFrame(const CompactLattice &clat,
     depth_per_frame->clear();
     return;
   }
+  FlatLattice flat_clat(clat);
   vector<int32> state_times;
-  int32 T = CompactLatticeStateTimes(clat, &state_times);
+  int32 T = flat_clat.StateTimes(&state_times);
 
   depth_per_frame->clear();
   if (T <= 0) {
     return;
   } else {
     depth_per_frame->resize(T, 0);
-    for (StateId s = 0; s < clat.NumStates(); s++) {
+    for (StateId s = 0; s < flat_clat.NumStates(); s++) {
       int32 start_time = state_times[s];
-      for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
-           aiter.Next()) {
-        const CompactLatticeArc &arc = aiter.Value();
-        int32 len = arc.weight.String().size();
+      for (int32 a = flat_clat.ArcBegin(s), end = flat_clat.ArcEnd(s);
+           a < end; a++) {
+        int32 len = flat_clat.Length(a);
         for (int32 t = start_time; t < start_time + len; t++) {
           KALDI_ASSERT(t < T);
           (*depth_per_frame)[t]++;
         }
       }
-      int32 final_len = clat.Final(s).String().size();
+      int32 final_len = flat_clat.FinalLength(s);
       for (int32 t = start_time; t < start_time + final_len; t++) {
         KALDI_ASSERT(t < T);
         (*depth_per_frame)[t]++;
@@ -799,10 +800,7 @@ BaseFloat LatticeForwardBackwardMpeVariants(
     std::string criterion,
     bool one_silence_class,
     Posterior *post) {
-  using namespace fst;
-  typedef Lattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
+  typedef FlatLattice::StateId StateId;
 
   KALDI_ASSERT(criterion == "mpfe" || criterion == "smbr");
   bool is_mpfe = (criterion == "mpfe");
@@ -811,9 +809,10 @@ BaseFloat LatticeForwardBackwardMpeVariants(
     KALDI_ERR << "Input lattice must be topologically sorted.";
   KALDI_ASSERT(lat.Start() == 0);
 
-  int32 num_states = lat.NumStates();
+  FlatLattice flat_lat(lat);
+  int32 num_states = flat_lat.NumStates();
   vector<int32> state_times;
-  int32 max_time = LatticeStateTimes(lat, &state_times);
+  int32 max_time = flat_lat.StateTimes(&state_times);
   KALDI_ASSERT(max_time == static_cast<int32>(num_ali.size()));
   std::vector<double> alpha(num_states, kLogZeroDouble),
       alpha_smbr(num_states, 0), //forward variable for sMBR
@@ -830,14 +829,15 @@ BaseFloat LatticeForwardBackwardMpeVariants(
   // First Pass Forward,
   for (StateId s = 0; s < num_states; s++) {
     double this_alpha = alpha[s];
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      alpha[arc.nextstate] = LogAdd(alpha[arc.nextstate], this_alpha + arc_like);
+    for (int32 a = flat_lat.ArcBegin(s), end = flat_lat.ArcEnd(s);
+         a < end; a++) {
+      double arc_like = -flat_lat.Cost(a);
+      double &next_alpha = alpha[flat_lat.NextState(a)];
+      next_alpha = LogAdd(next_alpha, this_alpha + arc_like);
     }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - (f.Value1() + f.Value2());
+    if (flat_lat.IsFinal(s)) {
+      double final_like = this_alpha -
+          (flat_lat.FinalGraphCost(s) + flat_lat.FinalAcousticCost(s));
       tot_forward_prob = LogAdd(tot_forward_prob, final_like);
       KALDI_ASSERT(state_times[s] == max_time &&
                    "Lattice is inconsistent (final-prob not at max_time)");
@@ -845,12 +845,12 @@ BaseFloat LatticeForwardBackwardMpeVariants(
   }
   // First Pass Backward,
   for (StateId s = num_states-1; s >= 0; s--) {
-    Weight f = lat.Final(s);
-    double this_beta = -(f.Value1() + f.Value2());
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = beta[arc.nextstate] + arc_like;
+    double this_beta = -(flat_lat.FinalGraphCost(s) +
+                         flat_lat.FinalAcousticCost(s));
+    for (int32 a = flat_lat.ArcBegin(s), end = flat_lat.ArcEnd(s);
+         a < end; a++) {
+      double arc_like = -flat_lat.Cost(a),
+          arc_beta = beta[flat_lat.NextState(a)] + arc_like;
       this_beta = LogAdd(this_beta, arc_beta);
     }
     beta[s] = this_beta;
@@ -867,13 +867,15 @@ BaseFloat LatticeForwardBackwardMpeVariants(
   // Second Pass Forward, calculate forward for MPFE/SMBR
   for (StateId s = 0; s < num_states; s++) {
     double this_alpha = alpha[s];
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
+    for (int32 a = flat_lat.ArcBegin(s), end = flat_lat.ArcEnd(s);
+         a < end; a++) {
+      StateId nextstate = flat_lat.NextState(a);
+      int32 transition_id = flat_lat.ILabel(a);
+      double arc_like = -flat_lat.Cost(a);
       double frame_acc = 0.0;
-      if (arc.ilabel != 0) {
+      if (transition_id != 0) {
         int32 cur_time = state_times[s];
-        int32 phone = trans.TransitionIdToPhone(arc.ilabel),
+        int32 phone = trans.TransitionIdToPhone(transition_id),
             ref_phone = trans.TransitionIdToPhone(num_ali[cur_time]);
         bool phone_is_sil = std::binary_search(silence_phones.begin(),
                                                silence_phones.end(),
@@ -883,7 +885,7 @@ BaseFloat LatticeForwardBackwardMpeVariants(
                                                   ref_phone),
             both_sil = phone_is_sil && ref_phone_is_sil;
         if (!is_mpfe) { // smbr.
-          int32 pdf = trans.TransitionIdToPdf(arc.ilabel),
+          int32 pdf = trans.TransitionIdToPdf(transition_id),
               ref_pdf = trans.TransitionIdToPdf(num_ali[cur_time]);
           if (!one_silence_class)  // old behavior
             frame_acc = (pdf == ref_pdf && !phone_is_sil) ? 1.0 : 0.0;
@@ -896,12 +898,12 @@ BaseFloat LatticeForwardBackwardMpeVariants(
             frame_acc = (phone == ref_phone || both_sil) ? 1.0 : 0.0;
         }
       }
-      double arc_scale = Exp(alpha[s] + arc_like - alpha[arc.nextstate]);
-      alpha_smbr[arc.nextstate] += arc_scale * (alpha_smbr[s] + frame_acc);
+      double arc_scale = Exp(alpha[s] + arc_like - alpha[nextstate]);
+      alpha_smbr[nextstate] += arc_scale * (alpha_smbr[s] + frame_acc);
     }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - (f.Value1() + f.Value2());
+    if (flat_lat.IsFinal(s)) {
+      double final_like = this_alpha -
+          (flat_lat.FinalGraphCost(s) + flat_lat.FinalAcousticCost(s));
       double arc_scale = Exp(final_like - tot_forward_prob);
       tot_forward_score += arc_scale * alpha_smbr[s];
       KALDI_ASSERT(state_times[s] == max_time &&
@@ -910,15 +912,16 @@ BaseFloat LatticeForwardBackwardMpeVariants(
   }
   // Second Pass Backward, collect Mpe style posteriors
   for (StateId s = num_states-1; s >= 0; s--) {
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = beta[arc.nextstate] + arc_like;
+    for (int32 a = flat_lat.ArcBegin(s), end = flat_lat.ArcEnd(s);
+         a < end; a++) {
+      StateId nextstate = flat_lat.NextState(a);
+      double arc_like = -flat_lat.Cost(a),
+          arc_beta = beta[nextstate] + arc_like;
       double frame_acc = 0.0;
-      int32 transition_id = arc.ilabel;
-      if (arc.ilabel != 0) {
+      int32 transition_id = flat_lat.ILabel(a);
+      if (transition_id != 0) {
         int32 cur_time = state_times[s];
-        int32 phone = trans.TransitionIdToPhone(arc.ilabel),
+        int32 phone = trans.TransitionIdToPhone(transition_id),
             ref_phone = trans.TransitionIdToPhone(num_ali[cur_time]);
         bool phone_is_sil = std::binary_search(silence_phones.begin(),
                                                silence_phones.end(), phone),
@@ -927,7 +930,7 @@ BaseFloat LatticeForwardBackwardMpeVariants(
                                                   ref_phone),
             both_sil = phone_is_sil && ref_phone_is_sil;
         if (!is_mpfe) { // smbr.
-          int32 pdf = trans.TransitionIdToPdf(arc.ilabel),
+          int32 pdf = trans.TransitionIdToPdf(transition_id),
               ref_pdf = trans.TransitionIdToPdf(num_ali[cur_time]);
           if (!one_silence_class)  // old behavior
             frame_acc = (pdf == ref_pdf && !phone_is_sil) ? 1.0 : 0.0;
@@ -940,16 +943,16 @@ BaseFloat LatticeForwardBackwardMpeVariants(
             frame_acc = (phone == ref_phone || both_sil) ? 1.0 : 0.0;
         }
       }
-      double arc_scale = Exp(beta[arc.nextstate] + arc_like - beta[s]);
+      double arc_scale = Exp(beta[nextstate] + arc_like - beta[s]);
       // check arc_scale NAN,
       // this is to prevent partial paths in Lattices
       // i.e., paths don't survive to the final state
       if (KALDI_ISNAN(arc_scale)) arc_scale = 0;
-      beta_smbr[s] += arc_scale * (beta_smbr[arc.nextstate] + frame_acc);
+      beta_smbr[s] += arc_scale * (beta_smbr[nextstate] + frame_acc);
 
       if (transition_id != 0) { // Arc has a transition-id on it [not epsilon]
         double posterior = Exp(alpha[s] + arc_beta - tot_forward_prob);
-        double acc_diff = alpha_smbr[s] + frame_acc + beta_smbr[arc.nextstate]
+        double acc_diff = alpha_smbr[s] + frame_acc + beta_smbr[nextstate]
                                - tot_forward_score;
         double posterior_smbr = posterior * acc_diff;
         (*post)[state_times[s]].push_back(std::make_pair(transition_id,
@@ -32,6 +32,7 @@
 #include "fstext/fstext-lib.h"
 #include "hmm/transition-model.h"
 #include "lat/kaldi-lattice.h"
+#include "lat/flat-lattice.h"
 #include "itf/decodable-itf.h"
 
 namespace kaldi {
@@ -81,6 +82,12 @@ BaseFloat LatticeForwardBackward(const Lattice &lat,
                                  Posterior *arc_post,
                                  double *acoustic_like_sum = NULL);
 
+/// As LatticeForwardBackward() above, but 'lat' must have been initialized
+/// from a Lattice.
+BaseFloat LatticeForwardBackward(const FlatLattice &lat,
+                                 Posterior *arc_post,
+                                 double *acoustic_like_sum = NULL);
+
 // This function is something similar to LatticeForwardBackward(), but it is on
 // the CompactLattice lattice format. Also we only need the alpha in the forward
 // path, not the posteriors.
@@ -92,6 +99,16 @@ bool ComputeCompactLatticeAlphas(const CompactLattice &lat,
 bool ComputeCompactLatticeBetas(const CompactLattice &lat,
                                 std::vector<double> *beta);
 
+// Versions of ComputeCompactLatticeAlphas() and ComputeCompactLatticeBetas()
+// for a FlatLattice initialized from a CompactLattice, with the same results;
+// use these if you need several such things for the same lattice.  (Note:
+// they will not check that the lattice was topologically sorted.)
+bool ComputeCompactLatticeAlphas(const FlatLattice &lat,
+                                 std::vector<double> *alpha);
+
+bool ComputeCompactLatticeBetas(const FlatLattice &lat,
+                                std::vector<double> *beta);
+
 
 // Computes (normal or Viterbi) alphas and betas; returns (total-prob, or
 // best-path negated cost) Note: in either case, the alphas and betas are
@@ -103,6 +120,13 @@ double ComputeLatticeAlphasAndBetas(const LatticeType &lat,
                                     std::vector<double> *alpha,
                                     std::vector<double> *beta);
 
+// The version of ComputeLatticeAlphasAndBetas() for a FlatLattice, which may
+// have been initialized from either type of lattice.
+double ComputeLatticeAlphasAndBetas(const FlatLattice &lat,
+                                    bool viterbi,
+                                    std::vector<double> *alpha,
+                                    std::vector<double> *beta);
+
 
 /// Topologically sort the compact lattice if not already topologically sorted.
 /// Will crash if the lattice cannot be topologically sorted.
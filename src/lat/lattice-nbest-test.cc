@@ -0,0 +1,106 @@
+// lat/lattice-nbest-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "lat/lattice-nbest.h"
+#include "fstext/rand-fst.h"
+
+namespace kaldi {
+
+// Appends the costs of all the paths from state s to *costs; 'cost' is the
+// cost so far.
+static void GetAllPathCosts(const CompactLattice &clat,
+                            CompactLatticeArc::StateId s, double cost,
+                            std::vector<double> *costs) {
+  if (clat.Final(s) != CompactLatticeWeight::Zero())
+    costs->push_back(cost + ConvertToCost(clat.Final(s)));
+  for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+       aiter.Next()) {
+    const CompactLatticeArc &arc = aiter.Value();
+    GetAllPathCosts(clat, arc.nextstate, cost + ConvertToCost(arc.weight),
+                    costs);
+  }
+}
+
+// Returns the cost of a linear lattice.
+static double GetLinearCost(const CompactLattice &path) {
+  double cost = 0.0;
+  CompactLatticeArc::StateId s = path.Start();
+  while (path.Final(s) == CompactLatticeWeight::Zero()) {
+    KALDI_ASSERT(path.NumArcs(s) == 1);
+    fst::ArcIterator<CompactLattice> aiter(path, s);
+    cost += ConvertToCost(aiter.Value().weight);
+    s = aiter.Value().nextstate;
+  }
+  KALDI_ASSERT(path.NumArcs(s) == 0);
+  return cost + ConvertToCost(path.Final(s));
+}
+
+static void TestCompactLatticeNbest() {
+  fst::RandFstOptions opts;
+  opts.acyclic = true;
+  Lattice *lat = fst::RandPairFst<LatticeArc>(opts);
+  CompactLattice clat;
+  ConvertLattice(*lat, &clat);
+  delete lat;
+
+  std::vector<double> ref_costs;
+  if (clat.Start() != fst::kNoStateId)
+    GetAllPathCosts(clat, clat.Start(), 0.0, &ref_costs);
+  std::sort(ref_costs.begin(), ref_costs.end());
+
+  int32 n = RandInt(1, 20);
+  double beam = (RandInt(0, 1) == 0 ? std::numeric_limits<double>::infinity()
+                 : 2.0);
+  std::vector<CompactLattice> nbest;
+  CompactLatticeNbestAsFsts(clat, n, beam, &nbest);
+  if (ref_costs.empty()) {
+    KALDI_ASSERT(nbest.empty());
+    return;
+  }
+  int32 num_expected = 0;
+  while (num_expected < n && num_expected < ref_costs.size() &&
+         ref_costs[num_expected] <= ref_costs[0] + beam)
+    num_expected++;
+  // paths right at the edge of the beam may or may not be included.
+  KALDI_ASSERT(std::abs(static_cast<int32>(nbest.size()) - num_expected) <= 1);
+  for (size_t i = 0; i < nbest.size(); i++)
+    KALDI_ASSERT(ApproxEqual(GetLinearCost(nbest[i]), ref_costs[i]));
+
+  // Check that the incremental interface agrees, including the costs.
+  CompactLatticeNbest nbest_computer(clat);
+  KALDI_ASSERT(ApproxEqual(nbest_computer.BestCost(), ref_costs[0]));
+  CompactLattice path;
+  double cost;
+  size_t num_paths = 0;
+  for (; nbest_computer.Next(&path, &cost); num_paths++) {
+    KALDI_ASSERT(num_paths < ref_costs.size() &&
+                 ApproxEqual(cost, ref_costs[num_paths]) &&
+                 ApproxEqual(GetLinearCost(path), cost));
+  }
+  KALDI_ASSERT(num_paths == ref_costs.size());
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 200; i++)
+    kaldi::TestCompactLatticeNbest();
+  std::cout << "Test OK\n";
+}
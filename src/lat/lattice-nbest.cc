@@ -0,0 +1,189 @@
+// lat/lattice-nbest.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "lat/lattice-nbest.h"
+
+namespace kaldi {
+
+namespace {
+struct ChoiceDeltaLess {
+  template<class Choice>
+  bool operator () (const Choice &a, const Choice &b) const {
+    return a.delta < b.delta;
+  }
+};
+}  // namespace
+
+CompactLatticeNbest::CompactLatticeNbest(const CompactLattice &clat,
+                                         double beam):
+    clat_(&clat), beam_(beam),
+    best_cost_(std::numeric_limits<double>::infinity()) {
+  if (clat.Properties(fst::kTopSorted, true) == 0) {
+    sorted_clat_ = clat;
+    if (!TopSort(&sorted_clat_))
+      KALDI_ERR << "Was not able to topologically sort lattice (cycles found?)";
+    clat_ = &sorted_clat_;
+  }
+  ComputeChoices();
+  StateId start = clat_->Start();
+  if (start != fst::kNoStateId && NumChoices(start) > 0) {
+    // The cost of the best path is the beta of the start state, which
+    // ComputeChoices() left in best_cost_.
+    AddCandidate(-1, start, 0, best_cost_);
+  } else {
+    best_cost_ = std::numeric_limits<double>::infinity();
+  }
+}
+
+void CompactLatticeNbest::ComputeChoices() {
+  const CompactLattice &clat = *clat_;
+  StateId num_states = clat.NumStates();
+  const double inf = std::numeric_limits<double>::infinity();
+  std::vector<double> beta(num_states, inf);
+  std::vector<std::vector<Choice> > state_choices(num_states);
+  // The lattice is top-sorted, so we can compute the betas in reverse order.
+  for (StateId s = num_states - 1; s >= 0; s--) {
+    std::vector<Choice> &this_choices = state_choices[s];
+    double final_cost = ConvertToCost(clat.Final(s));
+    if (final_cost != inf) {
+      Choice choice;
+      choice.arc_index = -1;
+      choice.nextstate = fst::kNoStateId;
+      choice.delta = final_cost;  // for now, the total cost to the end.
+      this_choices.push_back(choice);
+    }
+    int32 arc_index = 0;
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next(), arc_index++) {
+      const CompactLatticeArc &arc = aiter.Value();
+      KALDI_ASSERT(arc.nextstate > s);
+      double cost = ConvertToCost(arc.weight) + beta[arc.nextstate];
+      if (cost != inf) {
+        Choice choice;
+        choice.arc_index = arc_index;
+        choice.nextstate = arc.nextstate;
+        choice.delta = cost;
+        this_choices.push_back(choice);
+      }
+    }
+    if (this_choices.empty()) continue;
+    std::stable_sort(this_choices.begin(), this_choices.end(),
+                     ChoiceDeltaLess());
+    beta[s] = this_choices[0].delta;
+    for (size_t i = 0; i < this_choices.size(); i++)
+      this_choices[i].delta -= beta[s];
+  }
+  choice_begin_.resize(num_states + 1);
+  choices_.clear();
+  for (StateId s = 0; s < num_states; s++) {
+    choice_begin_[s] = choices_.size();
+    choices_.insert(choices_.end(), state_choices[s].begin(),
+                    state_choices[s].end());
+  }
+  choice_begin_[num_states] = choices_.size();
+  if (clat.Start() != fst::kNoStateId)
+    best_cost_ = beta[clat.Start()];
+}
+
+void CompactLatticeNbest::AddCandidate(int32 parent, StateId state,
+                                       int32 rank, double cost) {
+  if (cost > best_cost_ + beam_)
+    return;
+  Candidate candidate;
+  candidate.parent = parent;
+  candidate.state = state;
+  candidate.rank = rank;
+  candidate.cost = cost;
+  candidates_.push_back(candidate);
+  queue_.push(QueueElem(cost, static_cast<int32>(candidates_.size()) - 1));
+}
+
+bool CompactLatticeNbest::Next(CompactLattice *path, double *cost) {
+  path->DeleteStates();
+  if (queue_.empty())
+    return false;
+  int32 c = queue_.top().second;
+  queue_.pop();
+  // Note: we copy it because AddCandidate() may reallocate candidates_.
+  Candidate candidate = candidates_[c];
+  if (cost != NULL)
+    *cost = candidate.cost;
+
+  // The "sibling" of this candidate takes the next-best choice at the same
+  // state.
+  if (candidate.rank + 1 < NumChoices(candidate.state)) {
+    AddCandidate(candidate.parent, candidate.state, candidate.rank + 1,
+                 candidate.cost
+                 + GetChoice(candidate.state, candidate.rank + 1).delta
+                 - GetChoice(candidate.state, candidate.rank).delta);
+  }
+
+  // Work out the deviations that define this path, in order.
+  std::vector<int32> deviations;
+  for (int32 d = c; d != -1; d = candidates_[d].parent)
+    deviations.push_back(d);
+  std::reverse(deviations.begin(), deviations.end());
+
+  // Trace the path, and add a candidate for deviating at each state after the
+  // last deviation.
+  size_t next_deviation = 0;
+  StateId s = clat_->Start(), path_state = path->AddState();
+  path->SetStart(path_state);
+  while (true) {
+    int32 rank = 0;
+    if (next_deviation < deviations.size() &&
+        candidates_[deviations[next_deviation]].state == s) {
+      rank = candidates_[deviations[next_deviation]].rank;
+      next_deviation++;
+    } else if (next_deviation == deviations.size() && NumChoices(s) > 1) {
+      AddCandidate(c, s, 1, candidate.cost + GetChoice(s, 1).delta);
+    }
+    const Choice &choice = GetChoice(s, rank);
+    if (choice.arc_index == -1) {
+      path->SetFinal(path_state, clat_->Final(s));
+      break;
+    }
+    fst::ArcIterator<CompactLattice> aiter(*clat_, s);
+    aiter.Seek(choice.arc_index);
+    CompactLatticeArc arc = aiter.Value();
+    arc.nextstate = path->AddState();
+    path->AddArc(path_state, arc);
+    path_state = arc.nextstate;
+    s = choice.nextstate;
+  }
+  KALDI_ASSERT(next_deviation == deviations.size());
+  return true;
+}
+
+void CompactLatticeNbestAsFsts(const CompactLattice &clat, int32 n,
+                               double beam,
+                               std::vector<CompactLattice> *nbest) {
+  nbest->clear();
+  CompactLatticeNbest nbest_computer(clat, beam);
+  while (static_cast<int32>(nbest->size()) < n) {
+    nbest->resize(nbest->size() + 1);
+    if (!nbest_computer.Next(&(nbest->back()))) {
+      nbest->pop_back();
+      break;
+    }
+  }
+}
+
+}  // namespace kaldi
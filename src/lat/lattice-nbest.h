@@ -0,0 +1,131 @@
+// lat/lattice-nbest.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LAT_LATTICE_NBEST_H_
+#define KALDI_LAT_LATTICE_NBEST_H_
+
+#include <limits>
+#include <queue>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+/**
+   CompactLatticeNbest enumerates the paths through an acyclic CompactLattice
+   in order of increasing cost, one at a time, without expanding the lattice.
+   It is intended as a faster alternative to fst::ShortestPath() with
+   nshortest = n, which works on the (much larger) Lattice and has to keep
+   every partial path it creates; it is much faster for large n.
+
+   The algorithm is a lazy k-shortest-paths search in the style of Eppstein's
+   algorithm.  We first compute the best cost from each state to the end (the
+   "betas"), and at each state sort the arcs and the final-prob (the "choices")
+   by how much worse they are than the best choice.  A path is represented by
+   the choices at which it deviates from the best path, and each path we
+   output gives rise to a small number of candidates (its deviations at later
+   states, and its "sibling" that takes the next-best choice at its own
+   deviation point), which go into a priority queue; so the work per path is
+   about linear in its length.
+
+   As with fst::ShortestPath(), the paths are distinct but their word
+   sequences are only distinct if the lattice is deterministic.  The costs are
+   those given by ConvertToCost(), i.e. the sum of the graph and acoustic
+   costs, so apply any acoustic scale to the lattice first.
+*/
+class CompactLatticeNbest {
+ public:
+  typedef CompactLatticeArc::StateId StateId;
+
+  /// The lattice must be acyclic; it is topologically sorted first (on a copy)
+  /// if necessary.  It must not be changed or destroyed while this object
+  /// exists.  Paths whose cost is more than 'beam' worse than the best path
+  /// are not produced (and the candidates for them are not kept).
+  explicit CompactLatticeNbest(
+      const CompactLattice &clat,
+      double beam = std::numeric_limits<double>::infinity());
+
+  /// Outputs the next-best path as a linear CompactLattice, and its cost to
+  /// *cost if non-NULL.  Returns false if there are no more paths (within the
+  /// beam).
+  bool Next(CompactLattice *path, double *cost = NULL);
+
+  /// Returns the cost of the best path, or infinity if the lattice had no
+  /// successful path.
+  double BestCost() const { return best_cost_; }
+
+ private:
+  // A choice at a state: either an arc or the final-prob.
+  struct Choice {
+    int32 arc_index;  // index of the arc within the state, or -1 for final.
+    StateId nextstate;  // kNoStateId for the final-prob.
+    double delta;  // the extra cost vs. the best choice at this state (>= 0).
+  };
+  // A candidate path: it is the same as the path of 'parent' until it reaches
+  // 'state', where it takes choice number 'rank' (in sorted order), and from
+  // then on it takes the best choice at each state.
+  struct Candidate {
+    int32 parent;  // index into candidates_, or -1.
+    StateId state;
+    int32 rank;
+    double cost;
+  };
+
+  void ComputeChoices();
+
+  // Adds a candidate to candidates_ and queue_ if it is within the beam.
+  void AddCandidate(int32 parent, StateId state, int32 rank, double cost);
+
+  const Choice &GetChoice(StateId s, int32 rank) const {
+    return choices_[choice_begin_[s] + rank];
+  }
+  int32 NumChoices(StateId s) const {
+    return choice_begin_[s + 1] - choice_begin_[s];
+  }
+
+  CompactLattice sorted_clat_;  // used only if the input was not top-sorted.
+  const CompactLattice *clat_;
+  double beam_;
+  double best_cost_;
+
+  // The choices at state s are choices_[choice_begin_[s]] ...
+  // choices_[choice_begin_[s+1] - 1], sorted by delta.
+  std::vector<Choice> choices_;
+  std::vector<int32> choice_begin_;
+
+  std::vector<Candidate> candidates_;
+  // The queue of (cost, index into candidates_) that have not been output
+  // yet, lowest cost first.
+  typedef std::pair<double, int32> QueueElem;
+  std::priority_queue<QueueElem, std::vector<QueueElem>,
+                      std::greater<QueueElem> > queue_;
+};
+
+/// Outputs the n best paths through 'clat' (which must be acyclic), best
+/// first, as linear CompactLattices, stopping early if the cost of a path is
+/// more than 'beam' worse than the best.  The paths are distinct, but see the
+/// note about word sequences above CompactLatticeNbest.
+void CompactLatticeNbestAsFsts(const CompactLattice &clat, int32 n,
+                               double beam,
+                               std::vector<CompactLattice> *nbest);
+
+}  // namespace kaldi
+
+#endif  // KALDI_LAT_LATTICE_NBEST_H_
@@ -60,8 +60,9 @@ void MinimumBayesRisk::MbrDecode() {
       }
     }
     KALDI_VLOG(2) << "Iter = " << counter << ", delta-Q = " << delta_Q;
-    if (delta_Q == 0) break;
-    if (counter > 100) {
+    // delta_Q is zero if R_ did not change (apart from ties).
+    if (delta_Q == 0 || -delta_Q <= opts_.min_improvement) break;
+    if (counter + 1 >= opts_.max_iters) {
       KALDI_WARN << "Iterating too many times in MbrDecode; stopping.";
       break;
     }
@@ -99,6 +100,7 @@ double MinimumBayesRisk::EditDistance(int32 N, int32 Q,
   alpha_dash(1, 0) = 0.0; // Line 5.
   for (int32 q = 1; q <= Q; q++)
     alpha_dash(1, q) = alpha_dash(1, q-1) + l(0, r(q)); // Line 7.
+  double *alpha_dash_arc_data = alpha_dash_arc.Data();
   for (int32 n = 2; n <= N; n++) {
     double alpha_n = kLogZeroDouble;
     for (size_t i = 0; i < pre_[n].size(); i++) {
@@ -107,23 +109,27 @@ double MinimumBayesRisk::EditDistance(int32 N, int32 Q,
     }
     alpha(n) = alpha_n; // Line 10.
     // Line 11 omitted: matrix was initialized to zero.
+    double *alpha_dash_n = alpha_dash.RowData(n);
     for (size_t i = 0; i < pre_[n].size(); i++) {
       const Arc &arc = arcs_[pre_[n][i]];
       int32 s_a = arc.start_node, w_a = arc.word;
       BaseFloat p_a = arc.loglike;
-      for (int32 q = 0; q <= Q; q++) {
-        if (q == 0) {
-          alpha_dash_arc(q) = // line 15.
-              alpha_dash(s_a, q) + l(w_a, 0, true);
-        } else {  // a1,a2,a3 are the 3 parts of min expression of line 17.
-          int32 r_q = r(q);
-          double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
-              a2 = alpha_dash(s_a, q) + l(w_a, 0, true),
-              a3 = alpha_dash_arc(q-1) + l(0, r_q);
-          alpha_dash_arc(q) = std::min(a1, std::min(a2, a3));
-        }
+      const double *alpha_dash_s = alpha_dash.RowData(s_a);
+      // The probability of the arc given state n, as in line 19; and the
+      // cost of w_a versus epsilon.
+      double arc_prob = Exp(alpha(s_a) + p_a - alpha(n)),
+          eps_cost = l(w_a, 0, true);
+      alpha_dash_arc_data[0] = alpha_dash_s[0] + eps_cost; // line 15.
+      alpha_dash_n[0] += arc_prob * alpha_dash_arc_data[0];
+      for (int32 q = 1; q <= Q; q++) {
+        // a1,a2,a3 are the 3 parts of min expression of line 17.
+        int32 r_q = r(q);
+        double a1 = alpha_dash_s[q-1] + l(w_a, r_q),
+            a2 = alpha_dash_s[q] + eps_cost,
+            a3 = alpha_dash_arc_data[q-1] + l(0, r_q);
+        alpha_dash_arc_data[q] = std::min(a1, std::min(a2, a3));
         // line 19:
-        alpha_dash(n, q) += Exp(alpha(s_a) + p_a - alpha(n)) * alpha_dash_arc(q);
+        alpha_dash_n[q] += arc_prob * alpha_dash_arc_data[q];
       }
     }
   }
@@ -132,8 +138,6 @@ double MinimumBayesRisk::EditDistance(int32 N, int32 Q,
 
 // Figure 5 in the paper.
 void MinimumBayesRisk::AccStats() {
-  using std::map;
-
   int32 N = static_cast<int32>(pre_.size()) - 1,
       Q = static_cast<int32>(R_.size());
 
@@ -143,8 +147,9 @@ void MinimumBayesRisk::AccStats() {
   Matrix<double> beta_dash(N+1, Q+1); // index (1...N, 0...Q)
   Vector<double> beta_dash_arc(Q+1); // index 0...Q
   std::vector<char> b_arc(Q+1); // integer in {1,2,3}; index 1...Q
-  std::vector<map<int32, double> > gamma(Q+1); // temp. form of gamma.
-  // index 1...Q [word] -> occ.
+  std::vector<std::vector<std::pair<int32, double> > > gamma(Q+1);
+  // temp. form of gamma: index 1...Q, (word, occ) pairs in no particular
+  // order.
 
   // The tau arrays below are the sums over words of the tau_b
   // and tau_e timing quantities mentioned in Appendix C of
@@ -161,65 +166,72 @@ void MinimumBayesRisk::AccStats() {
   KALDI_VLOG(2) << "L = " << L_;
   // omit line 10: zero when initialized.
   beta_dash(N, Q) = 1.0; // Line 11.
+  double *alpha_dash_arc_data = alpha_dash_arc.Data(),
+      *beta_dash_arc_data = beta_dash_arc.Data();
   for (int32 n = N; n >= 2; n--) {
+    const double *beta_dash_n = beta_dash.RowData(n);
     for (size_t i = 0; i < pre_[n].size(); i++) {
       const Arc &arc = arcs_[pre_[n][i]];
       int32 s_a = arc.start_node, w_a = arc.word;
       BaseFloat p_a = arc.loglike;
-      alpha_dash_arc(0) = alpha_dash(s_a, 0) + l(w_a, 0, true); // line 14.
+      const double *alpha_dash_s = alpha_dash.RowData(s_a);
+      double *beta_dash_s = beta_dash.RowData(s_a);
+      double arc_prob = Exp(alpha(s_a) + p_a - alpha(n)),
+          eps_cost = l(w_a, 0, true);
+      alpha_dash_arc_data[0] = alpha_dash_s[0] + eps_cost; // line 14.
       for (int32 q = 1; q <= Q; q++) { // this loop == lines 15-18.
         int32 r_q = r(q);
-        double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
-            a2 = alpha_dash(s_a, q) + l(w_a, 0, true),
-            a3 = alpha_dash_arc(q-1) + l(0, r_q);
+        double a1 = alpha_dash_s[q-1] + l(w_a, r_q),
+            a2 = alpha_dash_s[q] + eps_cost,
+            a3 = alpha_dash_arc_data[q-1] + l(0, r_q);
         if (a1 <= a2) {
-          if (a1 <= a3) { b_arc[q] = 1; alpha_dash_arc(q) = a1; }
-          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
+          if (a1 <= a3) { b_arc[q] = 1; alpha_dash_arc_data[q] = a1; }
+          else { b_arc[q] = 3; alpha_dash_arc_data[q] = a3; }
         } else {
-          if (a2 <= a3) { b_arc[q] = 2; alpha_dash_arc(q) = a2; }
-          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
+          if (a2 <= a3) { b_arc[q] = 2; alpha_dash_arc_data[q] = a2; }
+          else { b_arc[q] = 3; alpha_dash_arc_data[q] = a3; }
         }
       }
       beta_dash_arc.SetZero(); // line 19.
       for (int32 q = Q; q >= 1; q--) {
         // line 21:
-        beta_dash_arc(q) += Exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, q);
+        beta_dash_arc_data[q] += arc_prob * beta_dash_n[q];
         switch (static_cast<int>(b_arc[q])) { // lines 22 and 23:
           case 1:
-            beta_dash(s_a, q-1) += beta_dash_arc(q);
+            beta_dash_s[q-1] += beta_dash_arc_data[q];
             // next: gamma(q, w(a)) += beta_dash_arc(q)
-            AddToMap(w_a, beta_dash_arc(q), &(gamma[q]));
+            AddToGamma(w_a, beta_dash_arc_data[q], &(gamma[q]));
             // next: accumulating times, see decl for tau_b,tau_e
-            tau_b(q) += state_times_[s_a] * beta_dash_arc(q);
-            tau_e(q) += state_times_[n] * beta_dash_arc(q);
+            tau_b(q) += state_times_[s_a] * beta_dash_arc_data[q];
+            tau_e(q) += state_times_[n] * beta_dash_arc_data[q];
             break;
           case 2:
-            beta_dash(s_a, q) += beta_dash_arc(q);
+            beta_dash_s[q] += beta_dash_arc_data[q];
             break;
           case 3:
-            beta_dash_arc(q-1) += beta_dash_arc(q);
+            beta_dash_arc_data[q-1] += beta_dash_arc_data[q];
             // next: gamma(q, epsilon) += beta_dash_arc(q)
-            AddToMap(0, beta_dash_arc(q), &(gamma[q]));
+            AddToGamma(0, beta_dash_arc_data[q], &(gamma[q]));
             // next: accumulating times, see decl for tau_b,tau_e
             // WARNING: there was an error in Appendix C.  If we followed
             // the instructions there the next line would say state_times_[sa], but
             // it would be wrong.  I will try to publish an erratum.
-            tau_b(q) += state_times_[n] * beta_dash_arc(q);
-            tau_e(q) += state_times_[n] * beta_dash_arc(q);
+            tau_b(q) += state_times_[n] * beta_dash_arc_data[q];
+            tau_e(q) += state_times_[n] * beta_dash_arc_data[q];
             break;
           default:
             KALDI_ERR << "Invalid b_arc value"; // error in code.
         }
       }
-      beta_dash_arc(0) += Exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, 0);
-      beta_dash(s_a, 0) += beta_dash_arc(0); // line 26.
+      beta_dash_arc_data[0] += arc_prob * beta_dash_n[0];
+      beta_dash_s[0] += beta_dash_arc_data[0]; // line 26.
     }
   }
   beta_dash_arc.SetZero(); // line 29.
   for (int32 q = Q; q >= 1; q--) {
     beta_dash_arc(q) += beta_dash(1, q);
     beta_dash_arc(q-1) += beta_dash_arc(q);
-    AddToMap(0, beta_dash_arc(q), &(gamma[q]));
+    AddToGamma(0, beta_dash_arc(q), &(gamma[q]));
     // the statements below are actually redundant because
     // state_times_[1] is zero.
     tau_b(q) += state_times_[1] * beta_dash_arc(q);
@@ -227,8 +239,8 @@ void MinimumBayesRisk::AccStats() {
   }
   for (int32 q = 1; q <= Q; q++) { // a check (line 35)
     double sum = 0.0;
-    for (map<int32, double>::iterator iter = gamma[q].begin();
-         iter != gamma[q].end(); ++iter) sum += iter->second;
+    for (size_t j = 0; j < gamma[q].size(); j++)
+      sum += gamma[q][j].second;
     if (fabs(sum - 1.0) > 0.1)
       KALDI_WARN << "sum of gamma[" << q << ",s] is " << sum;
   }
@@ -238,9 +250,9 @@ void MinimumBayesRisk::AccStats() {
   gamma_.clear();
   gamma_.resize(Q);
   for (int32 q = 1; q <= Q; q++) {
-    for (map<int32, double>::iterator iter = gamma[q].begin();
-         iter != gamma[q].end(); ++iter)
-      gamma_[q-1].push_back(std::make_pair(iter->first, static_cast<BaseFloat>(iter->second)));
+    for (size_t j = 0; j < gamma[q].size(); j++)
+      gamma_[q-1].push_back(std::make_pair(gamma[q][j].first,
+                                           static_cast<BaseFloat>(gamma[q][j].second)));
     // sort gamma_[q-1] from largest to smallest posterior.
     GammaCompare comp;
     std::sort(gamma_[q-1].begin(), gamma_[q-1].end(), comp);
@@ -23,7 +23,6 @@
 #define KALDI_LAT_SAUSAGES_H_
 
 #include <vector>
-#include <map>
 
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
@@ -60,13 +59,29 @@ struct MinimumBayesRiskOptions {
   /// Boolean configuration parameter: if true, the 1-best path will 'keep' the <eps> bins,
   bool print_silence;
 
-  MinimumBayesRiskOptions() : decode_mbr(true), print_silence(false)
+  /// The maximum number of iterations of MBR decoding, each of which
+  /// recomputes the stats for the current hypothesis.  It normally converges
+  /// in a few iterations.
+  int32 max_iters;
+  /// We stop iterating when the bound on the reduction in expected errors
+  /// from updating the hypothesis is no more than this (zero means, until the
+  /// hypothesis stops changing).
+  BaseFloat min_improvement;
+
+  MinimumBayesRiskOptions() : decode_mbr(true), print_silence(false),
+                              max_iters(100), min_improvement(0.0)
   { }
   void Register(OptionsItf *opts) {
     opts->Register("decode-mbr", &decode_mbr, "If true, do Minimum Bayes Risk "
                    "decoding (else, Maximum a Posteriori)");
     opts->Register("print-silence", &print_silence, "Keep the inter-word '<eps>' "
                    "bins in the 1-best output (ctm, <eps> can be a 'silence' or a 'deleted' word)");
+    opts->Register("mbr-max-iters", &max_iters, "Maximum number of iterations "
+                   "of MBR decoding");
+    opts->Register("mbr-min-improvement", &min_improvement, "Stop iterating "
+                   "MBR decoding when the expected reduction in word errors "
+                   "from an iteration is no more than this (e.g. 0.01 would "
+                   "save time on long utterances)");
   }
 };
 
@@ -170,13 +185,20 @@ class MinimumBayesRisk {
   static inline BaseFloat delta() { return 1.0e-05; }
 
 
-  /// Function used to increment map.
-  static inline void AddToMap(int32 i, double d, std::map<int32, double> *gamma) {
+  /// Function used to increment the stats for one position in AccStats().
+  /// There are normally only a few distinct words in each position, so a
+  /// linear search is faster than a map.
+  static inline void AddToGamma(int32 i, double d,
+                                std::vector<std::pair<int32, double> > *gamma) {
     if (d == 0) return;
-    std::pair<const int32, double> pr(i, d);
-    std::pair<std::map<int32, double>::iterator, bool> ret = gamma->insert(pr);
-    if (!ret.second) // not inserted, so add to contents.
-      ret.first->second += d;
+    for (std::vector<std::pair<int32, double> >::iterator iter = gamma->begin();
+         iter != gamma->end(); ++iter) {
+      if (iter->first == i) {
+        iter->second += d;
+        return;
+      }
+    }
+    gamma->push_back(std::pair<int32, double>(i, d));
   }
 
   struct Arc {
@@ -207,6 +207,7 @@ void TestWordAlignLatticeLexicon() {
                      // do this.
   opts.allow_duplicate_paths = true;
   opts.reorder = reorder;
+  opts.streaming_opts.streaming = (RandInt(0, 1) == 0);
   CompactLattice aligned_clat;
   bool ans = WordAlignLatticeLexicon(clat, *trans_model, lexicon_info, opts,
                                      &aligned_clat);
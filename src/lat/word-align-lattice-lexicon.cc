@@ -129,6 +129,17 @@ class LatticeLexiconWordAligner {
       return ans;
     }
 
+    // Returns the approximate number of bytes of memory used by this object
+    // (including the contents of its vectors).
+    size_t MemoryUsage() const {
+      size_t ans = sizeof(*this) +
+          sizeof(int32) * (phones_.size() + words_.size());
+      for (size_t i = 0; i < transition_ids_.size(); i++)
+        ans += sizeof(transition_ids_[i]) +
+            sizeof(int32) * transition_ids_[i].size();
+      return ans;
+    }
+
     bool operator == (const ComputationState &other) const {
       // phones_ is determined by transition-id sequence so don't
       // need to compare it.
@@ -200,13 +211,32 @@ class LatticeLexiconWordAligner {
     if (iter == map_.end()) { // not in map.
       StateId output_state = lat_out_->AddState();
       map_[tuple] = output_state;
-      queue_.push_back(std::make_pair(tuple, output_state));
+      mem_used_ += TupleMemoryUsage(tuple);
+      if (!pending_.empty() && tuple.input_state != cur_input_state_)
+        pending_[tuple.input_state].push_back(
+            std::make_pair(tuple, output_state));
+      else
+        queue_.push_back(std::make_pair(tuple, output_state));
       return output_state;
     } else {
       return iter->second;
     }
   }
 
+  // Returns the approximate memory used by a tuple and its entry in map_ (we
+  // don't separately count the copy in queue_ or pending_).
+  static size_t TupleMemoryUsage(const Tuple &tuple) {
+    return tuple.comp_state.MemoryUsage() + sizeof(StateId) +
+        2 * sizeof(void*);  // the last term is for the hash-table node.
+  }
+
+  // Removes 'tuple' from map_; used in streaming mode once we know it can't be
+  // reached again.
+  void ReleaseTuple(const Tuple &tuple) {
+    if (map_.erase(tuple) != 0)
+      mem_used_ -= TupleMemoryUsage(tuple);
+  }
+
   // This function may alter queue_, via GetStateForTuple.
   void ProcessTransition(StateId prev_output_state, // state-id of from-state in output lattice
                          const Tuple &next_tuple,
@@ -287,10 +317,12 @@ class LatticeLexiconWordAligner {
                             const WordAlignLatticeLexiconInfo &lexicon_info,
                             int32 max_states,
                             int32 partial_word_label,
+                            const WordAlignStreamingOpts &streaming_opts,
                             CompactLattice *lat_out):
       lat_in_(lat), tmodel_(tmodel), lexicon_info_(lexicon_info),
-      max_states_(max_states),
-      lat_out_(lat_out),
+      max_states_(max_states), streaming_(streaming_opts.streaming),
+      max_mem_(static_cast<int64>(streaming_opts.max_mem_mb) << 20),
+      lat_out_(lat_out), cur_input_state_(fst::kNoStateId), mem_used_(0),
       partial_word_label_(partial_word_label == 0 ?
                           kTemporaryEpsilon : partial_word_label),
       error_(false) {
@@ -299,6 +331,13 @@ class LatticeLexiconWordAligner {
     fst::CreateSuperFinal(&lat_in_); // Creates a super-final state, so the
     // only final-probs are One().  Note: the member lat_in_ is not a reference.
 
+    if (streaming_ && lat_in_.Properties(fst::kTopSorted, true) == 0) {
+      if (!TopSort(&lat_in_)) {
+        KALDI_WARN << "Lattice is cyclic, not using streaming mode for "
+                   << "word alignment.";
+        streaming_ = false;
+      }
+    }
   }
 
   // Removes epsilons; also removes unreachable states...
@@ -325,15 +364,19 @@ class LatticeLexiconWordAligner {
     StateId start_state = GetStateForTuple(initial_tuple);
     lat_out_->SetStart(start_state);
 
-    while (!queue_.empty()) {
-      if (max_states_ > 0 && lat_out_->NumStates() > max_states_) {
-        KALDI_WARN << "Number of states in lattice exceeded max-states of "
-                   << max_states_ << ", original lattice had "
-                   << lat_in_.NumStates() << " states.  Returning empty lattice.";
+    if (streaming_) {
+      if (!ProcessQueueInOrder()) {
         lat_out_->DeleteStates();
         return false;
       }
-      ProcessQueueElement();
+    } else {
+      while (!queue_.empty()) {
+        if (ExceededLimits()) {
+          lat_out_->DeleteStates();
+          return false;
+        }
+        ProcessQueueElement();
+      }
     }
     ProcessFinalWrapper();
 
@@ -342,19 +385,81 @@ class LatticeLexiconWordAligner {
     return !error_;
   }
 
+  // Returns true (and warns) if we have exceeded max_states_ or max_mem_.
+  bool ExceededLimits() const {
+    if (max_states_ > 0 && lat_out_->NumStates() > max_states_) {
+      KALDI_WARN << "Number of states in lattice exceeded max-states of "
+                 << max_states_ << ", original lattice had "
+                 << lat_in_.NumStates() << " states.  Returning empty lattice.";
+      return true;
+    }
+    if (max_mem_ > 0 && mem_used_ > max_mem_) {
+      KALDI_WARN << "Memory used in word alignment exceeded max-mem-mb of "
+                 << (max_mem_ >> 20) << ", original lattice had "
+                 << lat_in_.NumStates() << " states.  Returning empty lattice.";
+      return true;
+    }
+    return false;
+  }
+
+  // This is used instead of the simple loop in AlignLattice() if
+  // streaming_ == true.  Because lat_in_ is topologically sorted, processing a
+  // tuple only ever creates tuples whose input-state is the same or later; so
+  // if we process the input-states in order, once we have finished with
+  // input-state s no tuple with that input-state can be reached again, and we
+  // can remove those tuples from map_.  While we are processing input-state
+  // s, queue_ contains the tuples for s and pending_[t] those for each t > s.
+  // Returns false if we exceeded the limits.
+  bool ProcessQueueInOrder() {
+    StateId num_states = lat_in_.NumStates();
+    pending_.resize(num_states);
+    KALDI_ASSERT(queue_.size() == 1);
+    pending_[lat_in_.Start()].swap(queue_);
+    std::vector<Tuple> done;  // the tuples processed for this input-state.
+    for (cur_input_state_ = 0; cur_input_state_ < num_states;
+         cur_input_state_++) {
+      queue_.swap(pending_[cur_input_state_]);
+      std::vector<std::pair<Tuple, StateId> >().swap(
+          pending_[cur_input_state_]);
+      while (!queue_.empty()) {
+        if (ExceededLimits())
+          return false;
+        done.push_back(queue_.back().first);
+        ProcessQueueElement();
+      }
+      // We keep the tuples for the final state, as ProcessFinalForceOut()
+      // may need to look them up.
+      if (lat_in_.Final(cur_input_state_) == CompactLatticeWeight::Zero())
+        for (size_t i = 0; i < done.size(); i++)
+          ReleaseTuple(done[i]);
+      done.clear();
+    }
+    pending_.clear();  // from now on GetStateForTuple() adds to queue_.
+    return true;
+  }
+
   CompactLattice lat_in_;
   const TransitionModel &tmodel_;
   const WordAlignLatticeLexiconInfo &lexicon_info_;
   int32 max_states_;
+  bool streaming_;
+  int64 max_mem_;  // in bytes.
   CompactLattice *lat_out_;
 
   std::vector<std::pair<Tuple, StateId> > queue_;
 
+  // Used only if streaming_ == true: the tuples waiting to be processed,
+  // indexed by input-state (excluding cur_input_state_, whose tuples are in
+  // queue_).
+  std::vector<std::vector<std::pair<Tuple, StateId> > > pending_;
+  StateId cur_input_state_;
+
   std::vector<std::pair<Tuple, StateId> > final_queue_; // as queue_, but
   // just contains states that may have final-probs to process.  We process these
   // all at once, at the end.
 
   MapType map_; // map from tuples to StateId.
+  int64 mem_used_;  // approximate memory used by map_.
   int32 partial_word_label_;
   bool error_;
 };
@@ -1034,7 +1139,8 @@ bool WordAlignLatticeLexicon(const CompactLattice &lat,
   // If ans == false, we hope this is due to a forced-out lattice, and we try to
   // continue.
   LatticeLexiconWordAligner aligner(phone_aligned_lat, tmodel, lexicon_info,
-                                    max_states, opts.partial_word_label, lat_out);
+                                    max_states, opts.partial_word_label,
+                                    opts.streaming_opts, lat_out);
   // We'll let the calling code warn if this is false; it will know the utterance-id.
   ans = aligner.AlignLattice() && ans;
   if (ans && opts.test) { // We only test if it succeeded.
@@ -27,6 +27,7 @@
 #include "fstext/fstext-lib.h"
 #include "hmm/transition-model.h"
 #include "lat/kaldi-lattice.h"
+#include "lat/word-align-lattice.h"
 
 namespace kaldi {
 
@@ -123,6 +124,7 @@ struct WordAlignLatticeLexiconOpts {
   bool test;
   bool allow_duplicate_paths;
   BaseFloat max_expand;
+  WordAlignStreamingOpts streaming_opts;
 
   WordAlignLatticeLexiconOpts(): partial_word_label(0), reorder(true),
                                  test(false), allow_duplicate_paths(false),
@@ -150,6 +152,7 @@ struct WordAlignLatticeLexiconOpts {
                    "prevent 'pathological' lattices from causing the program to "
                    "exhaust memory.  Actual max-states is 1000 + max-expand * "
                    "orig-num-states.");
+    streaming_opts.Register(opts);
   }
 };
 
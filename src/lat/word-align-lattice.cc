@@ -115,6 +115,13 @@ class LatticeWordAligner {
       // efficiency issue.
     }
 
+    // Returns the approximate number of bytes of memory used by this object
+    // (including the contents of its vectors).
+    size_t MemoryUsage() const {
+      return sizeof(*this) +
+          sizeof(int32) * (transition_ids_.size() + word_labels_.size());
+    }
+
     // Just need an arbitrary complete order.
     bool operator == (const ComputationState &other) const {
       return (transition_ids_ == other.transition_ids_
@@ -161,14 +168,34 @@ class LatticeWordAligner {
     if (iter == map_.end()) { // not in map.
       StateId output_state = lat_out_->AddState();
       map_[tuple] = output_state;
-      if (add_to_queue)
-        queue_.push_back(std::make_pair(tuple, output_state));
+      mem_used_ += TupleMemoryUsage(tuple);
+      if (add_to_queue) {
+        if (!pending_.empty() && tuple.input_state != cur_input_state_)
+          pending_[tuple.input_state].push_back(
+              std::make_pair(tuple, output_state));
+        else
+          queue_.push_back(std::make_pair(tuple, output_state));
+      }
       return output_state;
     } else {
       return iter->second;
     }
   }
 
+  // Returns the approximate memory used by a tuple and its entry in map_ (we
+  // don't separately count the copy in queue_ or pending_).
+  static size_t TupleMemoryUsage(const Tuple &tuple) {
+    return tuple.comp_state.MemoryUsage() + sizeof(StateId) +
+        2 * sizeof(void*);  // the last term is for the hash-table node.
+  }
+
+  // Removes 'tuple' from map_; used in streaming mode once we know it can't be
+  // reached again.
+  void ReleaseTuple(const Tuple &tuple) {
+    if (map_.erase(tuple) != 0)
+      mem_used_ -= TupleMemoryUsage(tuple);
+  }
+
   void ProcessFinal(Tuple tuple, StateId output_state) {
     // ProcessFinal is only called if the input_state has
     // final-prob of One().  [else it should be zero.  This
@@ -253,10 +280,13 @@ class LatticeWordAligner {
                      const TransitionModel &tmodel,
                      const WordBoundaryInfo &info,
                      int32 max_states,
+                     const WordAlignStreamingOpts &streaming_opts,
                      CompactLattice *lat_out):
       lat_(lat), tmodel_(tmodel), info_in_(info), info_(info),
-      max_states_(max_states), lat_out_(lat_out),
-      error_(false) {
+      max_states_(max_states), streaming_(streaming_opts.streaming),
+      max_mem_(static_cast<int64>(streaming_opts.max_mem_mb) << 20),
+      lat_out_(lat_out),
+      cur_input_state_(fst::kNoStateId), mem_used_(0), error_(false) {
     bool test = true;
     uint64 props = lat_.Properties(fst::kIDeterministic|fst::kIEpsilons, test);
     if (props != fst::kIDeterministic) {
@@ -266,6 +296,13 @@ class LatticeWordAligner {
     }
     fst::CreateSuperFinal(&lat_); // Creates a super-final state, so the
     // only final-probs are One().
+    if (streaming_ && lat_.Properties(fst::kTopSorted, true) == 0) {
+      if (!TopSort(&lat_)) {
+        KALDI_WARN << "Lattice is cyclic, not using streaming mode for "
+                   << "word alignment.";
+        streaming_ = false;
+      }
+    }
 
     // Inside this class, we don't want to use zero for the silence
     // or partial-word labels, as this will interfere with the RmEpsilon
@@ -315,15 +352,19 @@ class LatticeWordAligner {
     StateId start_state = GetStateForTuple(initial_tuple, true); // True = add this to queue.
     lat_out_->SetStart(start_state);
 
-    while (!queue_.empty()) {
-      if (max_states_ > 0 && lat_out_->NumStates() > max_states_) {
-        KALDI_WARN << "Number of states in lattice exceeded max-states of "
-                   << max_states_ << ", original lattice had "
-                   << lat_.NumStates() << " states.  Returning what we have.";
+    if (streaming_) {
+      if (!ProcessQueueInOrder()) {
         RemoveEpsilonsFromLattice();
         return false;
       }
-      ProcessQueueElement();
+    } else {
+      while (!queue_.empty()) {
+        if (ExceededLimits()) {
+          RemoveEpsilonsFromLattice();
+          return false;
+        }
+        ProcessQueueElement();
+      }
     }
 
     RemoveEpsilonsFromLattice();
@@ -331,18 +372,78 @@ class LatticeWordAligner {
     return !error_;
   }
 
+  // Returns true (and warns) if we have exceeded max_states_ or max_mem_.
+  bool ExceededLimits() const {
+    if (max_states_ > 0 && lat_out_->NumStates() > max_states_) {
+      KALDI_WARN << "Number of states in lattice exceeded max-states of "
+                 << max_states_ << ", original lattice had "
+                 << lat_.NumStates() << " states.  Returning what we have.";
+      return true;
+    }
+    if (max_mem_ > 0 && mem_used_ > max_mem_) {
+      KALDI_WARN << "Memory used in word alignment exceeded max-mem-mb of "
+                 << (max_mem_ >> 20) << ", original lattice had "
+                 << lat_.NumStates() << " states.  Returning what we have.";
+      return true;
+    }
+    return false;
+  }
+
+  // This is used instead of the simple loop in AlignLattice() if
+  // streaming_ == true.  Because lat_ is topologically sorted, processing a
+  // tuple only ever creates tuples whose input-state is the same or later; so
+  // if we process the input-states in order, once we have finished with
+  // input-state s no tuple with that input-state can be reached again, and we
+  // can remove those tuples from map_.  While we are processing input-state
+  // s, queue_ contains the tuples for s and pending_[t] those for each t > s.
+  // Returns false if we exceeded the limits.
+  bool ProcessQueueInOrder() {
+    StateId num_states = lat_.NumStates();
+    pending_.resize(num_states);
+    KALDI_ASSERT(queue_.size() == 1);
+    pending_[lat_.Start()].swap(queue_);
+    std::vector<Tuple> done;  // the tuples processed for this input-state.
+    for (cur_input_state_ = 0; cur_input_state_ < num_states;
+         cur_input_state_++) {
+      queue_.swap(pending_[cur_input_state_]);
+      std::vector<std::pair<Tuple, StateId> >().swap(
+          pending_[cur_input_state_]);
+      while (!queue_.empty()) {
+        if (ExceededLimits())
+          return false;
+        done.push_back(queue_.back().first);
+        ProcessQueueElement();
+      }
+      // Nothing after this point can look these tuples up (this includes
+      // the super-final state, as ProcessFinal() is called directly from
+      // ProcessQueueElement()).
+      for (size_t i = 0; i < done.size(); i++)
+        ReleaseTuple(done[i]);
+      done.clear();
+    }
+    pending_.clear();
+    return true;
+  }
+
   CompactLattice lat_;
   const TransitionModel &tmodel_;
   const WordBoundaryInfo &info_in_;
   WordBoundaryInfo info_;
   int32 max_states_;
+  bool streaming_;
+  int64 max_mem_;  // in bytes.
   CompactLattice *lat_out_;
 
   std::vector<std::pair<Tuple, StateId> > queue_;
 
-
+  // Used only if streaming_ == true: the tuples waiting to be processed,
+  // indexed by input-state (excluding cur_input_state_, whose tuples are in
+  // queue_).
+  std::vector<std::vector<std::pair<Tuple, StateId> > > pending_;
+  StateId cur_input_state_;
 
   MapType map_; // map from tuples to StateId.
+  int64 mem_used_;  // approximate memory used by map_.
   bool error_;
 
 };
@@ -725,7 +826,18 @@ bool WordAlignLattice(const CompactLattice &lat,
                       const WordBoundaryInfo &info,
                       int32 max_states,
                       CompactLattice *lat_out) {
-  LatticeWordAligner aligner(lat, tmodel, info, max_states, lat_out);
+  return WordAlignLattice(lat, tmodel, info, max_states,
+                          WordAlignStreamingOpts(), lat_out);
+}
+
+bool WordAlignLattice(const CompactLattice &lat,
+                      const TransitionModel &tmodel,
+                      const WordBoundaryInfo &info,
+                      int32 max_states,
+                      const WordAlignStreamingOpts &streaming_opts,
+                      CompactLattice *lat_out) {
+  LatticeWordAligner aligner(lat, tmodel, info, max_states, streaming_opts,
+                             lat_out);
   return aligner.AlignLattice();
 }
 
@@ -168,6 +168,40 @@ struct WordBoundaryInfo {
   void SetOptions(const std::string int_list, PhoneType phone_type);
 };
 
+/// Options for the bounded-memory mode of word alignment, which is intended
+/// for very long lattices (e.g. an hour of audio decoded as one utterance).
+/// By default the word-alignment code expands the lattice depth-first and
+/// remembers every state it has created, keyed by the pending transition-ids
+/// and words, until it finishes; this can take gigabytes for long lattices.
+/// With --streaming=true it instead processes the states of the
+/// (topologically sorted) input lattice in order, which roughly corresponds to
+/// processing it in order of time, and forgets the states belonging to the
+/// input states it has finished with, so the memory used for the computation
+/// is proportional to the "width" of the lattice rather than its length.  The
+/// output is equivalent either way (but the state numbering may differ).
+/// These options are used both by WordAlignLattice() and (as part of
+/// WordAlignLatticeLexiconOpts) by WordAlignLatticeLexicon().
+struct WordAlignStreamingOpts {
+  bool streaming;
+  int32 max_mem_mb;
+
+  WordAlignStreamingOpts(): streaming(false), max_mem_mb(0) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("streaming", &streaming, "If true, use the bounded-memory "
+                   "version of word alignment, which processes the lattice in "
+                   "order of time and frees the parts of the computation it has "
+                   "finished with.  Recommended for very long lattices.");
+    opts->Register("max-mem-mb", &max_mem_mb, "If >0, the approximate "
+                   "maximum memory in megabytes that word alignment may use "
+                   "for its computation states (not counting the input and "
+                   "output lattices) before giving up on the lattice, as for "
+                   "--max-expand.  Mainly useful with --streaming=true, where "
+                   "the memory used does not grow with the length of the "
+                   "lattice.");
+  }
+};
+
 /// Align lattice so that each arc has the transition-ids on it
 /// that correspond to the word that is on that arc.  [May also have
 /// epsilon arcs for optional silences.]
@@ -194,6 +228,17 @@ bool WordAlignLattice(const CompactLattice &lat,
                       int32 max_states,
                       CompactLattice *lat_out);
 
+/// As WordAlignLattice() above, but with options for the bounded-memory mode;
+/// see WordAlignStreamingOpts.  If streaming_opts.max_mem_mb > 0 and the
+/// computation uses more than about that many megabytes, it is abandoned in
+/// the same way as when it exceeds max_states.
+bool WordAlignLattice(const CompactLattice &lat,
+                      const TransitionModel &tmodel,
+                      const WordBoundaryInfo &info,
+                      int32 max_states,
+                      const WordAlignStreamingOpts &streaming_opts,
+                      CompactLattice *lat_out);
+
 
 
 /// This function is designed to crash if something went wrong with the
@@ -0,0 +1,127 @@
+// latbin/benchmark-lattice-determinize.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-utils.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/determinize-lattice-pruned.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Measure the speed of pruned lattice determinization, as done at the\n"
+        "end of decoding, on raw (undeterminized) lattices such as those\n"
+        "written by the decoders with --determinize-lattice=false.  All the\n"
+        "lattices are read into memory first, and only the determinization\n"
+        "is timed.  The --phone-determinize and --word-determinize options\n"
+        "are as for lattice-determinize-phone-pruned.\n"
+        "Usage: benchmark-lattice-determinize [options] <model> "
+        "<lattice-rspecifier>\n"
+        "e.g.: benchmark-lattice-determinize --acoustic-scale=0.1 --beam=8 \\\n"
+        "   final.mdl ark:raw_lat.ark\n";
+    ParseOptions po(usage);
+    BaseFloat acoustic_scale = 1.0;
+    BaseFloat beam = 8.0;
+    int32 num_repeats = 1;
+    fst::DeterminizeLatticePhonePrunedOptions opts;
+
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for "
+                "acoustic likelihoods.");
+    po.Register("beam", &beam, "Pruning beam [applied after acoustic "
+                "scaling].");
+    po.Register("num-repeats", &num_repeats,
+                "Number of times to determinize the lattices");
+    opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Do not use a zero acoustic scale";
+    KALDI_ASSERT(num_repeats > 0);
+
+    std::string model_rxfilename = po.GetArg(1),
+        lats_rspecifier = po.GetArg(2);
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_rxfilename, &trans_model);
+
+    std::vector<Lattice> lats;
+    int64 num_states_in = 0, num_arcs_in = 0;
+    SequentialLatticeReader lat_reader(lats_rspecifier);
+    for (; !lat_reader.Done(); lat_reader.Next()) {
+      lats.resize(lats.size() + 1);
+      lats.back() = lat_reader.Value();
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale),
+                        &(lats.back()));
+      num_states_in += lats.back().NumStates();
+      num_arcs_in += fst::NumArcs(lats.back());
+    }
+    if (lats.empty())
+      KALDI_ERR << "No lattices read from " << lats_rspecifier;
+
+    double elapsed = 0.0;
+    int64 num_states_out = 0, num_arcs_out = 0;
+    int32 num_fail = 0;
+    for (int32 r = 0; r < num_repeats; r++) {
+      for (size_t i = 0; i < lats.size(); i++) {
+        // The determinization destroys its input.
+        Lattice lat(lats[i]);
+        CompactLattice clat;
+        Timer timer;
+        bool ans = DeterminizeLatticePhonePrunedWrapper(
+            trans_model, &lat, beam, &clat, opts);
+        elapsed += timer.Elapsed();
+        if (r == 0) {
+          if (!ans)
+            num_fail++;
+          num_states_out += clat.NumStates();
+          num_arcs_out += fst::NumArcs(clat);
+        }
+      }
+    }
+
+    int64 num_lats = lats.size() * static_cast<int64>(num_repeats);
+    KALDI_LOG << "Determinized " << num_lats << " lattices in " << elapsed
+              << " seconds: " << (num_lats / elapsed) << " lattices/sec, "
+              << (num_arcs_in * num_repeats / elapsed)
+              << " input arcs/sec.";
+    KALDI_LOG << "Input lattices had " << num_states_in << " states and "
+              << num_arcs_in << " arcs; determinized lattices had "
+              << num_states_out << " states and " << num_arcs_out
+              << " arcs; determinization hit the memory limit for "
+              << num_fail << " of " << lats.size() << " lattices.";
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
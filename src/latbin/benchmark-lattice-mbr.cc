@@ -0,0 +1,134 @@
+// latbin/benchmark-lattice-mbr.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "lat/sausages.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Measure the speed of Minimum Bayes Risk decoding, as done by\n"
+        "lattice-mbr-decode and lattice-to-ctm-conf.  All the lattices are\n"
+        "read into memory first, and only the MBR computation is timed.  The\n"
+        "time is also reported separately for the longest lattices (by number\n"
+        "of frames), since the cost grows faster than linearly with length.\n"
+        "Usage: benchmark-lattice-mbr [options] <lattice-rspecifier>\n"
+        "e.g.: benchmark-lattice-mbr --acoustic-scale=0.1 ark:1.lats\n";
+    ParseOptions po(usage);
+    BaseFloat acoustic_scale = 1.0, lm_scale = 1.0;
+    int32 num_repeats = 1;
+    BaseFloat long_proportion = 0.1;
+    MinimumBayesRiskOptions mbr_opts;
+
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for "
+                "acoustic likelihoods.");
+    po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
+                "scores.");
+    po.Register("num-repeats", &num_repeats,
+                "Number of times to decode the lattices");
+    po.Register("long-proportion", &long_proportion, "The proportion of the "
+                "lattices, taking the longest first, for which the time is "
+                "reported separately.");
+    mbr_opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 1) {
+      po.PrintUsage();
+      exit(1);
+    }
+    KALDI_ASSERT(num_repeats > 0 && long_proportion >= 0.0 &&
+                 long_proportion <= 1.0);
+
+    std::string lats_rspecifier = po.GetArg(1);
+
+    std::vector<CompactLattice> clats;
+    // pairs of (num-frames, index into clats).
+    std::vector<std::pair<int32, int32> > lengths;
+    int64 num_frames = 0;
+    SequentialCompactLatticeReader clat_reader(lats_rspecifier);
+    for (; !clat_reader.Done(); clat_reader.Next()) {
+      clats.resize(clats.size() + 1);
+      clats.back() = clat_reader.Value();
+      fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale),
+                        &(clats.back()));
+      TopSortCompactLatticeIfNeeded(&(clats.back()));
+      std::vector<int32> state_times;
+      int32 length = CompactLatticeStateTimes(clats.back(), &state_times);
+      lengths.push_back(std::pair<int32, int32>(length, clats.size() - 1));
+      num_frames += length;
+    }
+    if (clats.empty())
+      KALDI_ERR << "No lattices read from " << lats_rspecifier;
+    std::sort(lengths.begin(), lengths.end());
+    size_t num_long = static_cast<size_t>(long_proportion * clats.size());
+    std::vector<bool> is_long(clats.size(), false);
+    for (size_t i = clats.size() - num_long; i < clats.size(); i++)
+      is_long[lengths[i].second] = true;
+
+    double elapsed = 0.0, elapsed_long = 0.0, tot_bayes_risk = 0.0;
+    int64 num_words = 0, num_frames_long = 0;
+    for (int32 r = 0; r < num_repeats; r++) {
+      for (size_t i = 0; i < clats.size(); i++) {
+        Timer timer;
+        MinimumBayesRisk mbr(clats[i], mbr_opts);
+        double this_elapsed = timer.Elapsed();
+        elapsed += this_elapsed;
+        if (is_long[i])
+          elapsed_long += this_elapsed;
+        if (r == 0) {
+          tot_bayes_risk += mbr.GetBayesRisk();
+          num_words += mbr.GetOneBest().size();
+        }
+      }
+    }
+    for (size_t i = clats.size() - num_long; i < clats.size(); i++)
+      num_frames_long += lengths[i].first;
+
+    int64 num_lats = clats.size() * static_cast<int64>(num_repeats);
+    KALDI_LOG << "Decoded " << num_lats << " lattices in " << elapsed
+              << " seconds: " << (num_lats / elapsed) << " lattices/sec, "
+              << (num_frames * num_repeats / elapsed) << " frames/sec.";
+    if (num_long > 0 && elapsed_long > 0.0)
+      KALDI_LOG << "The longest " << num_long << " lattices (average "
+                << (num_frames_long / static_cast<double>(num_long))
+                << " frames) took " << (elapsed_long / elapsed * 100.0)
+                << "% of the time: "
+                << (num_frames_long * num_repeats / elapsed_long)
+                << " frames/sec.";
+    KALDI_LOG << "Average Bayes Risk per sentence is "
+              << (tot_bayes_risk / clats.size()) << ", with "
+              << (num_words / static_cast<double>(clats.size()))
+              << " words per sentence.";
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -42,7 +42,9 @@ int main(int argc, char *argv[]) {
         " e.g.: lattice-align-words-lexicon  --partial-word-label=4324 --max-expand 10.0 --test true \\\n"
         "   data/lang/phones/align_lexicon.int final.mdl ark:1.lats ark:aligned.lats\n"
         "See also: lattice-align-words, which is only applicable if your phones have word-position\n"
-        "markers, i.e. each phone comes in 5 versions like AA_B, AA_I, AA_W, AA_S, AA.\n";
+        "markers, i.e. each phone comes in 5 versions like AA_B, AA_I, AA_W, AA_S, AA.\n"
+        "For very long lattices, use --streaming=true (and possibly --max-mem-mb)\n"
+        "to limit the memory used.\n";
     
     ParseOptions po(usage);
     bool output_if_error = true;
@@ -23,6 +23,88 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/word-align-lattice.h"
 #include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Word-aligns the lattices for ProcessTableInParallel().
+class LatticeWordAligner {
+ public:
+  typedef CompactLattice Input;
+  struct Output {
+    CompactLattice aligned_clat;
+    bool ok;
+    Output(): ok(false) { }
+  };
+
+  LatticeWordAligner(const TransitionModel &tmodel,
+                     const WordBoundaryInfo &info,
+                     const WordAlignStreamingOpts &streaming_opts,
+                     BaseFloat max_expand, bool output_if_error,
+                     bool do_test, CompactLatticeWriter *clat_writer):
+      tmodel_(tmodel), info_(info), streaming_opts_(streaming_opts),
+      max_expand_(max_expand),
+      output_if_error_(output_if_error), do_test_(do_test),
+      clat_writer_(clat_writer), num_done_(0), num_err_(0) { }
+
+  void Process(const std::string &key, CompactLattice *clat,
+               Output *output) const {
+    int32 max_states;
+    if (max_expand_ > 0) max_states = 1000 + max_expand_ * clat->NumStates();
+    else max_states = 0;
+
+    output->ok = WordAlignLattice(*clat, tmodel_, info_, max_states,
+                                  streaming_opts_, &(output->aligned_clat));
+
+    if (do_test_ && output->ok)
+      TestWordAlignedLattice(*clat, tmodel_, info_, output->aligned_clat);
+
+    if (output->aligned_clat.Start() != fst::kNoStateId)
+      TopSortCompactLatticeIfNeeded(&(output->aligned_clat));
+  }
+
+  void Write(const std::string &key, Output *output) {
+    const CompactLattice &aligned_clat = output->aligned_clat;
+    if (!output->ok) {
+      num_err_++;
+      if (!output_if_error_)
+        KALDI_WARN << "Lattice for " << key
+                   << " did not align correctly, producing no output.";
+      else {
+        if (aligned_clat.Start() != fst::kNoStateId) {
+          KALDI_WARN << "Outputting partial lattice for " << key;
+          clat_writer_->Write(key, aligned_clat);
+        } else {
+          KALDI_WARN << "Empty aligned lattice for " << key
+                     << ", producing no output.";
+        }
+      }
+    } else {
+      if (aligned_clat.Start() == fst::kNoStateId) {
+        num_err_++;
+        KALDI_WARN << "Lattice was empty for key " << key;
+      } else {
+        num_done_++;
+        KALDI_VLOG(2) << "Aligned lattice for " << key;
+        clat_writer_->Write(key, aligned_clat);
+      }
+    }
+  }
+
+  int32 NumDone() const { return num_done_; }
+  int32 NumErr() const { return num_err_; }
+ private:
+  const TransitionModel &tmodel_;
+  const WordBoundaryInfo &info_;
+  const WordAlignStreamingOpts &streaming_opts_;
+  BaseFloat max_expand_;
+  bool output_if_error_;
+  bool do_test_;
+  CompactLatticeWriter *clat_writer_;
+  int32 num_done_, num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -40,7 +122,9 @@ int main(int argc, char *argv[]) {
         "Note: word-boundary file has format (on each line):\n"
         "<integer-phone-id> [begin|end|singleton|internal|nonword]\n"
         "See also: lattice-align-words-lexicon, for use in cases where phones\n"
-        "don't have word-position information.\n";
+        "don't have word-position information.\n"
+        "For very long lattices, use --streaming=true (and possibly --max-mem-mb)\n"
+        "to limit the memory used.\n";
     
     ParseOptions po(usage);
     BaseFloat max_expand = 0.0;
@@ -57,6 +141,10 @@ int main(int argc, char *argv[]) {
     
     WordBoundaryInfoNewOpts opts;
     opts.Register(&po);
+    WordAlignStreamingOpts streaming_opts;
+    streaming_opts.Register(&po);
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -79,49 +167,13 @@ int main(int argc, char *argv[]) {
 
     WordBoundaryInfo info(opts, word_boundary_rxfilename);
     
-    int32 num_done = 0, num_err = 0;
-    
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      const CompactLattice &clat = clat_reader.Value();
-
-      CompactLattice aligned_clat;
-      int32 max_states;
-      if (max_expand > 0) max_states = 1000 + max_expand * clat.NumStates();
-      else max_states = 0;
-      
-      bool ok = WordAlignLattice(clat, tmodel, info, max_states, &aligned_clat);
-      
-      if (do_test && ok)
-        TestWordAlignedLattice(clat, tmodel, info, aligned_clat);
-
-      if (!ok) {
-        num_err++;
-        if (!output_if_error)
-          KALDI_WARN << "Lattice for " << key
-                     << " did not align correctly, producing no output.";
-        else {
-          if (aligned_clat.Start() != fst::kNoStateId) {
-            KALDI_WARN << "Outputting partial lattice for " << key;
-            TopSortCompactLatticeIfNeeded(&aligned_clat);
-            clat_writer.Write(key, aligned_clat);
-          } else {
-            KALDI_WARN << "Empty aligned lattice for " << key
-                       << ", producing no output.";
-          }
-        }
-      } else {
-        if (aligned_clat.Start() == fst::kNoStateId) {
-          num_err++;
-          KALDI_WARN << "Lattice was empty for key " << key;
-        } else {
-          num_done++;
-          KALDI_VLOG(2) << "Aligned lattice for " << key;
-          TopSortCompactLatticeIfNeeded(&aligned_clat);
-          clat_writer.Write(key, aligned_clat);
-        }
-      }
-    }
+    // The lattices are aligned in parallel if --num-threads > 1, and
+    // written in the original order.
+    LatticeWordAligner aligner(tmodel, info, streaming_opts, max_expand,
+                               output_if_error, do_test, &clat_writer);
+    ProcessTableInParallel(sequencer_config, &clat_reader, &aligner);
+    int32 num_done = aligner.NumDone(), num_err = aligner.NumErr();
+
     KALDI_LOG << "Successfully aligned " << num_done << " lattices; "
               << num_err << " had errors.";
     return (num_done > num_err ? 0 : 1); // We changed the error condition slightly here,
@@ -42,12 +42,19 @@ class ArcPosteriorComputer {
   int32 OutputPosteriors(const std::string &utterance,
                          std::ostream &os) {
     int32 num_post = 0;
-    if (!ComputeCompactLatticeAlphas(clat_, &alpha_))
+    if (clat_.Properties(fst::kTopSorted, true) == 0) {
+      KALDI_WARN << "Input lattice must be topologically sorted.";
       return num_post;
-    if (!ComputeCompactLatticeBetas(clat_, &beta_))
+    }
+    // The alphas, betas and state times are all computed from one flat copy
+    // of the lattice.
+    FlatLattice flat_clat(clat_);
+    if (!ComputeCompactLatticeAlphas(flat_clat, &alpha_))
+      return num_post;
+    if (!ComputeCompactLatticeBetas(flat_clat, &beta_))
       return num_post;
 
-    CompactLatticeStateTimes(clat_, &state_times_);
+    flat_clat.StateTimes(&state_times_);
     if (clat_.Start() < 0)
       return 0;
     double tot_like = beta_[clat_.Start()];
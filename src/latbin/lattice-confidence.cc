@@ -24,6 +24,94 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/confidence.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Computes the confidences for ProcessTableInParallel(); LatticeType is
+// Lattice or CompactLattice.
+template<class LatticeType>
+class LatticeConfidenceComputer {
+ public:
+  typedef LatticeType Input;
+  struct Output {
+    int32 num_paths;
+    bool same_sentence;  // true if the best and second-best sentences were
+                         // identical.
+    BaseFloat confidence;
+    Output(): num_paths(0), same_sentence(false), confidence(0.0) { }
+  };
+
+  LatticeConfidenceComputer(BaseFloat lm_scale, BaseFloat acoustic_scale,
+                            BaseFloatWriter *confidence_writer):
+      lm_scale_(lm_scale), acoustic_scale_(acoustic_scale),
+      confidence_writer_(confidence_writer), num_done_(0), num_empty_(0),
+      num_one_sentence_(0), num_same_sentence_(0), sum_neg_exp_(0.0) { }
+
+  void Process(const std::string &key, LatticeType *lat,
+               Output *output) const {
+    if (acoustic_scale_ != 1.0 || lm_scale_ != 1.0)
+      fst::ScaleLattice(fst::LatticeScale(lm_scale_, acoustic_scale_), lat);
+    std::vector<int32> best_sentence, second_best_sentence;
+    output->confidence = SentenceLevelConfidence(*lat, &output->num_paths,
+                                                 &best_sentence,
+                                                 &second_best_sentence);
+    output->same_sentence = (output->num_paths == 2 &&
+                             best_sentence == second_best_sentence);
+  }
+
+  void Write(const std::string &key, Output *output) {
+    // Output this instead of infinity; I/O for infinity can be problematic.
+    const BaseFloat max_output = 1.0e+10;
+    if (output->num_paths == 0) {
+      KALDI_WARN << "Lattice for utterance " << key << " is equivalent to "
+                 << "the empty lattice.";
+      num_empty_++;
+      return;
+    } else if (output->num_paths == 1) {
+      num_one_sentence_++;
+    } else if (output->same_sentence) {
+      ReportSameSentence();
+      num_same_sentence_++;
+    }
+    num_done_++;
+    BaseFloat confidence = std::min(max_output, output->confidence);
+    sum_neg_exp_ += Exp(-confidence);  // diagnostic.
+    confidence_writer_->Write(key, confidence);
+  }
+
+  int64 NumDone() const { return num_done_; }
+  int64 NumEmpty() const { return num_empty_; }
+  int64 NumOneSentence() const { return num_one_sentence_; }
+  int64 NumSameSentence() const { return num_same_sentence_; }
+  double SumNegExp() const { return sum_neg_exp_; }
+ private:
+  // Called when the best and second-best sentences were identical; see the
+  // specializations below.
+  void ReportSameSentence();
+
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  BaseFloatWriter *confidence_writer_;
+  int64 num_done_, num_empty_, num_one_sentence_, num_same_sentence_;
+  double sum_neg_exp_;
+};
+
+template<>
+void LatticeConfidenceComputer<CompactLattice>::ReportSameSentence() {
+  KALDI_WARN << "Best and second-best sentences were identical: "
+             << "confidence is meaningless.  You should call with "
+             << "--read-compact-lattice=false.";
+}
+
+template<>
+void LatticeConfidenceComputer<Lattice>::ReportSameSentence() {
+  // This would be an error in some algorithm, in this case.
+  KALDI_ERR << "Best and second-best sentences were identical.";
+}
+
+}  // namespace kaldi
+
 
 int main(int argc, char *argv[]) {
   try {
@@ -60,7 +148,9 @@ int main(int argc, char *argv[]) {
                 "If true, read CompactLattice format; else, read Lattice format "
                 "(necessary for state-level lattices that were written in that "
                 "format).");
-    
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    sequencer_config.Register(&po);
+
     po.Read(argc, argv);
 
     if (po.NumArgs() != 2) {
@@ -73,85 +163,33 @@ int main(int argc, char *argv[]) {
     
     BaseFloatWriter confidence_writer(confidence_wspecifier);
     
-    // Output this instead of infinity; I/O for infinity can be problematic.
-    const BaseFloat max_output = 1.0e+10; 
-    
-    int64 num_done = 0, num_empty = 0,
-        num_one_sentence = 0, num_same_sentence = 0;
-    double sum_neg_exp = 0.0;
-    
-    
+    int64 num_done, num_empty, num_one_sentence, num_same_sentence;
+    double sum_neg_exp;
+
+    // The confidences are computed in parallel if --num-threads > 1, and
+    // written in the original order.
     if (read_compact_lattice) {
       SequentialCompactLatticeReader clat_reader(lats_rspecifier);
-      
-      for (; !clat_reader.Done(); clat_reader.Next()) {
-        CompactLattice clat = clat_reader.Value();
-        std::string key = clat_reader.Key();
-        // FreeCurrent() is an optimization that prevents the lattice from being
-        // copied unnecessarily (OpenFst does copy-on-write).
-        clat_reader.FreeCurrent();
-        if (acoustic_scale != 1.0 || lm_scale != 1.0)
-          fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
-
-        int32 num_paths;
-        std::vector<int32> best_sentence, second_best_sentence;
-        BaseFloat confidence;
-        confidence = SentenceLevelConfidence(clat, &num_paths,
-                                             &best_sentence,
-                                             &second_best_sentence);
-        if (num_paths == 0) {
-          KALDI_WARN << "Lattice for utterance " << key << " is equivalent to "
-                     << "the empty lattice.";
-          num_empty++;
-          continue;
-        } else if (num_paths == 1) {
-          num_one_sentence++;
-        } else if (num_paths == 2 && best_sentence == second_best_sentence) {
-          KALDI_WARN << "Best and second-best sentences were identical: "
-                     << "confidence is meaningless.  You should call with "
-                     << "--read-compact-lattice=false.";
-          num_same_sentence++;
-        }
-        num_done++;
-        confidence = std::min(max_output, confidence); // disallow infinity.
-        sum_neg_exp += Exp(-confidence); // diagnostic.
-        confidence_writer.Write(key, confidence);
-      }
+      LatticeConfidenceComputer<CompactLattice> computer(
+          lm_scale, acoustic_scale, &confidence_writer);
+      ProcessTableInParallel(sequencer_config, &clat_reader, &computer);
+      num_done = computer.NumDone();
+      num_empty = computer.NumEmpty();
+      num_one_sentence = computer.NumOneSentence();
+      num_same_sentence = computer.NumSameSentence();
+      sum_neg_exp = computer.SumNegExp();
     } else {
       SequentialLatticeReader lat_reader(lats_rspecifier);
-      
-      for (; !lat_reader.Done(); lat_reader.Next()) {
-        Lattice lat = lat_reader.Value();
-        std::string key = lat_reader.Key();
-        // FreeCurrent() is an optimization that prevents the lattice from being
-        // copied unnecessarily (OpenFst does copy-on-write).
-        lat_reader.FreeCurrent();
-        if (acoustic_scale != 1.0 || lm_scale != 1.0)
-          fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &lat);
-        int32 num_paths;
-        std::vector<int32> best_sentence, second_best_sentence;
-        BaseFloat confidence;
-        confidence = SentenceLevelConfidence(lat, &num_paths,
-                                             &best_sentence,
-                                             &second_best_sentence);
-        if (num_paths == 0) {
-          KALDI_WARN << "Lattice for utterance " << key << " is equivalent to "
-                     << "the empty lattice.";
-          num_empty++;
-          continue;
-        } else if (num_paths == 1) {
-          num_one_sentence++;
-        } else if (num_paths == 2 && best_sentence == second_best_sentence) {
-          // This would be an error in some algorithm, in this case.
-          KALDI_ERR << "Best and second-best sentences were identical.";
-        }
-        num_done++;
-        confidence = std::min(max_output, confidence); // disallow infinity.
-        sum_neg_exp += Exp(-confidence); // diagnostic.
-        confidence_writer.Write(key, confidence);
-      }
+      LatticeConfidenceComputer<Lattice> computer(
+          lm_scale, acoustic_scale, &confidence_writer);
+      ProcessTableInParallel(sequencer_config, &lat_reader, &computer);
+      num_done = computer.NumDone();
+      num_empty = computer.NumEmpty();
+      num_one_sentence = computer.NumOneSentence();
+      num_same_sentence = computer.NumSameSentence();
+      sum_neg_exp = computer.SumNegExp();
     }
-        
+
     KALDI_LOG << "Done " << num_done << " lattices, of which "
               << num_one_sentence << " contained only one sentence. "
               << num_empty << " were equivalent to the empty lattice.";
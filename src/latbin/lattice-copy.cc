@@ -23,6 +23,7 @@
 #include "util/common-utils.h"
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
+#include "lat/compressed-lattice.h"
 
 namespace kaldi {
   int32 CopySubsetLattices(std::string filename, 
@@ -145,6 +146,8 @@ int main(int argc, char *argv[]) {
         "Only one of --include and --exclude can be supplied.\n"
         "Usage: lattice-copy [options] lattice-rspecifier lattice-wspecifier\n"
         " e.g.: lattice-copy --write-compact=false ark:1.lats ark,t:text.lats\n"
+        "       lattice-copy --write-compressed=true 'ark:gunzip -c lat.1.gz|' \\\n"
+        "          'ark:|gzip -c >lat_compressed.1.gz'\n"
         "See also: lattice-to-fst, and the script egs/wsj/s5/utils/convert_slf.pl\n";
     
     ParseOptions po(usage);
@@ -163,8 +166,11 @@ int main(int argc, char *argv[]) {
                 "whose lattices will be excluded");
     po.Register("ignore-missing", &ignore_missing,
                 "Exit with status 0 even if no lattices are copied");
+    CompressedLatticeOptions compress_opts;
+    compress_opts.Register(&po);
 
     po.Read(argc, argv);
+    SetCompressedLatticeOptions(compress_opts);
 
     if (po.NumArgs() != 2) {
       po.PrintUsage();
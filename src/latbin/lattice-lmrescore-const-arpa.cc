@@ -24,6 +24,90 @@
 #include "lat/lattice-functions.h"
 #include "lm/const-arpa-lm.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores the lattices for ProcessTableInParallel().
+class ConstArpaLmRescorer {
+ public:
+  typedef CompactLattice Input;
+  struct Output {
+    CompactLattice clat;
+    bool ok;
+    Output(): ok(false) { }
+  };
+
+  // 'cache' may be NULL; if not, it is shared by all the lattices (and
+  // threads).
+  ConstArpaLmRescorer(const ConstArpaLm &const_arpa, BaseFloat lm_scale,
+                      ConstArpaLmArcCache *cache,
+                      CompactLatticeWriter *compact_lattice_writer):
+      const_arpa_(const_arpa), lm_scale_(lm_scale), cache_(cache),
+      compact_lattice_writer_(compact_lattice_writer),
+      n_done_(0), n_fail_(0) { }
+
+  void Process(const std::string &key, CompactLattice *clat,
+               Output *output) const {
+    if (lm_scale_ != 0.0) {
+      // Before composing with the LM FST, we scale the lattice weights
+      // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+      // We do it this way so we can determinize and it will give the
+      // right effect (taking the "best path" through the LM) regardless
+      // of the sign of lm_scale.
+      fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale_), clat);
+      ArcSort(clat, fst::OLabelCompare<CompactLatticeArc>());
+
+      // Wraps the ConstArpaLm format language model into FST. We re-create it
+      // for each lattice to prevent memory usage increasing with time; the
+      // LM scores that are looked up are remembered across lattices in
+      // cache_, whose size is bounded.
+      ConstArpaLmDeterministicFst const_arpa_fst(const_arpa_, cache_);
+
+      // Composes lattice with language model.
+      CompactLattice composed_clat;
+      ComposeCompactLatticeDeterministic(*clat,
+                                         &const_arpa_fst, &composed_clat);
+
+      // Determinizes the composed lattice.
+      Lattice composed_lat;
+      ConvertLattice(composed_clat, &composed_lat);
+      Invert(&composed_lat);
+      DeterminizeLattice(composed_lat, &(output->clat));
+      fst::ScaleLattice(fst::GraphLatticeScale(lm_scale_), &(output->clat));
+      if (output->clat.Start() == fst::kNoStateId) {
+        KALDI_WARN << "Empty lattice for utterance " << key
+            << " (incompatible LM?)";
+      } else {
+        output->ok = true;
+      }
+    } else {
+      // Zero scale so nothing to do.
+      output->clat = *clat;
+      output->ok = true;
+    }
+  }
+
+  void Write(const std::string &key, Output *output) {
+    if (output->ok) {
+      compact_lattice_writer_->Write(key, output->clat);
+      n_done_++;
+    } else {
+      n_fail_++;
+    }
+  }
+
+  int32 NumDone() const { return n_done_; }
+  int32 NumFail() const { return n_fail_; }
+ private:
+  const ConstArpaLm &const_arpa_;
+  BaseFloat lm_scale_;
+  ConstArpaLmArcCache *cache_;
+  CompactLatticeWriter *compact_lattice_writer_;
+  int32 n_done_, n_fail_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -45,9 +129,15 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     BaseFloat lm_scale = 1.0;
+    int32 arc_cache_size = 1000000;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "costs; frequently 1.0 or -1.0");
+    po.Register("arc-cache-size", &arc_cache_size, "Number of LM scores "
+                "(history, word) to cache across lattices; 0 disables the "
+                "cache.");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -62,57 +152,23 @@ int main(int argc, char *argv[]) {
 
     // Reads the language model in ConstArpaLm format.
     ConstArpaLm const_arpa;
-    ReadKaldiObject(lm_rxfilename, &const_arpa);
+    ReadConstArpaLm(lm_rxfilename, &const_arpa);
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
-    int32 n_done = 0, n_fail = 0;
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      if (lm_scale != 0.0) {
-        // Before composing with the LM FST, we scale the lattice weights
-        // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-        // We do it this way so we can determinize and it will give the
-        // right effect (taking the "best path" through the LM) regardless
-        // of the sign of lm_scale.
-        fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale), &clat);
-        ArcSort(&clat, fst::OLabelCompare<CompactLatticeArc>());
-
-        // Wraps the ConstArpaLm format language model into FST. We re-create it
-        // for each lattice to prevent memory usage increasing with time.
-        ConstArpaLmDeterministicFst const_arpa_fst(const_arpa);
-
-        // Composes lattice with language model.
-        CompactLattice composed_clat;
-        ComposeCompactLatticeDeterministic(clat,
-                                           &const_arpa_fst, &composed_clat);
-
-        // Determinizes the composed lattice.
-        Lattice composed_lat;
-        ConvertLattice(composed_clat, &composed_lat);
-        Invert(&composed_lat);
-        CompactLattice determinized_clat;
-        DeterminizeLattice(composed_lat, &determinized_clat);
-        fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), &determinized_clat);
-        if (determinized_clat.Start() == fst::kNoStateId) {
-          KALDI_WARN << "Empty lattice for utterance " << key
-              << " (incompatible LM?)";
-          n_fail++;
-        } else {
-          compact_lattice_writer.Write(key, determinized_clat);
-          n_done++;
-        }
-      } else {
-        // Zero scale so nothing to do.
-        n_done++;
-        compact_lattice_writer.Write(key, clat);
-      }
-    }
+    // The lattices are rescored in parallel if --num-threads > 1, and
+    // written in the original order.
+    ConstArpaLmArcCache *cache = NULL;
+    if (arc_cache_size > 0)
+      cache = new ConstArpaLmArcCache(arc_cache_size);
+    ConstArpaLmRescorer rescorer(const_arpa, lm_scale, cache,
+                                 &compact_lattice_writer);
+    ProcessTableInParallel(sequencer_config, &compact_lattice_reader,
+                           &rescorer);
+    int32 n_done = rescorer.NumDone(), n_fail = rescorer.NumFail();
+    delete cache;
 
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
     return (n_done != 0 ? 0 : 1);
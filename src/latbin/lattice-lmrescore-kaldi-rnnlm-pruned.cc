@@ -28,6 +28,100 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores the lattices for ProcessTableInParallel().  The old LM is either
+// an FST or a ConstArpaLm.
+class KaldiRnnlmPrunedRescorer {
+ public:
+  typedef CompactLattice Input;
+  typedef CompactLattice Output;  // Empty if the rescoring failed.
+
+  KaldiRnnlmPrunedRescorer(const ComposeLatticePrunedOptions &compose_opts,
+                           const rnnlm::RnnlmComputeStateInfo &info,
+                           int32 max_ngram_order,
+                           BaseFloat lm_scale,
+                           BaseFloat acoustic_scale,
+                           const fst::VectorFst<fst::StdArc> *lm_to_subtract_fst,
+                           const ConstArpaLm *const_arpa,
+                           CompactLatticeWriter *compact_lattice_writer):
+      compose_opts_(compose_opts), info_(info),
+      max_ngram_order_(max_ngram_order), lm_scale_(lm_scale),
+      acoustic_scale_(acoustic_scale), lm_to_subtract_fst_(lm_to_subtract_fst),
+      const_arpa_(const_arpa), compact_lattice_writer_(compact_lattice_writer),
+      num_done_(0), num_err_(0) {
+    KALDI_ASSERT((lm_to_subtract_fst != NULL) != (const_arpa != NULL));
+  }
+
+  void Process(const std::string &key, CompactLattice *clat,
+               CompactLattice *composed_clat) const {
+    using fst::StdArc;
+    // The deterministic on-demand FSTs keep the LM states they have seen, so
+    // we create them for each lattice; this also means that several lattices
+    // can be rescored at once, and that memory use does not grow with time.
+    fst::DeterministicOnDemandFst<StdArc> *lm_to_subtract_det;
+    if (const_arpa_ != NULL)
+      lm_to_subtract_det = new ConstArpaLmDeterministicFst(*const_arpa_);
+    else
+      lm_to_subtract_det =
+          new fst::BackoffDeterministicOnDemandFst<StdArc>(*lm_to_subtract_fst_);
+    fst::ScaleDeterministicOnDemandFst lm_to_subtract_det_scale(
+        -lm_scale_, lm_to_subtract_det);
+    rnnlm::KaldiRnnlmDeterministicFst lm_to_add_orig(max_ngram_order_, info_);
+    fst::ScaleDeterministicOnDemandFst lm_to_add(lm_scale_, &lm_to_add_orig);
+
+    // Before composing with the LM FST, we scale the lattice weights
+    // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+    // We do it this way so we can determinize and it will give the
+    // right effect (taking the "best path" through the LM) regardless
+    // of the sign of lm_scale.
+    if (acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat);
+    }
+    TopSortCompactLatticeIfNeeded(clat);
+
+    fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
+        &lm_to_subtract_det_scale, &lm_to_add);
+
+    // Composes lattice with language model.
+    ComposeCompactLatticePruned(compose_opts_, *clat,
+                                &combined_lms, composed_clat);
+
+    // If composed_clat is empty, something went wrong; a warning will already
+    // have been printed.
+    if (composed_clat->NumStates() != 0 && acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        composed_clat);
+    }
+    delete lm_to_subtract_det;
+  }
+
+  void Write(const std::string &key, CompactLattice *composed_clat) {
+    if (composed_clat->NumStates() == 0) {
+      num_err_++;
+    } else {
+      compact_lattice_writer_->Write(key, *composed_clat);
+      num_done_++;
+    }
+  }
+
+  int32 NumDone() const { return num_done_; }
+  int32 NumErr() const { return num_err_; }
+ private:
+  const ComposeLatticePrunedOptions &compose_opts_;
+  const rnnlm::RnnlmComputeStateInfo &info_;
+  int32 max_ngram_order_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  const fst::VectorFst<fst::StdArc> *lm_to_subtract_fst_;
+  const ConstArpaLm *const_arpa_;
+  CompactLatticeWriter *compact_lattice_writer_;
+  int32 num_done_, num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -60,6 +154,7 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
     rnnlm::RnnlmComputeStateComputationOptions opts;
     ComposeLatticePrunedOptions compose_opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     int32 max_ngram_order = 3;
     BaseFloat lm_scale = 0.5;
@@ -80,6 +175,7 @@ int main(int argc, char *argv[]) {
 
     opts.Register(&po);
     compose_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -91,6 +187,8 @@ int main(int argc, char *argv[]) {
     if (opts.bos_index == -1 || opts.eos_index == -1) {
       KALDI_ERR << "must set --bos-symbol and --eos-symbol options";
     }
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
 
     std::string lm_to_subtract_rxfilename, lats_rspecifier,
                 word_embedding_rxfilename, rnnlm_rxfilename, lats_wspecifier;
@@ -102,30 +200,17 @@ int main(int argc, char *argv[]) {
     lats_wspecifier = po.GetArg(5);
 
     // for G.fst
-    fst::ScaleDeterministicOnDemandFst *lm_to_subtract_det_scale = NULL;
-    fst::BackoffDeterministicOnDemandFst<StdArc> *lm_to_subtract_det_backoff = NULL;
     VectorFst<StdArc> *lm_to_subtract_fst = NULL;
-
     // for G.carpa
     ConstArpaLm* const_arpa = NULL;
-    fst::DeterministicOnDemandFst<StdArc> *carpa_lm_to_subtract_fst = NULL;
 
     KALDI_LOG << "Reading old LMs...";
     if (use_carpa) {
       const_arpa = new ConstArpaLm();
-      ReadKaldiObject(lm_to_subtract_rxfilename, const_arpa);
-      carpa_lm_to_subtract_fst = new ConstArpaLmDeterministicFst(*const_arpa);
-      lm_to_subtract_det_scale
-        = new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                 carpa_lm_to_subtract_fst);
+      ReadConstArpaLm(lm_to_subtract_rxfilename, const_arpa);
     } else {
       lm_to_subtract_fst = fst::ReadAndPrepareLmFst(
           lm_to_subtract_rxfilename);
-      lm_to_subtract_det_backoff =
-        new fst::BackoffDeterministicOnDemandFst<StdArc>(*lm_to_subtract_fst);
-      lm_to_subtract_det_scale =
-           new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                  lm_to_subtract_det_backoff);
     }
 
     kaldi::nnet3::Nnet rnnlm;
@@ -142,62 +227,18 @@ int main(int argc, char *argv[]) {
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
-    int32 num_done = 0, num_err = 0;
-
-    rnnlm::KaldiRnnlmDeterministicFst* lm_to_add_orig = 
-         new rnnlm::KaldiRnnlmDeterministicFst(max_ngram_order, info);
-
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      fst::DeterministicOnDemandFst<StdArc> *lm_to_add =
-         new fst::ScaleDeterministicOnDemandFst(lm_scale, lm_to_add_orig);
-
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      // Before composing with the LM FST, we scale the lattice weights
-      // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-      // We do it this way so we can determinize and it will give the
-      // right effect (taking the "best path" through the LM) regardless
-      // of the sign of lm_scale.
-      if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
-      }
-      TopSortCompactLatticeIfNeeded(&clat);
-
-      fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          lm_to_subtract_det_scale, lm_to_add);
-
-      // Composes lattice with language model.
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts, clat,
-                                  &combined_lms, &composed_clat);
-
-      lm_to_add_orig->Clear();
-
-      if (composed_clat.NumStates() == 0) {
-        // Something went wrong.  A warning will already have been printed.
-        num_err++;
-      } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
-        num_done++;
-      }
-      delete lm_to_add;
-    }
+    // The lattices are rescored in parallel if --num-threads > 1, and
+    // written in the original order.
+    KaldiRnnlmPrunedRescorer rescorer(compose_opts, info, max_ngram_order,
+                                      lm_scale, acoustic_scale,
+                                      lm_to_subtract_fst, const_arpa,
+                                      &compact_lattice_writer);
+    ProcessTableInParallel(sequencer_config, &compact_lattice_reader,
+                           &rescorer);
+    int32 num_done = rescorer.NumDone(), num_err = rescorer.NumErr();
 
     delete lm_to_subtract_fst;
-    delete lm_to_add_orig;
-    delete lm_to_subtract_det_backoff;
-    delete lm_to_subtract_det_scale;
-
     delete const_arpa;
-    delete carpa_lm_to_subtract_fst;
 
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
@@ -20,6 +20,73 @@
 #include "util/common-utils.h"
 #include "lat/sausages.h"
 #include "hmm/posterior.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Does the MBR decoding for ProcessTableInParallel().
+class LatticeMbrDecoder {
+ public:
+  typedef CompactLattice Input;
+  struct Output {
+    MinimumBayesRisk *mbr;
+    Output(): mbr(NULL) { }
+    ~Output() { delete mbr; }
+  };
+
+  LatticeMbrDecoder(BaseFloat lm_scale, BaseFloat acoustic_scale,
+                    bool one_best_times,
+                    Int32VectorWriter *trans_writer,
+                    BaseFloatWriter *bayes_risk_writer,
+                    PosteriorWriter *sausage_stats_writer,
+                    BaseFloatPairVectorWriter *times_writer):
+      lm_scale_(lm_scale), acoustic_scale_(acoustic_scale),
+      one_best_times_(one_best_times), trans_writer_(trans_writer),
+      bayes_risk_writer_(bayes_risk_writer),
+      sausage_stats_writer_(sausage_stats_writer),
+      times_writer_(times_writer), n_done_(0), n_words_(0),
+      tot_bayes_risk_(0.0) { }
+
+  void Process(const std::string &key, CompactLattice *clat,
+               Output *output) const {
+    fst::ScaleLattice(fst::LatticeScale(lm_scale_, acoustic_scale_), clat);
+    output->mbr = new MinimumBayesRisk(*clat);
+  }
+
+  // The writers for the outputs that were not wanted are not open.
+  void Write(const std::string &key, Output *output) {
+    const MinimumBayesRisk &mbr = *(output->mbr);
+    if (trans_writer_->IsOpen())
+      trans_writer_->Write(key, mbr.GetOneBest());
+    if (bayes_risk_writer_->IsOpen())
+      bayes_risk_writer_->Write(key, mbr.GetBayesRisk());
+    if (sausage_stats_writer_->IsOpen())
+      sausage_stats_writer_->Write(key, mbr.GetSausageStats());
+    if (times_writer_->IsOpen())
+      times_writer_->Write(key, one_best_times_ ? mbr.GetOneBestTimes() :
+                           mbr.GetSausageTimes());
+
+    n_done_++;
+    n_words_ += mbr.GetOneBest().size();
+    tot_bayes_risk_ += mbr.GetBayesRisk();
+  }
+
+  int32 NumDone() const { return n_done_; }
+  int32 NumWords() const { return n_words_; }
+  BaseFloat TotBayesRisk() const { return tot_bayes_risk_; }
+ private:
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  bool one_best_times_;
+  Int32VectorWriter *trans_writer_;
+  BaseFloatWriter *bayes_risk_writer_;
+  PosteriorWriter *sausage_stats_writer_;
+  BaseFloatPairVectorWriter *times_writer_;
+  int32 n_done_, n_words_;
+  BaseFloat tot_bayes_risk_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -60,6 +127,8 @@ int main(int argc, char *argv[]) {
                 "words [for debug output]");
     po.Register("one-best-times", &one_best_times, "If true, output times "
                 "corresponding to one-best, not whole sausage.");
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -91,31 +160,14 @@ int main(int argc, char *argv[]) {
         KALDI_ERR << "Could not read symbol table from file "
                    << word_syms_filename;
 
-    int32 n_done = 0, n_words = 0;
-    BaseFloat tot_bayes_risk = 0.0;
-
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice clat = clat_reader.Value();
-      clat_reader.FreeCurrent();
-      fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
-
-      MinimumBayesRisk mbr(clat);
-
-      if (trans_wspecifier != "")
-        trans_writer.Write(key, mbr.GetOneBest());
-      if (bayes_risk_wspecifier != "")
-        bayes_risk_writer.Write(key, mbr.GetBayesRisk());
-      if (sausage_stats_wspecifier != "")
-        sausage_stats_writer.Write(key, mbr.GetSausageStats());
-      if (times_wspecifier != "")
-        times_writer.Write(key, one_best_times ? mbr.GetOneBestTimes() :
-                           mbr.GetSausageTimes());
-
-      n_done++;
-      n_words += mbr.GetOneBest().size();
-      tot_bayes_risk += mbr.GetBayesRisk();
-    }
+    // The lattices are decoded in parallel if --num-threads > 1, and the
+    // outputs written in the original order.
+    LatticeMbrDecoder decoder(lm_scale, acoustic_scale, one_best_times,
+                              &trans_writer, &bayes_risk_writer,
+                              &sausage_stats_writer, &times_writer);
+    ProcessTableInParallel(sequencer_config, &clat_reader, &decoder);
+    int32 n_done = decoder.NumDone(), n_words = decoder.NumWords();
+    BaseFloat tot_bayes_risk = decoder.TotBayesRisk();
 
     KALDI_LOG << "Done " << n_done << " lattices.";
     KALDI_LOG << "Average Bayes Risk per sentence is "
@@ -21,8 +21,114 @@
 #include "util/common-utils.h"
 #include "util/kaldi-table.h"
 #include "lat/sausages.h"
+#include "util/kaldi-thread.h"
+#include <mutex>
 #include <numeric>
 
+namespace kaldi {
+
+// Does the MBR decoding and writes the ctm, for ProcessTableInParallel().
+class LatticeToCtmConf {
+ public:
+  typedef CompactLattice Input;
+  struct Output {
+    MinimumBayesRisk *mbr;  // NULL if the 1-best or times were missing.
+    bool no_one_best;
+    Output(): mbr(NULL), no_one_best(false) { }
+    ~Output() { delete mbr; }
+  };
+
+  // 'one_best_reader' and 'times_reader' may not be open.
+  LatticeToCtmConf(const MinimumBayesRiskOptions &mbr_opts,
+                   BaseFloat lm_scale, BaseFloat acoustic_scale,
+                   BaseFloat frame_shift,
+                   RandomAccessInt32VectorReader *one_best_reader,
+                   RandomAccessBaseFloatPairVectorReader *times_reader,
+                   std::ostream &ctm_stream):
+      mbr_opts_(mbr_opts), lm_scale_(lm_scale),
+      acoustic_scale_(acoustic_scale), frame_shift_(frame_shift),
+      one_best_reader_(one_best_reader), times_reader_(times_reader),
+      ctm_stream_(ctm_stream), n_done_(0), n_words_(0),
+      tot_bayes_risk_(0.0) { }
+
+  void Process(const std::string &key, CompactLattice *clat,
+               Output *output) const {
+    fst::ScaleLattice(fst::LatticeScale(lm_scale_, acoustic_scale_), clat);
+
+    if (!one_best_reader_->IsOpen()) {
+      output->mbr = new MinimumBayesRisk(*clat, mbr_opts_);
+      return;
+    }
+    std::vector<int32> one_best;
+    std::vector<std::pair<BaseFloat, BaseFloat> > times;
+    {
+      // The random-access readers are not thread-safe, and we copy the
+      // values because they may be freed on the next lookup.
+      std::lock_guard<std::mutex> lock(reader_mutex_);
+      if (!one_best_reader_->HasKey(key) ||
+          (times_reader_->IsOpen() && !times_reader_->HasKey(key))) {
+        output->no_one_best = !one_best_reader_->HasKey(key);
+        return;
+      }
+      one_best = one_best_reader_->Value(key);
+      if (times_reader_->IsOpen())
+        times = times_reader_->Value(key);
+    }
+    // get the 'mbr' decoding object,
+    if (!times_reader_->IsOpen()) {
+      output->mbr = new MinimumBayesRisk(*clat, one_best, mbr_opts_); // no 'times',
+    } else {
+      // with initial 'times' of the bins,
+      output->mbr = new MinimumBayesRisk(*clat, one_best, times, mbr_opts_);
+    }
+  }
+
+  void Write(const std::string &key, Output *output) {
+    if (output->mbr == NULL) {
+      if (output->no_one_best)
+        KALDI_WARN << "No 1-best present for utterance " << key;
+      else
+        KALDI_WARN << "No 'times' present for utterance " << key;
+      return;
+    }
+    const MinimumBayesRisk &mbr = *(output->mbr);
+    const std::vector<BaseFloat> &conf = mbr.GetOneBestConfidences();
+    const std::vector<int32> &words = mbr.GetOneBest();
+    const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
+        mbr.GetOneBestTimes();
+    KALDI_ASSERT(conf.size() == words.size() && words.size() == times.size());
+    for (size_t i = 0; i < words.size(); i++) {
+      KALDI_ASSERT(words[i] != 0 || mbr_opts_.print_silence); // Should not have epsilons.
+      ctm_stream_ << key << " 1 " << (frame_shift_ * times[i].first) << ' '
+                  << (frame_shift_ * (times[i].second-times[i].first)) << ' '
+                  << words[i] << ' ' << conf[i] << '\n';
+    }
+    KALDI_LOG << "For utterance " << key << ", Bayes Risk "
+              << mbr.GetBayesRisk() << ", avg. confidence per-word "
+              << std::accumulate(conf.begin(),conf.end(),0.0) / words.size();
+    n_done_++;
+    n_words_ += mbr.GetOneBest().size();
+    tot_bayes_risk_ += mbr.GetBayesRisk();
+  }
+
+  int32 NumDone() const { return n_done_; }
+  int32 NumWords() const { return n_words_; }
+  BaseFloat TotBayesRisk() const { return tot_bayes_risk_; }
+ private:
+  const MinimumBayesRiskOptions &mbr_opts_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  BaseFloat frame_shift_;
+  RandomAccessInt32VectorReader *one_best_reader_;
+  RandomAccessBaseFloatPairVectorReader *times_reader_;
+  mutable std::mutex reader_mutex_;
+  std::ostream &ctm_stream_;
+  int32 n_done_, n_words_;
+  BaseFloat tot_bayes_risk_;
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
@@ -72,6 +178,8 @@ int main(int argc, char *argv[]) {
 
     MinimumBayesRiskOptions mbr_opts;
     mbr_opts.Register(&po);
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -123,60 +231,14 @@ int main(int argc, char *argv[]) {
     // the #digits after the decimal point.
     ko.Stream().precision(confidence_digits);
 
-    int32 n_done = 0, n_words = 0;
-    BaseFloat tot_bayes_risk = 0.0;
-
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice clat = clat_reader.Value();
-      clat_reader.FreeCurrent();
-      fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
-
-      MinimumBayesRisk *mbr = NULL;
-
-      if (one_best_rspecifier == "") {
-        mbr = new MinimumBayesRisk(clat, mbr_opts);
-      } else {
-        // check,
-        if (!one_best_reader.HasKey(key)) {
-          KALDI_WARN << "No 1-best present for utterance " << key;
-          continue;
-        }
-        if (times_rspecifier != "" && !times_reader.HasKey(key)) {
-          KALDI_WARN << "No 'times' present for utterance " << key;
-          continue;
-        }
-        // get the 'mbr' decoding object,
-        if (times_rspecifier == "") {
-          const std::vector<int32> &one_best = one_best_reader.Value(key);
-          mbr = new MinimumBayesRisk(clat, one_best, mbr_opts); // no 'times',
-        } else {
-          // with initial 'times' of the bins,
-          const std::vector<int32> &one_best = one_best_reader.Value(key);
-          const std::vector<std::pair<BaseFloat,BaseFloat> > &times = times_reader.Value(key);
-          mbr = new MinimumBayesRisk(clat, one_best, times, mbr_opts);
-        }
-      }
-
-      const std::vector<BaseFloat> &conf = mbr->GetOneBestConfidences();
-      const std::vector<int32> &words = mbr->GetOneBest();
-      const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
-          mbr->GetOneBestTimes();
-      KALDI_ASSERT(conf.size() == words.size() && words.size() == times.size());
-      for (size_t i = 0; i < words.size(); i++) {
-        KALDI_ASSERT(words[i] != 0 || mbr_opts.print_silence); // Should not have epsilons.
-        ko.Stream() << key << " 1 " << (frame_shift * times[i].first) << ' '
-                    << (frame_shift * (times[i].second-times[i].first)) << ' '
-                    << words[i] << ' ' << conf[i] << '\n';
-      }
-      KALDI_LOG << "For utterance " << key << ", Bayes Risk "
-                << mbr->GetBayesRisk() << ", avg. confidence per-word "
-                << std::accumulate(conf.begin(),conf.end(),0.0) / words.size();
-      n_done++;
-      n_words += mbr->GetOneBest().size();
-      tot_bayes_risk += mbr->GetBayesRisk();
-      delete mbr;
-    }
+    // The lattices are decoded in parallel if --num-threads > 1, and the ctm
+    // written in the original order.
+    LatticeToCtmConf processor(mbr_opts, lm_scale, acoustic_scale,
+                               frame_shift, &one_best_reader, &times_reader,
+                               ko.Stream());
+    ProcessTableInParallel(sequencer_config, &clat_reader, &processor);
+    int32 n_done = processor.NumDone(), n_words = processor.NumWords();
+    BaseFloat tot_bayes_risk = processor.TotBayesRisk();
 
     KALDI_LOG << "Done " << n_done << " lattices.";
     KALDI_LOG << "Overall average Bayes Risk per sentence is "
@@ -22,6 +22,7 @@
 #include "util/common-utils.h"
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
+#include "lat/lattice-nbest.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -37,7 +38,8 @@ int main(int argc, char *argv[]) {
         "Note: only guarantees distinct word sequences if distinct paths in\n"
         "input lattices had distinct word-sequences (this will not be true if\n"
         "you produced lattices with --determinize-lattice=false, i.e. state-level\n"
-        "lattices).\n"
+        "lattices).  The n-best paths are found directly on the CompactLattice\n"
+        "by a lazy k-shortest-paths algorithm; use --beam to stop early.\n"
         "Usage: lattice-to-nbest [options] <lattice-rspecifier> <lattice-wspecifier>\n"
         " e.g.: lattice-to-nbest --acoustic-scale=0.1 --n=10 ark:1.lats ark:nbest.lats\n";
 
@@ -46,10 +48,14 @@ int main(int argc, char *argv[]) {
     bool random = false;
     int32 srand_seed = 0;
     int32 n = 1;
+    BaseFloat beam = std::numeric_limits<BaseFloat>::infinity();
 
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model scores.");
     po.Register("n", &n, "Number of distinct paths");
+    po.Register("beam", &beam, "If set, output only paths whose cost is "
+                "within this beam of the best path (after scaling); this makes "
+                "it faster for large --n.  Not used if --random=true.");
     po.Register("random", &random,
                 "If true, generate n random paths instead of n-best paths");
     po.Register("srand", &srand_seed, "Seed for random number generator "
@@ -70,8 +76,7 @@ int main(int argc, char *argv[]) {
         lats_wspecifier = po.GetArg(2);
 
 
-    // Read as regular lattice.
-    SequentialLatticeReader lattice_reader(lats_rspecifier);
+    SequentialCompactLatticeReader clat_reader(lats_rspecifier);
 
     // Write as compact lattice.
     CompactLatticeWriter compact_nbest_writer(lats_wspecifier);
@@ -81,43 +86,44 @@ int main(int argc, char *argv[]) {
 
     if (acoustic_scale == 0.0 || lm_scale == 0.0)
       KALDI_ERR << "Do not use a zero acoustic or LM scale (cannot be inverted)";
-    for (; !lattice_reader.Done(); lattice_reader.Next()) {
-      std::string key = lattice_reader.Key();
-      Lattice lat = lattice_reader.Value();
-      lattice_reader.FreeCurrent();
-      fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &lat);
-
-      std::vector<Lattice> nbest_lats;
-      {
-        Lattice nbest_lat;
-        if (!random) {
-          fst::ShortestPath(lat, &nbest_lat, n);
-        } else {
-          fst::UniformArcSelector<LatticeArc> uniform_selector;
-          fst::RandGenOptions<fst::UniformArcSelector<LatticeArc> > opts(uniform_selector);
-          opts.npath = n;
-          fst::RandGen(lat, &nbest_lat, opts);
-        }
+    for (; !clat_reader.Done(); clat_reader.Next()) {
+      std::string key = clat_reader.Key();
+      CompactLattice clat = clat_reader.Value();
+      clat_reader.FreeCurrent();
+      fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
+
+      std::vector<CompactLattice> nbest_clats;
+      if (!random) {
+        CompactLatticeNbestAsFsts(clat, n, beam, &nbest_clats);
+      } else {
+        Lattice lat, nbest_lat;
+        ConvertLattice(clat, &lat);
+        fst::UniformArcSelector<LatticeArc> uniform_selector;
+        fst::RandGenOptions<fst::UniformArcSelector<LatticeArc> > opts(uniform_selector);
+        opts.npath = n;
+        fst::RandGen(lat, &nbest_lat, opts);
+        std::vector<Lattice> nbest_lats;
         fst::ConvertNbestToVector(nbest_lat, &nbest_lats);
+        nbest_clats.resize(nbest_lats.size());
+        for (size_t k = 0; k < nbest_lats.size(); k++)
+          ConvertLattice(nbest_lats[k], &(nbest_clats[k]));
       }
 
-      if (nbest_lats.empty()) {
+      if (nbest_clats.empty()) {
         KALDI_WARN << "Possibly empty lattice for utterance-id " << key
                    << "(no N-best entries)";
       } else {
-        for (int32 k = 0; k < static_cast<int32>(nbest_lats.size()); k++) {
+        for (int32 k = 0; k < static_cast<int32>(nbest_clats.size()); k++) {
           std::ostringstream s;
           s << key << "-" << (k+1); // so if key is "utt_id", the keys
           // of the n-best are utt_id-1, utt_id-2, utt_id-3, etc.
           std::string nbest_key = s.str();
           fst::ScaleLattice(fst::LatticeScale(1.0/lm_scale, 1.0/acoustic_scale),
-                            &(nbest_lats[k]));
-          CompactLattice nbest_clat;
-          ConvertLattice(nbest_lats[k], &nbest_clat); // write in compact form.
-          compact_nbest_writer.Write(nbest_key, nbest_clat);
+                            &(nbest_clats[k]));
+          compact_nbest_writer.Write(nbest_key, nbest_clats[k]);
         }
         n_done++;
-        n_paths_out += nbest_lats.size();
+        n_paths_out += nbest_clats.size();
       }
     }
 
@@ -0,0 +1,176 @@
+// lm/const-arpa-lm-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <set>
+#include <sstream>
+#include "lm/const-arpa-lm.h"
+
+namespace kaldi {
+
+const int32 kBos = 1, kEos = 2, kUnk = 3;
+
+// Writes a random 4-gram Arpa LM with integer words 1 ... num_words to
+// 'filename'.  Each n-gram's prefix and suffix are also n-grams.
+static void WriteRandomArpa(int32 num_words, const std::string &filename) {
+  int32 order = 4;
+  std::vector<std::set<std::vector<int32> > > ngrams(order + 1);
+  for (int32 w = 1; w <= num_words; w++)
+    ngrams[1].insert(std::vector<int32>(1, w));
+  for (int32 n = 2; n <= order; n++) {
+    std::vector<std::vector<int32> > prefixes(ngrams[n - 1].begin(),
+                                              ngrams[n - 1].end());
+    for (int32 i = 0; i < 8 * num_words; i++) {
+      std::vector<int32> ngram = prefixes[RandInt(0, prefixes.size() - 1)];
+      ngram.push_back(RandInt(1, num_words));
+      if (ngram.back() == kBos) continue;
+      std::vector<int32> suffix(ngram.begin() + 1, ngram.end());
+      if (ngrams[n - 1].count(suffix) != 0)
+        ngrams[n].insert(ngram);
+    }
+  }
+  Output ko(filename, false);
+  std::ostream &os = ko.Stream();
+  os << "\n\\data\\\n";
+  for (int32 n = 1; n <= order; n++)
+    os << "ngram " << n << "=" << ngrams[n].size() << "\n";
+  for (int32 n = 1; n <= order; n++) {
+    os << "\n\\" << n << "-grams:\n";
+    for (std::set<std::vector<int32> >::iterator iter = ngrams[n].begin();
+         iter != ngrams[n].end(); ++iter) {
+      os << -0.1 * RandInt(1, 50) << '\t';
+      for (size_t i = 0; i < iter->size(); i++)
+        os << (i > 0 ? " " : "") << (*iter)[i];
+      if (n < order)
+        os << '\t' << -0.1 * RandInt(0, 10);
+      os << "\n";
+    }
+  }
+  os << "\n\\end\\\n";
+}
+
+// Checks that the faster ways of getting the n-gram log-probs give exactly
+// the same answers as GetNgramLogprob().
+static void TestHistoryLookup(const ConstArpaLm &lm, int32 num_words) {
+  for (int32 i = 0; i < 1000; i++) {
+    std::vector<int32> hist(RandInt(0, 5));
+    for (size_t j = 0; j < hist.size(); j++)
+      hist[j] = RandInt(1, num_words + 2);  // may be OOV.
+    ConstArpaLm::History history;
+    lm.LookUpHistory(hist, &history);
+    std::vector<int32> words(10);
+    for (size_t j = 0; j < words.size(); j++)
+      words[j] = RandInt(1, num_words + 2);
+    std::vector<float> logprobs;
+    lm.GetNgramLogprobs(history, words, &logprobs);
+    for (size_t j = 0; j < words.size(); j++) {
+      float logprob = lm.GetNgramLogprob(words[j], hist);
+      KALDI_ASSERT(lm.GetNgramLogprob(words[j], history) == logprob &&
+                   logprobs[j] == logprob);
+    }
+  }
+}
+
+// Checks that the FSTs give the same arcs whether or not they use a cache,
+// and when the cache is shared between FSTs.
+static void TestArcCache(const ConstArpaLm &lm, int32 num_words) {
+  ConstArpaLmArcCache cache(100);  // small, so that entries get evicted.
+  for (int32 n = 0; n < 5; n++) {
+    ConstArpaLmDeterministicFst fst1(lm), fst2(lm, &cache);
+    for (int32 i = 0; i < 100; i++) {
+      fst::StdArc::StateId s1 = fst1.Start(), s2 = fst2.Start();
+      int32 length = RandInt(1, 10);
+      for (int32 j = 0; j < length; j++) {
+        KALDI_ASSERT(fst1.Final(s1) == fst2.Final(s2));
+        int32 word = RandInt(1, num_words);
+        fst::StdArc arc1, arc2;
+        bool ans1 = fst1.GetArc(s1, word, &arc1),
+            ans2 = fst2.GetArc(s2, word, &arc2);
+        KALDI_ASSERT(ans1 == ans2);
+        if (!ans1) break;
+        KALDI_ASSERT(arc1.ilabel == arc2.ilabel && arc1.weight == arc2.weight);
+        s1 = arc1.nextstate;
+        s2 = arc2.nextstate;
+      }
+    }
+  }
+}
+
+// Checks that two language models give the same log-probs (up to rounding
+// if !exact).
+static void TestSameLogprobs(const ConstArpaLm &lm1, const ConstArpaLm &lm2,
+                             int32 num_words, bool exact) {
+  for (int32 i = 0; i < 1000; i++) {
+    std::vector<int32> hist(RandInt(0, 5));
+    for (size_t j = 0; j < hist.size(); j++)
+      hist[j] = RandInt(1, num_words + 2);
+    int32 word = RandInt(1, num_words + 2);
+    float logprob1 = lm1.GetNgramLogprob(word, hist),
+        logprob2 = lm2.GetNgramLogprob(word, hist);
+    KALDI_ASSERT(exact ? logprob1 == logprob2 :
+                 ApproxEqual(logprob1, logprob2, 1.0e-05));
+    KALDI_ASSERT(lm1.HistoryStateExists(hist) ==
+                 lm2.HistoryStateExists(hist));
+  }
+  if (exact) {
+    std::ostringstream arpa1, arpa2;
+    lm1.WriteArpa(arpa1);
+    lm2.WriteArpa(arpa2);
+    KALDI_ASSERT(arpa1.str() == arpa2.str());
+  }
+}
+
+static void UnitTestConstArpaLm() {
+  int32 num_words = RandInt(5, 20);
+  WriteRandomArpa(num_words, "tmp.arpa");
+  ArpaParseOptions options;
+  options.bos_symbol = kBos;
+  options.eos_symbol = kEos;
+  options.unk_symbol = kUnk;
+  BuildConstArpaLm(options, "tmp.arpa", "tmp.carpa");
+  ConstArpaLm lm;
+  ReadKaldiObject("tmp.carpa", &lm);
+  TestHistoryLookup(lm, num_words);
+  TestArcCache(lm, num_words);
+
+  // The random LM has fewer distinct log-probs than codes, so quantizing it
+  // loses nothing; but the unquantized formats lose the last bit of the leaf
+  // log-probs (see const-arpa-lm.h), so the results may differ slightly.
+  ConstArpaLmFormatOptions format_options;
+  format_options.mapped = true;
+  format_options.quantize_bits = 8 * RandInt(0, 2);
+  BuildConstArpaLm(options, format_options, "tmp.arpa", "tmp.carpa");
+  KALDI_ASSERT(IsMappedConstArpaLmFile("tmp.carpa"));
+  ConstArpaLm mapped_lm;
+  ReadConstArpaLm("tmp.carpa", &mapped_lm);
+  KALDI_ASSERT(mapped_lm.QuantizeBits() == format_options.quantize_bits);
+  TestSameLogprobs(lm, mapped_lm, num_words,
+                   format_options.quantize_bits == 0);
+  TestHistoryLookup(mapped_lm, num_words);
+  TestArcCache(mapped_lm, num_words);
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 5; i++)
+    kaldi::UnitTestConstArpaLm();
+  unlink("tmp.arpa");
+  unlink("tmp.carpa");
+  std::cout << "Test OK\n";
+}
@@ -18,6 +18,8 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <limits>
 #include <sstream>
 #include <utility>
@@ -49,6 +51,47 @@ struct ArpaLine {
   }
 };
 
+// Computes a codebook of <num_codes> values for quantizing <values>, which is
+// sorted in place. If there are no more distinct values than codes they are
+// represented exactly; otherwise we divide the sorted values into <num_codes>
+// bins with the same number of values, and use the mean of each bin. The
+// codebook is sorted, and padded to <num_codes> entries.
+static void ComputeQuantizationCodebook(std::vector<float> *values,
+                                        int32 num_codes,
+                                        std::vector<float> *codebook) {
+  std::sort(values->begin(), values->end());
+  size_t num_values = values->size(), num_distinct = 0;
+  for (size_t i = 0; i < num_values; ++i) {
+    if (i == 0 || (*values)[i] != (*values)[i - 1]) num_distinct++;
+  }
+  codebook->clear();
+  if (num_distinct <= num_codes) {
+    for (size_t i = 0; i < num_values; ++i) {
+      if (i == 0 || (*values)[i] != (*values)[i - 1])
+        codebook->push_back((*values)[i]);
+    }
+  } else {
+    for (int32 b = 0; b < num_codes; ++b) {
+      size_t begin = num_values * b / num_codes,
+          end = num_values * (b + 1) / num_codes;
+      double sum = 0.0;
+      for (size_t i = begin; i < end; ++i) sum += (*values)[i];
+      codebook->push_back(sum / (end - begin));
+    }
+  }
+  if (codebook->empty()) codebook->push_back(0.0);
+  codebook->resize(num_codes, codebook->back());
+}
+
+// Returns the index of the entry of the sorted <codebook> closest to <value>.
+static uint32 QuantizeValue(const std::vector<float> &codebook, float value) {
+  std::vector<float>::const_iterator iter =
+      std::lower_bound(codebook.begin(), codebook.end(), value);
+  if (iter == codebook.end()) return codebook.size() - 1;
+  if (iter != codebook.begin() && value - *(iter - 1) < *iter - value) --iter;
+  return iter - codebook.begin();
+}
+
 // Auxiliary class to build ConstArpaLm. We first use this class to figure out
 // the relative address of different LmStates, and then put everything into one
 // block in memory.
@@ -132,17 +175,38 @@ class LmState {
     return (backoff_logprob_ == 0.0 && children_.empty());
   }
 
+  // Checks if none of the children has an LmState of its own, in which case
+  // the state is "packed" if the language model is quantized.
+  bool ChildrenAreLeaves() const {
+    if (is_child_final_order_) return true;
+    for (size_t i = 0; i < children_.size(); ++i) {
+      if (!children_[i].second.state->IsLeaf()) return false;
+    }
+    return true;
+  }
+
   // Computes the size of the memory that the current LmState would take in
-  // <lm_states> array. It's the number of 4-byte chunks.
-  int32 MemSize() const {
+  // <lm_states> array. It's the number of 4-byte chunks.  <quantize_bits> is
+  // 0 if the language model is not quantized, else 8 or 16.
+  int32 MemSize(int32 quantize_bits) const {
     if (IsLeaf() && !is_unigram_) {
       // We don't create an entry in this case; the logprob will be stored in
       // the same int32 that we would normally store the pointer in.
       return 0;
-    } else {
+    } else if (quantize_bits == 0) {
       // We store the following information:
       // logprob, backoff_logprob, children.size() and children data.
       return (3 + 2 * children_.size());
+    } else if (ChildrenAreLeaves()) {
+      // Quantized logprob and backoff_logprob, children.size(), the words and
+      // the packed logprobs.
+      int32 codes_per_int = 32 / quantize_bits;
+      return (2 + children_.size() +
+              (children_.size() + codes_per_int - 1) / codes_per_int);
+    } else {
+      // Quantized logprob and backoff_logprob, children.size() and children
+      // data.
+      return (2 + 2 * children_.size());
     }
   }
 
@@ -176,8 +240,13 @@ class LmState {
 // auxiliary class LmState above.
 class ConstArpaLmBuilder : public ArpaFileParser {
  public:
-  explicit ConstArpaLmBuilder(ArpaParseOptions options)
-      : ArpaFileParser(options, NULL) {
+  // If <quantize_bits> is 8 or 16, the log-probs are quantized; such language
+  // models can only be written with WriteMapped().
+  explicit ConstArpaLmBuilder(ArpaParseOptions options,
+                              int32 quantize_bits = 0)
+      : ArpaFileParser(options, NULL), quantize_bits_(quantize_bits) {
+    KALDI_ASSERT(quantize_bits == 0 || quantize_bits == 8 ||
+                 quantize_bits == 16);
     ngram_order_ = 0;
     num_words_ = 0;
     overflow_buffer_size_ = 0;
@@ -205,6 +274,9 @@ class ConstArpaLmBuilder : public ArpaFileParser {
   // Writes ConstArpaLm.
   void Write(std::ostream &os, bool binary) const;
 
+  // Writes ConstArpaLm in the mapped format; see ConstArpaLm::WriteMapped().
+  void WriteMapped(std::ostream &os) const;
+
   void SetMaxAddressOffset(const int32 max_address_offset) {
     KALDI_WARN << "You are changing <max_address_offset_>; the default should "
         << "not be changed unless you are in testing mode.";
@@ -227,9 +299,19 @@ class ConstArpaLmBuilder : public ArpaFileParser {
   };
 
  private:
+  // Works out <logprob_codebook_> and <backoff_codebook_>.
+  void ComputeCodebooks();
+
   // Indicating if ConstArpaLm has been built or not.
   bool is_built_;
 
+  // 8 or 16 if the log-probs are quantized, else 0.
+  int32 quantize_bits_;
+
+  // The codebooks, if quantized; see ConstArpaLm.
+  std::vector<float> logprob_codebook_;
+  std::vector<float> backoff_codebook_;
+
   // Maximum relative address for the child. We put it here just for testing.
   // The default value is 30-bits and should not be changed except for testing.
   int32 max_address_offset_;
@@ -327,6 +409,30 @@ void ConstArpaLmBuilder::ConsumeNGram(const NGram &ngram) {
   }
 }
 
+void ConstArpaLmBuilder::ComputeCodebooks() {
+  // The backoff log-probs of most LmStates are zero, so we make sure that zero
+  // is represented exactly.
+  std::vector<float> logprobs, backoff_logprobs;
+  unordered_map<std::vector<int32>,
+                LmState*, VectorHasher<int32> >::iterator iter;
+  for (iter = seq_to_state_.begin(); iter != seq_to_state_.end(); ++iter) {
+    LmState *lm_state = iter->second;
+    logprobs.push_back(lm_state->Logprob());
+    if (lm_state->BackoffLogprob() != 0.0)
+      backoff_logprobs.push_back(lm_state->BackoffLogprob());
+    if (lm_state->IsChildFinalOrder()) {
+      for (int32 i = 0; i < lm_state->NumChildren(); ++i)
+        logprobs.push_back(lm_state->GetChild(i).second.prob);
+    }
+  }
+  int32 num_codes = 1 << quantize_bits_;
+  ComputeQuantizationCodebook(&logprobs, num_codes, &logprob_codebook_);
+  ComputeQuantizationCodebook(&backoff_logprobs, num_codes - 1,
+                              &backoff_codebook_);
+  backoff_codebook_.push_back(0.0);
+  std::sort(backoff_codebook_.begin(), backoff_codebook_.end());
+}
+
 // ConstArpaLm can be built in the following steps, assuming we have already
 // created LmStates <seq_to_state_>:
 // 1. Sort LmStates lexicographically.
@@ -360,7 +466,7 @@ void ConstArpaLmBuilder::ReadComplete() {
   unordered_map<std::vector<int32>,
                 LmState*, VectorHasher<int32> >::iterator iter;
   for (iter = seq_to_state_.begin(); iter != seq_to_state_.end(); ++iter) {
-    if (iter->second->MemSize() > 0) {
+    if (iter->second->MemSize(quantize_bits_) > 0) {
       sorted_vec.push_back(
           std::make_pair(const_cast<std::vector<int32>*>(&(iter->first)),
                          iter->second));
@@ -372,14 +478,16 @@ void ConstArpaLmBuilder::ReadComplete() {
 
   // STEP 2: updating <my_address> in LmState.
   for (int32 i = 0; i < sorted_vec.size(); ++i) {
-    lm_states_size_ += sorted_vec[i].second->MemSize();
+    lm_states_size_ += sorted_vec[i].second->MemSize(quantize_bits_);
     if (i == 0) {
       sorted_vec[i].second->SetMyAddress(0);
     } else {
       sorted_vec[i].second->SetMyAddress(sorted_vec[i - 1].second->MyAddress()
-          + sorted_vec[i - 1].second->MemSize());
+          + sorted_vec[i - 1].second->MemSize(quantize_bits_));
     }
   }
+  if (quantize_bits_ != 0)
+    ComputeCodebooks();
 
   // STEP 3: creating memory block to store LmStates.
   // Reserves a memory block for LmStates.
@@ -400,16 +508,33 @@ void ConstArpaLmBuilder::ReadComplete() {
     // Current address.
     int32* parent_address = lm_states_ + lm_states_index;
 
-    // Adds logprob.
-    Int32AndFloat logprob_f(sorted_vec[i].second->Logprob());
-    lm_states_[lm_states_index++] = logprob_f.i;
+    // In the quantized case, children that are all leaves are "packed".
+    bool packed = (quantize_bits_ != 0 &&
+                   sorted_vec[i].second->ChildrenAreLeaves());
+    if (quantize_bits_ == 0) {
+      // Adds logprob.
+      Int32AndFloat logprob_f(sorted_vec[i].second->Logprob());
+      lm_states_[lm_states_index++] = logprob_f.i;
 
-    // Adds backoff_logprob.
-    Int32AndFloat backoff_logprob_f(sorted_vec[i].second->BackoffLogprob());
-    lm_states_[lm_states_index++] = backoff_logprob_f.i;
+      // Adds backoff_logprob.
+      Int32AndFloat backoff_logprob_f(sorted_vec[i].second->BackoffLogprob());
+      lm_states_[lm_states_index++] = backoff_logprob_f.i;
 
-    // Adds num_children.
-    lm_states_[lm_states_index++] = sorted_vec[i].second->NumChildren();
+      // Adds num_children.
+      lm_states_[lm_states_index++] = sorted_vec[i].second->NumChildren();
+    } else {
+      // Adds the quantized logprob and backoff_logprob.
+      uint32 logprob_code = QuantizeValue(logprob_codebook_,
+                                          sorted_vec[i].second->Logprob()),
+          backoff_logprob_code = QuantizeValue(
+              backoff_codebook_, sorted_vec[i].second->BackoffLogprob());
+      lm_states_[lm_states_index++] =
+          static_cast<int32>(logprob_code | (backoff_logprob_code << 16));
+
+      // Adds num_children, and whether it is packed.
+      lm_states_[lm_states_index++] =
+          2 * sorted_vec[i].second->NumChildren() + (packed ? 1 : 0);
+    }
 
     // Adds children, there are 3 cases:
     // 1. Child is a leaf and not unigram
@@ -417,47 +542,75 @@ void ConstArpaLmBuilder::ReadComplete() {
     //    2.1 Relative address can be represented by 30 bits
     //    2.2 Relative address cannot be represented by 30 bits
     sorted_vec[i].second->SortChildren();
-    for (int32 j = 0; j < sorted_vec[i].second->NumChildren(); ++j) {
-      int32 child_info;
-      if (sorted_vec[i].second->IsChildFinalOrder() ||
-          sorted_vec[i].second->GetChild(j).second.state->MemSize() == 0) {
-        // Child is a leaf and not unigram. In this case we will not create an
-        // entry in <lm_states_>; instead, we put the logprob in the place where
-        // we normally store the poitner.
-        Int32AndFloat child_logprob_f;
-        if (sorted_vec[i].second->IsChildFinalOrder()) {
-          child_logprob_f.f = sorted_vec[i].second->GetChild(j).second.prob;
-        } else {
-          child_logprob_f.f =
-              sorted_vec[i].second->GetChild(j).second.state->Logprob();
-        }
-        child_info = child_logprob_f.i;
-        child_info &= ~1;   // Sets the last bit to 0 so <child_info> is even.
-      } else {
-        // Child is not a leaf or is unigram.
-        int64 offset =
-            sorted_vec[i].second->GetChild(j).second.state->MyAddress()
-            - sorted_vec[i].second->MyAddress();
-        KALDI_ASSERT(offset > 0);
-        if (offset <= max_address_offset_) {
-          // Relative address can be represented by 30 bits.
-          child_info = offset * 2;
-          child_info |= 1;
+    int32 num_children = sorted_vec[i].second->NumChildren();
+    if (packed) {
+      // The words, and then the logprob codes packed into int32s.
+      int32 codes_per_int = 32 / quantize_bits_;
+      int64 codes_index = lm_states_index + num_children;
+      int64 codes_end = codes_index +
+          (num_children + codes_per_int - 1) / codes_per_int;
+      for (int64 k = codes_index; k < codes_end; ++k)
+        lm_states_[k] = 0;
+      for (int32 j = 0; j < num_children; ++j) {
+        std::pair<int32, LmState::ChildType> child =
+            sorted_vec[i].second->GetChild(j);
+        float child_logprob = sorted_vec[i].second->IsChildFinalOrder() ?
+            child.second.prob : child.second.state->Logprob();
+        uint32 code = QuantizeValue(logprob_codebook_, child_logprob);
+        lm_states_[lm_states_index + j] = child.first;
+        lm_states_[codes_index + j / codes_per_int] |= static_cast<int32>(
+            code << (quantize_bits_ * (j % codes_per_int)));
+      }
+      lm_states_index = codes_end;
+    } else {
+      for (int32 j = 0; j < num_children; ++j) {
+        int32 child_info;
+        if (sorted_vec[i].second->IsChildFinalOrder() ||
+            sorted_vec[i].second->GetChild(j).second.state->MemSize(
+                quantize_bits_) == 0) {
+          // Child is a leaf and not unigram. In this case we will not create
+          // an entry in <lm_states_>; instead, we put the logprob in the place
+          // where we normally store the poitner.
+          Int32AndFloat child_logprob_f;
+          if (sorted_vec[i].second->IsChildFinalOrder()) {
+            child_logprob_f.f = sorted_vec[i].second->GetChild(j).second.prob;
+          } else {
+            child_logprob_f.f =
+                sorted_vec[i].second->GetChild(j).second.state->Logprob();
+          }
+          if (quantize_bits_ == 0) {
+            child_info = child_logprob_f.i;
+            child_info &= ~1;   // Sets the last bit to 0 so it is even.
+          } else {
+            child_info = 2 * QuantizeValue(logprob_codebook_,
+                                           child_logprob_f.f);
+          }
         } else {
-          // Relative address cannot be represented by 30 bits, we have to put
-          // the child address into <overflow_buffer_>.
-          int32* abs_address = parent_address + offset;
-          overflow_buffer_vec.push_back(abs_address);
-          int32 overflow_buffer_index = overflow_buffer_vec.size() - 1;
-          child_info = overflow_buffer_index * 2;
-          child_info |= 1;
-          child_info *= -1;
+          // Child is not a leaf or is unigram.
+          int64 offset =
+              sorted_vec[i].second->GetChild(j).second.state->MyAddress()
+              - sorted_vec[i].second->MyAddress();
+          KALDI_ASSERT(offset > 0);
+          if (offset <= max_address_offset_) {
+            // Relative address can be represented by 30 bits.
+            child_info = offset * 2;
+            child_info |= 1;
+          } else {
+            // Relative address cannot be represented by 30 bits, we have to put
+            // the child address into <overflow_buffer_>.
+            int32* abs_address = parent_address + offset;
+            overflow_buffer_vec.push_back(abs_address);
+            int32 overflow_buffer_index = overflow_buffer_vec.size() - 1;
+            child_info = overflow_buffer_index * 2;
+            child_info |= 1;
+            child_info *= -1;
+          }
         }
+        // Child word.
+        lm_states_[lm_states_index++] = sorted_vec[i].second->GetChild(j).first;
+        // Child info.
+        lm_states_[lm_states_index++] = child_info;
       }
-      // Child word.
-      lm_states_[lm_states_index++] = sorted_vec[i].second->GetChild(j).first;
-      // Child info.
-      lm_states_[lm_states_index++] = child_info;
     }
 
     // If the current state corresponds to an unigram, then create a separate
@@ -494,11 +647,25 @@ void ConstArpaLmBuilder::Write(std::ostream &os, bool binary) const {
   const_arpa_lm.Write(os, binary);
 }
 
+void ConstArpaLmBuilder::WriteMapped(std::ostream &os) const {
+  KALDI_ASSERT(is_built_);
+  ConstArpaLm const_arpa_lm(
+      Options().bos_symbol, Options().eos_symbol, Options().unk_symbol,
+      ngram_order_, num_words_, overflow_buffer_size_, lm_states_size_,
+      unigram_states_, overflow_buffer_, lm_states_, quantize_bits_,
+      logprob_codebook_, backoff_codebook_);
+  const_arpa_lm.WriteMapped(os);
+}
+
 void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   KALDI_ASSERT(initialized_);
   if (!binary) {
     KALDI_ERR << "text-mode writing is not implemented for ConstArpaLm.";
   }
+  if (quantize_bits_ != 0) {
+    KALDI_ERR << "Quantized ConstArpaLm can only be written in the mapped "
+              << "format.";
+  }
 
   WriteToken(os, binary, "<ConstArpaLm>");
 
@@ -718,6 +885,209 @@ void ConstArpaLm::ReadInternalOldFormat(std::istream &is, bool binary) {
   initialized_ = true;
 }
 
+// The mapped format (see ConstArpaLm::WriteMapped()) starts with this header.
+// The sections it points to start at multiples of kMappedConstArpaLmAlignment.
+static const char kMappedConstArpaLmMagic[8] = { 'K', 'A', 'L', 'D', 'I', 'C',
+                                                 'A', 'L' };
+static const int32 kMappedConstArpaLmVersion = 1;
+static const uint64 kMappedConstArpaLmAlignment = 64;
+
+struct MappedConstArpaLmHeader {
+  char magic[8];              // kMappedConstArpaLmMagic.
+  int32 version;              // kMappedConstArpaLmVersion.
+  int32 bos_symbol;
+  int32 eos_symbol;
+  int32 unk_symbol;
+  int32 ngram_order;
+  int32 num_words;
+  int32 overflow_buffer_size;
+  int32 quantize_bits;
+  int64 lm_states_size;
+  uint64 codebooks_offset;    // The two codebooks, if quantized (floats).
+  uint64 unigram_offset;      // Offsets of unigram LmStates, as in Write().
+  uint64 overflow_offset;     // Offsets in the overflow buffer, as in Write().
+  uint64 lm_states_offset;    // <lm_states_>.
+};
+
+static uint64 RoundUpToAlignment(uint64 offset) {
+  return (offset + kMappedConstArpaLmAlignment - 1) /
+      kMappedConstArpaLmAlignment * kMappedConstArpaLmAlignment;
+}
+
+// Writes zero bytes to <os> to go from offset <offset> to <new_offset>.
+static void WriteMappedPadding(std::ostream &os, uint64 offset,
+                               uint64 new_offset) {
+  static const char zeros[kMappedConstArpaLmAlignment] = { 0 };
+  KALDI_ASSERT(new_offset >= offset &&
+               new_offset - offset < kMappedConstArpaLmAlignment);
+  os.write(zeros, new_offset - offset);
+}
+
+void ConstArpaLm::WriteMapped(std::ostream &os) const {
+  KALDI_ASSERT(initialized_);
+  int32 num_codes = (quantize_bits_ == 0 ? 0 : 1 << quantize_bits_);
+
+  MappedConstArpaLmHeader header;
+  memset(static_cast<void*>(&header), 0, sizeof(header));
+  memcpy(header.magic, kMappedConstArpaLmMagic, sizeof(header.magic));
+  header.version = kMappedConstArpaLmVersion;
+  header.bos_symbol = bos_symbol_;
+  header.eos_symbol = eos_symbol_;
+  header.unk_symbol = unk_symbol_;
+  header.ngram_order = ngram_order_;
+  header.num_words = num_words_;
+  header.overflow_buffer_size = overflow_buffer_size_;
+  header.quantize_bits = quantize_bits_;
+  header.lm_states_size = lm_states_size_;
+  header.codebooks_offset = RoundUpToAlignment(sizeof(header));
+  uint64 codebooks_end = header.codebooks_offset +
+      2 * sizeof(float) * num_codes;
+  header.unigram_offset = RoundUpToAlignment(codebooks_end);
+  uint64 unigram_end = header.unigram_offset + sizeof(int64) * num_words_;
+  header.overflow_offset = RoundUpToAlignment(unigram_end);
+  uint64 overflow_end = header.overflow_offset +
+      sizeof(int64) * overflow_buffer_size_;
+  header.lm_states_offset = RoundUpToAlignment(overflow_end);
+
+  // As in Write(), we write the offsets of the pointers in <unigram_states_>
+  // and <overflow_buffer_> plus one, or zero for NULL.
+  std::vector<int64> unigram_address(num_words_),
+      overflow_address(overflow_buffer_size_);
+  for (int32 i = 0; i < num_words_; ++i) {
+    unigram_address[i] = (unigram_states_[i] == NULL) ? 0 :
+        unigram_states_[i] - lm_states_ + 1;
+  }
+  for (int32 i = 0; i < overflow_buffer_size_; ++i) {
+    overflow_address[i] = (overflow_buffer_[i] == NULL) ? 0 :
+        overflow_buffer_[i] - lm_states_ + 1;
+  }
+
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  WriteMappedPadding(os, sizeof(header), header.codebooks_offset);
+  if (num_codes > 0) {
+    os.write(reinterpret_cast<const char*>(&(logprob_codebook_[0])),
+             sizeof(float) * num_codes);
+    os.write(reinterpret_cast<const char*>(&(backoff_codebook_[0])),
+             sizeof(float) * num_codes);
+  }
+  WriteMappedPadding(os, codebooks_end, header.unigram_offset);
+  if (num_words_ > 0)
+    os.write(reinterpret_cast<const char*>(&(unigram_address[0])),
+             sizeof(int64) * num_words_);
+  WriteMappedPadding(os, unigram_end, header.overflow_offset);
+  if (overflow_buffer_size_ > 0)
+    os.write(reinterpret_cast<const char*>(&(overflow_address[0])),
+             sizeof(int64) * overflow_buffer_size_);
+  WriteMappedPadding(os, overflow_end, header.lm_states_offset);
+  os.write(reinterpret_cast<const char*>(lm_states_),
+           sizeof(int32) * lm_states_size_);
+  if (!os.good()) {
+    KALDI_ERR << "Error writing ConstArpaLm in mapped format.";
+  }
+}
+
+void ConstArpaLm::ReadMapped(const std::string &filename) {
+  KALDI_ASSERT(!initialized_);
+  mapped_file_ = new MemoryMappedFile(filename);
+  const char *data = mapped_file_->Data();
+  uint64 file_size = mapped_file_->Size();
+  if (file_size < sizeof(MappedConstArpaLmHeader)) {
+    KALDI_ERR << "File " << filename << " is too small to be a ConstArpaLm "
+              << "in mapped format.";
+  }
+  // mmap() returns page-aligned addresses, so the header is aligned.
+  const MappedConstArpaLmHeader &header =
+      *reinterpret_cast<const MappedConstArpaLmHeader*>(data);
+  if (memcmp(header.magic, kMappedConstArpaLmMagic,
+             sizeof(header.magic)) != 0) {
+    KALDI_ERR << "File " << filename << " is not a ConstArpaLm in mapped "
+              << "format.";
+  }
+  if (header.version != kMappedConstArpaLmVersion) {
+    KALDI_ERR << "ConstArpaLm " << filename << " has version "
+              << header.version << ", expected " << kMappedConstArpaLmVersion
+              << " (or it was written on a machine with a different byte "
+              << "order).";
+  }
+  bos_symbol_ = header.bos_symbol;
+  eos_symbol_ = header.eos_symbol;
+  unk_symbol_ = header.unk_symbol;
+  ngram_order_ = header.ngram_order;
+  num_words_ = header.num_words;
+  overflow_buffer_size_ = header.overflow_buffer_size;
+  quantize_bits_ = header.quantize_bits;
+  lm_states_size_ = header.lm_states_size;
+  if ((quantize_bits_ != 0 && quantize_bits_ != 8 && quantize_bits_ != 16) ||
+      num_words_ < 0 || overflow_buffer_size_ < 0 || lm_states_size_ <= 0 ||
+      header.codebooks_offset % kMappedConstArpaLmAlignment != 0 ||
+      header.unigram_offset % kMappedConstArpaLmAlignment != 0 ||
+      header.overflow_offset % kMappedConstArpaLmAlignment != 0 ||
+      header.lm_states_offset % kMappedConstArpaLmAlignment != 0) {
+    KALDI_ERR << "Invalid header in ConstArpaLm " << filename;
+  }
+  int32 num_codes = (quantize_bits_ == 0 ? 0 : 1 << quantize_bits_);
+  if (header.codebooks_offset + 2 * sizeof(float) * num_codes > file_size ||
+      header.unigram_offset + sizeof(int64) * num_words_ > file_size ||
+      header.overflow_offset + sizeof(int64) * overflow_buffer_size_ >
+      file_size ||
+      header.lm_states_offset + sizeof(int32) * lm_states_size_ > file_size) {
+    KALDI_ERR << "ConstArpaLm " << filename << " is truncated.";
+  }
+
+  // The codebooks and the pointers are small, so we copy them; the LmStates
+  // are used in place.
+  const float *codebooks =
+      reinterpret_cast<const float*>(data + header.codebooks_offset);
+  logprob_codebook_.assign(codebooks, codebooks + num_codes);
+  backoff_codebook_.assign(codebooks + num_codes, codebooks + 2 * num_codes);
+  lm_states_ = const_cast<int32*>(
+      reinterpret_cast<const int32*>(data + header.lm_states_offset));
+  const int64 *unigram_address =
+      reinterpret_cast<const int64*>(data + header.unigram_offset);
+  unigram_states_ = new int32*[num_words_];
+  for (int32 i = 0; i < num_words_; ++i) {
+    if (unigram_address[i] < 0 || unigram_address[i] > lm_states_size_)
+      KALDI_ERR << "Invalid unigram address in ConstArpaLm " << filename;
+    unigram_states_[i] = (unigram_address[i] == 0) ? NULL
+        : lm_states_ + unigram_address[i] - 1;
+  }
+  const int64 *overflow_address =
+      reinterpret_cast<const int64*>(data + header.overflow_offset);
+  overflow_buffer_ = new int32*[overflow_buffer_size_];
+  for (int32 i = 0; i < overflow_buffer_size_; ++i) {
+    if (overflow_address[i] < 0 || overflow_address[i] > lm_states_size_)
+      KALDI_ERR << "Invalid overflow address in ConstArpaLm " << filename;
+    overflow_buffer_[i] = (overflow_address[i] == 0) ? NULL
+        : lm_states_ + overflow_address[i] - 1;
+  }
+
+  KALDI_ASSERT(ngram_order_ > 0);
+  KALDI_ASSERT(bos_symbol_ < num_words_ && bos_symbol_ > 0);
+  KALDI_ASSERT(eos_symbol_ < num_words_ && eos_symbol_ > 0);
+  KALDI_ASSERT(unk_symbol_ < num_words_ &&
+               (unk_symbol_ > 0 || unk_symbol_ == -1));
+  lm_states_end_ = lm_states_ + lm_states_size_ - 1;
+  memory_assigned_ = true;
+  initialized_ = true;
+}
+
+bool IsMappedConstArpaLmFile(const std::string &filename) {
+  std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(kMappedConstArpaLmMagic)];
+  if (!is.read(magic, sizeof(magic)))
+    return false;
+  return memcmp(magic, kMappedConstArpaLmMagic, sizeof(magic)) == 0;
+}
+
+void ReadConstArpaLm(const std::string &rxfilename, ConstArpaLm *lm) {
+  if (ClassifyRxfilename(rxfilename) == kFileInput &&
+      IsMappedConstArpaLmFile(rxfilename)) {
+    lm->ReadMapped(rxfilename);
+  } else {
+    ReadKaldiObject(rxfilename, lm);
+  }
+}
+
 bool ConstArpaLm::HistoryStateExists(const std::vector<int32>& hist) const {
   // We do not create LmState for empty word sequence, but technically it is the
   // history state of all unigrams.
@@ -734,9 +1104,8 @@ bool ConstArpaLm::HistoryStateExists(const std::vector<int32>& hist) const {
     // Note that we always create LmState for unigrams, so even if <lm_state> is
     // not NULL, we still have to check if it has child.
     KALDI_ASSERT(lm_state >= lm_states_);
-    KALDI_ASSERT(lm_state + 2 <= lm_states_end_);
-    // <lm_state + 2> points to <num_children>.
-    if (*(lm_state + 2) > 0) {
+    KALDI_ASSERT(lm_state + (quantize_bits_ == 0 ? 2 : 1) <= lm_states_end_);
+    if (StateNumChildren(lm_state) > 0) {
       return true;
     } else {
       return false;
@@ -780,6 +1149,164 @@ float ConstArpaLm::GetNgramLogprob(const int32 word,
   return GetNgramLogprobRecurse(mapped_word, mapped_hist);
 }
 
+int64 ConstArpaLm::GetSequenceId(const std::vector<int32>& seq) const {
+  if (seq.empty()) return 0;
+  int32* lm_state = GetLmState(seq);
+  if (lm_state == NULL) return -1;
+  return 1 + (lm_state - lm_states_);
+}
+
+void ConstArpaLm::LookUpHistory(const std::vector<int32>& hist,
+                                History *history) const {
+  KALDI_ASSERT(initialized_);
+  // We process the history in the same way as GetNgramLogprob().
+  std::vector<int32> mapped_hist(hist);
+  if (mapped_hist.size() >= ngram_order_)
+    mapped_hist.erase(mapped_hist.begin(),
+                      mapped_hist.end() - (ngram_order_ - 1));
+  if (unk_symbol_ != -1) {
+    for (int32 i = 0; i < mapped_hist.size(); ++i) {
+      KALDI_ASSERT(mapped_hist[i] >= 0);
+      if (mapped_hist[i] >= num_words_ ||
+          unigram_states_[mapped_hist[i]] == NULL) {
+        mapped_hist[i] = unk_symbol_;
+      }
+    }
+  }
+  int32 hist_size = mapped_hist.size();
+  history->lm_states.resize(hist_size);
+  std::vector<int32> suffix;
+  for (int32 i = 0; i < hist_size; ++i) {
+    suffix.assign(mapped_hist.begin() + i, mapped_hist.end());
+    history->lm_states[i] = GetLmState(suffix);
+  }
+}
+
+float ConstArpaLm::GetNgramLogprob(const int32 word,
+                                   const History &history) const {
+  KALDI_ASSERT(initialized_);
+  int32 mapped_word = word;
+  if (unk_symbol_ != -1) {
+    KALDI_ASSERT(mapped_word >= 0);
+    if (mapped_word >= num_words_ || unigram_states_[mapped_word] == NULL) {
+      mapped_word = unk_symbol_;
+    }
+  }
+
+  // This does the same computation as GetNgramLogprobRecurse(), with the
+  // LmStates of the successively shorter histories taken from <history>:
+  // first we find the longest history that has <word> as a child, and then
+  // we add the backoff log-probs of the longer ones, in the same order as
+  // GetNgramLogprobRecurse() would.
+  const std::vector<int32*> &lm_states = history.lm_states;
+  int32 hist_size = lm_states.size(), i = 0;
+  float logprob = 0.0;
+  for (; i < hist_size; ++i) {
+    int32 child_info;
+    if (lm_states[i] != NULL &&
+        GetChildInfo(mapped_word, lm_states[i], &child_info)) {
+      int32* child_lm_state = NULL;
+      DecodeChildInfo(child_info, lm_states[i], &child_lm_state, &logprob);
+      break;
+    }
+  }
+  if (i == hist_size) {  // Unigram case.
+    if (mapped_word >= num_words_ || unigram_states_[mapped_word] == NULL) {
+      logprob = std::numeric_limits<float>::min();
+    } else {
+      logprob = StateLogprob(unigram_states_[mapped_word]);
+    }
+  }
+  for (--i; i >= 0; --i) {
+    float backoff_logprob = 0.0;
+    if (lm_states[i] != NULL)
+      backoff_logprob = StateBackoffLogprob(lm_states[i]);
+    logprob = backoff_logprob + logprob;
+  }
+  return logprob;
+}
+
+void ConstArpaLm::GetNgramLogprobs(const History &history,
+                                   const std::vector<int32>& words,
+                                   std::vector<float> *logprobs) const {
+  KALDI_ASSERT(initialized_);
+  int32 num_words = words.size();
+  logprobs->resize(num_words);
+
+  // <pending> contains the (mapped word, index into <words>) pairs for which
+  // we have not yet found the longest history that has the word as a child,
+  // sorted by word so that we can search the children of each history state
+  // (which are sorted by word) in a single forward pass.
+  std::vector<std::pair<int32, int32> > pending(num_words);
+  for (int32 j = 0; j < num_words; ++j) {
+    int32 mapped_word = words[j];
+    if (unk_symbol_ != -1) {
+      KALDI_ASSERT(mapped_word >= 0);
+      if (mapped_word >= num_words_ || unigram_states_[mapped_word] == NULL)
+        mapped_word = unk_symbol_;
+    }
+    pending[j] = std::make_pair(mapped_word, j);
+  }
+  std::sort(pending.begin(), pending.end());
+
+  // (*logprobs)[j] is first set to the log-prob from the longest history that
+  // has the word as a child, and <num_backoffs>[j] to the number of longer
+  // histories whose backoff log-probs we have to add; see
+  // GetNgramLogprob(word, history).
+  const std::vector<int32*> &lm_states = history.lm_states;
+  int32 hist_size = lm_states.size();
+  std::vector<int32> num_backoffs(num_words, hist_size);
+  for (int32 i = 0; i < hist_size && !pending.empty(); ++i) {
+    int32* lm_state = lm_states[i];
+    if (lm_state == NULL) continue;
+    int32 num_children = StateNumChildren(lm_state), c = 0;
+    size_t num_left = 0;
+    for (size_t p = 0; p < pending.size(); ++p) {
+      int32 word = pending[p].first, child_word = -1, child_info = 0;
+      // Find the first child at or after c whose word is not less than <word>.
+      int32 end = num_children;
+      while (c < end) {
+        int32 mid = (c + end) / 2;
+        GetChild(lm_state, mid, &child_word, &child_info);
+        if (child_word < word) c = mid + 1;
+        else end = mid;
+      }
+      if (c < num_children)
+        GetChild(lm_state, c, &child_word, &child_info);
+      if (c < num_children && child_word == word) {
+        int32* child_lm_state = NULL;
+        DecodeChildInfo(child_info, lm_state, &child_lm_state,
+                        &((*logprobs)[pending[p].second]));
+        num_backoffs[pending[p].second] = i;
+      } else {
+        pending[num_left++] = pending[p];
+      }
+    }
+    pending.resize(num_left);
+  }
+  for (size_t p = 0; p < pending.size(); ++p) {  // Unigram case.
+    int32 word = pending[p].first;
+    if (word >= num_words_ || unigram_states_[word] == NULL) {
+      (*logprobs)[pending[p].second] = std::numeric_limits<float>::min();
+    } else {
+      (*logprobs)[pending[p].second] = StateLogprob(unigram_states_[word]);
+    }
+  }
+
+  // Add the backoff log-probs in the same order as GetNgramLogprob() does, so
+  // that the results are exactly the same.
+  std::vector<float> backoff_logprobs(hist_size, 0.0);
+  for (int32 i = 0; i < hist_size; ++i)
+    if (lm_states[i] != NULL)
+      backoff_logprobs[i] = StateBackoffLogprob(lm_states[i]);
+  for (int32 j = 0; j < num_words; ++j) {
+    float logprob = (*logprobs)[j];
+    for (int32 i = num_backoffs[j] - 1; i >= 0; --i)
+      logprob = backoff_logprobs[i] + logprob;
+    (*logprobs)[j] = logprob;
+  }
+}
+
 float ConstArpaLm::GetNgramLogprobRecurse(
     const int32 word, const std::vector<int32>& hist) const {
   KALDI_ASSERT(initialized_);
@@ -793,8 +1320,7 @@ float ConstArpaLm::GetNgramLogprobRecurse(
       // defined.
       return std::numeric_limits<float>::min();
     } else {
-      Int32AndFloat logprob_i(*unigram_states_[word]);
-      return logprob_i.f;
+      return StateLogprob(unigram_states_[word]);
     }
   }
 
@@ -809,8 +1335,7 @@ float ConstArpaLm::GetNgramLogprobRecurse(
       DecodeChildInfo(child_info, state, &child_lm_state, &logprob);
       return logprob;
     } else {
-      Int32AndFloat backoff_logprob_i(*(state + 1));
-      backoff_logprob = backoff_logprob_i.f;
+      backoff_logprob = StateBackoffLogprob(state);
     }
   }
   std::vector<int32> new_hist(hist);
@@ -854,20 +1379,33 @@ bool ConstArpaLm::GetChildInfo(const int32 word,
   KALDI_ASSERT(parent >= lm_states_);
   KALDI_ASSERT(child_info != NULL);
 
-  KALDI_ASSERT(parent + 2 <= lm_states_end_);
-  int32 num_children = *(parent + 2);
-  KALDI_ASSERT(parent + 2 + 2 * num_children <= lm_states_end_);
+  KALDI_ASSERT(parent + (quantize_bits_ == 0 ? 2 : 1) <= lm_states_end_);
+  int32 num_children = StateNumChildren(parent);
 
   if (num_children == 0) return false;
 
-  // A binary search into the children memory block.
+  if (StateIsPacked(parent)) {
+    // The words are stored contiguously, followed by the packed logprobs.
+    int32* words = parent + 2;
+    KALDI_ASSERT(words + num_children - 1 <= lm_states_end_);
+    int32* iter = std::lower_bound(words, words + num_children, word);
+    if (iter == words + num_children || *iter != word) return false;
+    int32 child_word;
+    GetChild(parent, iter - words, &child_word, child_info);
+    return true;
+  }
+
+  // A binary search into the children memory block. <children> points to the
+  // first child, and the children are numbered from 1.
+  int32* children = parent + (quantize_bits_ == 0 ? 3 : 2);
+  KALDI_ASSERT(children + 2 * num_children - 1 <= lm_states_end_);
   int32 start_index = 1;
   int32 end_index = num_children;
   while (start_index <= end_index) {
     int32 mid_index = round((start_index + end_index) / 2);
-    int32 mid_word = *(parent + 1 + 2 * mid_index);
+    int32 mid_word = *(children - 2 + 2 * mid_index);
     if (mid_word == word) {
-      *child_info = *(parent + 2 + 2 * mid_index);
+      *child_info = *(children - 1 + 2 * mid_index);
       return true;
     } else if (mid_word < word) {
       start_index = mid_index + 1;
@@ -889,22 +1427,46 @@ void ConstArpaLm::DecodeChildInfo(const int32 child_info,
   if (child_info % 2 == 0) {
     // Child is a leaf, only returns the log probability.
     *child_lm_state = NULL;
-    Int32AndFloat logprob_i(child_info);
-    *logprob = logprob_i.f;
+    if (quantize_bits_ == 0) {
+      Int32AndFloat logprob_i(child_info);
+      *logprob = logprob_i.f;
+    } else {
+      *logprob = logprob_codebook_[child_info / 2];
+    }
   } else {
     int32 child_offset = child_info / 2;
     if (child_offset > 0) {
       *child_lm_state = parent + child_offset;
-      Int32AndFloat logprob_i(**child_lm_state);
-      *logprob = logprob_i.f;
     } else {
       KALDI_ASSERT(-child_offset < overflow_buffer_size_);
       *child_lm_state = overflow_buffer_[-child_offset];
-      Int32AndFloat logprob_i(**child_lm_state);
-      *logprob = logprob_i.f;
     }
     KALDI_ASSERT(*child_lm_state >= lm_states_);
     KALDI_ASSERT(*child_lm_state <= lm_states_end_);
+    *logprob = StateLogprob(*child_lm_state);
+  }
+}
+
+void ConstArpaLm::GetChild(int32* lm_state, int32 index, int32* word,
+                           int32* child_info) const {
+  int32 num_children = StateNumChildren(lm_state);
+  KALDI_ASSERT(index >= 0 && index < num_children);
+  if (StateIsPacked(lm_state)) {
+    // The words, followed by the logprob codes packed into int32s; leaf
+    // child_info is twice the code.
+    int32 codes_per_int = 32 / quantize_bits_;
+    int32* codes = lm_state + 2 + num_children;
+    KALDI_ASSERT(codes + index / codes_per_int <= lm_states_end_);
+    uint32 packed_codes = static_cast<uint32>(codes[index / codes_per_int]);
+    uint32 code = (packed_codes >> (quantize_bits_ * (index % codes_per_int)))
+        & ((1u << quantize_bits_) - 1);
+    *word = lm_state[2 + index];
+    *child_info = 2 * code;
+  } else {
+    int32* children = lm_state + (quantize_bits_ == 0 ? 3 : 2);
+    KALDI_ASSERT(children + 2 * index + 1 <= lm_states_end_);
+    *word = children[2 * index];
+    *child_info = children[2 * index + 1];
   }
 }
 
@@ -914,24 +1476,22 @@ void ConstArpaLm::WriteArpaRecurse(int32* lm_state,
   if (lm_state == NULL) return;
 
   KALDI_ASSERT(lm_state >= lm_states_);
-  KALDI_ASSERT(lm_state + 2 <= lm_states_end_);
+  KALDI_ASSERT(lm_state + (quantize_bits_ == 0 ? 2 : 1) <= lm_states_end_);
 
   // Inserts the current LmState to <output>.
   ArpaLine arpa_line;
   arpa_line.words = seq;
-  Int32AndFloat logprob_i(*lm_state);
-  arpa_line.logprob = logprob_i.f;
-  Int32AndFloat backoff_logprob_i(*(lm_state + 1));
-  arpa_line.backoff_logprob = backoff_logprob_i.f;
+  arpa_line.logprob = StateLogprob(lm_state);
+  arpa_line.backoff_logprob = StateBackoffLogprob(lm_state);
   output->push_back(arpa_line);
 
   // Scans for possible children, and recursively adds child to <output>.
-  int32 num_children = *(lm_state + 2);
-  KALDI_ASSERT(lm_state + 2 + 2 * num_children <= lm_states_end_);
+  int32 num_children = StateNumChildren(lm_state);
   for (int32 i = 0; i < num_children; ++i) {
+    int32 word, child_info;
+    GetChild(lm_state, i, &word, &child_info);
     std::vector<int32> new_seq(seq);
-    new_seq.push_back(*(lm_state + 3 + 2 * i));
-    int32 child_info = *(lm_state + 4 + 2 * i);
+    new_seq.push_back(word);
     float logprob;
     int32* child_lm_state = NULL;
     DecodeChildInfo(child_info, lm_state, &child_lm_state, &logprob);
@@ -1010,36 +1570,85 @@ void ConstArpaLm::WriteArpa(std::ostream &os) const {
   os << std::endl << "\\end\\" << std::endl;
 }
 
+ConstArpaLmArcCache::ConstArpaLmArcCache(int32 capacity):
+    shard_capacity_(capacity / kNumShards + 1) {
+  KALDI_ASSERT(capacity > 0);
+}
+
+bool ConstArpaLmArcCache::Lookup(int64 hist_id, int32 word, Entry *entry) {
+  Key key;
+  key.hist_id = hist_id;
+  key.word = word;
+  Shard &shard = GetShard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  unordered_map<Key, ListType::iterator, KeyHasher>::iterator iter =
+      shard.map.find(key);
+  if (iter == shard.map.end())
+    return false;
+  // Moves it to the front of the list, as the most recently used.
+  shard.lru_list.splice(shard.lru_list.begin(), shard.lru_list, iter->second);
+  *entry = iter->second->second;
+  return true;
+}
+
+void ConstArpaLmArcCache::Insert(int64 hist_id, int32 word,
+                                 const Entry &entry) {
+  Key key;
+  key.hist_id = hist_id;
+  key.word = word;
+  Shard &shard = GetShard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (shard.map.count(key) != 0)
+    return;  // another thread got there first.
+  shard.lru_list.push_front(std::make_pair(key, entry));
+  shard.map[key] = shard.lru_list.begin();
+  if (shard.map.size() > shard_capacity_) {
+    shard.map.erase(shard.lru_list.back().first);
+    shard.lru_list.pop_back();
+  }
+}
+
 ConstArpaLmDeterministicFst::ConstArpaLmDeterministicFst(
-    const ConstArpaLm& lm) : lm_(lm) {
+    const ConstArpaLm& lm, ConstArpaLmArcCache *cache):
+    lm_(lm), cache_(cache) {
   // Creates a history state for <s>.
   std::vector<Label> bos_state(1, lm_.BosSymbol());
+  int64 hist_id = lm_.GetSequenceId(bos_state);
   state_to_wseq_.push_back(bos_state);
-  wseq_to_state_[bos_state] = 0;
+  state_to_hist_id_.push_back(hist_id);
+  state_to_history_.resize(1);
+  state_has_history_.push_back(false);
+  hist_id_to_state_[hist_id] = 0;
   start_state_ = 0;
 }
 
+const ConstArpaLm::History &ConstArpaLmDeterministicFst::GetHistory(
+    StateId s) {
+  if (!state_has_history_[s]) {
+    lm_.LookUpHistory(state_to_wseq_[s], &(state_to_history_[s]));
+    state_has_history_[s] = true;
+  }
+  return state_to_history_[s];
+}
+
 fst::StdArc::Weight ConstArpaLmDeterministicFst::Final(StateId s) {
   // At this point, we should have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
-  const std::vector<Label>& wseq = state_to_wseq_[s];
-  float logprob = lm_.GetNgramLogprob(lm_.EosSymbol(), wseq);
+  float logprob = lm_.GetNgramLogprob(lm_.EosSymbol(), GetHistory(s));
   return Weight(-logprob);
 }
 
-bool ConstArpaLmDeterministicFst::GetArc(StateId s,
-                                         Label ilabel, fst::StdArc *oarc) {
-  // At this point, we should have created the state.
-  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
-  std::vector<Label> wseq = state_to_wseq_[s];
-
-  float logprob = lm_.GetNgramLogprob(ilabel, wseq);
-  if (logprob == std::numeric_limits<float>::min()) {
-    return false;
-  }
+void ConstArpaLmDeterministicFst::ComputeArc(
+    StateId s, Label ilabel, ConstArpaLmArcCache::Entry *entry) {
+  entry->logprob = lm_.GetNgramLogprob(ilabel, GetHistory(s));
+  entry->next_hist_len = 0;
+  entry->next_hist_id = 0;
+  if (entry->logprob == std::numeric_limits<float>::min())
+    return;
 
   // Locates the next state in ConstArpaLm. Note that OOV and backoff have been
   // taken care of in ConstArpaLm.
+  std::vector<Label> wseq = state_to_wseq_[s];
   wseq.push_back(ilabel);
   while (wseq.size() >= lm_.NgramOrder()) {
     // History state has at most lm_.NgramOrder() -1 words in the state.
@@ -1049,24 +1658,51 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
     KALDI_ASSERT(wseq.size() > 0);
     wseq.erase(wseq.begin(), wseq.begin() + 1);
   }
+  entry->next_hist_len = wseq.size();
+  entry->next_hist_id = lm_.GetSequenceId(wseq);
+}
 
-  std::pair<const std::vector<Label>, StateId> wseq_state_pair(
-      wseq, static_cast<Label>(state_to_wseq_.size()));
-
-  // Attemps to insert the current <wseq_state_pair>. If the pair already exists
-  // then it returns false.
-  typedef MapType::iterator IterType;
-  std::pair<IterType, bool> result = wseq_to_state_.insert(wseq_state_pair);
+fst::StdArc::StateId ConstArpaLmDeterministicFst::GetNextState(
+    StateId s, Label ilabel, int32 hist_len, int64 hist_id) {
+  MapType::iterator iter = hist_id_to_state_.find(hist_id);
+  if (iter != hist_id_to_state_.end())
+    return iter->second;
+  const std::vector<Label> &wseq = state_to_wseq_[s];
+  KALDI_ASSERT(hist_len <= wseq.size() + 1);
+  std::vector<Label> next_wseq;
+  if (hist_len > 0) {
+    next_wseq.assign(wseq.end() - (hist_len - 1), wseq.end());
+    next_wseq.push_back(ilabel);
+  }
+  StateId next_state = state_to_wseq_.size();
+  state_to_wseq_.push_back(next_wseq);
+  state_to_hist_id_.push_back(hist_id);
+  state_to_history_.resize(next_state + 1);
+  state_has_history_.push_back(false);
+  hist_id_to_state_[hist_id] = next_state;
+  return next_state;
+}
 
-  // If the pair was just inserted, then also add it to <state_to_wseq_>.
-  if (result.second == true)
-    state_to_wseq_.push_back(wseq);
+bool ConstArpaLmDeterministicFst::GetArc(StateId s,
+                                         Label ilabel, fst::StdArc *oarc) {
+  // At this point, we should have created the state.
+  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
+  int64 hist_id = state_to_hist_id_[s];
+  ConstArpaLmArcCache::Entry entry;
+  if (cache_ == NULL || !cache_->Lookup(hist_id, ilabel, &entry)) {
+    ComputeArc(s, ilabel, &entry);
+    if (cache_ != NULL)
+      cache_->Insert(hist_id, ilabel, entry);
+  }
+  if (entry.logprob == std::numeric_limits<float>::min())
+    return false;
 
   // Creates the arc.
   oarc->ilabel = ilabel;
   oarc->olabel = ilabel;
-  oarc->nextstate = result.first->second;
-  oarc->weight = Weight(-logprob);
+  oarc->nextstate = GetNextState(s, ilabel, entry.next_hist_len,
+                                 entry.next_hist_id);
+  oarc->weight = Weight(-entry.logprob);
 
   return true;
 }
@@ -1074,11 +1710,38 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
 bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
                       const std::string& const_arpa_wxfilename) {
-  ConstArpaLmBuilder lm_builder(options);
+  ConstArpaLmFormatOptions format_options;
+  return BuildConstArpaLm(options, format_options, arpa_rxfilename,
+                          const_arpa_wxfilename);
+}
+
+bool BuildConstArpaLm(const ArpaParseOptions& options,
+                      const ConstArpaLmFormatOptions& format_options,
+                      const std::string& arpa_rxfilename,
+                      const std::string& const_arpa_wxfilename) {
+  if (format_options.quantize_bits != 0) {
+    if (format_options.quantize_bits != 8 &&
+        format_options.quantize_bits != 16) {
+      KALDI_ERR << "--quantize-bits must be 0, 8 or 16, got "
+                << format_options.quantize_bits;
+    }
+    if (!format_options.mapped) {
+      KALDI_ERR << "Quantized language models can only be written in the "
+                << "mapped format (--mapped=true).";
+    }
+  }
+  ConstArpaLmBuilder lm_builder(options, format_options.quantize_bits);
   KALDI_LOG << "Reading " << arpa_rxfilename;
   Input ki(arpa_rxfilename);
   lm_builder.Read(ki.Stream());
-  WriteKaldiObject(lm_builder, const_arpa_wxfilename, true);
+  if (format_options.mapped) {
+    // No Kaldi binary header, so that the file starts with the magic string.
+    Output ko(const_arpa_wxfilename, true, false);
+    lm_builder.WriteMapped(ko.Stream());
+    ko.Close();
+  } else {
+    WriteKaldiObject(lm_builder, const_arpa_wxfilename, true);
+  }
   return true;
 }
 
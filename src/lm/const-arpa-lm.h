@@ -20,13 +20,17 @@
 #ifndef KALDI_LM_CONST_ARPA_LM_H_
 #define KALDI_LM_CONST_ARPA_LM_H_
 
+#include <list>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "base/kaldi-common.h"
 #include "fstext/deterministic-fst.h"
 #include "lm/arpa-file-parser.h"
 #include "util/common-utils.h"
+#include "util/memory-mapped-file.h"
 
 namespace kaldi {
 
@@ -194,6 +198,28 @@ namespace kaldi {
        of LmState whose address differs too much from the parent address. See
        above how we handle the leaf case.
     5. With the information in step 4, create the class ConstArpaLm.
+
+    There is also a "mapped" on-disk format (see ConstArpaLm::WriteMapped()),
+    in which <lm_states_> is stored exactly as in memory at an aligned offset,
+    so that ConstArpaLm::ReadMapped() can use it in place from a memory-mapped
+    file: loading takes about as long as reading <unigram_states_>, and
+    processes on the same machine share one copy of the language model.  In
+    this format the log-probs and backoff log-probs may optionally be quantized
+    to 8 or 16 bits, as indexes into two codebooks (of log-probs and of backoff
+    log-probs).  A quantized LmState is laid out as follows:
+
+    struct QuantizedLmState {
+      int32 logprob_and_backoff;  // logprob index | (backoff index << 16)
+      int32 num_children_and_flag;  // 2 * num_children + (packed ? 1 : 0)
+      ...children...
+    }
+
+    Leaf children store (2 * logprob index) where they would otherwise store
+    the float.  If all the children are leaves (which is true of all the
+    LmStates of order N - 1, whose children are the N-grams), the state is
+    "packed": the children are stored as int32 words[num_children] followed by
+    the log-prob indexes packed 4 or 2 to an int32, so the highest-order N-grams
+    take 5 or 6 bytes each instead of 8.
 */
 
 // Forward declaration of Auxiliary struct ArpaLine.
@@ -217,22 +243,39 @@ class ConstArpaLm {
     lm_states_ = NULL;
     unigram_states_ = NULL;
     overflow_buffer_ = NULL;
+    mapped_file_ = NULL;
+    quantize_bits_ = 0;
     memory_assigned_ = false;
     initialized_ = false;
   }
 
   // Special constructor, will be used when you initialize ConstArpaLm from
-  // scratch through this constructor.
+  // scratch through this constructor.  If <quantize_bits> is 8 or 16,
+  // <lm_states> is in the quantized layout (see the comment at the top of this
+  // file) and the codebooks must have 2^<quantize_bits> entries.
   ConstArpaLm(const int32 bos_symbol, const int32 eos_symbol,
               const int32 unk_symbol, const int32 ngram_order,
               const int32 num_words, const int32 overflow_buffer_size,
               const int64 lm_states_size, int32** unigram_states,
-              int32** overflow_buffer, int32* lm_states) :
+              int32** overflow_buffer, int32* lm_states,
+              const int32 quantize_bits = 0,
+              const std::vector<float> &logprob_codebook =
+                  std::vector<float>(),
+              const std::vector<float> &backoff_codebook =
+                  std::vector<float>()) :
       bos_symbol_(bos_symbol), eos_symbol_(eos_symbol),
       unk_symbol_(unk_symbol), ngram_order_(ngram_order),
       num_words_(num_words), overflow_buffer_size_(overflow_buffer_size),
       lm_states_size_(lm_states_size), unigram_states_(unigram_states),
-      overflow_buffer_(overflow_buffer), lm_states_(lm_states) {
+      overflow_buffer_(overflow_buffer), lm_states_(lm_states),
+      mapped_file_(NULL), quantize_bits_(quantize_bits),
+      logprob_codebook_(logprob_codebook),
+      backoff_codebook_(backoff_codebook) {
+    KALDI_ASSERT(quantize_bits_ == 0 || quantize_bits_ == 8 ||
+                 quantize_bits_ == 16);
+    KALDI_ASSERT(quantize_bits_ == 0 ||
+                 (logprob_codebook_.size() == (1 << quantize_bits_) &&
+                  backoff_codebook_.size() == (1 << quantize_bits_)));
     KALDI_ASSERT(unigram_states_ != NULL);
     KALDI_ASSERT(overflow_buffer_ != NULL);
     KALDI_ASSERT(lm_states_ != NULL);
@@ -248,19 +291,36 @@ class ConstArpaLm {
 
   ~ConstArpaLm() {
     if (memory_assigned_) {
-      delete[] lm_states_;
+      if (mapped_file_ == NULL)
+        delete[] lm_states_;
       delete[] unigram_states_;
       delete[] overflow_buffer_;
     }
+    delete mapped_file_;
   }
 
   // Reads the ConstArpaLm format language model. It calls ReadInternal() or
   // ReadInternalOldFormat() to do the actual reading.
   void Read(std::istream &is, bool binary);
 
-  // Writes the language model in ConstArpaLm format.
+  // Writes the language model in ConstArpaLm format.  This does not support
+  // quantized language models; use WriteMapped() for those.
   void Write(std::ostream &os, bool binary) const;
 
+  // Writes the language model in the mapped format (see the comment at the
+  // top of this file).  <os> should be opened in binary mode without the
+  // Kaldi binary header, e.g. Output ko(wxfilename, true, false).
+  void WriteMapped(std::ostream &os) const;
+
+  // Maps a file written by WriteMapped() into memory and uses it in place.
+  // <filename> must be an actual file (not a pipe).  The mapping is released
+  // when this object is destroyed.
+  void ReadMapped(const std::string &filename);
+
+  // Returns the number of bits the log-probs are quantized to, or 0 if they
+  // are stored as floats.
+  int32 QuantizeBits() const { return quantize_bits_; }
+
   // Creates Arpa format language model from ConstArpaLm format, and writes it
   // to output stream. This will be useful in testing.
   void WriteArpa(std::ostream &os) const;
@@ -273,6 +333,41 @@ class ConstArpaLm {
   // <hist> will be a state in the FST format language model.
   bool HistoryStateExists(const std::vector<int32>& hist) const;
 
+  // Returns an integer that identifies the word sequence <seq> in the language
+  // model without having to store the sequence: 0 for the empty sequence, a
+  // positive number if the sequence has an LmState (which is true of all
+  // history states, see HistoryStateExists()), and -1 otherwise.
+  int64 GetSequenceId(const std::vector<int32>& seq) const;
+
+  // A word history that has been looked up in the language model, so that
+  // the words following it can be scored without looking up the history
+  // again; see LookUpHistory().  For a history of n words (after the
+  // processing done in GetNgramLogprob()), <lm_states>[i] is the LmState of
+  // the last n - i words of the history, or NULL if it has none.  Callers
+  // should treat this as opaque.
+  struct History {
+    std::vector<int32*> lm_states;
+  };
+
+  // Looks up the history word sequence <hist> for use in the versions of
+  // GetNgramLogprob() below.  This walks the trie once for each suffix of the
+  // history, which is the work GetNgramLogprob() would otherwise do for each
+  // word.
+  void LookUpHistory(const std::vector<int32>& hist, History *history) const;
+
+  // As GetNgramLogprob(word, hist), where <history> was obtained from
+  // LookUpHistory(hist); gives exactly the same result.
+  float GetNgramLogprob(const int32 word, const History &history) const;
+
+  // Scores all the words in <words> following the same history: sets
+  // (*logprobs)[i] to GetNgramLogprob(words[i], history).  This sorts the
+  // words and then searches the children of each history state in a single
+  // forward pass, so it is faster than calling GetNgramLogprob() for each word
+  // when there are many of them.
+  void GetNgramLogprobs(const History &history,
+                        const std::vector<int32>& words,
+                        std::vector<float> *logprobs) const;
+
   int32 BosSymbol() const { return bos_symbol_; }
   int32 EosSymbol() const { return eos_symbol_; }
   int32 UnkSymbol() const { return unk_symbol_; }
@@ -317,6 +412,37 @@ class ConstArpaLm {
   void DecodeChildInfo(const int32 child_info, int32* parent,
                        int32** child_lm_state, float* logprob) const;
 
+  // Gets the <index>'th child of <lm_state>, i.e. its word and child_info.
+  void GetChild(int32* lm_state, int32 index, int32* word,
+                int32* child_info) const;
+
+  // Returns the logprob of the sequence that <lm_state> represents.
+  inline float StateLogprob(const int32* lm_state) const {
+    if (quantize_bits_ == 0) {
+      Int32AndFloat logprob_i(*lm_state);
+      return logprob_i.f;
+    }
+    return logprob_codebook_[*lm_state & 0xffff];
+  }
+
+  // Returns the backoff logprob of the sequence that <lm_state> represents.
+  inline float StateBackoffLogprob(const int32* lm_state) const {
+    if (quantize_bits_ == 0) {
+      Int32AndFloat backoff_logprob_i(*(lm_state + 1));
+      return backoff_logprob_i.f;
+    }
+    return backoff_codebook_[static_cast<uint32>(*lm_state) >> 16];
+  }
+
+  inline int32 StateNumChildren(const int32* lm_state) const {
+    return (quantize_bits_ == 0 ? *(lm_state + 2) : *(lm_state + 1) / 2);
+  }
+
+  // Returns true if <lm_state> is a "packed" quantized state.
+  inline bool StateIsPacked(const int32* lm_state) const {
+    return (quantize_bits_ != 0 && (*(lm_state + 1) & 1) != 0);
+  }
+
   void WriteArpaRecurse(int32* lm_state,
                         const std::vector<int32>& seq,
                         std::vector<ArpaLine> *output) const;
@@ -381,12 +507,84 @@ class ConstArpaLm {
   // bytes, therefore one LmState will occupy the following number of bytes:
   //
   // x = 1 + 1 + 1 + 2 * children.size() = 3 + 2 * children.size()
+  //
+  // If the language model is quantized the layout is different; see the
+  // comment at the top of this file.  If it was read by ReadMapped(), this
+  // points into <mapped_file_> and must not be written to.
   int32* lm_states_;
+
+  // The file the language model is mapped from, if ReadMapped() was called.
+  MemoryMappedFile *mapped_file_;
+
+  // 8 or 16 if the log-probs are quantized, else 0.
+  int32 quantize_bits_;
+
+  // If quantized, the log-probs and backoff log-probs corresponding to the
+  // indexes stored in <lm_states_>; they each have 2^<quantize_bits_> entries.
+  std::vector<float> logprob_codebook_;
+  std::vector<float> backoff_codebook_;
+};
+
+/**
+ This class caches the arcs of ConstArpaLmDeterministicFst, i.e. it maps from
+ (history-state, word) to the log-probability and the next history-state.  It
+ is intended to be shared by the FSTs for all the lattices in an archive (which
+ are created afresh for each lattice), so that the same arcs are not computed
+ again for each lattice.  It keeps at most about <capacity> entries, discarding
+ the least recently used ones.  The history-states are identified by the
+ integers from ConstArpaLm::GetSequenceId(), so it must only be used with one
+ language model.  It may be used from several threads at once: the entries are
+ divided into a number of shards, each with its own lock.
+ */
+class ConstArpaLmArcCache {
+ public:
+  struct Entry {
+    float logprob;  // std::numeric_limits<float>::min() if no arc.
+    int32 next_hist_len;  // length of the word sequence of the next state.
+    int64 next_hist_id;  // GetSequenceId() of the next state.
+  };
+
+  explicit ConstArpaLmArcCache(int32 capacity);
+
+  // If the arc for word <word> from the history-state with id <hist_id> is in
+  // the cache, outputs it to <entry> and returns true.
+  bool Lookup(int64 hist_id, int32 word, Entry *entry);
+
+  void Insert(int64 hist_id, int32 word, const Entry &entry);
+
+ private:
+  struct Key {
+    int64 hist_id;
+    int32 word;
+    bool operator == (const Key &other) const {
+      return hist_id == other.hist_id && word == other.word;
+    }
+  };
+  struct KeyHasher {
+    size_t operator () (const Key &key) const {
+      return static_cast<size_t>(key.hist_id) * 7853 + key.word;
+    }
+  };
+  typedef std::list<std::pair<Key, Entry> > ListType;
+  struct Shard {
+    std::mutex mutex;
+    ListType lru_list;  // most recently used first.
+    unordered_map<Key, ListType::iterator, KeyHasher> map;
+  };
+  static const int32 kNumShards = 16;
+
+  Shard &GetShard(const Key &key) {
+    return shards_[KeyHasher()(key) % kNumShards];
+  }
+
+  size_t shard_capacity_;
+  Shard shards_[kNumShards];
 };
 
 /**
  This class wraps a ConstArpaLm format language model with the interface defined
- in DeterministicOnDemandFst.
+ in DeterministicOnDemandFst.  If you rescore many lattices with the same
+ language model, give it a ConstArpaLmArcCache that is shared between them.
  */
 class ConstArpaLmDeterministicFst
   : public fst::DeterministicOnDemandFst<fst::StdArc> {
@@ -395,7 +593,9 @@ class ConstArpaLmDeterministicFst
   typedef fst::StdArc::StateId StateId;
   typedef fst::StdArc::Label Label;
 
-  explicit ConstArpaLmDeterministicFst(const ConstArpaLm& lm);
+  // <cache> may be NULL; if not, it must outlive this object.
+  explicit ConstArpaLmDeterministicFst(const ConstArpaLm& lm,
+                                       ConstArpaLmArcCache *cache = NULL);
 
   // We cannot use "const" because the pure virtual function in the interface is
   // not const.
@@ -408,12 +608,47 @@ class ConstArpaLmDeterministicFst
   virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
 
  private:
-  typedef unordered_map<std::vector<Label>,
-                        StateId, VectorHasher<Label> > MapType;
+  // Works out the arc from state s with label ilabel, without the cache.
+  void ComputeArc(StateId s, Label ilabel, ConstArpaLmArcCache::Entry *entry);
+
+  // Returns the history of state s, looking it up if it was not already.
+  const ConstArpaLm::History &GetHistory(StateId s);
+
+  // Returns the state for the history-state with id <hist_id>, whose word
+  // sequence is the last <hist_len> words of the word sequence of state s
+  // followed by <ilabel>, creating it if needed.
+  StateId GetNextState(StateId s, Label ilabel, int32 hist_len, int64 hist_id);
+
+  // Maps from ConstArpaLm::GetSequenceId() of the word sequence to state.
+  typedef unordered_map<int64, StateId> MapType;
   StateId start_state_;
-  MapType wseq_to_state_;
+  MapType hist_id_to_state_;
   std::vector<std::vector<Label> > state_to_wseq_;
+  std::vector<int64> state_to_hist_id_;
+  // The histories, looked up only when needed (state_has_history_ says which
+  // ones have been).
+  std::vector<ConstArpaLm::History> state_to_history_;
+  std::vector<bool> state_has_history_;
   const ConstArpaLm& lm_;
+  ConstArpaLmArcCache *cache_;
+};
+
+// Options for the on-disk format that BuildConstArpaLm() writes.
+struct ConstArpaLmFormatOptions {
+  bool mapped;
+  int32 quantize_bits;
+
+  ConstArpaLmFormatOptions(): mapped(false), quantize_bits(0) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("mapped", &mapped, "If true, write the language model in "
+                   "a format that programs map into memory instead of reading "
+                   "it, so it loads quickly and is shared between processes.");
+    opts->Register("quantize-bits", &quantize_bits, "If 8 or 16, quantize "
+                   "the log-probs and backoff log-probs to this many bits, "
+                   "which makes the language model smaller.  Requires "
+                   "--mapped=true.");
+  }
 };
 
 // Reads in an Arpa format language model and converts it into ConstArpaLm
@@ -423,6 +658,21 @@ bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
                       const std::string& const_arpa_wxfilename);
 
+// As above, but <format_options> says which on-disk format to write.
+bool BuildConstArpaLm(const ArpaParseOptions& options,
+                      const ConstArpaLmFormatOptions& format_options,
+                      const std::string& arpa_rxfilename,
+                      const std::string& const_arpa_wxfilename);
+
+// Returns true if <filename> is a file (not a pipe or other rxfilename) that
+// was written by ConstArpaLm::WriteMapped().  Does not throw.
+bool IsMappedConstArpaLmFile(const std::string &filename);
+
+// Reads a language model in any of the ConstArpaLm formats: files in the mapped
+// format are mapped into memory (see ConstArpaLm::ReadMapped()), and anything
+// else is read with ReadKaldiObject().  <lm> must be newly constructed.
+void ReadConstArpaLm(const std::string &rxfilename, ConstArpaLm *lm);
+
 }  // namespace kaldi
 
 #endif  // KALDI_LM_CONST_ARPA_LM_H_
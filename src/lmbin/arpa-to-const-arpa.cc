@@ -37,6 +37,10 @@ int main(int argc, char *argv[]) {
         "ConstArpaLm format language model. We first map the words in an Arpa\n"
         "format language model to integers using utils/map_arpa_m.pl, and\n"
         "then use this program to build a ConstArpaLm format language model.\n"
+        "With --mapped=true, the output is in a format that programs map into\n"
+        "memory instead of reading (it must then be an actual file), which\n"
+        "loads quickly and is shared between processes on the same machine;\n"
+        "the log-probs can then also be quantized with --quantize-bits.\n"
         "\n"
         "Usage: arpa-to-const-arpa [opts] <input-arpa> <const-arpa>\n"
         " e.g.: arpa-to-const-arpa --bos-symbol=1 --eos-symbol=2 \\\n"
@@ -46,6 +50,8 @@ int main(int argc, char *argv[]) {
 
     ArpaParseOptions options;
     options.Register(&po);
+    ConstArpaLmFormatOptions format_options;
+    format_options.Register(&po);
 
     // Ideally, these registrations would be in ArpaParseOptions, but some
     // programs want integers and other want symbols, so we register them
@@ -75,7 +81,7 @@ int main(int argc, char *argv[]) {
     std::string arpa_rxfilename = po.GetArg(1),
         const_arpa_wxfilename = po.GetOptArg(2);
 
-    bool ans = BuildConstArpaLm(options, arpa_rxfilename,
+    bool ans = BuildConstArpaLm(options, format_options, arpa_rxfilename,
                                 const_arpa_wxfilename);
     if (ans)
       return 0;
@@ -247,6 +247,16 @@ BaseFloat DecodableAmNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
       trans_model_.TransitionIdToPdf(index));
 }
 
+void DecodableAmNnetLoopedOnline::LogLikelihoods(
+    int32 subsampled_frame, const std::vector<int32> &transition_ids,
+    std::vector<BaseFloat> *log_likes) {
+  EnsureFrameIsComputed(subsampled_frame);
+  trans_model_.TransitionIdsToPdfValues(
+      current_log_post_.RowData(subsampled_frame -
+                                current_log_post_subsampled_offset_),
+      transition_ids, log_likes);
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
@@ -183,6 +183,10 @@ class DecodableAmNnetLoopedOnline: public DecodableNnetLoopedOnlineBase {
   virtual BaseFloat LogLikelihood(int32 subsampled_frame,
                                   int32 transition_id);
 
+  virtual void LogLikelihoods(int32 subsampled_frame,
+                              const std::vector<int32> &transition_ids,
+                              std::vector<BaseFloat> *log_likes);
+
  private:
   const TransitionModel &trans_model_;
 
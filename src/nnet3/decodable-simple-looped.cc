@@ -83,9 +83,15 @@ void DecodableNnetSimpleLoopedInfo::Init(
                                  num_sequences,
                                  &request1, &request2, &request3);
 
-  CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
-                &computation);
-  computation.ComputeCudaIndexes();
+  if (!opts.precompiled_computations.empty() &&
+      ReadPrecompiledComputation(opts, *nnet)) {
+    KALDI_LOG << "Read precompiled looped computation from "
+              << opts.precompiled_computations;
+  } else {
+    CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
+                  &computation);
+    computation.ComputeCudaIndexes();
+  }
   if (GetVerboseLevel() >= 3) {
     KALDI_VLOG(3) << "Computation is:";
     computation.Print(std::cerr, *nnet);
@@ -93,6 +99,39 @@ void DecodableNnetSimpleLoopedInfo::Init(
 }
 
 
+bool DecodableNnetSimpleLoopedInfo::ReadPrecompiledComputation(
+    const NnetSimpleLoopedComputationOptions &opts, const Nnet &nnet) {
+  PrecompiledComputations computations;
+  ReadKaldiObject(opts.precompiled_computations, &computations);
+  if (!SetPrecompiledComputation(computations, opts.optimize_config, nnet)) {
+    KALDI_WARN << "No usable looped computation in "
+               << opts.precompiled_computations << "; it was probably "
+               << "compiled for a different model or with different options.";
+    return false;
+  }
+  return true;
+}
+
+bool DecodableNnetSimpleLoopedInfo::SetPrecompiledComputation(
+    const PrecompiledComputations &computations,
+    const NnetOptimizeOptions &optimize_config,
+    const Nnet &nnet) {
+  if (!(computations.OptimizeConfig() == optimize_config))
+    return false;
+  std::vector<ComputationRequest> requests;
+  requests.push_back(request1);
+  requests.push_back(request2);
+  requests.push_back(request3);
+  const NnetComputation *precompiled =
+      computations.Find(NnetStructureHash(nnet), requests);
+  if (precompiled == NULL)
+    return false;
+  // Read() has already called ComputeCudaIndexes().
+  computation = *precompiled;
+  return true;
+}
+
+
 DecodableNnetSimpleLooped::DecodableNnetSimpleLooped(
     const DecodableNnetSimpleLoopedInfo &info,
     const MatrixBase<BaseFloat> &feats,
@@ -261,6 +300,13 @@ BaseFloat DecodableAmNnetSimpleLooped::LogLikelihood(int32 frame,
   return decodable_nnet_.GetOutput(frame, pdf_id);
 }
 
+void DecodableAmNnetSimpleLooped::LogLikelihoods(
+    int32 frame, const std::vector<int32> &transition_ids,
+    std::vector<BaseFloat> *log_likes) {
+  trans_model_.TransitionIdsToPdfValues(decodable_nnet_.GetOutputRow(frame),
+                                        transition_ids, log_likes);
+}
+
 
 
 } // namespace nnet3
@@ -49,6 +49,7 @@ struct NnetSimpleLoopedComputationOptions {
   int32 frames_per_chunk;
   BaseFloat acoustic_scale;
   bool debug_computation;
+  std::string precompiled_computations;
   NnetOptimizeOptions optimize_config;
   NnetComputeOptions compute_config;
   NnetSimpleLoopedComputationOptions():
@@ -83,6 +84,10 @@ struct NnetSimpleLoopedComputationOptions {
                    "if needed.");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
+    opts->Register("precompiled-computations", &precompiled_computations,
+                   "If set, read the looped computation precompiled for this "
+                   "model and these options by nnet3-precompile --looped=true "
+                   "from here, so that it doesn't have to be compiled.");
 
     // register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -119,6 +124,22 @@ class DecodableNnetSimpleLoopedInfo  {
   void Init(const NnetSimpleLoopedComputationOptions &opts,
             Nnet *nnet);
 
+  // Called from Init() if opts.precompiled_computations is set, after setting
+  // up request1, request2 and request3: reads the looped computation for
+  // those requests from there into 'computation' and returns true, or
+  // returns false (with a warning) if it does not contain one that was
+  // compiled for 'nnet' with opts.optimize_config.
+  bool ReadPrecompiledComputation(
+      const NnetSimpleLoopedComputationOptions &opts, const Nnet &nnet);
+
+  // Called from ReadPrecompiledComputation(): if 'computations' contains the
+  // looped computation for request1, request2 and request3 compiled for
+  // 'nnet' with 'optimize_config', copies it to 'computation' and returns
+  // true; else returns false.
+  bool SetPrecompiledComputation(const PrecompiledComputations &computations,
+                                 const NnetOptimizeOptions &optimize_config,
+                                 const Nnet &nnet);
+
   const NnetSimpleLoopedComputationOptions &opts;
 
   const Nnet &nnet;
@@ -215,6 +236,20 @@ class DecodableNnetSimpleLooped {
                              current_log_post_subsampled_offset_,
                              pdf_id);
   }
+
+  // Returns the outputs for a particular frame, indexed by pdf_id, as an
+  // array of dimension OutputDim(); it is only valid until the next call to
+  // GetOutput() or GetOutputRow() for a frame that is not yet computed.  The
+  // same ordering constraints apply as for GetOutput().
+  inline const BaseFloat *GetOutputRow(int32 subsampled_frame) {
+    KALDI_ASSERT(subsampled_frame >= current_log_post_subsampled_offset_ &&
+                 "Frames must be accessed in order.");
+    while (subsampled_frame >= current_log_post_subsampled_offset_ +
+                            current_log_post_.NumRows())
+      AdvanceChunk();
+    return current_log_post_.RowData(subsampled_frame -
+                                     current_log_post_subsampled_offset_);
+  }
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetSimpleLooped);
 
@@ -304,6 +339,10 @@ class DecodableAmNnetSimpleLooped: public DecodableInterface {
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual void LogLikelihoods(int32 frame,
+                              const std::vector<int32> &transition_ids,
+                              std::vector<BaseFloat> *log_likes);
+
   virtual inline int32 NumFramesReady() const {
     return decodable_nnet_.NumFrames();
   }
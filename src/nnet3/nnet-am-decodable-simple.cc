@@ -17,6 +17,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include "nnet3/nnet-am-decodable-simple.h"
 #include "nnet3/nnet-utils.h"
 
@@ -24,6 +25,91 @@ namespace kaldi {
 namespace nnet3 {
 
 
+// Creates the ComputationRequest for computing 'num_subsampled_frames' output
+// frames, starting from t = output_t_start, from the 'num_input_frames' input
+// frames starting from t = input_t_start (and an iVector if 'has_ivector').
+static void CreateSimpleComputationRequest(int32 input_t_start,
+                                           int32 num_input_frames,
+                                           bool has_ivector,
+                                           int32 output_t_start,
+                                           int32 num_subsampled_frames,
+                                           int32 frame_subsampling_factor,
+                                           ComputationRequest *request) {
+  request->need_model_derivative = false;
+  request->store_component_stats = false;
+
+  // First add the regular features-- named "input".
+  request->inputs.clear();
+  request->inputs.reserve(2);
+  request->inputs.push_back(
+      IoSpecification("input", input_t_start,
+                      input_t_start + num_input_frames));
+  if (has_ivector) {
+    std::vector<Index> indexes;
+    indexes.push_back(Index(0, 0, 0));
+    request->inputs.push_back(IoSpecification("ivector", indexes));
+  }
+  IoSpecification output_spec;
+  output_spec.name = "output";
+  output_spec.has_deriv = false;
+  output_spec.indexes.resize(num_subsampled_frames);
+  // leave n and x values at 0 (the constructor sets these).
+  for (int32 i = 0; i < num_subsampled_frames; i++)
+    output_spec.indexes[i].t = output_t_start +
+        i * frame_subsampling_factor;
+  request->outputs.resize(1);
+  request->outputs[0].Swap(&output_spec);
+}
+
+void GetSimpleComputationRequests(const NnetSimpleComputationOptions &opts,
+                                  const Nnet &nnet,
+                                  std::vector<ComputationRequest> *requests) {
+  KALDI_ASSERT(IsSimpleNnet(nnet));
+  int32 nnet_left_context, nnet_right_context;
+  ComputeSimpleNnetContext(nnet, &nnet_left_context, &nnet_right_context);
+  bool has_ivector = (nnet.InputDim("ivector") > 0);
+  // Round --frames-per-chunk up as in DecodableNnetSimple::CheckAndFixConfigs().
+  int32 subsample = opts.frame_subsampling_factor,
+      n = Lcm(subsample, nnet.Modulus()),
+      frames_per_chunk = n * ((opts.frames_per_chunk + n - 1) / n),
+      subsampled_frames_per_chunk = frames_per_chunk / subsample;
+
+  requests->clear();
+  // Only the last chunk of an utterance can have fewer than
+  // 'subsampled_frames_per_chunk' frames, and the first and last chunks may
+  // have different extra context from the others (see
+  // DecodableNnetSimple::EnsureFrameIsComputed()).
+  for (int32 num_subsampled_frames = 1;
+       num_subsampled_frames <= subsampled_frames_per_chunk;
+       num_subsampled_frames++) {
+    for (int32 is_first = 0; is_first <= 1; is_first++) {
+      for (int32 is_last = 0; is_last <= 1; is_last++) {
+        if (!is_last && num_subsampled_frames < subsampled_frames_per_chunk)
+          continue;
+        int32 extra_left_context = opts.extra_left_context,
+            extra_right_context = opts.extra_right_context;
+        if (is_first && opts.extra_left_context_initial >= 0)
+          extra_left_context = opts.extra_left_context_initial;
+        if (is_last && opts.extra_right_context_final >= 0)
+          extra_right_context = opts.extra_right_context_final;
+        int32 left_context = nnet_left_context + extra_left_context,
+            right_context = nnet_right_context + extra_right_context,
+            last_output_frame = (num_subsampled_frames - 1) * subsample,
+            num_input_frames = left_context + last_output_frame +
+            right_context + 1;
+        ComputationRequest request;
+        CreateSimpleComputationRequest(-left_context, num_input_frames,
+                                       has_ivector, 0, num_subsampled_frames,
+                                       subsample, &request);
+        if (std::find(requests->begin(), requests->end(), request) ==
+            requests->end())
+          requests->push_back(request);
+      }
+    }
+  }
+}
+
+
 DecodableNnetSimple::DecodableNnetSimple(
     const NnetSimpleComputationOptions &opts,
     const Nnet &nnet,
@@ -41,7 +127,8 @@ DecodableNnetSimple::DecodableNnetSimple(
     ivector_(ivector), online_ivector_feats_(online_ivectors),
     online_ivector_period_(online_ivector_period),
     compiler_(*compiler),
-    current_log_post_subsampled_offset_(0) {
+    current_log_post_subsampled_offset_(0),
+    thread_pool_(NULL) {
   num_subsampled_frames_ =
       (feats_.NumRows() + opts_.frame_subsampling_factor - 1) /
       opts_.frame_subsampling_factor;
@@ -52,6 +139,12 @@ DecodableNnetSimple::DecodableNnetSimple(
                  "You need to set the --online-ivector-period option!"));
   log_priors_.ApplyLog();
   CheckAndFixConfigs();
+  if (opts_.compute_config.num_threads > 1)
+    thread_pool_ = new ThreadPool(opts_.compute_config.num_threads);
+}
+
+DecodableNnetSimple::~DecodableNnetSimple() {
+  delete thread_pool_;
 }
 
 
@@ -64,13 +157,17 @@ DecodableAmNnetSimple::DecodableAmNnetSimple(
     const MatrixBase<BaseFloat> *online_ivectors,
     int32 online_ivector_period,
     CachingOptimizingCompiler *compiler):
-    compiler_(am_nnet.GetNnet(), opts.optimize_config, opts.compiler_config),
+    compiler_(am_nnet.GetNnet(), opts.optimize_config,
+              compiler != NULL ? CachingOptimizingCompilerOptions() :
+              opts.compiler_config),
     decodable_nnet_(opts, am_nnet.GetNnet(), am_nnet.Priors(),
                     feats, compiler != NULL ? compiler : &compiler_,
                     ivector, online_ivectors,
                     online_ivector_period),
     trans_model_(trans_model) {
-  // note: we only use compiler_ if the passed-in 'compiler' is NULL.
+  // note: we only use compiler_ if the passed-in 'compiler' is NULL, which is
+  // why we don't give it opts.compiler_config otherwise (it would read any
+  // precompiled computations for nothing).
 }
 
 
@@ -81,6 +178,13 @@ BaseFloat DecodableAmNnetSimple::LogLikelihood(int32 frame,
   return decodable_nnet_.GetOutput(frame, pdf_id);
 }
 
+void DecodableAmNnetSimple::LogLikelihoods(
+    int32 frame, const std::vector<int32> &transition_ids,
+    std::vector<BaseFloat> *log_likes) {
+  trans_model_.TransitionIdsToPdfValues(decodable_nnet_.GetOutputRow(frame),
+                                        transition_ids, log_likes);
+}
+
 int32 DecodableNnetSimple::GetIvectorDim() const {
   if (ivector_ != NULL)
     return ivector_->Dim();
@@ -219,39 +323,22 @@ void DecodableNnetSimple::DoNnetComputation(
     int32 output_t_start,
     int32 num_subsampled_frames) {
   ComputationRequest request;
-  request.need_model_derivative = false;
-  request.store_component_stats = false;
-
   bool shift_time = true; // shift the 'input' and 'output' to a consistent
   // time, to take advantage of caching in the compiler.
   // An optimization.
   int32 time_offset = (shift_time ? -output_t_start : 0);
-
-  // First add the regular features-- named "input".
-  request.inputs.reserve(2);
-  request.inputs.push_back(
-      IoSpecification("input", time_offset + input_t_start,
-                      time_offset + input_t_start + input_feats.NumRows()));
-  if (ivector.Dim() != 0) {
-    std::vector<Index> indexes;
-    indexes.push_back(Index(0, 0, 0));
-    request.inputs.push_back(IoSpecification("ivector", indexes));
-  }
-  IoSpecification output_spec;
-  output_spec.name = "output";
-  output_spec.has_deriv = false;
   int32 subsample = opts_.frame_subsampling_factor;
-  output_spec.indexes.resize(num_subsampled_frames);
-  // leave n and x values at 0 (the constructor sets these).
-  for (int32 i = 0; i < num_subsampled_frames; i++)
-    output_spec.indexes[i].t = time_offset + output_t_start + i * subsample;
-  request.outputs.resize(1);
-  request.outputs[0].Swap(&output_spec);
+  CreateSimpleComputationRequest(time_offset + input_t_start,
+                                 input_feats.NumRows(), ivector.Dim() != 0,
+                                 time_offset + output_t_start,
+                                 num_subsampled_frames, subsample, &request);
 
   std::shared_ptr<const NnetComputation> computation = compiler_.Compile(request);
   Nnet *nnet_to_update = NULL;  // we're not doing any update.
   NnetComputer computer(opts_.compute_config, *computation,
                         nnet_, nnet_to_update);
+  if (thread_pool_ != NULL)
+    computer.SetThreadPool(thread_pool_);
 
   CuMatrix<BaseFloat> input_feats_cu(input_feats);
   computer.AcceptInput("input", &input_feats_cu);
@@ -361,6 +448,13 @@ BaseFloat DecodableAmNnetSimpleParallel::LogLikelihood(int32 frame,
   return decodable_nnet_->GetOutput(frame, pdf_id);
 }
 
+void DecodableAmNnetSimpleParallel::LogLikelihoods(
+    int32 frame, const std::vector<int32> &transition_ids,
+    std::vector<BaseFloat> *log_likes) {
+  trans_model_.TransitionIdsToPdfValues(decodable_nnet_->GetOutputRow(frame),
+                                        transition_ids, log_likes);
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
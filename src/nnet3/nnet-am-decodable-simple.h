@@ -94,6 +94,11 @@ struct NnetSimpleComputationOptions {
                    "input frames");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
+    opts->Register("precompiled-computations",
+                   &compiler_config.precompiled_computations, "If set, read "
+                   "computations precompiled for this model and these options "
+                   "by nnet3-precompile from here, so that they don't have to "
+                   "be compiled on first use.");
 
     // register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -105,6 +110,16 @@ struct NnetSimpleComputationOptions {
   }
 };
 
+/**
+   Outputs the distinct ComputationRequests that class DecodableNnetSimple may
+   compile when decoding utterances of any length with these options and this
+   network (with an iVector if the network takes one).  This is used by
+   nnet3-precompile, so that the computations can be compiled ahead of time.
+*/
+void GetSimpleComputationRequests(const NnetSimpleComputationOptions &opts,
+                                  const Nnet &nnet,
+                                  std::vector<ComputationRequest> *requests);
+
 /*
   This class handles the neural net computation; it's mostly accessed
   via other wrapper classes.
@@ -154,6 +169,8 @@ class DecodableNnetSimple {
                       const MatrixBase<BaseFloat> *online_ivectors = NULL,
                       int32 online_ivector_period = 1);
 
+  ~DecodableNnetSimple();
+
 
   // returns the number of frames of likelihoods.  The same as feats_.NumRows()
   // in the normal case (but may be less if opts_.frame_subsampling_factor !=
@@ -178,6 +195,18 @@ class DecodableNnetSimple {
                              current_log_post_subsampled_offset_,
                              pdf_id);
   }
+
+  // Returns the outputs for a particular frame, indexed by pdf_id, as an
+  // array of dimension OutputDim(); it is only valid until the next call to
+  // GetOutput() or GetOutputRow() for a frame that is not yet computed.
+  inline const BaseFloat *GetOutputRow(int32 subsampled_frame) {
+    if (subsampled_frame < current_log_post_subsampled_offset_ ||
+        subsampled_frame >= current_log_post_subsampled_offset_ +
+                            current_log_post_.NumRows())
+      EnsureFrameIsComputed(subsampled_frame);
+    return current_log_post_.RowData(subsampled_frame -
+                                     current_log_post_subsampled_offset_);
+  }
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetSimple);
 
@@ -244,6 +273,11 @@ class DecodableNnetSimple {
   // opts_.frame_subsampling_factor > 1, this will be measured in subsampled
   // frames.
   int32 current_log_post_subsampled_offset_;
+
+  // If opts_.compute_config.num_threads > 1, the threads that the
+  // NnetComputer for each chunk uses (so they are only started once per
+  // utterance), else NULL.
+  ThreadPool *thread_pool_;
 };
 
 class DecodableAmNnetSimple: public DecodableInterface {
@@ -294,6 +328,10 @@ class DecodableAmNnetSimple: public DecodableInterface {
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual void LogLikelihoods(int32 frame,
+                              const std::vector<int32> &transition_ids,
+                              std::vector<BaseFloat> *log_likes);
+
   virtual inline int32 NumFramesReady() const {
     return decodable_nnet_.NumFrames();
   }
@@ -365,6 +403,10 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual void LogLikelihoods(int32 frame,
+                              const std::vector<int32> &transition_ids,
+                              std::vector<BaseFloat> *log_likes);
+
   virtual inline int32 NumFramesReady() const {
     return decodable_nnet_->NumFrames();
   }
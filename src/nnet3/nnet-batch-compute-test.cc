@@ -0,0 +1,145 @@
+// nnet3/nnet-batch-compute-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-batch-compute.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// This checks that the output of NnetBatchComputer, for several utterances
+// computed together, is the same as what we get from DecodableNnetSimple for
+// each utterance separately.
+void TestNnetBatchComputer(Nnet *nnet) {
+  int32 num_utts = RandInt(1, 10),
+      input_dim = nnet->InputDim("input"),
+      output_dim = nnet->OutputDim("output"),
+      ivector_dim = std::max<int32>(0, nnet->InputDim("ivector"));
+
+  SetBatchnormTestMode(true, nnet);
+  SetDropoutTestMode(true, nnet);
+
+  Vector<BaseFloat> priors(RandInt(0, 1) == 0 ? output_dim : 0);
+  if (priors.Dim() != 0) {
+    priors.SetRandn();
+    priors.ApplyExp();
+  }
+
+  NnetBatchComputerOptions opts;
+  opts.frames_per_chunk = RandInt(5, 25);
+  opts.minibatch_size = RandInt(1, 8);
+
+  std::vector<Matrix<BaseFloat> > inputs(num_utts);
+  std::vector<Vector<BaseFloat> > ivectors(num_utts);
+  std::vector<std::vector<NnetInferenceTask> > tasks(num_utts);
+
+  NnetBatchComputer computer(opts, *nnet, priors);
+  for (int32 i = 0; i < num_utts; i++) {
+    inputs[i].Resize(RandInt(1, 100), input_dim);
+    inputs[i].SetRandn();
+    ivectors[i].Resize(ivector_dim);
+    ivectors[i].SetRandn();
+    computer.SplitUtteranceIntoTasks(inputs[i],
+                                     (ivector_dim != 0 ? &ivectors[i] : NULL),
+                                     NULL, 0, &(tasks[i]));
+    for (size_t j = 0; j < tasks[i].size(); j++)
+      computer.AcceptTask(&(tasks[i][j]));
+    while (computer.FullMinibatchReady())
+      computer.Compute(false);
+  }
+  while (computer.Compute(true));
+  KALDI_ASSERT(computer.NumTasksPending() == 0);
+
+  // the components that we exclude from this test, are excluded because they
+  // all take "optional" right context, and this destroys the equivalence that
+  // we are testing; also for recurrent nnets the output depends on how much
+  // left context we had.
+  bool check_equal =
+      (!NnetIsRecurrent(*nnet) &&
+       nnet->Info().find("statistics-extraction") == std::string::npos &&
+       nnet->Info().find("TimeHeightConvolutionComponent") == std::string::npos &&
+       nnet->Info().find("RestrictedAttentionComponent") == std::string::npos);
+
+  for (int32 i = 0; i < num_utts; i++) {
+    Matrix<BaseFloat> batch_output;
+    NnetBatchComputer::MergeTaskOutput(tasks[i], &batch_output);
+    int32 num_frames = inputs[i].NumRows();
+    KALDI_ASSERT(batch_output.NumRows() == num_frames &&
+                 batch_output.NumCols() == output_dim);
+    if (!check_equal)
+      continue;
+    Matrix<BaseFloat> simple_output(num_frames, output_dim);
+    CachingOptimizingCompiler compiler(*nnet);
+    DecodableNnetSimple decodable(opts, *nnet, priors, inputs[i], &compiler,
+                                  (ivector_dim != 0 ? &ivectors[i] : NULL));
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> row(simple_output, t);
+      decodable.GetOutputForFrame(t, &row);
+    }
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> row1(batch_output, t),
+          row2(simple_output, t);
+      KALDI_ASSERT(row1.ApproxEqual(row2));
+    }
+  }
+}
+
+void UnitTestNnetBatchCompute() {
+  for (int32 n = 0; n < 20; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      KALDI_LOG << "Input config[" << j << "] is: " << configs[j];
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    if (!IsSimpleNnet(nnet))
+      continue;
+    TestNnetBatchComputer(&nnet);
+  }
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+
+  for (kaldi::int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    UnitTestNnetBatchCompute();
+  }
+#if HAVE_CUDA == 1
+  CuDevice::Instantiate().PrintProfile();
+#endif
+  KALDI_LOG << "Nnet batch-compute tests succeeded.";
+
+  return 0;
+}
@@ -0,0 +1,416 @@
+// nnet3/nnet-batch-compute.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+NnetBatchComputer::NnetBatchComputer(
+    const NnetBatchComputerOptions &opts,
+    const Nnet &nnet,
+    const VectorBase<BaseFloat> &priors):
+    opts_(opts),
+    nnet_(nnet),
+    compiler_(nnet_, opts.optimize_config, opts.compiler_config),
+    log_priors_(priors),
+    num_tasks_pending_(0),
+    next_seq_(0),
+    num_minibatches_computed_(0),
+    num_tasks_computed_(0),
+    tot_padded_minibatch_size_(0) {
+  KALDI_ASSERT(IsSimpleNnet(nnet));
+  ComputeSimpleNnetContext(nnet, &nnet_left_context_, &nnet_right_context_);
+  log_priors_.ApplyLog();
+  CheckAndFixConfigs();
+}
+
+
+NnetBatchComputer::~NnetBatchComputer() {
+  if (num_tasks_pending_ != 0)
+    KALDI_WARN << "Destroying NnetBatchComputer with " << num_tasks_pending_
+               << " tasks not computed.";
+  if (num_minibatches_computed_ > 0) {
+    KALDI_LOG << "Computed " << num_tasks_computed_ << " chunks in "
+              << num_minibatches_computed_ << " minibatches; average "
+              << "minibatch size was "
+              << (num_tasks_computed_ /
+                  static_cast<BaseFloat>(num_minibatches_computed_))
+              << " chunks, plus "
+              << ((tot_padded_minibatch_size_ - num_tasks_computed_) /
+                  static_cast<BaseFloat>(num_minibatches_computed_))
+              << " chunks of padding.";
+  }
+}
+
+
+bool NnetBatchComputer::ComputationShape::operator < (
+    const ComputationShape &other) const {
+  if (first_input_t != other.first_input_t)
+    return first_input_t < other.first_input_t;
+  if (num_input_frames != other.num_input_frames)
+    return num_input_frames < other.num_input_frames;
+  if (num_output_frames != other.num_output_frames)
+    return num_output_frames < other.num_output_frames;
+  return ivector_dim < other.ivector_dim;
+}
+
+
+void NnetBatchComputer::CheckAndFixConfigs() {
+  int32 nnet_modulus = nnet_.Modulus();
+  if (opts_.frame_subsampling_factor < 1 ||
+      opts_.frames_per_chunk < 1)
+    KALDI_ERR << "--frame-subsampling-factor and --frames-per-chunk must be > 0";
+  if (opts_.minibatch_size < 1)
+    KALDI_ERR << "--minibatch-size must be > 0";
+  KALDI_ASSERT(nnet_modulus > 0);
+  int32 n = Lcm(opts_.frame_subsampling_factor, nnet_modulus);
+
+  if (opts_.frames_per_chunk % n != 0) {
+    // round up to the nearest multiple of n.
+    int32 frames_per_chunk = n * ((opts_.frames_per_chunk + n - 1) / n);
+    KALDI_LOG << "Increasing --frames-per-chunk from "
+              << opts_.frames_per_chunk << " to "
+              << frames_per_chunk << " due to "
+              << "--frame-subsampling-factor="
+              << opts_.frame_subsampling_factor << " and "
+              << "nnet shift-invariance modulus = " << nnet_modulus;
+    opts_.frames_per_chunk = frames_per_chunk;
+  }
+}
+
+
+void NnetBatchComputer::GetCurrentIvector(
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period,
+    int32 output_t_start,
+    int32 num_output_frames,
+    Vector<BaseFloat> *ivector_out) const {
+  if (ivector != NULL) {
+    *ivector_out = *ivector;
+    return;
+  } else if (online_ivectors == NULL) {
+    ivector_out->Resize(0);
+    return;
+  }
+  KALDI_ASSERT(online_ivector_period > 0);
+  // As in DecodableNnetSimple, we choose the iVector for a frame near the
+  // middle of the current chunk.
+  int32 frame_to_search = output_t_start + num_output_frames / 2;
+  int32 ivector_frame = frame_to_search / online_ivector_period;
+  KALDI_ASSERT(ivector_frame >= 0);
+  if (ivector_frame >= online_ivectors->NumRows()) {
+    int32 margin = ivector_frame - (online_ivectors->NumRows() - 1);
+    if (margin * online_ivector_period > 50) {
+      // Half a second seems like too long to be explainable as edge effects.
+      KALDI_ERR << "Could not get iVector for frame " << frame_to_search
+                << ", only available till frame "
+                << online_ivectors->NumRows()
+                << " * ivector-period=" << online_ivector_period
+                << " (mismatched --online-ivector-period?)";
+    }
+    ivector_frame = online_ivectors->NumRows() - 1;
+  }
+  *ivector_out = online_ivectors->Row(ivector_frame);
+}
+
+
+void NnetBatchComputer::SplitUtteranceIntoTasks(
+    const MatrixBase<BaseFloat> &input,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period,
+    std::vector<NnetInferenceTask> *tasks) {
+  KALDI_ASSERT(!(ivector != NULL && online_ivectors != NULL));
+  KALDI_ASSERT(!(online_ivectors != NULL && online_ivector_period <= 0 &&
+                 "You need to set the --online-ivector-period option!"));
+  int32 nnet_input_dim = nnet_.InputDim("input"),
+      nnet_ivector_dim = std::max<int32>(0, nnet_.InputDim("ivector")),
+      ivector_dim = (ivector != NULL ? ivector->Dim() :
+                     (online_ivectors != NULL ? online_ivectors->NumCols() : 0));
+  if (input.NumCols() != nnet_input_dim)
+    KALDI_ERR << "Neural net expects 'input' features with dimension "
+              << nnet_input_dim << " but you provided " << input.NumCols();
+  if (ivector_dim != nnet_ivector_dim)
+    KALDI_ERR << "Neural net expects 'ivector' features with dimension "
+              << nnet_ivector_dim << " but you provided " << ivector_dim;
+
+  int32 num_input_frames = input.NumRows(),
+      subsampling_factor = opts_.frame_subsampling_factor,
+      num_subsampled_frames = (num_input_frames + subsampling_factor - 1) /
+                              subsampling_factor,
+      subsampled_frames_per_chunk = opts_.frames_per_chunk / subsampling_factor,
+      // all chunks have the same size; the utterance may be shorter than a
+      // chunk, in which case there is just one (shorter) chunk.
+      chunk_size = std::min<int32>(subsampled_frames_per_chunk,
+                                   num_subsampled_frames),
+      num_chunks = (num_subsampled_frames + subsampled_frames_per_chunk - 1) /
+                   subsampled_frames_per_chunk;
+  KALDI_ASSERT(num_subsampled_frames > 0);
+  KALDI_ASSERT(opts_.extra_left_context >= 0 && opts_.extra_right_context >= 0);
+
+  tasks->clear();
+  tasks->resize(num_chunks);
+  for (int32 c = 0; c < num_chunks; c++) {
+    NnetInferenceTask &task = (*tasks)[c];
+    int32 first_subsampled_frame = c * subsampled_frames_per_chunk,
+        num_initial_unused = 0;
+    if (first_subsampled_frame + chunk_size > num_subsampled_frames) {
+      // Shift the last chunk to the left so it has the same size as the
+      // others; this means we don't need a differently-shaped computation for
+      // the end of each utterance.
+      num_initial_unused = first_subsampled_frame + chunk_size -
+                           num_subsampled_frames;
+      first_subsampled_frame -= num_initial_unused;
+    }
+    int32 last_subsampled_frame = first_subsampled_frame + chunk_size - 1,
+        first_output_frame = first_subsampled_frame * subsampling_factor,
+        last_output_frame = last_subsampled_frame * subsampling_factor;
+
+    int32 extra_left_context = opts_.extra_left_context,
+        extra_right_context = opts_.extra_right_context;
+    if (first_output_frame == 0 && opts_.extra_left_context_initial >= 0)
+      extra_left_context = opts_.extra_left_context_initial;
+    if (last_subsampled_frame == num_subsampled_frames - 1 &&
+        opts_.extra_right_context_final >= 0)
+      extra_right_context = opts_.extra_right_context_final;
+    int32 left_context = nnet_left_context_ + extra_left_context,
+        right_context = nnet_right_context_ + extra_right_context;
+    int32 first_input_frame = first_output_frame - left_context,
+        last_input_frame = last_output_frame + right_context,
+        this_num_input_frames = last_input_frame + 1 - first_input_frame;
+
+    task.input.Resize(this_num_input_frames, input.NumCols(), kUndefined);
+    if (first_input_frame >= 0 && last_input_frame < num_input_frames) {
+      task.input.CopyFromMat(input.RowRange(first_input_frame,
+                                            this_num_input_frames));
+    } else {
+      // Pad at the utterance boundaries by repeating the first or last frame.
+      for (int32 i = 0; i < this_num_input_frames; i++) {
+        int32 t = i + first_input_frame;
+        if (t < 0) t = 0;
+        if (t >= num_input_frames) t = num_input_frames - 1;
+        task.input.Row(i).CopyFromVec(input.Row(t));
+      }
+    }
+    task.first_input_t = -left_context;
+    task.num_output_frames = chunk_size;
+    task.num_initial_unused_output_frames = num_initial_unused;
+    task.num_used_output_frames = chunk_size - num_initial_unused;
+    GetCurrentIvector(ivector, online_ivectors, online_ivector_period,
+                      first_output_frame,
+                      last_output_frame - first_output_frame,
+                      &task.ivector);
+    task.is_computed = false;
+  }
+}
+
+
+void NnetBatchComputer::AcceptTask(NnetInferenceTask *task) {
+  KALDI_ASSERT(!task->is_computed && task->num_output_frames > 0);
+  ComputationShape shape;
+  shape.first_input_t = task->first_input_t;
+  shape.num_input_frames = task->input.NumRows();
+  shape.num_output_frames = task->num_output_frames;
+  shape.ivector_dim = task->ivector.Dim();
+  tasks_[shape].push_back(PendingTask(task, next_seq_++));
+  num_tasks_pending_++;
+}
+
+
+bool NnetBatchComputer::FullMinibatchReady() const {
+  for (TaskMap::const_iterator iter = tasks_.begin(); iter != tasks_.end();
+       ++iter)
+    if (iter->second.size() >= static_cast<size_t>(opts_.minibatch_size))
+      return true;
+  return false;
+}
+
+
+bool NnetBatchComputer::Compute(bool allow_partial_minibatch) {
+  TaskMap::iterator chosen = tasks_.end();
+  for (TaskMap::iterator iter = tasks_.begin(); iter != tasks_.end(); ++iter) {
+    if (iter->second.size() >= static_cast<size_t>(opts_.minibatch_size)) {
+      chosen = iter;
+      break;
+    }
+  }
+  if (chosen == tasks_.end()) {
+    if (!allow_partial_minibatch)
+      return false;
+    // Choose the queue containing the oldest task, so that the utterance that
+    // has been waiting the longest can be completed.
+    for (TaskMap::iterator iter = tasks_.begin(); iter != tasks_.end();
+         ++iter) {
+      if (iter->second.empty()) continue;
+      if (chosen == tasks_.end() ||
+          iter->second.front().seq < chosen->second.front().seq)
+        chosen = iter;
+    }
+    if (chosen == tasks_.end())
+      return false;
+  }
+  ComputeMinibatch(chosen->first, &(chosen->second));
+  if (chosen->second.empty())
+    tasks_.erase(chosen);
+  return true;
+}
+
+
+int32 NnetBatchComputer::GetActualMinibatchSize(int32 num_tasks) const {
+  KALDI_ASSERT(num_tasks > 0 && num_tasks <= opts_.minibatch_size);
+  int32 ans = 1;
+  while (ans < num_tasks)
+    ans *= 2;
+  return std::min<int32>(ans, opts_.minibatch_size);
+}
+
+
+void NnetBatchComputer::GetComputationRequest(
+    const ComputationShape &shape,
+    int32 minibatch_size,
+    ComputationRequest *request) const {
+  request->need_model_derivative = false;
+  request->store_component_stats = false;
+  request->inputs.clear();
+  request->outputs.clear();
+  request->inputs.resize(shape.ivector_dim > 0 ? 2 : 1);
+  request->outputs.resize(1);
+
+  // Note: the indexes are in the same order as in merged training examples,
+  // with the 'n' index varying the slowest, so that each chunk occupies a
+  // contiguous range of rows of the input and output matrices.
+  IoSpecification &input = request->inputs[0];
+  input.name = "input";
+  input.indexes.resize(minibatch_size * shape.num_input_frames);
+  for (int32 n = 0, i = 0; n < minibatch_size; n++)
+    for (int32 t = 0; t < shape.num_input_frames; t++, i++)
+      input.indexes[i] = Index(n, shape.first_input_t + t);
+  if (shape.ivector_dim > 0) {
+    IoSpecification &ivector = request->inputs[1];
+    ivector.name = "ivector";
+    ivector.indexes.resize(minibatch_size);
+    for (int32 n = 0; n < minibatch_size; n++)
+      ivector.indexes[n] = Index(n, 0);
+  }
+  IoSpecification &output = request->outputs[0];
+  output.name = "output";
+  output.has_deriv = false;
+  output.indexes.resize(minibatch_size * shape.num_output_frames);
+  int32 subsampling_factor = opts_.frame_subsampling_factor;
+  for (int32 n = 0, i = 0; n < minibatch_size; n++)
+    for (int32 t = 0; t < shape.num_output_frames; t++, i++)
+      output.indexes[i] = Index(n, t * subsampling_factor);
+}
+
+
+void NnetBatchComputer::ComputeMinibatch(const ComputationShape &shape,
+                                         std::deque<PendingTask> *queue) {
+  int32 num_tasks = std::min<int32>(queue->size(), opts_.minibatch_size),
+      minibatch_size = GetActualMinibatchSize(num_tasks),
+      num_input_frames = shape.num_input_frames,
+      num_output_frames = shape.num_output_frames;
+  KALDI_ASSERT(num_tasks > 0);
+
+  ComputationRequest request;
+  GetComputationRequest(shape, minibatch_size, &request);
+  std::shared_ptr<const NnetComputation> computation =
+      compiler_.Compile(request);
+
+  int32 input_dim = queue->front().task->input.NumCols();
+  CuMatrix<BaseFloat> input(minibatch_size * num_input_frames, input_dim,
+                            kUndefined);
+  CuMatrix<BaseFloat> ivectors;
+  if (shape.ivector_dim > 0)
+    ivectors.Resize(minibatch_size, shape.ivector_dim, kUndefined);
+  for (int32 n = 0; n < minibatch_size; n++) {
+    // Any padding at the end of the minibatch is done by repeating the last
+    // task; its output is discarded.
+    const NnetInferenceTask &task =
+        *((*queue)[std::min<int32>(n, num_tasks - 1)].task);
+    input.RowRange(n * num_input_frames, num_input_frames).CopyFromMat(
+        task.input);
+    if (shape.ivector_dim > 0)
+      ivectors.Row(n).CopyFromVec(task.ivector);
+  }
+
+  Nnet *nnet_to_update = NULL;  // we're not doing any update.
+  NnetComputer computer(opts_.compute_config, *computation,
+                        nnet_, nnet_to_update);
+  computer.AcceptInput("input", &input);
+  if (shape.ivector_dim > 0)
+    computer.AcceptInput("ivector", &ivectors);
+  computer.Run();
+  CuMatrix<BaseFloat> output;
+  computer.GetOutputDestructive("output", &output);
+  // subtract log-prior (divide by prior)
+  if (log_priors_.Dim() != 0)
+    output.AddVecToRows(-1.0, log_priors_);
+  // apply the acoustic scale
+  output.Scale(opts_.acoustic_scale);
+
+  for (int32 n = 0; n < num_tasks; n++) {
+    NnetInferenceTask *task = (*queue)[n].task;
+    task->output.Resize(num_output_frames, output.NumCols(), kUndefined);
+    task->output.CopyFromMat(output.RowRange(n * num_output_frames,
+                                             num_output_frames));
+    task->is_computed = true;
+  }
+  queue->erase(queue->begin(), queue->begin() + num_tasks);
+  num_tasks_pending_ -= num_tasks;
+  num_minibatches_computed_++;
+  num_tasks_computed_ += num_tasks;
+  tot_padded_minibatch_size_ += minibatch_size;
+}
+
+
+// static
+void NnetBatchComputer::MergeTaskOutput(
+    const std::vector<NnetInferenceTask> &tasks,
+    Matrix<BaseFloat> *output) {
+  int32 num_tasks = tasks.size(),
+      num_output_frames = 0,
+      output_dim = -1;
+  for (int32 i = 0; i < num_tasks; i++) {
+    if (!tasks[i].is_computed)
+      KALDI_ERR << "Not all tasks have been computed";
+    num_output_frames += tasks[i].num_used_output_frames;
+    if (i == 0)
+      output_dim = tasks[i].output.NumCols();
+    else
+      KALDI_ASSERT(tasks[i].output.NumCols() == output_dim);
+  }
+  output->Resize(num_output_frames, output_dim, kUndefined);
+  int32 cur_output_frame = 0;
+  for (int32 i = 0; i < num_tasks; i++) {
+    const NnetInferenceTask &task = tasks[i];
+    output->RowRange(cur_output_frame, task.num_used_output_frames).CopyFromMat(
+        task.output.RowRange(task.num_initial_unused_output_frames,
+                             task.num_used_output_frames));
+    cur_output_frame += task.num_used_output_frames;
+  }
+  KALDI_ASSERT(cur_output_frame == num_output_frames);
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
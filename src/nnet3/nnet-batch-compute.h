@@ -0,0 +1,259 @@
+// nnet3/nnet-batch-compute.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_BATCH_COMPUTE_H_
+#define KALDI_NNET3_NNET_BATCH_COMPUTE_H_
+
+#include <vector>
+#include <map>
+#include <deque>
+#include "base/kaldi-common.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+/*
+  This file contains code for doing the neural net computation for many
+  utterances at once, in large minibatches.  The utterances are broken up into
+  fixed-size chunks (as in DecodableNnetSimple, see nnet-am-decodable-simple.h),
+  and chunks of the same shape, from any utterance, are combined into a single
+  computation in which the chunks are distinguished by the 'n' index.  This
+  gives much larger matrix multiplications than computing each utterance
+  separately, which is more efficient with BLAS on CPU and especially on GPU.
+
+  The results are identical to what DecodableNnetSimple would give, except that
+  (a) the last chunk of an utterance is shifted to the left so that it has the
+  same size as the others (so the overlapping frames are computed with a
+  different amount of left context), and (b) the online iVector for that chunk
+  may be taken from a slightly different frame.
+*/
+
+
+struct NnetBatchComputerOptions: public NnetSimpleComputationOptions {
+  int32 minibatch_size;
+  int32 max_pending_utterances;
+
+  NnetBatchComputerOptions(): minibatch_size(128),
+                              max_pending_utterances(200) { }
+
+  void Register(OptionsItf *opts) {
+    NnetSimpleComputationOptions::Register(opts);
+    opts->Register("minibatch-size", &minibatch_size, "Number of chunks "
+                   "(from possibly different utterances) that are computed "
+                   "together in one minibatch.");
+    opts->Register("max-pending-utterances", &max_pending_utterances,
+                   "Maximum number of utterances whose neural net output is "
+                   "not yet complete; when this is exceeded we start computing "
+                   "partial minibatches.  Controls latency and memory use.");
+  }
+};
+
+
+/**
+   An NnetInferenceTask is one chunk of one utterance, to be computed as part
+   of a minibatch.  It is created by NnetBatchComputer::SplitUtteranceIntoTasks().
+ */
+struct NnetInferenceTask {
+  // The input features for this chunk (already padded at the utterance
+  // boundaries, if necessary).  The first row corresponds to time
+  // 'first_input_t' relative to the first output frame of the chunk, which has
+  // t = 0.
+  Matrix<BaseFloat> input;
+
+  // first_input_t is the time index of the first row of 'input', relative to
+  // the first output frame; it's <= 0 and equals minus the left-context.
+  int32 first_input_t;
+
+  // The number of output frames (after subsampling) that will be computed for
+  // this chunk.
+  int32 num_output_frames;
+
+  // The number of initial output frames of this chunk that are not used
+  // because they overlap with the previous chunk.  This is only nonzero for
+  // the last chunk of an utterance that had to be shifted left so that it has
+  // the same size as the other chunks.
+  int32 num_initial_unused_output_frames;
+
+  // The number of output frames that are used (equals num_output_frames
+  // minus num_initial_unused_output_frames).
+  int32 num_used_output_frames;
+
+  // The iVector for this chunk, if we are using iVectors; else empty.
+  Vector<BaseFloat> ivector;
+
+  // The output of the computation (after subtracting the log-priors, if any,
+  // and scaling by the acoustic scale); has num_output_frames rows.  This is
+  // only valid once is_computed is true.
+  Matrix<BaseFloat> output;
+
+  // True once the computation for this task has been done.
+  bool is_computed;
+
+  NnetInferenceTask(): first_input_t(0), num_output_frames(0),
+                       num_initial_unused_output_frames(0),
+                       num_used_output_frames(0), is_computed(false) { }
+};
+
+
+/**
+   Class NnetBatchComputer is responsible for grouping NnetInferenceTasks that
+   have the same shape into minibatches, and doing the computation for them.
+
+   It is not thread-safe: the intended use is that one thread (e.g. the main
+   thread of a decoding program) accepts tasks and calls Compute(), while the
+   expensive decoding of the utterances whose tasks are complete is done in
+   other threads.  Because all computations go through the same
+   CachingOptimizingCompiler, each distinct computation is compiled only once.
+ */
+class NnetBatchComputer {
+ public:
+  /**
+     Constructor.
+       @param [in] opts  Options class.  Warning: it includes an acoustic
+                      weight, whose default is 0.1.
+       @param [in] nnet  The neural net, which must satisfy IsSimpleNnet(nnet).
+       @param [in] priors  Vector of priors-- if supplied and nonempty, we
+                      subtract the log of these priors from the nnet output.
+   */
+  NnetBatchComputer(const NnetBatchComputerOptions &opts,
+                    const Nnet &nnet,
+                    const VectorBase<BaseFloat> &priors);
+
+  /**
+     Splits a single utterance into a sequence of tasks, which the user should
+     then give to AcceptTask().  The interface is similar to the constructor
+     of DecodableNnetSimple; the features and iVectors are copied into the
+     tasks, so they need not persist.
+   */
+  void SplitUtteranceIntoTasks(const MatrixBase<BaseFloat> &input,
+                               const VectorBase<BaseFloat> *ivector,
+                               const MatrixBase<BaseFloat> *online_ivectors,
+                               int32 online_ivector_period,
+                               std::vector<NnetInferenceTask> *tasks);
+
+  /// Accepts a task for computation.  Does not take ownership of the pointer;
+  /// the task must not be moved or destroyed until task->is_computed is true.
+  void AcceptTask(NnetInferenceTask *task);
+
+  /// Returns the number of tasks that have been accepted but not computed.
+  int32 NumTasksPending() const { return num_tasks_pending_; }
+
+  /// Returns true if there is at least one group of same-shaped tasks that
+  /// is large enough to make a full minibatch.
+  bool FullMinibatchReady() const;
+
+  /**
+     Does the computation for one minibatch, if one is ready.  If
+     allow_partial_minibatch is true and there is no full minibatch ready, it
+     will compute a partial minibatch containing the oldest pending task (this
+     is used to limit latency, and to flush the remaining tasks at the end).
+     Returns true if it did some computation, false if there was nothing to do.
+   */
+  bool Compute(bool allow_partial_minibatch);
+
+  /**
+     Merges the outputs of the tasks from SplitUtteranceIntoTasks(), which must
+     all have been computed, into a single matrix of log-likelihoods for the
+     whole utterance.
+   */
+  static void MergeTaskOutput(const std::vector<NnetInferenceTask> &tasks,
+                              Matrix<BaseFloat> *output);
+
+  /// Prints some diagnostics about the minibatch sizes that were computed.
+  ~NnetBatchComputer();
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetBatchComputer);
+
+  // Tasks with the same ComputationShape can be computed together.
+  struct ComputationShape {
+    int32 first_input_t;
+    int32 num_input_frames;
+    int32 num_output_frames;
+    int32 ivector_dim;
+    bool operator < (const ComputationShape &other) const;
+  };
+
+  // A pending task, together with a sequence number that says in what order
+  // the tasks were accepted (used to find the oldest task).
+  struct PendingTask {
+    NnetInferenceTask *task;
+    int64 seq;
+    PendingTask(NnetInferenceTask *task, int64 seq): task(task), seq(seq) { }
+  };
+
+  typedef std::map<ComputationShape, std::deque<PendingTask> > TaskMap;
+
+  // Computes a minibatch of up to opts_.minibatch_size tasks from the front of
+  // the queue for this shape, removing them from the queue.
+  void ComputeMinibatch(const ComputationShape &shape,
+                        std::deque<PendingTask> *queue);
+
+  // Returns the size of minibatch we actually compile the computation for,
+  // given that we have 'num_tasks' tasks.  To avoid having to compile a
+  // separate computation for every possible size, we round up to a power of
+  // two (but not more than opts_.minibatch_size).
+  int32 GetActualMinibatchSize(int32 num_tasks) const;
+
+  // Gets the computation request for a minibatch of the given shape and size.
+  void GetComputationRequest(const ComputationShape &shape,
+                             int32 minibatch_size,
+                             ComputationRequest *request) const;
+
+  // Gets the iVector for the chunk whose first and last output frames (in
+  // un-subsampled numbering) are as given.  Mirrors
+  // DecodableNnetSimple::GetCurrentIvector().
+  void GetCurrentIvector(const VectorBase<BaseFloat> *ivector,
+                         const MatrixBase<BaseFloat> *online_ivectors,
+                         int32 online_ivector_period,
+                         int32 output_t_start,
+                         int32 num_output_frames,
+                         Vector<BaseFloat> *ivector_out) const;
+
+  // called from the constructor.
+  void CheckAndFixConfigs();
+
+  NnetBatchComputerOptions opts_;
+  const Nnet &nnet_;
+  CachingOptimizingCompiler compiler_;
+  int32 nnet_left_context_;
+  int32 nnet_right_context_;
+  // the log priors (or the empty vector if the priors are not set).
+  CuVector<BaseFloat> log_priors_;
+
+  TaskMap tasks_;
+  int32 num_tasks_pending_;
+  int64 next_seq_;
+
+  // Stats: the number of minibatches and tasks computed, and the total
+  // minibatch size including padding, for diagnostics.
+  int64 num_minibatches_computed_;
+  int64 num_tasks_computed_;
+  int64 tot_padded_minibatch_size_;
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif  // KALDI_NNET3_NNET_BATCH_COMPUTE_H_
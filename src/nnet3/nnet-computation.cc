@@ -18,6 +18,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <iterator>
 #include <sstream>
 #include "nnet3/nnet-computation.h"
@@ -97,6 +98,155 @@ void NnetComputation::ComputeCudaIndexes() {
     // the interface of CUDA being plain C.
     indexes_ranges_cuda[i].CopyFromVec(*input_cast);
   }
+  ComputeMemoryPlan();
+}
+
+int32 NnetComputation::MemoryPlanStride(int32 matrix_index) const {
+  const MatrixInfo &info = matrices[matrix_index];
+  if (info.stride_type == kStrideEqualNumCols)
+    return info.num_cols;
+  // Round up to a multiple of 16 bytes, as Matrix does.
+  int32 alignment = 16 / sizeof(BaseFloat);
+  return (info.num_cols + alignment - 1) / alignment * alignment;
+}
+
+// Used in ComputeMemoryPlan(); returns the representative element of the set
+// containing 'm'.
+static int32 FindMatrixGroup(std::vector<int32> *group, int32 m) {
+  while ((*group)[m] != m) {
+    (*group)[m] = (*group)[(*group)[m]];
+    m = (*group)[m];
+  }
+  return m;
+}
+
+void NnetComputation::ComputeMemoryPlan() {
+  int32 num_matrices = matrices.size(),
+      num_commands = commands.size();
+  matrix_offsets.clear();
+  matrix_offsets.resize(num_matrices, -1);
+  memory_plan_size = 0;
+
+  // A kSwapMatrix command that moves the data of an allocated matrix to an
+  // unallocated one (as created by RemoveUnnecessaryAllocation()) doesn't
+  // need any memory to move, so we plan for such matrices as a group that
+  // shares the same memory.  'group' is a union-find structure for those
+  // groups.  Swaps of two allocated matrices (as in looped computations)
+  // would need the memory to move, so we don't plan for those matrices.
+  std::vector<int32> group(num_matrices);
+  for (int32 m = 0; m < num_matrices; m++)
+    group[m] = m;
+  std::vector<bool> can_plan(num_matrices, true), allocated(num_matrices,
+                                                            false);
+  if (num_matrices > 0)
+    can_plan[0] = false;  // matrix zero is the empty matrix.
+  for (int32 c = 0; c < num_commands; c++) {
+    const Command &command = commands[c];
+    int32 m1, m2;
+    switch (command.command_type) {
+      case kAllocMatrix:
+        allocated[submatrices[command.arg1].matrix_index] = true;
+        break;
+      case kDeallocMatrix:
+        allocated[submatrices[command.arg1].matrix_index] = false;
+        break;
+      case kSwapMatrix:
+        m1 = submatrices[command.arg1].matrix_index;
+        m2 = submatrices[command.arg2].matrix_index;
+        if ((allocated[m1] && allocated[m2]) ||
+            MemoryPlanStride(m1) != MemoryPlanStride(m2)) {
+          can_plan[m1] = false;
+          can_plan[m2] = false;
+        } else {
+          group[FindMatrixGroup(&group, m1)] = FindMatrixGroup(&group, m2);
+        }
+        allocated.swap(allocated[m1], allocated[m2]);
+        break;
+      case kAcceptInput: case kProvideOutput:
+      case kCompressMatrix: case kDecompressMatrix:
+        can_plan[submatrices[command.arg1].matrix_index] = false;
+        break;
+      default:
+        break;
+    }
+  }
+  for (int32 m = 0; m < num_matrices; m++)
+    if (!can_plan[m])
+      can_plan[FindMatrixGroup(&group, m)] = false;
+
+  // Work out the lifetime of each group, from the first allocation of one of
+  // its matrices until none of them is allocated any more (or the end of the
+  // computation).  If two matrices of a group are ever allocated at the same
+  // time, we can't plan for it.
+  std::vector<int32> lifetime_begin(num_matrices, -1),
+      lifetime_end(num_matrices, num_commands),
+      num_allocated(num_matrices, 0);
+  for (int32 c = 0; c < num_commands; c++) {
+    const Command &command = commands[c];
+    if (command.command_type != kAllocMatrix &&
+        command.command_type != kDeallocMatrix)
+      continue;
+    int32 g = FindMatrixGroup(&group, submatrices[command.arg1].matrix_index);
+    if (command.command_type == kAllocMatrix) {
+      if (lifetime_begin[g] == -1)
+        lifetime_begin[g] = c;
+      if (++num_allocated[g] > 1)
+        can_plan[g] = false;
+    } else {
+      if (--num_allocated[g] == 0)
+        lifetime_end[g] = c;
+    }
+  }
+
+  // Each element is (minus the size, group), so sorting puts the largest
+  // groups first.
+  std::vector<std::pair<int64, int32> > to_place;
+  std::vector<int64> sizes(num_matrices, 0);
+  for (int32 m = 0; m < num_matrices; m++) {
+    int32 g = FindMatrixGroup(&group, m);
+    if (!can_plan[g] || lifetime_begin[g] == -1)
+      continue;
+    if (num_allocated[g] > 0)
+      lifetime_end[g] = num_commands;
+    // Round the size up to a multiple of 64 bytes so that each matrix starts
+    // on a new cache line.
+    int64 size = static_cast<int64>(matrices[m].num_rows) *
+        MemoryPlanStride(m), alignment = 64 / sizeof(BaseFloat);
+    size = (size + alignment - 1) / alignment * alignment;
+    if (g == m && size > 0)
+      to_place.push_back(std::pair<int64, int32>(-size, g));
+    sizes[g] = std::max(sizes[g], size);
+  }
+  std::sort(to_place.begin(), to_place.end());
+
+  std::vector<int32> placed;
+  std::vector<std::pair<int64, int64> > occupied;  // (begin, end) offsets.
+  for (size_t i = 0; i < to_place.size(); i++) {
+    int32 g = to_place[i].second;
+    occupied.clear();
+    for (size_t j = 0; j < placed.size(); j++) {
+      int32 g2 = placed[j];
+      if (lifetime_begin[g2] <= lifetime_end[g] &&
+          lifetime_begin[g] <= lifetime_end[g2])
+        occupied.push_back(std::pair<int64, int64>(
+            matrix_offsets[g2], matrix_offsets[g2] + sizes[g2]));
+    }
+    std::sort(occupied.begin(), occupied.end());
+    int64 offset = 0;
+    for (size_t j = 0; j < occupied.size(); j++) {
+      if (offset + sizes[g] <= occupied[j].first)
+        break;
+      offset = std::max(offset, occupied[j].second);
+    }
+    matrix_offsets[g] = offset;
+    memory_plan_size = std::max(memory_plan_size, offset + sizes[g]);
+    placed.push_back(g);
+  }
+  for (int32 m = 0; m < num_matrices; m++) {
+    int32 g = FindMatrixGroup(&group, m);
+    if (g != m && can_plan[g] && lifetime_begin[g] != -1 && sizes[g] > 0)
+      matrix_offsets[m] = matrix_offsets[g];
+  }
 }
 
 int32 NnetComputation::NewSubMatrix(int32 base_submatrix,
@@ -549,7 +699,10 @@ static void PrintCommand(std::ostream &os_out,
       if (c.arg2 == 0) os << "NULL, ";
       else os << "precomputed_indexes[" << c.arg2 << "], ";
       os << submatrix_strings[c.arg3] << ", &" << submatrix_strings[c.arg4]
-         << ")\n";
+         << ")";
+      if (c.arg7 > 0)
+        os << "  # fused with next " << c.arg7 << " command(s)";
+      os << "\n";
       break;
     case kBackprop:
     case kBackpropNoModelUpdate: {
@@ -1142,7 +1295,9 @@ NnetComputation::NnetComputation(const NnetComputation &other):
     commands(other.commands),
     need_model_derivative(other.need_model_derivative),
     indexes_cuda(other.indexes_cuda),
-    indexes_ranges_cuda(other.indexes_ranges_cuda) {
+    indexes_ranges_cuda(other.indexes_ranges_cuda),
+    matrix_offsets(other.matrix_offsets),
+    memory_plan_size(other.memory_plan_size) {
   for (size_t i = 1; i < component_precomputed_indexes.size(); i++)
     component_precomputed_indexes[i].data =
         component_precomputed_indexes[i].data->Copy();
@@ -1159,6 +1314,8 @@ NnetComputation& NnetComputation::operator = (const NnetComputation &other) {
   need_model_derivative = other.need_model_derivative;
   indexes_cuda = other.indexes_cuda;
   indexes_ranges_cuda = other.indexes_ranges_cuda;
+  matrix_offsets = other.matrix_offsets;
+  memory_plan_size = other.memory_plan_size;
 
   for (size_t i = 1; i < component_precomputed_indexes.size(); i++)
     delete component_precomputed_indexes[i].data;
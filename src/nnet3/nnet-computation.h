@@ -205,6 +205,10 @@ struct ComputationRequestPtrEqual {
      - arg6 is 1 if we need to call StoreStats() after the Propagate, or 0
        if we don't.  We used to have a separate command for storing the
        stats, but that has been removed.
+     - arg7 is normally -1; if it is positive, it means this command was
+       fused by FuseComponents() with the following arg7 commands (which
+       will be in-place kPropagate commands for elementwise components), and
+       NnetComputer may execute them all together.
    - kBackprop: Do the back-propagation operation, see Component::Backprop()
      - arg1 is index of component in neural net
      - arg2 is index into ComponentPrecomputedIndexes (0 if NULL; always 0
@@ -447,6 +451,19 @@ struct NnetComputation {
   // computed from "indexes_ranges" by ComputeCudaIndexes().
   std::vector<CuArray<Int32Pair> > indexes_ranges_cuda;
 
+  // matrix_offsets and memory_plan_size are a static plan of the memory used
+  // by the computation, which NnetComputer uses when not using a GPU so that
+  // it doesn't have to allocate memory for each matrix; they are computed by
+  // ComputeMemoryPlan(), which ComputeCudaIndexes() calls.  matrix_offsets is
+  // indexed by matrix index, and gives the offset (in elements) of the matrix
+  // within a single buffer of memory_plan_size elements, with row stride
+  // MemoryPlanStride(m); or -1 for matrices that are not in the buffer (the
+  // inputs and outputs, compressed matrices, and matrices that are swapped
+  // while both are allocated).  Matrices whose lifetimes don't overlap may
+  // share memory.
+  std::vector<int64> matrix_offsets;
+  int64 memory_plan_size;
+
 
   /// Convenience function used when adding new matrices.  Writes to
   /// 'this->matrices' and 'this->submatrices'; and if 'this->matrix_debug_info'
@@ -470,9 +487,24 @@ struct NnetComputation {
 
   // This must be called after setting up the computation but prior to actually
   // using the Computation object in a computation, to compute CUDA versions of
-  // the indexes.
+  // the indexes.  It also calls ComputeMemoryPlan().
   void ComputeCudaIndexes();
 
+  // Sets up matrix_offsets and memory_plan_size.  Matrices connected by
+  // kSwapMatrix commands that just move data to an unallocated matrix share
+  // the same memory.  The lifetime of each such group is taken to be from
+  // its first kAllocMatrix command to the kDeallocMatrix command after which
+  // none of it is allocated (or the end of the computation), which is also
+  // valid for looped computations, as matrices that are allocated inside the
+  // loop are deallocated inside it too.  The matrices are placed, largest first, at
+  // the lowest offset that doesn't overlap any matrix with an overlapping
+  // lifetime that has already been placed.
+  void ComputeMemoryPlan();
+
+  // Returns the row stride of matrix 'matrix_index' in the memory plan; this
+  // is the same as for a CPU-based Matrix of that size and stride type.
+  int32 MemoryPlanStride(int32 matrix_index) const;
+
   // This function produces pretty-print ouput intended to allow a human to
   // interpret the computation.
   void Print(std::ostream &os, const Nnet &nnet) const;
@@ -511,7 +543,7 @@ struct NnetComputation {
   // Assignment operator.
   NnetComputation &operator = (const NnetComputation &other);
   // Default constructor
-  NnetComputation(): need_model_derivative(false) { }
+  NnetComputation(): need_model_derivative(false), memory_plan_size(0) { }
 };
 
 
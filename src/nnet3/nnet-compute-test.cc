@@ -53,6 +53,65 @@ void UnitTestNnetComputationIo(NnetComputation *computation) {
   }
 }
 
+// Checks that matrices that share memory in the computation's memory plan
+// are never allocated at the same time.
+void UnitTestMemoryPlan(const NnetComputation &computation) {
+  int32 num_matrices = computation.matrices.size(),
+      num_commands = computation.commands.size();
+  KALDI_ASSERT(computation.matrix_offsets.size() == num_matrices);
+  // begin and end are the first and last commands at which each matrix holds
+  // data, taking account of data moved by kSwapMatrix commands.
+  std::vector<int32> begin(num_matrices, -1), end(num_matrices, num_commands);
+  std::vector<bool> allocated(num_matrices, false);
+  for (int32 c = 0; c < num_commands; c++) {
+    const NnetComputation::Command &command = computation.commands[c];
+    int32 m1 = -1, m2 = -1;
+    if (command.command_type == kAllocMatrix) {
+      m1 = computation.submatrices[command.arg1].matrix_index;
+      allocated[m1] = true;
+    } else if (command.command_type == kDeallocMatrix) {
+      m1 = computation.submatrices[command.arg1].matrix_index;
+      allocated[m1] = false;
+    } else if (command.command_type == kSwapMatrix) {
+      m1 = computation.submatrices[command.arg1].matrix_index;
+      m2 = computation.submatrices[command.arg2].matrix_index;
+      allocated.swap(allocated[m1], allocated[m2]);
+    }
+    for (int32 m = m1; m != -1; m = (m == m1 ? m2 : -1)) {
+      if (allocated[m]) {
+        if (begin[m] == -1)
+          begin[m] = c;
+        end[m] = num_commands;
+      } else if (begin[m] != -1) {
+        end[m] = c;
+      }
+    }
+  }
+  int32 num_planned = 0;
+  for (int32 m = 0; m < num_matrices; m++) {
+    int64 offset = computation.matrix_offsets[m],
+        size = computation.matrices[m].num_rows *
+        computation.MemoryPlanStride(m);
+    if (offset < 0)
+      continue;
+    num_planned++;
+    KALDI_ASSERT(begin[m] >= 0 &&
+                 offset + size <= computation.memory_plan_size);
+    for (int32 m2 = 0; m2 < m; m2++) {
+      int64 offset2 = computation.matrix_offsets[m2],
+          size2 = computation.matrices[m2].num_rows *
+          computation.MemoryPlanStride(m2);
+      if (offset2 >= 0 && offset < offset2 + size2 && offset2 < offset + size)
+        KALDI_ASSERT(end[m] <= begin[m2] || end[m2] <= begin[m]);
+    }
+  }
+  KALDI_LOG << "Memory plan has " << num_planned << " of " << num_matrices
+            << " matrices in " << computation.memory_plan_size
+            << " elements; max memory use without it is "
+            << (GetMaxMemoryUse(computation) / sizeof(BaseFloat))
+            << " elements.";
+}
+
 void UnitTestComputationRequestIo(ComputationRequest *request) {
   bool binary = (Rand() % 2 == 0);
   std::ostringstream os;
@@ -144,6 +203,83 @@ void TestNnetDecodable(Nnet *nnet) {
   }
 }
 
+// this checks that the computations that the decodable objects need can be
+// precompiled and read back, and that none of them are dropped from the
+// compiler's cache.
+void TestPrecompiledComputations(const Nnet &nnet_in) {
+  Nnet nnet(nnet_in);
+  SetBatchnormTestMode(true, &nnet);
+  SetDropoutTestMode(true, &nnet);
+  int32 num_frames = 5 + RandInt(1, 100),
+      ivector_dim = std::max<int32>(0, nnet.InputDim("ivector"));
+  Matrix<BaseFloat> input(num_frames, nnet.InputDim("input"));
+  input.SetRandn();
+  Vector<BaseFloat> ivector(ivector_dim);
+  ivector.SetRandn();
+  Vector<BaseFloat> priors, output(nnet.OutputDim("output"));
+  bool binary = (RandInt(0, 1) == 0);
+
+  {
+    NnetSimpleComputationOptions opts;
+    // This gives more computations than the default cache capacity of 64.
+    opts.frames_per_chunk = RandInt(70, 80);
+    PrecompiledComputations precompiled(opts.optimize_config);
+    std::vector<ComputationRequest> requests;
+    GetSimpleComputationRequests(opts, nnet, &requests);
+    {
+      CachingOptimizingCompiler compiler(nnet, opts.optimize_config);
+      for (size_t i = 0; i < requests.size(); i++)
+        precompiled.Add(NnetStructureHash(nnet),
+                        std::vector<ComputationRequest>(1, requests[i]),
+                        *compiler.Compile(requests[i]));
+    }
+    std::ostringstream os;
+    precompiled.Write(os, binary);
+    PrecompiledComputations precompiled2;
+    std::istringstream is(os.str());
+    precompiled2.Read(is, binary);
+
+    // AddPrecompiled() has to make room for all the computations.
+    CachingOptimizingCompiler compiler(nnet, opts.optimize_config);
+    KALDI_ASSERT(compiler.AddPrecompiled(precompiled2) ==
+                 precompiled.NumComputations());
+    std::ostringstream cache_before, cache_after;
+    compiler.WriteCache(cache_before, true);
+    DecodableNnetSimple decodable(opts, nnet, priors, input, &compiler,
+                                  (ivector_dim != 0 ? &ivector : NULL));
+    for (int32 t = 0; t < num_frames; t++)
+      decodable.GetOutputForFrame(t, &output);
+    // The decodable object should not have had to compile anything, and none
+    // of the computations should have been evicted from the cache.
+    for (size_t i = 0; i < requests.size(); i++)
+      compiler.Compile(requests[i]);
+    compiler.WriteCache(cache_after, true);
+    KALDI_ASSERT(cache_before.str() == cache_after.str());
+  }
+
+  {
+    NnetSimpleLoopedComputationOptions opts;
+    // caution: this may modify nnet, by changing how it consumes iVectors.
+    DecodableNnetSimpleLoopedInfo info(opts, priors, &nnet);
+    PrecompiledComputations precompiled(opts.optimize_config);
+    std::vector<ComputationRequest> requests;
+    requests.push_back(info.request1);
+    requests.push_back(info.request2);
+    requests.push_back(info.request3);
+    precompiled.Add(NnetStructureHash(nnet), requests, info.computation);
+    std::ostringstream os, os1, os2;
+    precompiled.Write(os, binary);
+    PrecompiledComputations precompiled2;
+    std::istringstream is(os.str());
+    precompiled2.Read(is, binary);
+    info.computation.Write(os1, true);
+    KALDI_ASSERT(info.SetPrecompiledComputation(precompiled2,
+                                                opts.optimize_config, nnet));
+    info.computation.Write(os2, true);
+    KALDI_ASSERT(os1.str() == os2.str());
+  }
+}
+
 void UnitTestNnetCompute() {
   for (int32 n = 0; n < 20; n++) {
     struct NnetGenerationOptions gen_config;
@@ -220,6 +356,7 @@ void UnitTestNnetCompute() {
       compute_opts.debug = true;
 
     computation.ComputeCudaIndexes();
+    UnitTestMemoryPlan(computation);
     NnetComputer computer(compute_opts,
                           computation,
                           nnet,
@@ -273,6 +410,7 @@ void UnitTestNnetCompute() {
       }
     }
     TestNnetDecodable(&nnet);
+    TestPrecompiledComputations(nnet);
   }
 }
 
@@ -17,9 +17,18 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <functional>
 #include <iterator>
+#include <mutex>
+#include <new>
+#include <queue>
 #include <sstream>
 #include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-optimize-utils.h"
+#include "nnet3/nnet-simple-component.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -31,7 +40,8 @@ NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            Nnet *nnet_to_update):
     options_(options), computation_(computation), nnet_(nnet),
     program_counter_(0), nnet_to_store_stats_(nnet_to_update),
-    nnet_to_update_(nnet_to_update) {
+    nnet_to_update_(nnet_to_update), thread_pool_(NULL),
+    delete_thread_pool_(false), memory_plan_buffer_(NULL) {
   Init();
 }
 
@@ -41,7 +51,8 @@ NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            Nnet *nnet_to_update):
     options_(options), computation_(computation), nnet_(*nnet),
     program_counter_(0), nnet_to_store_stats_(nnet),
-    nnet_to_update_(nnet_to_update) {
+    nnet_to_update_(nnet_to_update), thread_pool_(NULL),
+    delete_thread_pool_(false), memory_plan_buffer_(NULL) {
   Init();
 }
 
@@ -62,6 +73,163 @@ void NnetComputer::Init() {
     KALDI_LOG << preamble;
     computation_.GetSubmatrixStrings(nnet_, &submatrix_strings_);
   }
+  // We don't use the memory plan in debug mode, as the debug code looks at
+  // matrices_ directly.
+  use_memory_plan_ = (options_.use_memory_plan && !debug_ &&
+                      computation_.memory_plan_size > 0 &&
+                      computation_.matrix_offsets.size() ==
+                      computation_.matrices.size());
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    use_memory_plan_ = false;  // CuMemoryAllocator does this job on GPU.
+#endif
+  if (use_memory_plan_)
+    AllocateMemoryPlanBuffer();
+  if (!debug_)
+    ComputeFusedPropagates();
+  if (options_.num_threads > 1 && !debug_) {
+    // Multi-threaded execution is only supported on CPU.
+#if HAVE_CUDA == 1
+    if (!CuDevice::Instantiate().Enabled())
+#endif
+      ComputeCommandDependencies();
+  }
+}
+
+void NnetComputer::ComputeCommandDependencies() {
+  ComputationVariables variables;
+  variables.Init(computation_);
+  std::vector<CommandAttributes> attributes;
+  ComputeCommandAttributes(nnet_, computation_, variables, &attributes);
+
+  const std::vector<NnetComputation::Command> &commands = computation_.commands;
+  int32 num_commands = commands.size(),
+      num_variables = variables.NumVariables();
+  // For each variable, the last command that wrote to it, and the commands
+  // that have read it since then.
+  std::vector<int32> last_write(num_variables, -1);
+  std::vector<std::vector<int32> > reads_since_write(num_variables);
+  // The command that saved each memo.
+  std::vector<int32> memo_to_command;
+  // We keep the commands that have side effects (updating the model or
+  // storing stats), and those of random components (which may use the global
+  // random number generator), in their original order so that the results
+  // don't depend on the scheduling.
+  int32 last_side_effect = -1, last_random = -1;
+  // If we use the memory plan, matrices may share memory, so the allocation
+  // of a matrix must wait for the deallocation of any earlier matrices that
+  // overlap it in memory_plan_buffer_.  'deallocated' contains the
+  // deallocation commands and the matrices they deallocated.
+  std::vector<std::pair<int32, int32> > deallocated;
+
+  command_dependencies_.clear();
+  command_dependencies_.resize(num_commands);
+  for (int32 c = 0; c < num_commands; c++) {
+    const NnetComputation::Command &command = commands[c];
+    CommandAttributes &attr = attributes[c];
+    std::vector<int32> &dependencies = command_dependencies_[c];
+    int32 num_fused = 0, component_index = -1;
+    switch (command.command_type) {
+      case kAllocMatrix: case kDeallocMatrix: {
+        // ComputeCommandAttributes() records no access for these because they
+        // leave the matrix undefined, but for our purposes they write to it.
+        variables.RecordAccessForSubmatrix(command.arg1, kWriteAccess, &attr);
+        int32 m = computation_.submatrices[command.arg1].matrix_index;
+        if (!use_memory_plan_ || computation_.matrix_offsets[m] < 0)
+          break;
+        if (command.command_type == kDeallocMatrix) {
+          deallocated.push_back(std::pair<int32, int32>(c, m));
+          break;
+        }
+        int64 begin = computation_.matrix_offsets[m],
+            end = begin + static_cast<int64>(computation_.matrices[m].num_rows) *
+            computation_.MemoryPlanStride(m);
+        for (size_t i = 0; i < deallocated.size(); i++) {
+          int32 m2 = deallocated[i].second;
+          int64 begin2 = computation_.matrix_offsets[m2],
+              end2 = begin2 +
+              static_cast<int64>(computation_.matrices[m2].num_rows) *
+              computation_.MemoryPlanStride(m2);
+          if (begin < end2 && begin2 < end)
+            dependencies.push_back(deallocated[i].first);
+        }
+        break;
+      }
+      case kSwapMatrix:
+        variables.RecordAccessForSubmatrix(command.arg1, kWriteAccess, &attr);
+        variables.RecordAccessForSubmatrix(command.arg2, kWriteAccess, &attr);
+        break;
+      case kPropagate:
+        component_index = command.arg1;
+        if (command.arg5 > 0) {
+          if (memo_to_command.size() <= static_cast<size_t>(command.arg5))
+            memo_to_command.resize(command.arg5 + 1, -1);
+          memo_to_command[command.arg5] = c;
+        }
+        if (command.arg6 != 0)
+          attr.has_side_effects = true;
+        if (command.arg7 > 0) {
+          // The commands fused with this one will be executed with it.
+          num_fused = command.arg7;
+          for (int32 f = c + 1; f <= c + num_fused; f++) {
+            const CommandAttributes &fused_attr = attributes[f];
+            attr.variables_read.insert(attr.variables_read.end(),
+                                       fused_attr.variables_read.begin(),
+                                       fused_attr.variables_read.end());
+            attr.variables_written.insert(attr.variables_written.end(),
+                                          fused_attr.variables_written.begin(),
+                                          fused_attr.variables_written.end());
+          }
+        }
+        break;
+      case kBackprop: case kBackpropNoModelUpdate:
+        component_index = command.arg1;
+        if (command.arg7 > 0 &&
+            static_cast<size_t>(command.arg7) < memo_to_command.size() &&
+            memo_to_command[command.arg7] >= 0)
+          dependencies.push_back(memo_to_command[command.arg7]);
+        break;
+      default:
+        break;
+    }
+    SortAndUniq(&attr.variables_read);
+    SortAndUniq(&attr.variables_written);
+
+    if (attr.has_side_effects) {
+      if (last_side_effect >= 0)
+        dependencies.push_back(last_side_effect);
+      last_side_effect = c;
+    }
+    if (component_index >= 0 &&
+        (nnet_.GetComponent(component_index)->Properties() &
+         kRandomComponent)) {
+      if (last_random >= 0)
+        dependencies.push_back(last_random);
+      last_random = c;
+    }
+    for (size_t i = 0; i < attr.variables_read.size(); i++) {
+      int32 v = attr.variables_read[i];
+      if (last_write[v] >= 0)
+        dependencies.push_back(last_write[v]);
+    }
+    for (size_t i = 0; i < attr.variables_written.size(); i++) {
+      int32 v = attr.variables_written[i];
+      if (last_write[v] >= 0)
+        dependencies.push_back(last_write[v]);
+      dependencies.insert(dependencies.end(), reads_since_write[v].begin(),
+                          reads_since_write[v].end());
+    }
+    SortAndUniq(&dependencies);
+
+    for (size_t i = 0; i < attr.variables_read.size(); i++)
+      reads_since_write[attr.variables_read[i]].push_back(c);
+    for (size_t i = 0; i < attr.variables_written.size(); i++) {
+      int32 v = attr.variables_written[i];
+      last_write[v] = c;
+      reads_since_write[v].clear();
+    }
+    c += num_fused;
+  }
 }
 
 //static
@@ -198,22 +366,47 @@ NnetComputer::NnetComputer(const NnetComputer &other):
     command_attributes_(other.command_attributes_),
     submatrix_strings_(other.submatrix_strings_),
     command_strings_(other.command_strings_),
+    command_dependencies_(other.command_dependencies_),
+    // We share the other object's thread pool only if it does not own it.
+    thread_pool_(other.delete_thread_pool_ ? NULL : other.thread_pool_),
+    delete_thread_pool_(false),
+    fused_propagates_(other.fused_propagates_),
+    use_memory_plan_(other.use_memory_plan_),
+    memory_plan_buffer_(NULL),
     matrices_(other.matrices_),
     memos_(other.memos_) {
-  // Note: this is the same as the default copy constructor, except for the check below.
+  // Note: this is the same as the default copy constructor, except for the
+  // thread pool, the memory-plan buffer and the check below.
   if (!memos_.empty()) {
     KALDI_ERR << "You cannot use the copy constructor of NnetComputer if "
         "memos are used.";
   }
+  if (use_memory_plan_) {
+    AllocateMemoryPlanBuffer();
+    memcpy(memory_plan_buffer_, other.memory_plan_buffer_,
+           computation_.memory_plan_size * sizeof(BaseFloat));
+  }
+}
+
+void NnetComputer::AllocateMemoryPlanBuffer() {
+  KALDI_ASSERT(memory_plan_buffer_ == NULL);
+  void *data, *free_data;
+  size_t size = computation_.memory_plan_size * sizeof(BaseFloat);
+  if ((data = KALDI_MEMALIGN(64, size, &free_data)) != NULL)
+    memory_plan_buffer_ = static_cast<BaseFloat*>(data);
+  else
+    throw std::bad_alloc();
 }
 
-void NnetComputer::ExecuteCommand() {
-  const NnetComputation::Command &c = computation_.commands[program_counter_];
+void NnetComputer::ExecuteCommand(int32 command_index) {
+  const NnetComputation::Command &c = computation_.commands[command_index];
   int32 m1, m2;
   try {
     switch (c.command_type) {
       case kAllocMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
+        if (use_memory_plan_ && computation_.matrix_offsets[m1] >= 0)
+          break;  // the matrix is part of memory_plan_buffer_.
         matrices_[m1].Resize(computation_.matrices[m1].num_rows,
                              computation_.matrices[m1].num_cols,
                              kUndefined,
@@ -221,11 +414,15 @@ void NnetComputer::ExecuteCommand() {
         break;
       case kDeallocMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
+        if (use_memory_plan_ && computation_.matrix_offsets[m1] >= 0)
+          break;
         matrices_[m1].Resize(0, 0);
         break;
       case kSwapMatrix:
         m1 = computation_.submatrices[c.arg1].matrix_index;
         m2 = computation_.submatrices[c.arg2].matrix_index;
+        if (use_memory_plan_ && computation_.matrix_offsets[m1] >= 0)
+          break;  // m1 and m2 share the same memory in memory_plan_buffer_.
         matrices_[m1].Swap(&(matrices_[m2]));
         break;
       case kSetConst: {
@@ -235,6 +432,12 @@ void NnetComputer::ExecuteCommand() {
         break;
       }
       case kPropagate: {
+        if (c.arg7 > 0 && !debug_) {
+          // This command was fused with the following c.arg7 commands by
+          // FuseComponents(); in debug mode we just run them one by one.
+          ExecuteFusedPropagate(command_index);
+          break;
+        }
         const Component *component = nnet_.GetComponent(c.arg1);
         ComponentPrecomputedIndexes *indexes =
             computation_.component_precomputed_indexes[c.arg2].data;
@@ -423,6 +626,8 @@ void NnetComputer::ExecuteCommand() {
       case kNoOperationLabel:
         break;
       case kGotoLabel:
+        // Note: this is only reached from Run(), never from
+        // ExecuteCommandsParallel().
         KALDI_ASSERT(computation_.commands[c.arg1].command_type == kNoOperationLabel);
         program_counter_ = c.arg1;
         break;
@@ -430,17 +635,20 @@ void NnetComputer::ExecuteCommand() {
         KALDI_ERR << "Invalid command in computation";
     }
   } catch (...) {
+    // We use a local copy of the command strings, as with
+    // --num-threads > 1 this may be called from several threads.
+    std::vector<std::string> command_strings(command_strings_);
     if (!debug_) {
       std::string preamble;
-      computation_.GetCommandStrings(nnet_, &preamble, &command_strings_);
+      computation_.GetCommandStrings(nnet_, &preamble, &command_strings);
       KALDI_WARN << "Printing some background info since error was detected";
       KALDI_LOG << preamble;
-      for (int32 prev_c = 0; prev_c < program_counter_; prev_c++)
-        KALDI_LOG << command_strings_[prev_c];
+      for (int32 prev_c = 0; prev_c < command_index; prev_c++)
+        KALDI_LOG << command_strings[prev_c];
     }
     // the following will re-throw the error, but now we've printed more info
     // about what went wrong.
-    KALDI_ERR << "Error running command " << command_strings_[program_counter_];
+    KALDI_ERR << "Error running command " << command_strings[command_index];
   }
 }
 
@@ -449,11 +657,163 @@ CuSubMatrix<BaseFloat> NnetComputer::GetSubMatrix(int32 submatrix_index) {
                         computation_.submatrices.size());
   const NnetComputation::SubMatrixInfo &info =
       computation_.submatrices[submatrix_index];
+  if (use_memory_plan_) {
+    int64 offset = computation_.matrix_offsets[info.matrix_index];
+    if (offset >= 0) {
+      int32 stride = computation_.MemoryPlanStride(info.matrix_index);
+      return CuSubMatrix<BaseFloat>(
+          memory_plan_buffer_ + offset +
+          static_cast<int64>(info.row_offset) * stride + info.col_offset,
+          info.num_rows, info.num_cols, stride);
+    }
+  }
   const CuMatrix<BaseFloat> &mat = matrices_[info.matrix_index];
   return CuSubMatrix<BaseFloat>(
       mat, info.row_offset, info.num_rows, info.col_offset, info.num_cols);
 }
 
+void NnetComputer::ComputeFusedPropagates() {
+  bool full_dim = true;  // True if we set up all scales and offsets with the
+                         // output dimension, see FusedPropagateInfo.
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    full_dim = false;
+#endif
+  int32 num_commands = computation_.commands.size();
+  fused_propagates_.clear();
+  for (int32 command_index = 0; command_index < num_commands;
+       command_index++) {
+    const NnetComputation::Command &c = computation_.commands[command_index];
+    if (c.command_type != kPropagate || c.arg7 <= 0)
+      continue;
+    if (fused_propagates_.empty())
+      fused_propagates_.resize(num_commands);
+    FusedPropagateInfo &info = fused_propagates_[command_index];
+    std::vector<CuVector<BaseFloat> > &scales = info.scales,
+        &offsets = info.offsets;
+    std::vector<bool> &floors = info.floors;
+    scales.resize(1);
+    offsets.resize(1);
+    floors.resize(1, false);
+
+    const Component *component = nnet_.GetComponent(c.arg1);
+    if (const AffineComponent *ac =
+        dynamic_cast<const AffineComponent*>(component)) {
+      info.linear_params = &(ac->LinearParams());
+      offsets[0] = ac->BiasParams();
+    } else if (const FixedAffineComponent *fc =
+               dynamic_cast<const FixedAffineComponent*>(component)) {
+      info.linear_params = &(fc->LinearParams());
+      offsets[0] = fc->BiasParams();
+    }
+
+    for (int32 i = 1; i <= c.arg7; i++) {
+      const NnetComputation::Command &next_c =
+          computation_.commands[command_index + i];
+      KALDI_ASSERT(next_c.command_type == kPropagate &&
+                   next_c.arg3 == c.arg4 && next_c.arg4 == c.arg4);
+      CuVector<BaseFloat> scale, offset;
+      bool floor;
+      if (!GetElementwiseAffineParams(*nnet_.GetComponent(next_c.arg1),
+                                      &scale, &offset, &floor))
+        KALDI_ERR << "Cannot fuse component "
+                  << nnet_.GetComponentName(next_c.arg1);
+      if (floors.back()) {  // The previous stage is finished.
+        scales.push_back(CuVector<BaseFloat>());
+        offsets.push_back(CuVector<BaseFloat>());
+        floors.push_back(false);
+      }
+      CuVector<BaseFloat> &this_scale = scales.back(),
+          &this_offset = offsets.back();
+      if (scale.Dim() != 0) {
+        if (this_offset.Dim() != 0)
+          this_offset.MulElements(scale);
+        if (this_scale.Dim() != 0)
+          this_scale.MulElements(scale);
+        else
+          this_scale.Swap(&scale);
+      }
+      if (offset.Dim() != 0) {
+        if (this_offset.Dim() != 0)
+          this_offset.AddVec(1.0, offset);
+        else
+          this_offset.Swap(&offset);
+      }
+      if (floor)
+        floors.back() = true;
+    }
+
+    if (full_dim) {
+      int32 num_cols = computation_.submatrices[c.arg4].num_cols;
+      for (size_t s = 0; s < floors.size(); s++) {
+        if (scales[s].Dim() == 0) {
+          scales[s].Resize(num_cols, kUndefined);
+          scales[s].Set(1.0);
+        }
+        if (offsets[s].Dim() == 0)
+          offsets[s].Resize(num_cols);
+      }
+    }
+  }
+}
+
+void NnetComputer::ExecuteFusedPropagate(int32 command_index) {
+  const NnetComputation::Command &c = computation_.commands[command_index];
+  KALDI_ASSERT(static_cast<size_t>(command_index) < fused_propagates_.size());
+  const FusedPropagateInfo &info = fused_propagates_[command_index];
+  const CuSubMatrix<BaseFloat> input(GetSubMatrix(c.arg3));
+  CuSubMatrix<BaseFloat> output(GetSubMatrix(c.arg4));
+
+  if (info.linear_params != NULL) {
+    output.AddMatMat(1.0, input, kNoTrans, *info.linear_params, kTrans, 0.0);
+  } else {
+    const Component *component = nnet_.GetComponent(c.arg1);
+    ComponentPrecomputedIndexes *indexes =
+        computation_.component_precomputed_indexes[c.arg2].data;
+    void *memo = component->Propagate(indexes, input, &output);
+    SaveMemo(c.arg5, *component, memo);
+  }
+
+  const std::vector<CuVector<BaseFloat> > &scales = info.scales,
+      &offsets = info.offsets;
+  const std::vector<bool> &floors = info.floors;
+  int32 num_stages = floors.size();
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    for (int32 s = 0; s < num_stages; s++) {
+      if (scales[s].Dim() != 0)
+        output.MulColsVec(scales[s]);
+      if (offsets[s].Dim() != 0)
+        output.AddVecToRows(1.0, offsets[s]);
+      if (floors[s])
+        output.ApplyFloor(0.0);
+    }
+  } else
+#endif
+  {
+    // On CPU we do all the stages for each row while it is in cache, so we
+    // only make one pass over the output.
+    int32 num_rows = output.NumRows(), num_cols = output.NumCols();
+    MatrixBase<BaseFloat> &output_mat = output.Mat();
+    for (int32 r = 0; r < num_rows; r++) {
+      BaseFloat *row_data = output_mat.RowData(r);
+      for (int32 s = 0; s < num_stages; s++) {
+        const BaseFloat *scale_data = scales[s].Data(),
+            *offset_data = offsets[s].Data();
+        if (floors[s]) {
+          for (int32 j = 0; j < num_cols; j++) {
+            BaseFloat y = row_data[j] * scale_data[j] + offset_data[j];
+            row_data[j] = (y > 0.0 ? y : 0.0);
+          }
+        } else {
+          for (int32 j = 0; j < num_cols; j++)
+            row_data[j] = row_data[j] * scale_data[j] + offset_data[j];
+        }
+      }
+    }
+  }
+}
+
 void NnetComputer::GetPointers(int32 indexes_multi_index,
                                int32 num_cols,
                                CuArray<BaseFloat*> *pointers) {
@@ -527,9 +887,30 @@ void NnetComputer::Run() {
       // interaction, e.g. the end of the forward or backward phase.
       break;
     }
+    if (!command_dependencies_.empty()) {
+      // Multi-threaded execution: run all the commands up to the next
+      // command that needs to be executed on its own.
+      int32 end = program_counter_;
+      while (end < num_commands &&
+             c[end].command_type != kAcceptInput &&
+             c[end].command_type != kProvideOutput &&
+             c[end].command_type != kGotoLabel)
+        end++;
+      if (end > program_counter_) {
+        ExecuteCommandsParallel(program_counter_, end);
+        program_counter_ = end - 1;
+        continue;
+      }
+    }
     if (debug_)
       DebugBeforeExecute(program_counter_, &info);
-    ExecuteCommand();
+    const NnetComputation::Command &command = c[program_counter_];
+    ExecuteCommand(program_counter_);
+    if (command.command_type == kPropagate && command.arg7 > 0 && !debug_) {
+      // Skip over the commands that were executed as part of this one; see
+      // ExecuteFusedPropagate().
+      program_counter_ += command.arg7;
+    }
     if (debug_) {
       double total_elapsed_now = timer.Elapsed();
       DebugAfterExecute(program_counter_, info,
@@ -539,6 +920,98 @@ void NnetComputer::Run() {
   }
 }
 
+void NnetComputer::ExecuteCommandsParallel(int32 begin, int32 end) {
+  const std::vector<NnetComputation::Command> &commands = computation_.commands;
+  // Work out which commands in this range are waiting for which.  Commands
+  // that were fused with a preceding command are not scheduled separately.
+  std::vector<int32> num_waiting_for(end - begin, 0);
+  std::vector<std::vector<int32> > waited_for_by(end - begin);
+  // 'ready' contains the commands that can be executed now; we take the
+  // lowest-numbered first, to keep the order (and so the memory use) close to
+  // that of sequential execution.
+  std::priority_queue<int32, std::vector<int32>, std::greater<int32> > ready;
+  int32 num_to_execute = 0, max_memo_index = 0;
+  for (int32 c = begin; c < end; c++) {
+    const std::vector<int32> &dependencies = command_dependencies_[c];
+    for (size_t i = 0; i < dependencies.size(); i++) {
+      int32 d = dependencies[i];
+      if (d >= begin) {
+        waited_for_by[d - begin].push_back(c);
+        num_waiting_for[c - begin]++;
+      }
+    }
+    if (num_waiting_for[c - begin] == 0)
+      ready.push(c);
+    num_to_execute++;
+    const NnetComputation::Command &command = commands[c];
+    if (command.command_type == kPropagate) {
+      max_memo_index = std::max(max_memo_index, command.arg5);
+      if (command.arg7 > 0)
+        c += command.arg7;
+    }
+  }
+  // Make sure SaveMemo() won't need to resize memos_ while other threads are
+  // using it.
+  if (memos_.size() <= static_cast<size_t>(max_memo_index))
+    memos_.resize(max_memo_index + 1, NULL);
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::exception_ptr error;
+  // Each thread (including this one) executes commands as they become ready,
+  // until all are done or one of them fails.
+  auto execute_commands = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      while (ready.empty() && num_to_execute > 0 && !error)
+        condition.wait(lock);
+      if (num_to_execute == 0 || error)
+        return;
+      int32 c = ready.top();
+      ready.pop();
+      lock.unlock();
+      try {
+        ExecuteCommand(c);
+      } catch (...) {
+        lock.lock();
+        if (!error)
+          error = std::current_exception();
+        condition.notify_all();
+        return;
+      }
+      lock.lock();
+      num_to_execute--;
+      const std::vector<int32> &waiting = waited_for_by[c - begin];
+      for (size_t i = 0; i < waiting.size(); i++)
+        if (--num_waiting_for[waiting[i] - begin] == 0)
+          ready.push(waiting[i]);
+      condition.notify_all();
+    }
+  };
+  int32 num_threads = std::min(options_.num_threads, num_to_execute);
+  if (num_threads > 1) {
+    if (thread_pool_ == NULL) {
+      thread_pool_ = new ThreadPool(options_.num_threads);
+      delete_thread_pool_ = true;
+    }
+    // Each job runs execute_commands(); if the pool has fewer threads than
+    // that (it may have come from SetThreadPool()), the jobs that start late
+    // will find nothing left to do.
+    thread_pool_->Run(num_threads, [&](int32) { execute_commands(); });
+  } else {
+    execute_commands();
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void NnetComputer::SetThreadPool(ThreadPool *pool) {
+  if (delete_thread_pool_)
+    delete thread_pool_;
+  thread_pool_ = pool;
+  delete_thread_pool_ = false;
+}
+
 void NnetComputer::AcceptInput(const std::string &node_name,
                                CuMatrix<BaseFloat> *input) {
   bool is_output = false;
@@ -679,6 +1152,10 @@ NnetComputer::~NnetComputer() {
   // the forward propagation but not the backprop.
   for (size_t i = 0; i < compressed_matrices_.size(); i++)
     delete compressed_matrices_[i];
+  if (delete_thread_pool_)
+    delete thread_pool_;
+  if (memory_plan_buffer_ != NULL)
+    KALDI_MEMALIGN_FREE(memory_plan_buffer_);
 }
 
 } // namespace nnet3
@@ -25,6 +25,7 @@
 #include "nnet3/nnet-computation.h"
 #include "nnet3/nnet-analyze.h"
 #include "nnet3/nnet-example.h"
+#include "util/kaldi-thread.h"
 
 #include <iostream>
 #include <sstream>
@@ -38,11 +39,25 @@ namespace nnet3 {
 
 struct NnetComputeOptions {
   bool debug;
-  NnetComputeOptions(): debug(false) { }
+  int32 num_threads;
+  bool use_memory_plan;
+  NnetComputeOptions(): debug(false), num_threads(1), use_memory_plan(true) { }
   void Register(OptionsItf *opts) {
     opts->Register("debug", &debug, "If true, turn on "
                    "debug for the neural net computation (very verbose!) "
                    "Will be turned on regardless if --verbose >= 5");
+    opts->Register("num-threads", &num_threads, "Number of threads with "
+                   "which to execute the commands of the computation, when "
+                   "not using a GPU.  Commands that don't depend on each "
+                   "other (e.g. the branches of multi-branch networks) can "
+                   "then run at the same time, which can reduce the latency "
+                   "of a single computation.  Note: if you set this, you may "
+                   "want to set OPENBLAS_NUM_THREADS=1 or the equivalent.");
+    opts->Register("use-memory-plan", &use_memory_plan, "If true, when not "
+                   "using a GPU, allocate the matrices of the computation "
+                   "(other than inputs and outputs) from a single buffer "
+                   "according to the computation's static memory plan, "
+                   "instead of allocating each one separately.");
   }
 
 };
@@ -124,6 +139,12 @@ class NnetComputer {
   void GetOutputDestructive(const std::string &output_name,
                             CuMatrix<BaseFloat> *output);
 
+  /// If options.num_threads > 1, makes this object run commands in parallel
+  /// using the threads of 'pool' (which it does not take ownership of, and
+  /// which must outlive it) instead of starting its own pool the first time
+  /// they are needed.  This is for code that creates a new NnetComputer for
+  /// each chunk of data, so that the threads are not started each time.
+  void SetThreadPool(ThreadPool *pool);
 
   ~NnetComputer();
  private:
@@ -155,6 +176,51 @@ class NnetComputer {
   std::vector<std::string> submatrix_strings_;
   // command_strings_ is only used if debug_=true, or in case of error.
   std::vector<std::string> command_strings_;
+  // command_dependencies_ is only set up if options_.num_threads > 1 (and
+  // debug_=false, and we are not using a GPU); otherwise it is empty.  For
+  // each command c, it is a sorted list of the earlier commands that must
+  // finish before c is executed.  It is empty for commands that were fused
+  // with a preceding command, as those are executed together with it.
+  std::vector<std::vector<int32> > command_dependencies_;
+  // The threads that ExecuteCommandsParallel() uses; NULL until it is first
+  // needed, unless SetThreadPool() was called.  We own it if
+  // delete_thread_pool_ is true.
+  ThreadPool *thread_pool_;
+  bool delete_thread_pool_;
+
+  // What ExecuteFusedPropagate() needs for a command of type kPropagate that
+  // FuseComponents() fused with the commands that follow it (arg7 > 0).  It is
+  // worked out once, in Init(), from the components' parameters, which must
+  // not change while this object is in use.
+  struct FusedPropagateInfo {
+    // If the first component is affine, its linear parameters (and its bias
+    // is in offsets[0], so we add it in the same pass as the elementwise
+    // operations); else NULL.
+    const CuMatrix<BaseFloat> *linear_params;
+    // The elementwise operations that follow the first Propagate(), as a
+    // sequence of stages, each of which does y = x * scales[i] + offsets[i],
+    // and then floors y at zero if floors[i] is true.  On GPU an empty scale
+    // or offset means we skip that operation; on CPU they are all set up
+    // with the output dimension.
+    std::vector<CuVector<BaseFloat> > scales;
+    std::vector<CuVector<BaseFloat> > offsets;
+    std::vector<bool> floors;
+    FusedPropagateInfo(): linear_params(NULL) { }
+  };
+  // Indexed by command index; only set up for the commands of type kPropagate
+  // with arg7 > 0, if debug_ is false.
+  std::vector<FusedPropagateInfo> fused_propagates_;
+
+  // True if we are using the computation's memory plan (see
+  // NnetComputation::matrix_offsets), which we do if
+  // options_.use_memory_plan is true, debug_ is false and we are not using a
+  // GPU.  In that case the matrices m with computation_.matrix_offsets[m] >= 0
+  // live in memory_plan_buffer_, and the corresponding elements of matrices_
+  // are not used.
+  bool use_memory_plan_;
+  // If use_memory_plan_ is true, a buffer of computation_.memory_plan_size
+  // elements, allocated by AllocateMemoryPlanBuffer(); else NULL.
+  BaseFloat *memory_plan_buffer_;
 
   // The matrices used in the computation.
   std::vector<CuMatrix<BaseFloat> > matrices_;
@@ -173,8 +239,34 @@ class NnetComputer {
   std::vector<CuCompressedMatrixBase*> compressed_matrices_;
 
 
-  // executes the command in computation_.commands[program_counter_].
-  void ExecuteCommand();
+  // executes the command computation_.commands[command_index].  If it is a
+  // command of type kPropagate with arg7 > 0 (and debug_ is false), this
+  // executes the commands fused with it too; the caller must skip over those.
+  void ExecuteCommand(int32 command_index);
+
+  // Called from ExecuteCommand() for a command of type kPropagate with arg7 >
+  // 0, meaning that FuseComponents() fused it with the following arg7
+  // commands; it executes all of them.
+  void ExecuteFusedPropagate(int32 command_index);
+
+  // Allocates memory_plan_buffer_.  It is aligned to 64 bytes, so that each
+  // matrix in it starts on a cache line (ComputeMemoryPlan() puts them at
+  // offsets that are multiples of 64 bytes).
+  void AllocateMemoryPlanBuffer();
+
+  // Sets up fused_propagates_.  Called from Init() if debug_ is false.
+  void ComputeFusedPropagates();
+
+  // Sets up command_dependencies_, using the same analysis of the
+  // variables that each command reads and writes as the optimization code.
+  // Called from Init() if options_.num_threads > 1.
+  void ComputeCommandDependencies();
+
+  // Executes the commands with indexes begin <= c < end using
+  // options_.num_threads threads, respecting command_dependencies_.  The
+  // range must not contain commands of type kAcceptInput, kProvideOutput or
+  // kGotoLabel.
+  void ExecuteCommandsParallel(int32 begin, int32 end);
 
   // Returns the matrix index where the input (if is_output==false) or output
   // matrix index for "node_name" is stored.  This looks at the next command (at
@@ -23,6 +23,7 @@
 #include "nnet3/nnet-test-utils.h"
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-utils.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -86,6 +87,12 @@ static bool UnitTestNnetOptimizeWithOptions(int32 srand_seed,
   NnetComputeOptions compute_opts;
   if (RandInt(0, 1) == 0)
     compute_opts.debug = true;
+  // The optimized computation is sometimes run with multiple threads, and
+  // the unoptimized one sometimes without the memory plan.
+  NnetComputeOptions compute_opts_opt(compute_opts);
+  if (!compute_opts.debug)
+    compute_opts_opt.num_threads = RandInt(1, 4);
+  compute_opts.use_memory_plan = (RandInt(0, 1) == 0);
 
   computation.ComputeCudaIndexes();
   // computation_opt has already had this function called.
@@ -111,7 +118,7 @@ static bool UnitTestNnetOptimizeWithOptions(int32 srand_seed,
   SetNnetAsGradient(&nnet_opt_to_update);
 
   // NnetComputer for the optimized version of the computation.
-  NnetComputer computer_opt(compute_opts,
+  NnetComputer computer_opt(compute_opts_opt,
                             computation_opt,
                             nnet_opt,
                             &nnet_opt_to_update);
@@ -265,6 +272,11 @@ static void UnitTestNnetOptimizeInternal(int32 srand_seed) {
                                                               compiler);
   optimize = optimize_all;
 
+  optimize.fuse_components = false;
+  bool succ_no_fuse_components = UnitTestNnetOptimizeWithOptions(srand_seed, optimize,
+                                                                 compiler);
+  optimize = optimize_all;
+
 
   optimize.min_deriv_time = std::numeric_limits<int32>::min();
   optimize.max_deriv_time = std::numeric_limits<int32>::max();
@@ -288,6 +300,7 @@ static void UnitTestNnetOptimizeInternal(int32 srand_seed) {
     << "\n  allocate_from_other  ... " << KALDI_SUCCFAIL(succ_no_allocate_from_other)
     << "\n  move_sizing_commands ... " << KALDI_SUCCFAIL(succ_no_move_sizing_commands)
     << "\n  snip_row_ops         ... " << KALDI_SUCCFAIL(succ_no_snip_row_ops)
+    << "\n  fuse_components      ... " << KALDI_SUCCFAIL(succ_no_fuse_components)
     << "\n  no_deriv_time        ... " << KALDI_SUCCFAIL(succ_no_deriv_time);
 #undef KALDI_SUCCFAIL
 }
@@ -302,6 +315,87 @@ static void UnitTestNnetOptimize() {
 
 
 
+// Checks that FuseComponents() fuses the components that follow affine
+// components in a typical model at test time, and that this does not change
+// the output.
+static void UnitTestNnetFuseComponents() {
+  std::istringstream config(
+      "input-node name=input dim=20\n"
+      "component name=affine1 type=NaturalGradientAffineComponent "
+      "input-dim=60 output-dim=40\n"
+      "component-node name=affine1 component=affine1 "
+      "input=Append(Offset(input, -1), input, Offset(input, 1))\n"
+      "component name=relu1 type=RectifiedLinearComponent dim=40\n"
+      "component-node name=relu1 component=relu1 input=affine1\n"
+      "component name=batchnorm1 type=BatchNormComponent dim=40\n"
+      "component-node name=batchnorm1 component=batchnorm1 input=relu1\n"
+      "component name=affine2 type=AffineComponent "
+      "input-dim=40 output-dim=30\n"
+      "component-node name=affine2 component=affine2 input=batchnorm1\n"
+      "component name=scale2 type=FixedScaleComponent dim=30 scale=0.5\n"
+      "component-node name=scale2 component=scale2 input=affine2\n"
+      "component name=scale-offset2 type=ScaleAndOffsetComponent dim=30 "
+      "block-dim=10\n"
+      "component-node name=scale-offset2 component=scale-offset2 "
+      "input=scale2\n"
+      "component name=offset2 type=PerElementOffsetComponent dim=30 "
+      "block-dim=10 param-stddev=0.1\n"
+      "component-node name=offset2 component=offset2 input=scale-offset2\n"
+      "component name=relu2 type=RectifiedLinearComponent dim=30\n"
+      "component-node name=relu2 component=relu2 input=offset2\n"
+      "component name=scale3 type=PerElementScaleComponent dim=30 "
+      "param-mean=1.0 param-stddev=0.1\n"
+      "component-node name=scale3 component=scale3 input=relu2\n"
+      "component name=affine3 type=AffineComponent "
+      "input-dim=30 output-dim=10\n"
+      "component-node name=affine3 component=affine3 input=scale3\n"
+      "output-node name=output input=affine3\n");
+  Nnet nnet;
+  nnet.ReadConfig(config);
+  PerturbParams(0.1, &nnet);
+  SetBatchnormTestMode(true, &nnet);
+
+  ComputationRequest request;
+  std::vector<Matrix<BaseFloat> > inputs;
+  ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+  request.need_model_derivative = false;
+  request.store_component_stats = false;
+  for (size_t i = 0; i < request.inputs.size(); i++)
+    request.inputs[i].has_deriv = false;
+  for (size_t i = 0; i < request.outputs.size(); i++)
+    request.outputs[i].has_deriv = false;
+
+  CuMatrix<BaseFloat> output[2];
+  for (int32 i = 0; i < 2; i++) {
+    NnetOptimizeOptions opt_config;
+    opt_config.fuse_components = (i == 1);
+    CachingOptimizingCompiler compiler(nnet, opt_config);
+    const NnetComputation &computation = *compiler.Compile(request);
+    int32 num_fused = 0;
+    for (size_t c = 0; c < computation.commands.size(); c++)
+      if (computation.commands[c].command_type == kPropagate &&
+          computation.commands[c].arg7 > 0)
+        num_fused += computation.commands[c].arg7;
+    if (i == 1) {
+      std::ostringstream os;
+      computation.Print(os, nnet);
+      KALDI_LOG << "Computation with fused components is: " << os.str();
+      // relu1 and batchnorm1; scale2, scale-offset2, offset2, relu2 and scale3.
+      KALDI_ASSERT(num_fused == 7);
+    } else {
+      KALDI_ASSERT(num_fused == 0);
+    }
+    NnetComputeOptions compute_opts;
+    NnetComputer computer(compute_opts, computation, nnet, NULL);
+    CuMatrix<BaseFloat> input(inputs[0]);
+    computer.AcceptInput("input", &input);
+    computer.Run();
+    computer.GetOutputDestructive("output", &(output[i]));
+  }
+  KALDI_ASSERT(output[0].ApproxEqual(output[1], 1.0e-04));
+}
+
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -313,9 +407,11 @@ int main() {
 #if HAVE_CUDA == 1
   CuDevice::Instantiate().SetDebugStrideMode(true);
   CuDevice::Instantiate().SelectGpuId("no");
+  UnitTestNnetFuseComponents();
   UnitTestNnetOptimize();
   CuDevice::Instantiate().SelectGpuId("yes");
 #endif
+  UnitTestNnetFuseComponents();
   UnitTestNnetOptimize();
 
   KALDI_LOG << "Nnet tests succeeded.";
@@ -20,6 +20,8 @@
 #include <map>
 #include "nnet3/nnet-optimize-utils.h"
 #include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-simple-component.h"
+#include "nnet3/nnet-normalize-component.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -4947,6 +4949,130 @@ void OptimizeMemoryCompression(const Nnet &nnet,
 }
 
 
+// Sets 'dest' to 'src' repeated as many times as needed to make it
+// dimension 'dim'.
+static void RepeatVector(const CuVectorBase<BaseFloat> &src, int32 dim,
+                         CuVector<BaseFloat> *dest) {
+  int32 block_dim = src.Dim();
+  KALDI_ASSERT(block_dim > 0 && dim % block_dim == 0);
+  dest->Resize(dim, kUndefined);
+  for (int32 i = 0; i < dim; i += block_dim)
+    dest->Range(i, block_dim).CopyFromVec(src);
+}
+
+bool GetElementwiseAffineParams(const Component &c,
+                                CuVector<BaseFloat> *scale,
+                                CuVector<BaseFloat> *offset,
+                                bool *floor) {
+  const CuVectorBase<BaseFloat> *this_scale = NULL, *this_offset = NULL;
+  CuVector<BaseFloat> nonzero_scale;
+  bool this_floor = false;
+  if (dynamic_cast<const RectifiedLinearComponent*>(&c) != NULL) {
+    this_floor = true;
+  } else if (const BatchNormComponent *bc =
+             dynamic_cast<const BatchNormComponent*>(&c)) {
+    // The offset and scale are only set up in test mode.
+    if (bc->Offset().Dim() == 0)
+      return false;
+    this_scale = &(bc->Scale());
+    this_offset = &(bc->Offset());
+  } else if (const FixedScaleComponent *fc =
+             dynamic_cast<const FixedScaleComponent*>(&c)) {
+    this_scale = &(fc->Scales());
+  } else if (const FixedBiasComponent *fc =
+             dynamic_cast<const FixedBiasComponent*>(&c)) {
+    this_offset = &(fc->Bias());
+  } else if (const PerElementScaleComponent *pc =
+             dynamic_cast<const PerElementScaleComponent*>(&c)) {
+    this_scale = &(pc->Scales());
+  } else if (const PerElementOffsetComponent *pc =
+             dynamic_cast<const PerElementOffsetComponent*>(&c)) {
+    this_offset = &(pc->Offsets());
+  } else if (const ScaleAndOffsetComponent *sc =
+             dynamic_cast<const ScaleAndOffsetComponent*>(&c)) {
+    if (scale != NULL) {
+      nonzero_scale.Resize(sc->Offsets().Dim(), kUndefined);
+      sc->GetScales(&nonzero_scale);
+      this_scale = &nonzero_scale;
+    }
+    this_offset = &(sc->Offsets());
+  } else {
+    return false;
+  }
+  int32 dim = c.OutputDim();
+  if (scale != NULL) {
+    if (this_scale != NULL) RepeatVector(*this_scale, dim, scale);
+    else scale->Resize(0);
+  }
+  if (offset != NULL) {
+    if (this_offset != NULL) RepeatVector(*this_offset, dim, offset);
+    else offset->Resize(0);
+  }
+  if (floor != NULL)
+    *floor = this_floor;
+  return true;
+}
+
+void FuseComponents(const Nnet &nnet,
+                    NnetComputation *computation) {
+  std::vector<NnetComputation::Command> &commands = computation->commands;
+  int32 num_commands = commands.size(), num_fused = 0;
+  for (int32 c = 0; c < num_commands; c++) {
+    const NnetComputation::Command &command = commands[c];
+    // We don't fuse commands that store a memo for the backprop or that
+    // store stats, as the fused computation doesn't provide for that.
+    if (command.command_type != kPropagate || command.arg5 != 0 ||
+        command.arg6 != 0)
+      continue;
+    int32 output_submatrix = command.arg4,
+        output_matrix = computation->submatrices[output_submatrix].matrix_index;
+    // 'fused' is the list of commands to fuse with command c; 'deallocs' is
+    // a list of commands that deallocate other matrices which appear among
+    // them (typically the input of command c), which we'll move to after
+    // the fused commands.
+    std::vector<int32> fused, deallocs;
+    int32 d = c + 1;
+    for (; d < num_commands; d++) {
+      const NnetComputation::Command &next_command = commands[d];
+      if (next_command.command_type == kDeallocMatrix &&
+          computation->submatrices[next_command.arg1].matrix_index !=
+          output_matrix) {
+        deallocs.push_back(d);
+        continue;
+      }
+      if (next_command.command_type != kPropagate ||
+          next_command.arg3 != output_submatrix ||
+          next_command.arg4 != output_submatrix ||
+          next_command.arg2 != 0 || next_command.arg5 != 0 ||
+          next_command.arg6 != 0 ||
+          !GetElementwiseAffineParams(*nnet.GetComponent(next_command.arg1),
+                                      NULL, NULL, NULL))
+        break;
+      fused.push_back(d);
+    }
+    if (fused.empty())
+      continue;
+    // Reorder commands c through fused.back() so that the fused commands are
+    // consecutive.
+    int32 end = fused.back() + 1;
+    std::vector<NnetComputation::Command> reordered;
+    reordered.reserve(end - c);
+    reordered.push_back(command);
+    for (size_t i = 0; i < fused.size(); i++)
+      reordered.push_back(commands[fused[i]]);
+    for (size_t i = 0; i < deallocs.size() && deallocs[i] < end; i++)
+      reordered.push_back(commands[deallocs[i]]);
+    KALDI_ASSERT(static_cast<int32>(reordered.size()) == end - c);
+    std::copy(reordered.begin(), reordered.end(), commands.begin() + c);
+    commands[c].arg7 = fused.size();
+    num_fused += fused.size();
+    c += fused.size();
+  }
+  if (num_fused > 0)
+    KALDI_VLOG(3) << "Fused " << num_fused << " commands.";
+}
+
+
 std::shared_ptr<const NnetComputation> ComputationCache::Find(
     const ComputationRequest &in_request) {
   std::lock_guard<std::mutex> lock(mutex_);
@@ -5014,6 +5140,12 @@ std::shared_ptr<const NnetComputation> ComputationCache::Insert(
 }
 
 
+void ComputationCache::Reserve(int32 num_computations) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cache_capacity_ = std::max<int32>(
+      cache_capacity_, computation_cache_.size() + num_computations);
+}
+
 void ComputationCache::Read(std::istream &is, bool binary) {
   // Note: the object on disk doesn't have tokens like "<ComputationCache>"
   // and "</ComputationCache>" for back-compatibility reasons.
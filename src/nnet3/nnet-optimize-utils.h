@@ -616,6 +616,35 @@ void OptimizeLoopedComputation(const Nnet &nnet,
 void FixGotoLabel(NnetComputation *computation);
 
 
+/// This function returns true if the Propagate() function of component 'c' is
+/// equivalent to a per-column affine function, i.e. y = x * scale + offset
+/// (for example, BatchNormComponent in test mode, or ScaleAndOffsetComponent),
+/// or to a rectifier, y = max(x, 0).  These are the components that
+/// FuseComponents() can fuse with the command that produces their input.
+/// If 'scale', 'offset' and 'floor' are non-NULL it outputs the parameters:
+/// 'scale' and 'offset' are set to dimension c.OutputDim(), or to empty if
+/// they would be all ones or all zeros respectively; and 'floor' is set to
+/// true if the result is to be floored at zero (i.e. for rectifiers).
+bool GetElementwiseAffineParams(const Component &c,
+                                CuVector<BaseFloat> *scale,
+                                CuVector<BaseFloat> *offset,
+                                bool *floor);
+
+/// This optimization, which is used at test time, fuses commands of type
+/// kPropagate with the in-place kPropagate commands for per-column affine
+/// components and rectifiers that immediately follow them (see
+/// GetElementwiseAffineParams()), e.g. the chain Affine+BatchNorm+ReLU in a
+/// model that has not been collapsed.  The fused commands are left in the
+/// computation; we set arg7 of the first kPropagate command to the number of
+/// following commands fused with it, and NnetComputer then executes them as a
+/// single pass over the output matrix (and for affine components, adds the
+/// bias in that same pass).  We don't fuse commands that store memos or
+/// stats, so this doesn't change the results of the computation or its
+/// backprop, but it's mainly useful at test time.
+void FuseComponents(const Nnet &nnet,
+                    NnetComputation *computation);
+
+
 /// Class ComputationCache is used inside class CachingOptimizingCompiler to
 /// cache previously computed computations.  The code was moved from class
 /// CachingOptimizingCompiler to this separate class for clarity when adding
@@ -649,6 +678,11 @@ class ComputationCache {
   std::shared_ptr<const NnetComputation> Insert(const ComputationRequest &request,
                                                 const NnetComputation *computation);
 
+  // Increases the capacity of the cache, if necessary, so that
+  // 'num_computations' more computations can be inserted without any of the
+  // ones already in it being purged.
+  void Reserve(int32 num_computations);
+
   ~ComputationCache();
 
   // Checks the stored computation for correctness.
@@ -21,6 +21,7 @@
 #include <iomanip>
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-optimize-utils.h"
+#include "nnet3/nnet-utils.h"
 #include "base/timer.h"
 
 namespace kaldi {
@@ -78,6 +79,10 @@ void NnetOptimizeOptions::Read(std::istream &is, bool binary) {
     ExpectToken(is, binary, "<MemoryCompressionLevel>");
     ReadBasicType(is, binary, &memory_compression_level);
   }
+  if (PeekToken(is, binary) == 'F') {
+    ExpectToken(is, binary, "<FuseComponents>");
+    ReadBasicType(is, binary, &fuse_components);
+  }
   ExpectToken(is, binary, "</NnetOptimizeOptions>");
 }
 
@@ -121,6 +126,8 @@ void NnetOptimizeOptions::Write(std::ostream &os, bool binary) const {
   WriteBasicType(os, binary, snip_row_ops);
   WriteToken(os, binary, "<MemoryCompressionLevel>");
   WriteBasicType(os, binary, memory_compression_level);
+  WriteToken(os, binary, "<FuseComponents>");
+  WriteBasicType(os, binary, fuse_components);
   WriteToken(os, binary, "</NnetOptimizeOptions>");
 }
 
@@ -142,7 +149,8 @@ bool NnetOptimizeOptions::operator == (const NnetOptimizeOptions &other) const {
           other.max_deriv_time == max_deriv_time &&
           other.max_deriv_time_relative == max_deriv_time_relative &&
           other.snip_row_ops == snip_row_ops &&
-          other.memory_compression_level == memory_compression_level);
+          other.memory_compression_level == memory_compression_level &&
+          other.fuse_components == fuse_components);
 }
 
 // move commands that resize and zero matrices to as late/early as possible.
@@ -623,6 +631,14 @@ void Optimize(const NnetOptimizeOptions &config,
       CheckComputation(nnet, *computation, false);
   }
 
+  // This should be the last optimization, as other optimizations might
+  // insert or move commands between those that it fuses.
+  if (config.optimize && config.fuse_components) {
+    FuseComponents(nnet, computation);
+    if (GetVerboseLevel() >= 3)
+      CheckComputation(nnet, *computation, false);
+  }
+
   if (GetVerboseLevel() >= 3) {
     CheckComputation(nnet, *computation, false);
     KALDI_LOG << "After optimization, max memory use (bytes) = "
@@ -631,6 +647,80 @@ void Optimize(const NnetOptimizeOptions &config,
 }
 
 
+void PrecompiledComputations::Add(
+    uint64 nnet_hash, const std::vector<ComputationRequest> &requests,
+    const NnetComputation &computation) {
+  if (Find(nnet_hash, requests) != NULL)
+    return;
+  PrecompiledComputation c;
+  c.nnet_hash = nnet_hash;
+  c.requests = requests;
+  c.computation = new NnetComputation(computation);
+  computations_.push_back(c);
+}
+
+const NnetComputation *PrecompiledComputations::Find(
+    uint64 nnet_hash, const std::vector<ComputationRequest> &requests) const {
+  for (size_t i = 0; i < computations_.size(); i++)
+    if (computations_[i].nnet_hash == nnet_hash &&
+        computations_[i].requests == requests)
+      return computations_[i].computation;
+  return NULL;
+}
+
+void PrecompiledComputations::Clear() {
+  for (size_t i = 0; i < computations_.size(); i++)
+    delete computations_[i].computation;
+  computations_.clear();
+}
+
+void PrecompiledComputations::Read(std::istream &is, bool binary) {
+  Clear();
+  ExpectToken(is, binary, "<PrecompiledComputations>");
+  opt_config_.Read(is, binary);
+  int32 num_computations;
+  ExpectToken(is, binary, "<NumComputations>");
+  ReadBasicType(is, binary, &num_computations);
+  KALDI_ASSERT(num_computations >= 0);
+  computations_.resize(num_computations);
+  for (int32 i = 0; i < num_computations; i++)
+    computations_[i].computation = NULL;
+  for (int32 i = 0; i < num_computations; i++) {
+    PrecompiledComputation &c = computations_[i];
+    ExpectToken(is, binary, "<NnetHash>");
+    ReadBasicType(is, binary, &(c.nnet_hash));
+    int32 num_requests;
+    ExpectToken(is, binary, "<NumRequests>");
+    ReadBasicType(is, binary, &num_requests);
+    KALDI_ASSERT(num_requests > 0);
+    c.requests.resize(num_requests);
+    for (int32 j = 0; j < num_requests; j++)
+      c.requests[j].Read(is, binary);
+    c.computation = new NnetComputation();
+    c.computation->Read(is, binary);
+  }
+  ExpectToken(is, binary, "</PrecompiledComputations>");
+}
+
+void PrecompiledComputations::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<PrecompiledComputations>");
+  opt_config_.Write(os, binary);
+  WriteToken(os, binary, "<NumComputations>");
+  WriteBasicType(os, binary, static_cast<int32>(computations_.size()));
+  for (size_t i = 0; i < computations_.size(); i++) {
+    const PrecompiledComputation &c = computations_[i];
+    WriteToken(os, binary, "<NnetHash>");
+    WriteBasicType(os, binary, c.nnet_hash);
+    WriteToken(os, binary, "<NumRequests>");
+    WriteBasicType(os, binary, static_cast<int32>(c.requests.size()));
+    for (size_t j = 0; j < c.requests.size(); j++)
+      c.requests[j].Write(os, binary);
+    c.computation->Write(os, binary);
+  }
+  WriteToken(os, binary, "</PrecompiledComputations>");
+}
+
+
 CachingOptimizingCompiler::CachingOptimizingCompiler(
     const Nnet &nnet,
     const CachingOptimizingCompilerOptions config):
@@ -638,7 +728,10 @@ CachingOptimizingCompiler::CachingOptimizingCompiler(
     seconds_taken_total_(0.0), seconds_taken_compile_(0.0),
     seconds_taken_optimize_(0.0), seconds_taken_expand_(0.0),
     seconds_taken_check_(0.0), seconds_taken_indexes_(0.0),
-    seconds_taken_io_(0.0), cache_(config.cache_capacity) { }
+    seconds_taken_io_(0.0), cache_(config.cache_capacity) {
+  if (!config_.precompiled_computations.empty())
+    ReadPrecompiled(config_.precompiled_computations);
+}
 
 CachingOptimizingCompiler::CachingOptimizingCompiler(
     const Nnet &nnet,
@@ -648,7 +741,51 @@ CachingOptimizingCompiler::CachingOptimizingCompiler(
     seconds_taken_total_(0.0), seconds_taken_compile_(0.0),
     seconds_taken_optimize_(0.0), seconds_taken_expand_(0.0),
     seconds_taken_check_(0.0), seconds_taken_indexes_(0.0),
-    seconds_taken_io_(0.0), cache_(config.cache_capacity) { }
+    seconds_taken_io_(0.0), cache_(config.cache_capacity) {
+  if (!config_.precompiled_computations.empty())
+    ReadPrecompiled(config_.precompiled_computations);
+}
+
+int32 CachingOptimizingCompiler::AddPrecompiled(
+    const PrecompiledComputations &computations) {
+  if (!(computations.OptimizeConfig() == opt_config_))
+    return 0;
+  uint64 nnet_hash = NnetStructureHash(nnet_);
+  std::vector<int32> to_add;
+  for (size_t i = 0; i < computations.computations_.size(); i++) {
+    const PrecompiledComputations::PrecompiledComputation &c =
+        computations.computations_[i];
+    if (c.nnet_hash == nnet_hash && c.requests.size() == 1 &&
+        cache_.Find(c.requests[0]) == NULL)
+      to_add.push_back(i);
+  }
+  // Make sure that adding these doesn't purge any of them (or anything else)
+  // from the cache.
+  cache_.Reserve(to_add.size());
+  for (size_t i = 0; i < to_add.size(); i++) {
+    const PrecompiledComputations::PrecompiledComputation &c =
+        computations.computations_[to_add[i]];
+    cache_.Insert(c.requests[0], new NnetComputation(*c.computation));
+  }
+  return to_add.size();
+}
+
+void CachingOptimizingCompiler::ReadPrecompiled(
+    const std::string &rxfilename) {
+  Timer timer;
+  PrecompiledComputations computations;
+  ReadKaldiObject(rxfilename, &computations);
+  int32 num_added = AddPrecompiled(computations);
+  seconds_taken_io_ += timer.Elapsed();
+  if (num_added == 0)
+    KALDI_WARN << "None of the " << computations.NumComputations()
+               << " computations in " << rxfilename << " could be used; "
+               << "they were probably compiled for a different model or "
+               << "with different optimization options.";
+  else
+    KALDI_LOG << "Read " << num_added << " precompiled computations from "
+              << rxfilename;
+}
 
 
 void CachingOptimizingCompiler::ReadCache(std::istream &is, bool binary) {
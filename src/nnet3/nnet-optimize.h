@@ -54,6 +54,7 @@ struct NnetOptimizeOptions {
   int32 max_deriv_time_relative;
   bool snip_row_ops;
   int32 memory_compression_level;
+  bool fuse_components;
   // optimize_looped_computation is a 'hidden config' not available from
   // the command line; it's set to true to enable the optimization for
   // looped computation that turns a linear computation into a loop.
@@ -79,6 +80,7 @@ struct NnetOptimizeOptions {
       max_deriv_time_relative(std::numeric_limits<int32>::max()),
       snip_row_ops(true),
       memory_compression_level(1),
+      fuse_components(true),
       optimize_looped_computation(false) { }
 
   void Register(OptionsItf *opts) {
@@ -145,6 +147,11 @@ struct NnetOptimizeOptions {
                    "potentially at the expense of speed and the accuracy "
                    "of derivatives.  0 means no compression at all; 1 means "
                    "compression that shouldn't affect results at all.");
+    opts->Register("fuse-components", &fuse_components, "Set this to false "
+                   "to disable an optimization that fuses components such as "
+                   "batchnorm (in test mode), fixed scales and offsets and "
+                   "ReLUs with the command that precedes them, so they are "
+                   "done in one pass over the data.");
 
   }
   void Read(std::istream &is, bool binary);
@@ -192,6 +199,10 @@ void Optimize(const NnetOptimizeOptions &config,
 struct CachingOptimizingCompilerOptions {
   bool use_shortcut;
   int32 cache_capacity;
+  // If nonempty, the rxfilename of computations precompiled by
+  // nnet3-precompile (see class PrecompiledComputations), which the compiler
+  // reads into its cache when it is constructed.
+  std::string precompiled_computations;
 
   CachingOptimizingCompilerOptions():
       use_shortcut(true),
@@ -208,9 +219,73 @@ struct CachingOptimizingCompilerOptions {
     opts->Register("cache-capacity", &cache_capacity,
                    "Determines how many computations the computation-cache will "
                    "store (most-recently-used).");
+    opts->Register("precompiled-computations", &precompiled_computations,
+                   "If set, computations precompiled by nnet3-precompile "
+                   "are read from here, so they don't have to be compiled "
+                   "on first use.  The cache capacity is increased if "
+                   "necessary to hold them all.");
   }
 };
 
+
+/**
+   Class PrecompiledComputations stores computations that have been compiled
+   ahead of time for a particular network, so that programs can avoid
+   compiling them on first use; it is written by the program nnet3-precompile
+   and read by CachingOptimizingCompiler (see its option
+   --precompiled-computations) and by DecodableNnetSimpleLoopedInfo.
+
+   Each computation is stored with the ComputationRequests it was compiled
+   from (one request for a normal computation, or the three requests given to
+   CompileLooped() for a looped computation) and the NnetStructureHash() of
+   the network it was compiled for.  All the computations are compiled with
+   the same optimization options.
+ */
+class PrecompiledComputations {
+ public:
+  PrecompiledComputations() { }
+
+  explicit PrecompiledComputations(const NnetOptimizeOptions &opt_config):
+      opt_config_(opt_config) { }
+
+  /// Returns the optimization options that the computations were compiled
+  /// with.
+  const NnetOptimizeOptions &OptimizeConfig() const { return opt_config_; }
+
+  /// Adds a copy of 'computation', which was compiled from 'requests' for a
+  /// network whose NnetStructureHash() is 'nnet_hash'.  Does nothing if there
+  /// is already a computation for this hash and these requests.
+  void Add(uint64 nnet_hash, const std::vector<ComputationRequest> &requests,
+           const NnetComputation &computation);
+
+  /// Returns the computation compiled from 'requests' for a network whose
+  /// NnetStructureHash() is 'nnet_hash', or NULL if there is none.
+  const NnetComputation *Find(
+      uint64 nnet_hash, const std::vector<ComputationRequest> &requests) const;
+
+  int32 NumComputations() const { return computations_.size(); }
+
+  void Read(std::istream &is, bool binary);
+  void Write(std::ostream &os, bool binary) const;
+
+  ~PrecompiledComputations() { Clear(); }
+ private:
+  friend class CachingOptimizingCompiler;
+
+  void Clear();
+
+  struct PrecompiledComputation {
+    uint64 nnet_hash;
+    std::vector<ComputationRequest> requests;
+    NnetComputation *computation;  // owned here.
+  };
+
+  NnetOptimizeOptions opt_config_;
+  std::vector<PrecompiledComputation> computations_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(PrecompiledComputations);
+};
+
 /// This class enables you to do the compilation and optimization in one call,
 /// and also ensures that if the ComputationRequest is identical to the previous
 /// one, the compilation process is not repeated.
@@ -242,6 +317,14 @@ class CachingOptimizingCompiler {
   void ReadCache(std::istream &is, bool binary);
   void WriteCache(std::ostream &os, bool binary);
 
+  /// Adds to the cache those computations in 'computations' that have a single
+  /// request and were compiled for this network with this compiler's
+  /// optimization options; returns the number of computations added.  The
+  /// cache capacity (config.cache_capacity) is increased if necessary so that
+  /// they all fit.  This is called from the constructor if
+  /// config.precompiled_computations is set.
+  int32 AddPrecompiled(const PrecompiledComputations &computations);
+
  private:
 
   // This function just implements the work of Compile(); it's made a separate
@@ -275,6 +358,10 @@ class CachingOptimizingCompiler {
   // the computation cache).
   const NnetComputation *CompileNoShortcut(const ComputationRequest &request);
 
+  // Reads precompiled computations from 'rxfilename' and calls
+  // AddPrecompiled(); called from the constructor.
+  void ReadPrecompiled(const std::string &rxfilename);
+
   const Nnet &nnet_;
   CachingOptimizingCompilerOptions config_;
   NnetOptimizeOptions opt_config_;
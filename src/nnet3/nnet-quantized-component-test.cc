@@ -0,0 +1,156 @@
+// nnet3/nnet-quantized-component-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-quantized-component.h"
+#include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Returns the relative difference between the output of 'c' and that of the
+// affine function with parameters 'linear' and 'bias' (bias may be empty).
+static BaseFloat QuantizationError(const QuantizedAffineComponent &c,
+                                   const Matrix<BaseFloat> &linear,
+                                   const Vector<BaseFloat> &bias) {
+  int32 num_rows = RandInt(1, 20);  // will test the partial blocks of frames.
+  CuMatrix<BaseFloat> in(num_rows, c.InputDim()),
+      out(num_rows, c.OutputDim());
+  in.SetRandn();
+  c.Propagate(NULL, in, &out);
+
+  Matrix<BaseFloat> ref_out(num_rows, c.OutputDim());
+  if (bias.Dim() != 0)
+    ref_out.CopyRowsFromVec(bias);
+  ref_out.AddMatMat(1.0, Matrix<BaseFloat>(in), kNoTrans, linear, kTrans, 1.0);
+  Matrix<BaseFloat> diff(out);
+  diff.AddMat(-1.0, ref_out);
+  return diff.FrobeniusNorm() / ref_out.FrobeniusNorm();
+}
+
+static void UnitTestQuantizedAffineComponent() {
+  int32 input_dim = RandInt(1, 100), output_dim = RandInt(1, 50);
+  Matrix<BaseFloat> linear(output_dim, input_dim);
+  linear.SetRandn();
+  Vector<BaseFloat> bias;
+  if (RandInt(0, 1) == 0) {
+    bias.Resize(output_dim);
+    bias.SetRandn();
+  }
+  QuantizedAffineComponent c;
+  c.Init(linear, bias);
+  KALDI_ASSERT(c.InputDim() == input_dim && c.OutputDim() == output_dim);
+
+  // Each parameter is within half a quantization step of the original.
+  Matrix<BaseFloat> linear2;
+  c.GetLinearParams(&linear2);
+  for (int32 i = 0; i < output_dim; i++) {
+    BaseFloat step = std::max(linear.Row(i).Max(),
+                              -linear.Row(i).Min()) / 127.0;
+    for (int32 j = 0; j < input_dim; j++)
+      KALDI_ASSERT(std::abs(linear(i, j) - linear2(i, j)) <= 0.501 * step);
+  }
+
+  BaseFloat error = QuantizationError(c, linear, bias);
+  KALDI_LOG << "Relative error of quantized output is " << error;
+  KALDI_ASSERT(error < 0.05);
+
+  // Check that writing and reading gives the same output.
+  bool binary = (RandInt(0, 1) == 0);
+  std::ostringstream os;
+  c.Write(os, binary);
+  std::istringstream is(os.str());
+  Component *c2 = Component::ReadNew(is, binary);
+  KALDI_ASSERT(c2->Type() == "QuantizedAffineComponent");
+  CuMatrix<BaseFloat> in(RandInt(1, 10), input_dim),
+      out1(in.NumRows(), output_dim), out2(in.NumRows(), output_dim);
+  in.SetRandn();
+  c.Propagate(NULL, in, &out1);
+  c2->Propagate(NULL, in, &out2);
+  KALDI_ASSERT(out1.ApproxEqual(out2, 1.0e-05));
+  delete c2;
+}
+
+static void UnitTestQuantizeAffineComponents() {
+  std::istringstream config(
+      "input-node name=input dim=30\n"
+      "component name=affine1 type=NaturalGradientAffineComponent "
+      "input-dim=30 output-dim=40\n"
+      "component-node name=affine1 component=affine1 input=input\n"
+      "component name=relu1 type=RectifiedLinearComponent dim=40\n"
+      "component-node name=relu1 component=relu1 input=affine1\n"
+      "component name=linear2 type=LinearComponent "
+      "input-dim=40 output-dim=20\n"
+      "component-node name=linear2 component=linear2 input=relu1\n"
+      "component name=affine3 type=AffineComponent "
+      "input-dim=20 output-dim=10\n"
+      "component-node name=affine3 component=affine3 input=linear2\n"
+      "output-node name=output input=affine3\n");
+  Nnet nnet;
+  nnet.ReadConfig(config);
+  Nnet quantized_nnet(nnet);
+  KALDI_ASSERT(QuantizeAffineComponents("affine*", &quantized_nnet) == 2);
+  KALDI_ASSERT(QuantizeAffineComponents("*", &quantized_nnet) == 1);
+  for (int32 c = 0; c < nnet.NumComponents(); c++) {
+    const Component *orig = nnet.GetComponent(c),
+        *quantized = quantized_nnet.GetComponent(c);
+    if (orig->Type() == "RectifiedLinearComponent") {
+      KALDI_ASSERT(quantized->Type() == orig->Type());
+      continue;
+    }
+    KALDI_ASSERT(quantized->Type() == "QuantizedAffineComponent");
+    const QuantizedAffineComponent *qac =
+        dynamic_cast<const QuantizedAffineComponent*>(quantized);
+    Matrix<BaseFloat> linear;
+    Vector<BaseFloat> bias;
+    if (const AffineComponent *ac =
+        dynamic_cast<const AffineComponent*>(orig)) {
+      linear = Matrix<BaseFloat>(ac->LinearParams());
+      bias = Vector<BaseFloat>(ac->BiasParams());
+    } else {
+      const LinearComponent *lc = dynamic_cast<const LinearComponent*>(orig);
+      KALDI_ASSERT(lc != NULL);
+      linear = Matrix<BaseFloat>(lc->Params());
+      KALDI_ASSERT(qac->BiasParams().Dim() == 0);
+    }
+    KALDI_ASSERT(QuantizationError(*qac, linear, bias) < 0.05);
+  }
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    CuDevice::Instantiate().SetDebugStrideMode(true);
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("optional");
+#endif
+    for (int32 i = 0; i < 20; i++)
+      UnitTestQuantizedAffineComponent();
+    UnitTestQuantizeAffineComponents();
+  }
+  KALDI_LOG << "Quantized component tests succeeded.";
+  return 0;
+}
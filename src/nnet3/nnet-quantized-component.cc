@@ -0,0 +1,360 @@
+// nnet3/nnet-quantized-component.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iterator>
+#include <sstream>
+#include <iomanip>
+#include "nnet3/nnet-quantized-component.h"
+#include "nnet3/nnet-parse.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace kaldi {
+namespace nnet3 {
+
+// The number of input rows (frames), and of rows of the parameters, that the
+// inner loop of the matrix multiplication handles at once.  These were tuned
+// for SSE2 and AVX2 on a few x86 machines.
+static const int32 kQuantizedFrameBlock = 2, kQuantizedRowBlock = 4;
+
+#if defined(__SSE2__) || defined(__AVX2__)
+static inline int32 HorizontalSum(__m128i v) {
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(v);
+}
+#endif
+
+// Sets ans[r * kQuantizedFrameBlock + k] to the dot product of row r of 'w'
+// with row k of 'x', for r < kQuantizedRowBlock and k < kQuantizedFrameBlock.
+// Both have 'dim' columns, which must be a multiple of 16, and a row stride
+// of 'dim'.  The products are at most 127 * 127 in magnitude so the sums
+// cannot overflow for any reasonable dimension.
+static inline void QuantizedDotProducts(const int8 *w, const int16 *x,
+                                        int32 dim, int32 *ans) {
+  const int32 F = kQuantizedFrameBlock, R = kQuantizedRowBlock;
+#if defined(__AVX2__)
+  __m256i sum[R][F];
+  for (int32 r = 0; r < R; r++)
+    for (int32 k = 0; k < F; k++)
+      sum[r][k] = _mm256_setzero_si256();
+  for (int32 i = 0; i < dim; i += 16) {
+    __m256i xv[F];
+    for (int32 k = 0; k < F; k++)
+      xv[k] = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(x + k * dim + i));
+    for (int32 r = 0; r < R; r++) {
+      __m256i wv = _mm256_cvtepi8_epi16(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + r * dim + i)));
+      for (int32 k = 0; k < F; k++)
+        sum[r][k] = _mm256_add_epi32(sum[r][k], _mm256_madd_epi16(wv, xv[k]));
+    }
+  }
+  for (int32 r = 0; r < R; r++)
+    for (int32 k = 0; k < F; k++)
+      ans[r * F + k] = HorizontalSum(
+          _mm_add_epi32(_mm256_castsi256_si128(sum[r][k]),
+                        _mm256_extracti128_si256(sum[r][k], 1)));
+#elif defined(__SSE2__)
+  __m128i sum[R][F];
+  const __m128i zero = _mm_setzero_si128();
+  for (int32 r = 0; r < R; r++)
+    for (int32 k = 0; k < F; k++)
+      sum[r][k] = zero;
+  for (int32 i = 0; i < dim; i += 16) {
+    for (int32 r = 0; r < R; r++) {
+      // sign-extend the 16 weights to two registers of 8 int16's.
+      __m128i wb = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(w + r * dim + i)),
+          sign = _mm_cmpgt_epi8(zero, wb),
+          wlo = _mm_unpacklo_epi8(wb, sign),
+          whi = _mm_unpackhi_epi8(wb, sign);
+      for (int32 k = 0; k < F; k++) {
+        const __m128i *xp = reinterpret_cast<const __m128i*>(x + k * dim + i);
+        sum[r][k] = _mm_add_epi32(sum[r][k],
+                                  _mm_madd_epi16(wlo, _mm_loadu_si128(xp)));
+        sum[r][k] = _mm_add_epi32(sum[r][k],
+                                  _mm_madd_epi16(whi, _mm_loadu_si128(xp + 1)));
+      }
+    }
+  }
+  for (int32 r = 0; r < R; r++)
+    for (int32 k = 0; k < F; k++)
+      ans[r * F + k] = HorizontalSum(sum[r][k]);
+#else
+  for (int32 r = 0; r < R; r++) {
+    for (int32 k = 0; k < F; k++) {
+      const int8 *wr = w + r * dim;
+      const int16 *xk = x + k * dim;
+      int32 sum = 0;
+      for (int32 i = 0; i < dim; i++)
+        sum += static_cast<int32>(wr[i]) * xk[i];
+      ans[r * F + k] = sum;
+    }
+  }
+#endif
+}
+
+// Quantizes the elements of 'v' to integers in [-127, 127] and returns the
+// scale, i.e. the value of one quantization step.
+template<class Int>
+static BaseFloat QuantizeRow(const BaseFloat *v, int32 dim, Int *q) {
+  BaseFloat max_abs = 0.0;
+  for (int32 i = 0; i < dim; i++)
+    max_abs = std::max(max_abs, std::abs(v[i]));
+  if (max_abs == 0.0) {
+    std::fill(q, q + dim, 0);
+    return 1.0;
+  }
+  BaseFloat inv_scale = 127.0 / max_abs;
+  for (int32 i = 0; i < dim; i++) {
+    int32 j = static_cast<int32>(std::floor(v[i] * inv_scale + 0.5));
+    q[i] = static_cast<Int>(std::max(-127, std::min(127, j)));
+  }
+  return max_abs / 127.0;
+}
+
+
+QuantizedAffineComponent::QuantizedAffineComponent(
+    const QuantizedAffineComponent &other):
+    input_dim_(other.input_dim_),
+    padded_input_dim_(other.padded_input_dim_),
+    linear_params_(other.linear_params_),
+    row_scales_(other.row_scales_),
+    bias_params_(other.bias_params_) { }
+
+QuantizedAffineComponent::QuantizedAffineComponent(const AffineComponent &c) {
+  Matrix<BaseFloat> linear(c.LinearParams());
+  Vector<BaseFloat> bias(c.BiasParams());
+  Init(linear, bias);
+}
+
+QuantizedAffineComponent::QuantizedAffineComponent(const LinearComponent &c) {
+  Matrix<BaseFloat> linear(c.Params());
+  Init(linear, Vector<BaseFloat>());
+}
+
+QuantizedAffineComponent::QuantizedAffineComponent(
+    const FixedAffineComponent &c) {
+  Matrix<BaseFloat> linear(c.LinearParams());
+  Vector<BaseFloat> bias(c.BiasParams());
+  Init(linear, bias);
+}
+
+void QuantizedAffineComponent::Init(const MatrixBase<BaseFloat> &linear,
+                                    const VectorBase<BaseFloat> &bias) {
+  int32 output_dim = linear.NumRows();
+  KALDI_ASSERT(output_dim > 0 && linear.NumCols() > 0);
+  KALDI_ASSERT(bias.Dim() == 0 || bias.Dim() == output_dim);
+  input_dim_ = linear.NumCols();
+  padded_input_dim_ = (input_dim_ + 15) / 16 * 16;
+  linear_params_.clear();
+  linear_params_.resize(static_cast<size_t>(PaddedOutputDim(output_dim)) *
+                        padded_input_dim_, 0);
+  row_scales_.Resize(output_dim);
+  for (int32 i = 0; i < output_dim; i++)
+    row_scales_(i) = QuantizeRow(linear.RowData(i), input_dim_,
+                                 &(linear_params_[i * padded_input_dim_]));
+  bias_params_ = bias;
+}
+
+void QuantizedAffineComponent::InitFromConfig(ConfigLine *cfl) {
+  std::string filename;
+  Matrix<BaseFloat> mat;
+  // Two forms allowed: "matrix=<rxfilename>", or "input-dim=x output-dim=y"
+  // (for testing purposes only).
+  if (cfl->GetValue("matrix", &filename)) {
+    if (cfl->HasUnusedValues())
+      KALDI_ERR << "Invalid initializer for layer of type "
+                << Type() << ": \"" << cfl->WholeLine() << "\"";
+    ReadKaldiObject(filename, &mat);
+    KALDI_ASSERT(mat.NumRows() != 0 && mat.NumCols() > 1);
+  } else {
+    int32 input_dim = -1, output_dim = -1;
+    if (!cfl->GetValue("input-dim", &input_dim) ||
+        !cfl->GetValue("output-dim", &output_dim) || cfl->HasUnusedValues()) {
+      KALDI_ERR << "Invalid initializer for layer of type "
+                << Type() << ": \"" << cfl->WholeLine() << "\"";
+    }
+    mat.Resize(output_dim, input_dim + 1);
+    mat.SetRandn();
+  }
+  int32 input_dim = mat.NumCols() - 1;
+  Vector<BaseFloat> bias(mat.NumRows());
+  bias.CopyColFromMat(mat, input_dim);
+  Init(mat.Range(0, mat.NumRows(), 0, input_dim), bias);
+}
+
+std::string QuantizedAffineComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info();
+  CuVector<BaseFloat> row_scales(row_scales_);
+  PrintParameterStats(stream, "row-scales", row_scales, true);
+  if (bias_params_.Dim() != 0) {
+    CuVector<BaseFloat> bias(bias_params_);
+    PrintParameterStats(stream, "bias", bias, true);
+  }
+  return stream.str();
+}
+
+void QuantizedAffineComponent::GetLinearParams(
+    Matrix<BaseFloat> *linear) const {
+  linear->Resize(OutputDim(), input_dim_);
+  for (int32 i = 0; i < OutputDim(); i++) {
+    const int8 *q = &(linear_params_[i * padded_input_dim_]);
+    BaseFloat *row = linear->RowData(i), scale = row_scales_(i);
+    for (int32 j = 0; j < input_dim_; j++)
+      row[j] = scale * q[j];
+  }
+}
+
+void QuantizedAffineComponent::PropagateCpu(const MatrixBase<BaseFloat> &in,
+                                            MatrixBase<BaseFloat> *out) const {
+  const int32 F = kQuantizedFrameBlock, R = kQuantizedRowBlock;
+  int32 num_frames = in.NumRows(), output_dim = OutputDim(),
+      padded_dim = padded_input_dim_,
+      padded_num_frames = (num_frames + F - 1) / F * F;
+  if (num_frames == 0)
+    return;
+  // Quantize the input, one scale per frame.  The buffer is local so that
+  // several threads may use the same component.  Any extra frames are zero.
+  std::vector<int16> in_quantized(static_cast<size_t>(padded_num_frames) *
+                                  padded_dim, 0);
+  Vector<BaseFloat> in_scales(num_frames, kUndefined);
+  for (int32 t = 0; t < num_frames; t++)
+    in_scales(t) = QuantizeRow(in.RowData(t), input_dim_,
+                               &(in_quantized[t * padded_dim]));
+
+  if (bias_params_.Dim() != 0)
+    out->CopyRowsFromVec(bias_params_);
+  else
+    out->SetZero();
+
+  // Process the parameters in blocks of rows that fit comfortably in the
+  // cache, and for each block go through all the frames.  The parameters
+  // have PaddedOutputDim() rows, so we can always process R rows at a time.
+  int32 rows_per_block = std::max<int32>(1, 32768 / (padded_dim * R)) * R;
+  int32 dots[F * R];
+  for (int32 r0 = 0; r0 < output_dim; r0 += rows_per_block) {
+    int32 r1 = std::min(output_dim, r0 + rows_per_block);
+    for (int32 t0 = 0; t0 < num_frames; t0 += F) {
+      int32 this_num_frames = std::min(F, num_frames - t0);
+      for (int32 r = r0; r < r1; r += R) {
+        QuantizedDotProducts(&(linear_params_[r * padded_dim]),
+                             &(in_quantized[t0 * padded_dim]),
+                             padded_dim, dots);
+        int32 this_num_rows = std::min(R, output_dim - r);
+        for (int32 k = 0; k < this_num_frames; k++) {
+          BaseFloat *out_row = out->RowData(t0 + k) + r,
+              in_scale = in_scales(t0 + k);
+          for (int32 i = 0; i < this_num_rows; i++)
+            out_row[i] += row_scales_(r + i) * in_scale * dots[i * F + k];
+        }
+      }
+    }
+  }
+}
+
+void* QuantizedAffineComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled()) {
+    Matrix<BaseFloat> in_cpu(in),
+        out_cpu(out->NumRows(), out->NumCols(), kUndefined);
+    PropagateCpu(in_cpu, &out_cpu);
+    out->CopyFromMat(out_cpu);
+    return NULL;
+  }
+#endif
+  PropagateCpu(in.Mat(), &(out->Mat()));
+  return NULL;
+}
+
+void QuantizedAffineComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &, //in_value
+    const CuMatrixBase<BaseFloat> &, //out_value
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    void *memo,
+    Component *to_update,
+    CuMatrixBase<BaseFloat> *in_deriv) const {
+  KALDI_ERR << "Backprop is not supported for " << Type()
+            << " (component " << debug_info << "); it is for inference only.";
+}
+
+Component* QuantizedAffineComponent::Copy() const {
+  return new QuantizedAffineComponent(*this);
+}
+
+void QuantizedAffineComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedAffineComponent>");
+  WriteToken(os, binary, "<InputDim>");
+  WriteBasicType(os, binary, input_dim_);
+  WriteToken(os, binary, "<LinearParams>");
+  // Write without the padding.
+  std::vector<int8> linear_params(static_cast<size_t>(OutputDim()) *
+                                  input_dim_);
+  for (int32 i = 0; i < OutputDim(); i++)
+    std::copy(linear_params_.begin() + i * padded_input_dim_,
+              linear_params_.begin() + i * padded_input_dim_ + input_dim_,
+              linear_params.begin() + i * input_dim_);
+  WriteIntegerVector(os, binary, linear_params);
+  WriteToken(os, binary, "<RowScales>");
+  row_scales_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</QuantizedAffineComponent>");
+}
+
+void QuantizedAffineComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<QuantizedAffineComponent>", "<InputDim>");
+  ReadBasicType(is, binary, &input_dim_);
+  ExpectToken(is, binary, "<LinearParams>");
+  std::vector<int8> linear_params;
+  ReadIntegerVector(is, binary, &linear_params);
+  ExpectToken(is, binary, "<RowScales>");
+  row_scales_.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</QuantizedAffineComponent>");
+  int32 output_dim = row_scales_.Dim();
+  if (input_dim_ <= 0 || output_dim == 0 ||
+      linear_params.size() != static_cast<size_t>(output_dim) * input_dim_ ||
+      (bias_params_.Dim() != 0 && bias_params_.Dim() != output_dim))
+    KALDI_ERR << "Invalid dimensions reading QuantizedAffineComponent.";
+  padded_input_dim_ = (input_dim_ + 15) / 16 * 16;
+  linear_params_.clear();
+  linear_params_.resize(static_cast<size_t>(PaddedOutputDim(output_dim)) *
+                        padded_input_dim_, 0);
+  for (int32 i = 0; i < output_dim; i++)
+    std::copy(linear_params.begin() + i * input_dim_,
+              linear_params.begin() + (i + 1) * input_dim_,
+              linear_params_.begin() + i * padded_input_dim_);
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,146 @@
+// nnet3/nnet-quantized-component.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_QUANTIZED_COMPONENT_H_
+#define KALDI_NNET3_NNET_QUANTIZED_COMPONENT_H_
+
+#include "nnet3/nnet-common.h"
+#include "nnet3/nnet-component-itf.h"
+#include "nnet3/nnet-simple-component.h"
+#include <iostream>
+
+namespace kaldi {
+namespace nnet3 {
+
+/// @file  nnet-quantized-component.h
+///
+/// Contains components that store their parameters in reduced precision, for
+/// faster inference on CPU.  They are not trainable.
+
+
+/**
+   QuantizedAffineComponent is an inference-only version of AffineComponent
+   (and of NaturalGradientAffineComponent, LinearComponent and
+   FixedAffineComponent) in which the linear parameters are stored as 8-bit
+   integers, with one floating-point scale per row (i.e. per output
+   dimension).  The bias, if present, is kept in floating point.
+
+   In Propagate(), each row (frame) of the input is quantized on the fly to
+   integers in the range [-127, 127] with its own scale, the matrix product is
+   done with integer arithmetic using SSE2 or AVX2 instructions (with a plain
+   C++ fallback), and the int32 results are scaled back to floating point.
+   The relative error that this introduces is typically around 1e-02 per
+   output, which for most acoustic models makes no difference to the WER; use
+   nnet3-quantize to check this on your own data.  Like the rest of Kaldi,
+   this code needs to be compiled with optimization (e.g. -O2) to be fast; if
+   your machines support AVX2, add -mavx2 to CXXFLAGS to use it.
+
+   The computation is always done on CPU; if a GPU is in use, the data is
+   copied to and from the CPU, so there is no point in using this component
+   with a GPU.  Backprop() is not supported.
+
+   You would normally create this component by converting a trained model
+   with nnet3-quantize (see QuantizeAffineComponents() in nnet-utils.h).  For
+   testing purposes it can also be created from a config line, with either
+     matrix=<rxfilename>   A matrix of dimension output-dim by (input-dim + 1),
+                           whose last column is the bias, as for
+                           FixedAffineComponent.
+   or
+     input-dim=<int> output-dim=<int>   Initialize with random parameters.
+ */
+class QuantizedAffineComponent: public Component {
+ public:
+  QuantizedAffineComponent(): input_dim_(0), padded_input_dim_(0) { }
+  explicit QuantizedAffineComponent(const QuantizedAffineComponent &other);
+  explicit QuantizedAffineComponent(const AffineComponent &c);
+  explicit QuantizedAffineComponent(const LinearComponent &c);
+  explicit QuantizedAffineComponent(const FixedAffineComponent &c);
+
+  /// Quantizes the matrix 'linear' (of dimension output-dim by input-dim) and
+  /// stores it with the bias 'bias', which must either be empty (meaning no
+  /// bias) or have dimension output-dim.
+  void Init(const MatrixBase<BaseFloat> &linear,
+            const VectorBase<BaseFloat> &bias);
+
+  virtual std::string Type() const { return "QuantizedAffineComponent"; }
+  virtual std::string Info() const;
+  virtual void InitFromConfig(ConfigLine *cfl);
+  virtual int32 Properties() const { return kSimpleComponent; }
+  virtual int32 InputDim() const { return input_dim_; }
+  virtual int32 OutputDim() const { return row_scales_.Dim(); }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  // Backprop() is not supported; it will crash.
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &in_value,
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  /// Outputs the linear parameters converted back to floating point (i.e.
+  /// including the quantization error).
+  void GetLinearParams(Matrix<BaseFloat> *linear) const;
+  /// Returns the bias; will be empty if this component has no bias.
+  const Vector<BaseFloat> &BiasParams() const { return bias_params_; }
+
+ private:
+  // Returns the number of rows we store in linear_params_ for a given output
+  // dim; we round up to a multiple of 4 so the matrix multiplication can
+  // process 4 rows at a time.
+  static int32 PaddedOutputDim(int32 output_dim) {
+    return (output_dim + 3) / 4 * 4;
+  }
+
+  // Does the work of Propagate() on CPU.
+  void PropagateCpu(const MatrixBase<BaseFloat> &in,
+                    MatrixBase<BaseFloat> *out) const;
+
+  int32 input_dim_;
+  // input_dim_ rounded up to a multiple of 16, so the inner loop never has
+  // to deal with a partial SIMD register.
+  int32 padded_input_dim_;
+  // The quantized linear parameters, of dimension
+  // PaddedOutputDim(OutputDim()) by padded_input_dim_, row-major; the padding
+  // is zero.
+  std::vector<int8> linear_params_;
+  // The scale of each row of linear_params_, i.e. the real value of the
+  // parameter is row_scales_(i) * linear_params_[i * padded_input_dim_ + j].
+  Vector<BaseFloat> row_scales_;
+  // The bias; empty if there is none.
+  Vector<BaseFloat> bias_params_;
+
+  QuantizedAffineComponent &operator = (
+      const QuantizedAffineComponent &other); // Disallow.
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+
+#endif
@@ -1124,6 +1124,7 @@ class FixedBiasComponent: public Component {
   virtual void InitFromConfig(ConfigLine *cfl);
   virtual int32 InputDim() const { return bias_.Dim(); }
   virtual int32 OutputDim() const { return bias_.Dim(); }
+  const CuVector<BaseFloat> &Bias() const { return bias_; }
   using Component::Propagate; // to avoid name hiding
   virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
                          const CuMatrixBase<BaseFloat> &in,
@@ -1508,6 +1509,8 @@ class PerElementScaleComponent: public UpdatableComponent {
   void Init(int32 dim, BaseFloat param_mean, BaseFloat param_stddev);
   void Init(std::string vector_filename);
 
+  const CuVector<BaseFloat> &Scales() const { return scales_; }
+
  protected:
   // This function Update() is for extensibility; child classes may override
   // this, e.g. for natural gradient update.
@@ -1600,6 +1603,10 @@ class PerElementOffsetComponent: public UpdatableComponent {
 
   // Copy constructor
   explicit PerElementOffsetComponent(const PerElementOffsetComponent &other);
+
+  // Note: the dimension of the offsets may be a divisor of OutputDim(), in
+  // which case they are repeated.
+  const CuVector<BaseFloat> &Offsets() const { return offsets_; }
  protected:
   const PerElementOffsetComponent &operator
       = (const PerElementOffsetComponent &other); // Disallow.
@@ -1844,6 +1851,14 @@ class ScaleAndOffsetComponent: public UpdatableComponent {
 
   // copy constructor
   explicit ScaleAndOffsetComponent(const ScaleAndOffsetComponent &other);
+
+  // Outputs the scales as used in Propagate(), i.e. with values very close
+  // to zero moved away from zero.  Note: the dimension of the scales and
+  // offsets may be a divisor of OutputDim(), in which case they are repeated.
+  void GetScales(CuVectorBase<BaseFloat> *scales) const {
+    cu::EnsureNonzero(scales_, Epsilon(), scales);
+  }
+  const CuVector<BaseFloat> &Offsets() const { return offsets_; }
  private:
   // Internal version of propagate, requires in.NumCols() equal to scales_.Dim()
   // (if batch-dim was set, this may require the caller to reshape the input and
@@ -21,6 +21,7 @@
 #include "nnet3/nnet-nnet.h"
 #include "nnet3/nnet-simple-component.h"
 #include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -100,6 +101,33 @@ void UnitTestConvertRepeatedToBlockAffineComposite() {
   }
 }
 
+void UnitTestNnetStructureHash() {
+  for (int32 n = 0; n < 20; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    std::istringstream is(configs[0]);
+    nnet.ReadConfig(is);
+    uint64 hash = NnetStructureHash(nnet);
+
+    // The hash should not depend on the parameters or the learning rate.
+    Nnet nnet2(nnet);
+    PerturbParams(0.1, &nnet2);
+    SetLearningRate(0.5, &nnet2);
+    KALDI_ASSERT(NnetStructureHash(nnet2) == hash);
+
+    // ... but it should depend on batchnorm test mode, which changes how
+    // the computation is compiled.
+    bool has_batchnorm = false;
+    for (int32 c = 0; c < nnet.NumComponents(); c++)
+      if (nnet.GetComponent(c)->Type() == "BatchNormComponent")
+        has_batchnorm = true;
+    SetBatchnormTestMode(true, &nnet2);
+    KALDI_ASSERT((NnetStructureHash(nnet2) != hash) == has_batchnorm);
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -111,6 +139,7 @@ int main() {
   UnitTestNnetContext();
   UnitTestConvertRepeatedToBlockAffine();
   UnitTestConvertRepeatedToBlockAffineComposite();
+  UnitTestNnetStructureHash();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
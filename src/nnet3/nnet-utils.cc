@@ -25,6 +25,7 @@
 #include "nnet3/nnet-normalize-component.h"
 #include "nnet3/nnet-general-component.h"
 #include "nnet3/nnet-convolutional-component.h"
+#include "nnet3/nnet-quantized-component.h"
 #include "nnet3/nnet-parse.h"
 #include "nnet3/nnet-computation-graph.h"
 #include "nnet3/nnet-diagnostics.h"
@@ -458,6 +459,34 @@ void ConvertRepeatedToBlockAffine(Nnet *nnet) {
   }
 }
 
+int32 QuantizeAffineComponents(const std::string &component_names,
+                               Nnet *nnet) {
+  int32 num_converted = 0;
+  for (int32 c = 0; c < nnet->NumComponents(); c++) {
+    if (!NameMatchesPattern(nnet->GetComponentName(c).c_str(),
+                            component_names.c_str()))
+      continue;
+    const Component *comp = nnet->GetComponent(c);
+    QuantizedAffineComponent *qac = NULL;
+    // N.B.: NaturalGradientAffineComponent is a subclass of AffineComponent.
+    if (const AffineComponent *ac =
+        dynamic_cast<const AffineComponent*>(comp))
+      qac = new QuantizedAffineComponent(*ac);
+    else if (const LinearComponent *lc =
+             dynamic_cast<const LinearComponent*>(comp))
+      qac = new QuantizedAffineComponent(*lc);
+    else if (const FixedAffineComponent *fac =
+             dynamic_cast<const FixedAffineComponent*>(comp))
+      qac = new QuantizedAffineComponent(*fac);
+    if (qac != NULL) {
+      // following call deletes the old component.
+      nnet->SetComponent(c, qac);
+      num_converted++;
+    }
+  }
+  return num_converted;
+}
+
 std::string NnetInfo(const Nnet &nnet) {
   std::ostringstream ostr;
   if (IsSimpleNnet(nnet)) {
@@ -475,6 +504,50 @@ std::string NnetInfo(const Nnet &nnet) {
   return ostr.str();
 }
 
+uint64 NnetStructureHash(const Nnet &nnet) {
+  std::ostringstream ostr;
+  std::vector<std::string> config_lines;
+  bool include_dim = true;
+  nnet.GetConfigLines(include_dim, &config_lines);
+  for (size_t i = 0; i < config_lines.size(); i++)
+    ostr << config_lines[i] << "\n";
+  for (int32 c = 0; c < nnet.NumComponents(); c++) {
+    // Compilation only depends on the type, dimensions and properties of a
+    // component (the properties reflect things like batchnorm test mode), and
+    // not on its parameters; except that components that are not simple
+    // work out their input indexes from their configuration (e.g. the time
+    // offsets of a TdnnComponent), which only their Info() shows.  Info() also
+    // shows statistics of the parameters, and the learning rate, so we print
+    // it for a copy without them.
+    const Component *component = nnet.GetComponent(c);
+    int32 properties = component->Properties();
+    ostr << "component name=" << nnet.GetComponentName(c)
+         << " type=" << component->Type()
+         << " input-dim=" << component->InputDim()
+         << " output-dim=" << component->OutputDim()
+         << " properties=" << properties;
+    if (!(properties & kSimpleComponent)) {
+      Component *copy = component->Copy();
+      copy->Scale(0.0);
+      UpdatableComponent *uc = dynamic_cast<UpdatableComponent*>(copy);
+      if (uc != NULL)
+        uc->SetActualLearningRate(0.0);
+      ostr << " info=" << copy->Info();
+      delete copy;
+    }
+    ostr << "\n";
+  }
+  // 64-bit FNV-1a hash; we don't use std::hash because its value is not
+  // guaranteed to be the same across builds.
+  std::string str = ostr.str();
+  uint64 ans = 14695981039346656037ULL;
+  for (size_t i = 0; i < str.size(); i++) {
+    ans ^= static_cast<unsigned char>(str[i]);
+    ans *= 1099511628211ULL;
+  }
+  return ans;
+}
+
 void SetDropoutProportion(BaseFloat dropout_proportion,
                           Nnet *nnet) {
   for (int32 c = 0; c < nnet->NumComponents(); c++) {
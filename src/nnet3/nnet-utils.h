@@ -156,6 +156,16 @@ void FreezeNaturalGradient(bool freeze, Nnet *nnet);
 /// NaturalGradientRepeatedAffineComponent to BlockAffineComponent in nnet.
 void ConvertRepeatedToBlockAffine(Nnet *nnet);
 
+/// Converts the components whose names match 'component_names' (a pattern
+/// as accepted by NameMatchesPattern(), e.g. "*" or "tdnn*") and which are of
+/// type AffineComponent, NaturalGradientAffineComponent, LinearComponent or
+/// FixedAffineComponent, to QuantizedAffineComponent, which stores its
+/// parameters as 8-bit integers and is much faster for CPU inference.  The
+/// resulting nnet cannot be trained.  Returns the number of components
+/// converted.
+int32 QuantizeAffineComponents(const std::string &component_names,
+                               Nnet *nnet);
+
 /// This function returns various info about the neural net.
 /// If the nnet satisfied IsSimpleNnet(nnet), the info includes "left-context=5\nright-context=3\n...".  The info includes
 /// the output of nnet.Info().
@@ -163,6 +173,15 @@ void ConvertRepeatedToBlockAffine(Nnet *nnet);
 /// Info() function (we need this in the CTC code).
 std::string NnetInfo(const Nnet &nnet);
 
+/// Returns a hash of those aspects of the network that affect how computations
+/// for it are compiled: its config lines and the name, type, dimensions and
+/// properties of its components (plus, for components that are not simple,
+/// their configuration), but not the values of its parameters.  It is used to
+/// check that computations compiled ahead of time (see class
+/// PrecompiledComputations) were compiled for this network, so they can be
+/// reused when the model is retrained with the same structure.
+uint64 NnetStructureHash(const Nnet &nnet);
+
 /// This function sets the dropout proportion in all dropout components to
 /// dropout_proportion value.
 void SetDropoutProportion(BaseFloat dropout_proportion, Nnet *nnet);
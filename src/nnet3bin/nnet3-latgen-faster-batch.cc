@@ -0,0 +1,305 @@
+// nnet3bin/nnet3-latgen-faster-batch.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <deque>
+#include "base/timer.h"
+#include "base/kaldi-common.h"
+#include "decoder/decoder-wrappers.h"
+#include "decoder/decodable-matrix.h"
+#include "fstext/fstext-lib.h"
+#include "hmm/transition-model.h"
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/nnet-utils.h"
+#include "util/kaldi-thread.h"
+#include "tree/context-dep.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// An utterance whose neural net computation is in progress.
+struct PendingUtterance {
+  std::string utt;
+  std::vector<NnetInferenceTask> tasks;
+
+  bool IsComputed() const {
+    for (size_t i = 0; i < tasks.size(); i++)
+      if (!tasks[i].is_computed)
+        return false;
+    return true;
+  }
+};
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::Fst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Generate lattices using nnet3 neural net model.  This version does\n"
+        "the neural net computation for many utterances at once, in large\n"
+        "minibatches (see --minibatch-size), which is much more efficient,\n"
+        "especially on GPU; the decoding is done in multiple threads (see\n"
+        "--num-threads).  Only a single decoding graph is supported.\n"
+        "Usage: nnet3-latgen-faster-batch [options] <nnet-in> <fst-in> "
+        "<features-rspecifier> <lattice-wspecifier> [ <words-wspecifier> "
+        "[<alignments-wspecifier>] ]\n"
+        "e.g.: nnet3-latgen-faster-batch --use-gpu=yes --num-threads=8 \\\n"
+        "   final.mdl HCLG.fst scp:feats.scp ark:lat.ark\n";
+    ParseOptions po(usage);
+
+    Timer timer;
+    bool allow_partial = false;
+    TaskSequencerConfig sequencer_config; // has --num-threads option
+    LatticeFasterDecoderConfig config;
+    DecoderStatsOptions stats_opts;
+    NnetBatchComputerOptions batch_opts;
+    std::string use_gpu = "no";
+
+    std::string word_syms_filename;
+    std::string ivector_rspecifier,
+        online_ivector_rspecifier,
+        utt2spk_rspecifier;
+    int32 online_ivector_period = 0;
+    sequencer_config.Register(&po);
+    config.Register(&po);
+    stats_opts.Register(&po);
+    batch_opts.Register(&po);
+    po.Register("word-symbol-table", &word_syms_filename,
+                "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial,
+                "If true, produce output even if end state was not reached.");
+    po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
+                "iVectors as vectors (i.e. not estimated online); per utterance "
+                "by default, or per speaker if you provide the --utt2spk option.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "Rspecifier for "
+                "utt2spk option used to get ivectors per speaker");
+    po.Register("online-ivectors", &online_ivector_rspecifier, "Rspecifier for "
+                "iVectors estimated online, as matrices.  If you supply this,"
+                " you must set the --online-ivector-period option.");
+    po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
+                "between iVectors in matrices supplied to the --online-ivectors "
+                "option");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 4 || po.NumArgs() > 6) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_str = po.GetArg(2),
+        feature_rspecifier = po.GetArg(3),
+        lattice_wspecifier = po.GetArg(4),
+        words_wspecifier = po.GetOptArg(5),
+        alignment_wspecifier = po.GetOptArg(6);
+
+    if (ClassifyRspecifier(fst_in_str, NULL, NULL) != kNoRspecifier)
+      KALDI_ERR << "nnet3-latgen-faster-batch does not support a table of "
+                << "FSTs; use nnet3-latgen-faster-parallel for that.";
+
+    TaskSequencer<DecodeUtteranceLatticeFasterClass> sequencer(sequencer_config);
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    RandomAccessBaseFloatMatrixReader online_ivector_reader(
+        online_ivector_rspecifier);
+    RandomAccessBaseFloatVectorReaderMapped ivector_reader(
+        ivector_rspecifier, utt2spk_rspecifier);
+
+    Int32VectorWriter words_writer(words_wspecifier);
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+    DecoderStatsWriter stats_writer(stats_opts);
+    DecoderStatsWriter *stats_writer_ptr =
+        (stats_writer.IsOpen() ? &stats_writer : NULL);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+
+    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+
+    Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+    timer.Reset();
+
+    {
+      NnetBatchComputer computer(batch_opts, am_nnet.GetNnet(),
+                                 am_nnet.Priors());
+      // Utterances whose nnet output is not yet complete, in the order in
+      // which they were read.  We hand them to the decoder in the same order,
+      // so that the output order is the same as the input order.
+      std::deque<PendingUtterance*> pending_utts;
+
+      for (bool input_done = false; !input_done || !pending_utts.empty(); ) {
+        if (!feature_reader.Done()) {
+          std::string utt = feature_reader.Key();
+          const Matrix<BaseFloat> &features (feature_reader.Value());
+          const Matrix<BaseFloat> *online_ivectors = NULL;
+          const Vector<BaseFloat> *ivector = NULL;
+          bool ok = true;
+          if (features.NumRows() == 0) {
+            KALDI_WARN << "Zero-length utterance: " << utt;
+            ok = false;
+          }
+          if (ok && !ivector_rspecifier.empty()) {
+            if (!ivector_reader.HasKey(utt)) {
+              KALDI_WARN << "No iVector available for utterance " << utt;
+              ok = false;
+            } else {
+              ivector = &ivector_reader.Value(utt);
+            }
+          }
+          if (ok && !online_ivector_rspecifier.empty()) {
+            if (!online_ivector_reader.HasKey(utt)) {
+              KALDI_WARN << "No online iVector available for utterance " << utt;
+              ok = false;
+            } else {
+              online_ivectors = &online_ivector_reader.Value(utt);
+            }
+          }
+          if (ok) {
+            PendingUtterance *pending = new PendingUtterance;
+            pending->utt = utt;
+            computer.SplitUtteranceIntoTasks(features, ivector,
+                                             online_ivectors,
+                                             online_ivector_period,
+                                             &(pending->tasks));
+            for (size_t i = 0; i < pending->tasks.size(); i++)
+              computer.AcceptTask(&(pending->tasks[i]));
+            pending_utts.push_back(pending);
+          } else {
+            num_fail++;
+          }
+          feature_reader.Next();
+        } else {
+          input_done = true;
+        }
+
+        while (computer.FullMinibatchReady())
+          computer.Compute(false);
+        // If too many utterances are waiting, or we have reached the end of
+        // the input, compute partial minibatches so that the oldest utterance
+        // can be completed.
+        while ((input_done ||
+                static_cast<int32>(pending_utts.size()) >
+                batch_opts.max_pending_utterances) &&
+               !pending_utts.empty() && !pending_utts.front()->IsComputed()) {
+          if (!computer.Compute(true))
+            KALDI_ERR << "Nothing to compute, but utterance is incomplete "
+                      << "(code error)";
+        }
+
+        while (!pending_utts.empty() && pending_utts.front()->IsComputed()) {
+          PendingUtterance *pending = pending_utts.front();
+          pending_utts.pop_front();
+          Matrix<BaseFloat> *likes = new Matrix<BaseFloat>();
+          NnetBatchComputer::MergeTaskOutput(pending->tasks, likes);
+          std::string utt = pending->utt;
+          delete pending;
+
+          LatticeFasterDecoder *decoder =
+              new LatticeFasterDecoder(*decode_fst, config);
+
+          // The acoustic scale has already been applied by the
+          // NnetBatchComputer; the decodable takes ownership of 'likes'.
+          DecodableInterface *decodable =
+              new DecodableMatrixScaledMapped(trans_model, 1.0, likes);
+
+          DecodeUtteranceLatticeFasterClass *task =
+              new DecodeUtteranceLatticeFasterClass(
+                  decoder, decodable, // takes ownership of these two.
+                  trans_model, word_syms, utt, batch_opts.acoustic_scale,
+                  determinize, allow_partial, &alignment_writer, &words_writer,
+                  &compact_lattice_writer, &lattice_writer,
+                  &tot_like, &frame_count, &num_success, &num_fail, NULL,
+                  stats_writer_ptr);
+
+          sequencer.Run(task); // takes ownership of "task",
+                               // and will delete it when done.
+        }
+      }
+      KALDI_ASSERT(computer.NumTasksPending() == 0);
+    }
+    sequencer.Wait(); // Waits for all tasks to be done.
+    delete decode_fst;
+
+    kaldi::int64 input_frame_count =
+        frame_count * batch_opts.frame_subsampling_factor;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken " << elapsed
+              << "s: real-time factor assuming 100 feature frames/sec is "
+              << (elapsed * 100.0 / input_frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is "
+              << (tot_like / frame_count) << " over "
+              << frame_count << " frames.";
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().PrintProfile();
+#endif
+    stats_writer.Close();
+    delete word_syms;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,284 @@
+// nnet3bin/nnet3-latgen-faster-lookahead.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "fstext/lookahead-compose-fst.h"
+#include "lm/const-arpa-lm.h"
+#include "decoder/decoder-wrappers.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-utils.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    using fst::Fst;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Generate lattices using nnet3 neural net model, composing the\n"
+        "decoding graph HCL with the grammar G on the fly instead of using a\n"
+        "precompiled HCLG.  HCL must have words (not disambiguation symbols) as\n"
+        "its output labels, e.g. it may be made like HCLG but from L.fst\n"
+        "instead of L_disambig.fst and without G; G may be an FST (which will\n"
+        "be projected on its output, so it need not have its disambiguation\n"
+        "symbols removed) or, with --use-const-arpa=true, a language model in\n"
+        "const-arpa format as created by arpa-to-const-arpa.  The composed\n"
+        "states are cached and shared between utterances.\n"
+        "Usage: nnet3-latgen-faster-lookahead [options] <nnet-in> <hcl-fst-in>"
+        " <g-in> <features-rspecifier> <lattice-wspecifier>"
+        " [ <words-wspecifier> [<alignments-wspecifier>] ]\n"
+        "e.g.: nnet3-latgen-faster-lookahead --use-const-arpa=true final.mdl \\\n"
+        "   HCL.fst G.carpa ark:feats.ark ark:lat.ark\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false;
+    bool use_const_arpa = false;
+    int32 max_cached_arcs = 10000000;
+    LatticeFasterDecoderConfig config;
+    DecoderStatsOptions stats_opts;
+    NnetSimpleComputationOptions decodable_opts;
+
+    std::string word_syms_filename;
+    std::string ivector_rspecifier,
+        online_ivector_rspecifier,
+        utt2spk_rspecifier;
+    int32 online_ivector_period = 0;
+    config.Register(&po);
+    stats_opts.Register(&po);
+    decodable_opts.Register(&po);
+    po.Register("word-symbol-table", &word_syms_filename,
+                "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial,
+                "If true, produce output even if end state was not reached.");
+    po.Register("use-const-arpa", &use_const_arpa, "If true, <g-in> is "
+                "expected to be in const-arpa format; if false it's expected "
+                "to be in FST format.");
+    po.Register("max-cached-arcs", &max_cached_arcs, "The cache of composed "
+                "states is cleared before an utterance if it has more than "
+                "this many arcs (about 16 bytes each).");
+    po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
+                "iVectors as vectors (i.e. not estimated online); per utterance "
+                "by default, or per speaker if you provide the --utt2spk option.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "Rspecifier for "
+                "utt2spk option used to get ivectors per speaker");
+    po.Register("online-ivectors", &online_ivector_rspecifier, "Rspecifier for "
+                "iVectors estimated online, as matrices.  If you supply this,"
+                " you must set the --online-ivector-period option.");
+    po.Register("online-ivector-period", &online_ivector_period, "Number of frames "
+                "between iVectors in matrices supplied to the --online-ivectors "
+                "option");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 5 || po.NumArgs() > 7) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (config.num_emitting_threads != 1)
+      KALDI_ERR << "--num-emitting-threads must be 1 with on-the-fly "
+                << "composition, since the composed FST is not thread-safe.";
+    KALDI_ASSERT(max_cached_arcs >= 0);
+
+    std::string model_in_filename = po.GetArg(1),
+        hcl_in_filename = po.GetArg(2),
+        g_in_filename = po.GetArg(3),
+        feature_rspecifier = po.GetArg(4),
+        lattice_wspecifier = po.GetArg(5),
+        words_wspecifier = po.GetOptArg(6),
+        alignment_wspecifier = po.GetOptArg(7);
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    RandomAccessBaseFloatMatrixReader online_ivector_reader(
+        online_ivector_rspecifier);
+    RandomAccessBaseFloatVectorReaderMapped ivector_reader(
+        ivector_rspecifier, utt2spk_rspecifier);
+
+    Int32VectorWriter words_writer(words_wspecifier);
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+    DecoderStatsWriter stats_writer(stats_opts);
+    DecoderStatsWriter *stats_writer_ptr =
+        (stats_writer.IsOpen() ? &stats_writer : NULL);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    Fst<StdArc> *hcl = fst::ReadFstKaldiGeneric(hcl_in_filename);
+
+    // The grammar, and the lookahead costs of the words, which are the
+    // unigram costs for a const-arpa LM and otherwise the costs from the
+    // start state of G.
+    VectorFst<StdArc> *g_fst = NULL;
+    ConstArpaLm const_arpa;
+    fst::DeterministicOnDemandFst<StdArc> *g = NULL;
+    std::vector<float> unigram_costs;
+    if (use_const_arpa) {
+      ReadConstArpaLm(g_in_filename, &const_arpa);
+      g = new ConstArpaLmDeterministicFst(const_arpa);
+      int32 max_word = 0;
+      for (fst::StateIterator<Fst<StdArc> > siter(*hcl); !siter.Done();
+           siter.Next())
+        for (fst::ArcIterator<Fst<StdArc> > aiter(*hcl, siter.Value());
+             !aiter.Done(); aiter.Next())
+          max_word = std::max(max_word, aiter.Value().olabel);
+      unigram_costs.resize(max_word + 1, 0.0);
+      std::vector<int32> no_history;
+      for (size_t word = 1; word < unigram_costs.size(); word++) {
+        float logprob = const_arpa.GetNgramLogprob(word, no_history);
+        // ConstArpaLm returns this for words it can't score.
+        unigram_costs[word] = (logprob == std::numeric_limits<float>::min() ?
+                               std::numeric_limits<float>::infinity() :
+                               -logprob);
+      }
+    } else {
+      g_fst = fst::ReadAndPrepareLmFst(g_in_filename);
+      g = new fst::BackoffDeterministicOnDemandFst<StdArc>(*g_fst);
+    }
+
+    Timer init_timer;
+    fst::LookaheadComposeFst<StdArc> hclg(
+        *hcl, g, (use_const_arpa ? &unigram_costs : NULL), max_cached_arcs);
+    KALDI_LOG << "Computed the lookahead potentials for "
+              << fst::CountStates(*hcl) << " states of HCL in "
+              << init_timer.Elapsed() << " seconds.";
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+    // this compiler object allows caching of computations across
+    // different utterances.
+    CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
+                                       decodable_opts.optimize_config,
+                                       decodable_opts.compiler_config);
+    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    timer.Reset();
+
+    {
+      LatticeFasterDecoder decoder(hclg, config);
+
+      for (; !feature_reader.Done(); feature_reader.Next()) {
+        std::string utt = feature_reader.Key();
+        const Matrix<BaseFloat> &features (feature_reader.Value());
+        if (features.NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_fail++;
+          continue;
+        }
+        const Matrix<BaseFloat> *online_ivectors = NULL;
+        const Vector<BaseFloat> *ivector = NULL;
+        if (!ivector_rspecifier.empty()) {
+          if (!ivector_reader.HasKey(utt)) {
+            KALDI_WARN << "No iVector available for utterance " << utt;
+            num_fail++;
+            continue;
+          } else {
+            ivector = &ivector_reader.Value(utt);
+          }
+        }
+        if (!online_ivector_rspecifier.empty()) {
+          if (!online_ivector_reader.HasKey(utt)) {
+            KALDI_WARN << "No online iVector available for utterance " << utt;
+            num_fail++;
+            continue;
+          } else {
+            online_ivectors = &online_ivector_reader.Value(utt);
+          }
+        }
+
+        DecodableAmNnetSimple nnet_decodable(
+            decodable_opts, trans_model, am_nnet,
+            features, ivector, online_ivectors,
+            online_ivector_period, &compiler);
+
+        // The decoder doesn't hold on to any state ids between utterances, so
+        // this is the time to free memory if the cache has got too large.
+        hclg.TrimCache();
+
+        double like;
+        if (DecodeUtteranceLatticeFaster(
+                decoder, nnet_decodable, trans_model, word_syms, utt,
+                decodable_opts.acoustic_scale, determinize, allow_partial,
+                &alignment_writer, &words_writer, &compact_lattice_writer,
+                &lattice_writer,
+                &like, stats_writer_ptr)) {
+          tot_like += like;
+          frame_count += nnet_decodable.NumFramesReady();
+          num_success++;
+        } else num_fail++;
+        KALDI_VLOG(1) << "The cache of composed states has "
+                      << hclg.NumStatesCreated() << " states and "
+                      << hclg.NumCachedArcs() << " arcs.";
+      }
+    }
+
+    kaldi::int64 input_frame_count =
+        frame_count * decodable_opts.frame_subsampling_factor;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed * 100.0 / input_frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is "
+              << (tot_like / frame_count) << " over "
+              << frame_count << " frames.";
+
+    stats_writer.Close();
+    delete g;
+    delete g_fst;
+    delete hcl;
+    delete word_syms;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -53,6 +53,7 @@ int main(int argc, char *argv[]) {
     Timer timer;
     bool allow_partial = false;
     LatticeFasterDecoderConfig config;
+    DecoderStatsOptions stats_opts;
     NnetSimpleLoopedComputationOptions decodable_opts;
 
     std::string word_syms_filename;
@@ -61,6 +62,7 @@ int main(int argc, char *argv[]) {
         utt2spk_rspecifier;
     int32 online_ivector_period = 0;
     config.Register(&po);
+    stats_opts.Register(&po);
     decodable_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
@@ -117,6 +119,9 @@ int main(int argc, char *argv[]) {
 
     Int32VectorWriter words_writer(words_wspecifier);
     Int32VectorWriter alignment_writer(alignment_wspecifier);
+    DecoderStatsWriter stats_writer(stats_opts);
+    DecoderStatsWriter *stats_writer_ptr =
+        (stats_writer.IsOpen() ? &stats_writer : NULL);
 
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_filename != "")
@@ -185,7 +190,7 @@ int main(int argc, char *argv[]) {
                   decodable_opts.acoustic_scale, determinize, allow_partial,
                   &alignment_writer, &words_writer, &compact_lattice_writer,
                   &lattice_writer,
-                  &like)) {
+                  &like, stats_writer_ptr)) {
             tot_like += like;
             frame_count += nnet_decodable.NumFramesReady();
             num_success++;
@@ -243,7 +248,7 @@ int main(int argc, char *argv[]) {
                 decoder, nnet_decodable, trans_model, word_syms, utt,
                 decodable_opts.acoustic_scale, determinize, allow_partial,
                 &alignment_writer, &words_writer, &compact_lattice_writer,
-                &lattice_writer, &like)) {
+                &lattice_writer, &like, stats_writer_ptr)) {
           tot_like += like;
           frame_count += nnet_decodable.NumFramesReady();
           num_success++;
@@ -264,6 +269,7 @@ int main(int argc, char *argv[]) {
               << (tot_like / frame_count) << " over "
               << frame_count <<" frames.";
 
+    stats_writer.Close();
     delete word_syms;
     if (num_success != 0) return 0;
     else return 1;
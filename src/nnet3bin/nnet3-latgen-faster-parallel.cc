@@ -54,6 +54,7 @@ int main(int argc, char *argv[]) {
     bool allow_partial = false;
     TaskSequencerConfig sequencer_config; // has --num-threads option
     LatticeFasterDecoderConfig config;
+    DecoderStatsOptions stats_opts;
     NnetSimpleComputationOptions decodable_opts;
 
     std::string word_syms_filename;
@@ -63,6 +64,7 @@ int main(int argc, char *argv[]) {
     int32 online_ivector_period = 0;
     sequencer_config.Register(&po);
     config.Register(&po);
+    stats_opts.Register(&po);
     decodable_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
@@ -120,6 +122,9 @@ int main(int argc, char *argv[]) {
 
     Int32VectorWriter words_writer(words_wspecifier);
     Int32VectorWriter alignment_writer(alignment_wspecifier);
+    DecoderStatsWriter stats_writer(stats_opts);
+    DecoderStatsWriter *stats_writer_ptr =
+        (stats_writer.IsOpen() ? &stats_writer : NULL);
 
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_filename != "")
@@ -183,7 +188,8 @@ int main(int argc, char *argv[]) {
                   trans_model, word_syms, utt, decodable_opts.acoustic_scale,
                   determinize, allow_partial, &alignment_writer, &words_writer,
                    &compact_lattice_writer, &lattice_writer,
-                   &tot_like, &frame_count, &num_success, &num_fail, NULL);
+                   &tot_like, &frame_count, &num_success, &num_fail, NULL,
+                   stats_writer_ptr);
 
           sequencer.Run(task); // takes ownership of "task",
                                // and will delete it when done.
@@ -247,7 +253,8 @@ int main(int argc, char *argv[]) {
                 trans_model, word_syms, utt, decodable_opts.acoustic_scale,
                 determinize, allow_partial, &alignment_writer, &words_writer,
                 &compact_lattice_writer, &lattice_writer,
-                &tot_like, &frame_count, &num_success, &num_fail, NULL);
+                &tot_like, &frame_count, &num_success, &num_fail, NULL,
+                stats_writer_ptr);
 
         sequencer.Run(task); // takes ownership of "task",
         // and will delete it when done.
@@ -269,6 +276,7 @@ int main(int argc, char *argv[]) {
               << (tot_like / frame_count) << " over "
               << frame_count << " frames.";
 
+    stats_writer.Close();
     delete word_syms;
     if (num_success != 0) return 0;
     else return 1;
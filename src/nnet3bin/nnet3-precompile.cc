@@ -0,0 +1,152 @@
+// nnet3bin/nnet3-precompile.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "base/timer.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/decodable-simple-looped.h"
+#include "nnet3/nnet-utils.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Compile ahead of time the nnet3 computations that decoding with a\n"
+        "model will need, and write them to a file that can be given to the\n"
+        "decoding programs with the --precompiled-computations option, so that\n"
+        "they don't have to compile them on first use.  The options must match\n"
+        "those used for decoding (--frames-per-chunk, --extra-left-context,\n"
+        "--frame-subsampling-factor, the --optimization.* options, and so on);\n"
+        "computations that don't match the model or the options are ignored\n"
+        "by the decoders.  The model is put in test mode (batchnorm, dropout)\n"
+        "and collapsed first, as the decoding programs would do.\n"
+        "By default this compiles the computations used by nnet3-latgen-faster\n"
+        "and similar programs for chunks of every possible size; with\n"
+        "--looped=true it compiles the looped computation used by\n"
+        "nnet3-latgen-faster-looped and the online decoders (for which only\n"
+        "--frames-per-chunk, --frame-subsampling-factor,\n"
+        "--extra-left-context-initial and the --optimization.* options are\n"
+        "relevant).  --frames-per-chunk defaults to the value those programs\n"
+        "use: 50, or 20 with --looped=true.\n"
+        "\n"
+        "Usage:  nnet3-precompile [options] <nnet-in> <computations-out>\n"
+        "e.g.:\n"
+        " nnet3-precompile --frames-per-chunk=150 --extra-left-context=40 \\\n"
+        "   final.mdl final.mdl.computations\n"
+        " nnet3-precompile --looped=true --frame-subsampling-factor=3 \\\n"
+        "   final.mdl final.mdl.looped_computations\n";
+
+    bool binary_write = true,
+        raw = false,
+        looped = false;
+    NnetSimpleComputationOptions opts;
+    // The default depends on --looped; see below.
+    opts.frames_per_chunk = -1;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("raw", &raw, "If true, read a 'raw' neural net rather than an "
+                "acoustic model (with transition model and priors).");
+    po.Register("looped", &looped, "If true, compile the looped computation "
+                "used by nnet3-latgen-faster-looped and the online decoders, "
+                "instead of the computations used by nnet3-latgen-faster.");
+    opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        computations_wxfilename = po.GetArg(2);
+
+    NnetSimpleLoopedComputationOptions looped_opts;
+    if (opts.frames_per_chunk == -1)
+      opts.frames_per_chunk = (looped ? looped_opts.frames_per_chunk :
+                               NnetSimpleComputationOptions().frames_per_chunk);
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    Nnet raw_nnet;
+    if (raw) {
+      ReadKaldiObject(nnet_rxfilename, &raw_nnet);
+    } else {
+      bool binary;
+      Input ki(nnet_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+    }
+    Nnet &nnet = (raw ? raw_nnet : am_nnet.GetNnet());
+    SetBatchnormTestMode(true, &nnet);
+    SetDropoutTestMode(true, &nnet);
+    CollapseModel(CollapseModelConfig(), &nnet);
+
+    Timer timer;
+    PrecompiledComputations computations(opts.optimize_config);
+    if (!looped) {
+      std::vector<ComputationRequest> requests;
+      GetSimpleComputationRequests(opts, nnet, &requests);
+      CachingOptimizingCompilerOptions compiler_config(opts.compiler_config);
+      compiler_config.precompiled_computations = "";
+      CachingOptimizingCompiler compiler(nnet, opts.optimize_config,
+                                         compiler_config);
+      uint64 nnet_hash = NnetStructureHash(nnet);
+      for (size_t i = 0; i < requests.size(); i++) {
+        std::shared_ptr<const NnetComputation> computation =
+            compiler.Compile(requests[i]);
+        computations.Add(nnet_hash,
+                         std::vector<ComputationRequest>(1, requests[i]),
+                         *computation);
+      }
+    } else {
+      looped_opts.frames_per_chunk = opts.frames_per_chunk;
+      looped_opts.frame_subsampling_factor = opts.frame_subsampling_factor;
+      looped_opts.extra_left_context_initial =
+          std::max<int32>(0, opts.extra_left_context_initial);
+      looped_opts.optimize_config = opts.optimize_config;
+      // This may modify 'nnet' to take iVectors at intervals, as the decoders
+      // do, so we hash it afterwards.
+      DecodableNnetSimpleLoopedInfo info(looped_opts, &nnet);
+      std::vector<ComputationRequest> requests;
+      requests.push_back(info.request1);
+      requests.push_back(info.request2);
+      requests.push_back(info.request3);
+      computations.Add(NnetStructureHash(nnet), requests, info.computation);
+    }
+    KALDI_LOG << "Compiled " << computations.NumComputations()
+              << " computations in " << timer.Elapsed() << " seconds.";
+
+    WriteKaldiObject(computations, computations_wxfilename, binary_write);
+    KALDI_LOG << "Wrote precompiled computations to "
+              << computations_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -0,0 +1,236 @@
+// nnet3bin/nnet3-quantize.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "base/timer.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-utils.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Convert the affine and linear components of an nnet3 model to\n"
+        "QuantizedAffineComponent, which stores the parameters as 8-bit\n"
+        "integers and is faster for decoding on CPU.  The model is put in\n"
+        "test mode (batchnorm, dropout) and collapsed first, as the decoding\n"
+        "programs would do.  The resulting model cannot be trained.\n"
+        "If --test-feats is given, the original and the quantized model are\n"
+        "both run on those features and the time taken and the agreement\n"
+        "of the outputs is reported; to measure the effect on WER, decode\n"
+        "with both models.\n"
+        "\n"
+        "Usage:  nnet3-quantize [options] <nnet-in> <nnet-out>\n"
+        "e.g.:\n"
+        " nnet3-quantize final.mdl final_quantized.mdl\n"
+        " nnet3-quantize --raw=true final.raw final_quantized.raw\n"
+        " nnet3-quantize --test-feats=scp:data/dev/feats.scp \\\n"
+        "   --online-ivectors=scp:exp/ivectors_dev/ivector_online.scp \\\n"
+        "   --online-ivector-period=10 final.mdl final_quantized.mdl\n";
+
+    bool binary_write = true,
+        raw = false;
+    std::string component_names = "*";
+    std::string test_feats_rspecifier,
+        ivector_rspecifier,
+        online_ivector_rspecifier,
+        utt2spk_rspecifier;
+    int32 online_ivector_period = 0;
+    NnetSimpleComputationOptions opts;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("raw", &raw, "If true, read and write a 'raw' neural net "
+                "rather than an acoustic model (with transition model and "
+                "priors).");
+    po.Register("component-names", &component_names, "Pattern (as for "
+                "nnet3-copy --edits) for the names of the components to "
+                "quantize, e.g. 'tdnn*'; the default is all suitable "
+                "components.");
+    po.Register("test-feats", &test_feats_rspecifier, "If supplied, "
+                "features on which to compare the speed and the output of "
+                "the original and quantized models.");
+    po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
+                "iVectors as vectors (i.e. not estimated online) for "
+                "--test-feats; per utterance by default, or per speaker if "
+                "you provide the --utt2spk option.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "Rspecifier for "
+                "utt2spk option used to get ivectors per speaker");
+    po.Register("online-ivectors", &online_ivector_rspecifier, "Rspecifier "
+                "for iVectors estimated online, as matrices, for "
+                "--test-feats.  If you supply this, you must set the "
+                "--online-ivector-period option.");
+    po.Register("online-ivector-period", &online_ivector_period, "Number of "
+                "frames between iVectors in matrices supplied to the "
+                "--online-ivectors option");
+    opts.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        nnet_wxfilename = po.GetArg(2);
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    Nnet raw_nnet;
+    if (raw) {
+      ReadKaldiObject(nnet_rxfilename, &raw_nnet);
+    } else {
+      bool binary;
+      Input ki(nnet_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+    }
+    Nnet &nnet = (raw ? raw_nnet : am_nnet.GetNnet());
+    SetBatchnormTestMode(true, &nnet);
+    SetDropoutTestMode(true, &nnet);
+    CollapseModel(CollapseModelConfig(), &nnet);
+
+    Nnet float_nnet(nnet);
+    int32 num_quantized = QuantizeAffineComponents(component_names, &nnet);
+    KALDI_LOG << "Quantized " << num_quantized << " components.";
+    if (num_quantized == 0)
+      KALDI_WARN << "No components were quantized; check --component-names.";
+
+    if (!test_feats_rspecifier.empty()) {
+      Vector<BaseFloat> priors;
+      if (!raw)
+        priors = am_nnet.Priors();
+      SequentialBaseFloatMatrixReader feature_reader(test_feats_rspecifier);
+      RandomAccessBaseFloatMatrixReader online_ivector_reader(
+          online_ivector_rspecifier);
+      RandomAccessBaseFloatVectorReaderMapped ivector_reader(
+          ivector_rspecifier, utt2spk_rspecifier);
+      CachingOptimizingCompiler float_compiler(float_nnet,
+                                               opts.optimize_config),
+          quantized_compiler(nnet, opts.optimize_config);
+
+      double float_time = 0.0, quantized_time = 0.0,
+          tot_sqdiff = 0.0, tot_sq = 0.0;
+      int64 num_frames = 0, num_frames_timed = 0, num_agree = 0;
+      int32 num_done = 0, num_err = 0;
+      for (; !feature_reader.Done(); feature_reader.Next()) {
+        std::string utt = feature_reader.Key();
+        const Matrix<BaseFloat> &features = feature_reader.Value();
+        const Matrix<BaseFloat> *online_ivectors = NULL;
+        const Vector<BaseFloat> *ivector = NULL;
+        if (!ivector_rspecifier.empty()) {
+          if (!ivector_reader.HasKey(utt)) {
+            KALDI_WARN << "No iVector available for utterance " << utt;
+            num_err++;
+            continue;
+          }
+          ivector = &ivector_reader.Value(utt);
+        }
+        if (!online_ivector_rspecifier.empty()) {
+          if (!online_ivector_reader.HasKey(utt)) {
+            KALDI_WARN << "No online iVector available for utterance " << utt;
+            num_err++;
+            continue;
+          }
+          online_ivectors = &online_ivector_reader.Value(utt);
+        }
+        if (features.NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << utt;
+          num_err++;
+          continue;
+        }
+
+        Matrix<BaseFloat> output[2];
+        double elapsed[2];
+        for (int32 i = 0; i < 2; i++) {
+          Timer timer;
+          DecodableNnetSimple decodable(
+              opts, (i == 0 ? float_nnet : nnet), priors, features,
+              (i == 0 ? &float_compiler : &quantized_compiler),
+              ivector, online_ivectors, online_ivector_period);
+          output[i].Resize(decodable.NumFrames(), decodable.OutputDim(),
+                           kUndefined);
+          for (int32 t = 0; t < decodable.NumFrames(); t++) {
+            SubVector<BaseFloat> row(output[i], t);
+            decodable.GetOutputForFrame(t, &row);
+          }
+          elapsed[i] = timer.Elapsed();
+        }
+        // Don't time the first utterance, as it includes the compilation.
+        if (num_done > 0) {
+          float_time += elapsed[0];
+          quantized_time += elapsed[1];
+          num_frames_timed += output[0].NumRows();
+        }
+        for (int32 t = 0; t < output[0].NumRows(); t++) {
+          SubVector<BaseFloat> float_row(output[0], t),
+              quantized_row(output[1], t);
+          int32 float_best, quantized_best;
+          float_row.Max(&float_best);
+          quantized_row.Max(&quantized_best);
+          if (float_best == quantized_best)
+            num_agree++;
+        }
+        tot_sq += TraceMatMat(output[0], output[0], kTrans);
+        output[1].AddMat(-1.0, output[0]);
+        tot_sqdiff += TraceMatMat(output[1], output[1], kTrans);
+        num_frames += output[0].NumRows();
+        num_done++;
+      }
+      KALDI_LOG << "Compared outputs for " << num_done << " utterances ("
+                << num_frames << " frames), errors on " << num_err;
+      if (num_frames > 0) {
+        KALDI_LOG << "Relative difference of quantized output is "
+                  << std::sqrt(tot_sqdiff / tot_sq) << "; the best-scoring "
+                  << "output agrees on " << (100.0 * num_agree / num_frames)
+                  << "% of frames.";
+      }
+      if (num_frames_timed > 0) {
+        KALDI_LOG << "Real-time factor assuming 100 frames/sec is "
+                  << (float_time * 100.0 / num_frames_timed)
+                  << " for the original model and "
+                  << (quantized_time * 100.0 / num_frames_timed)
+                  << " for the quantized model, a speedup of "
+                  << (float_time / quantized_time);
+      }
+    }
+
+    if (raw) {
+      WriteKaldiObject(nnet, nnet_wxfilename, binary_write);
+    } else {
+      Output ko(nnet_wxfilename, binary_write);
+      trans_model.Write(ko.Stream(), binary_write);
+      am_nnet.Write(ko.Stream(), binary_write);
+    }
+    KALDI_LOG << "Wrote quantized model to " << nnet_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
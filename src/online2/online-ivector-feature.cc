@@ -414,7 +414,11 @@ void OnlineSilenceWeighting::ComputeCurrentTraceback(
   bool use_final_probs = false;
   LatticeFasterOnlineDecoder::BestPathIterator iter =
       decoder.BestPathEnd(use_final_probs, NULL);
-  while (frame >= 0) {
+  // If the decoder has frozen part of the lattice (see
+  // GetFrozenRawLattice()), the traceback stops at the frozen frame; the
+  // best path before that can no longer change.
+  int32 first_frame = decoder.NumFramesFrozen();
+  while (frame >= first_frame) {
     LatticeArc arc;
     arc.ilabel = 0;
     while (arc.ilabel == 0)  // the while loop skips over input-epsilons
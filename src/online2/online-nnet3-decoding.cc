@@ -35,7 +35,9 @@ SingleUtteranceNnet3Decoder::SingleUtteranceNnet3Decoder(
     trans_model_(trans_model),
     decodable_(trans_model_, info,
                features->InputFeature(), features->IvectorFeature()),
-    decoder_(fst, decoder_opts_) {
+    decoder_(fst, decoder_opts_),
+    determinizer_(trans_model_, decoder_opts_.lattice_beam,
+                  decoder_opts_.det_opts) {
   decoder_.InitDecoding();
 }
 
@@ -55,15 +57,76 @@ void SingleUtteranceNnet3Decoder::GetLattice(bool end_of_utterance,
                                              CompactLattice *clat) const {
   if (NumFramesDecoded() == 0)
     KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
+  if (!decoder_opts_.determinize_lattice)
+    KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
+
+  if (NumFramesDeterminized() > 0) {
+    // Add the rest of the lattice to a copy of what we have determinized so
+    // far, so that we can carry on decoding afterwards.
+    Lattice raw_chunk;
+    std::vector<LatticeArc::StateId> initial_states;
+    if (!decoder_.GetLastRawLatticeChunk(end_of_utterance, &raw_chunk,
+                                         &initial_states)) {
+      // The lattice determinized so far has no final-states, so there is
+      // nothing useful we can output.
+      KALDI_WARN << "Failed to get the last raw lattice chunk; outputting an "
+                 << "empty lattice.";
+      clat->DeleteStates();
+      return;
+    }
+    LatticeIncrementalDeterminizer determinizer(determinizer_);
+    if (!determinizer.AcceptRawLatticeChunk(
+            &raw_chunk, initial_states, std::vector<LatticeArc::StateId>()))
+      KALDI_WARN << "Determinization of the last lattice chunk hit its memory "
+                 << "limit; it was determinized with a smaller beam.";
+    determinizer.GetLattice(clat);
+    return;
+  }
   Lattice raw_lat;
   decoder_.GetRawLattice(&raw_lat, end_of_utterance);
 
+  BaseFloat lat_beam = decoder_opts_.lattice_beam;
+  DeterminizeLatticePhonePrunedWrapper(
+      trans_model_, &raw_lat, lat_beam, clat, decoder_opts_.det_opts);
+}
+
+bool SingleUtteranceNnet3Decoder::GetFrozenLattice(int32 max_num_frames,
+                                                   CompactLattice *clat) {
   if (!decoder_opts_.determinize_lattice)
     KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
-
+  Lattice raw_lat;
+  if (!decoder_.GetFrozenRawLattice(max_num_frames, &raw_lat))
+    return false;
   BaseFloat lat_beam = decoder_opts_.lattice_beam;
   DeterminizeLatticePhonePrunedWrapper(
       trans_model_, &raw_lat, lat_beam, clat, decoder_opts_.det_opts);
+  return true;
+}
+
+int32 SingleUtteranceNnet3Decoder::NumFramesFrozen() const {
+  return decoder_.NumFramesFrozen();
+}
+
+bool SingleUtteranceNnet3Decoder::DeterminizeLatticeChunk(int32 end_frame) {
+  if (!decoder_opts_.determinize_lattice)
+    KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
+  Lattice raw_chunk;
+  std::vector<LatticeArc::StateId> initial_states, final_states;
+  if (!decoder_.GetRawLatticeChunk(end_frame, &raw_chunk, &initial_states,
+                                   &final_states))
+    return false;
+  if (!determinizer_.AcceptRawLatticeChunk(&raw_chunk, initial_states,
+                                           final_states)) {
+    KALDI_WARN << "Determinization of the lattice chunk up to frame "
+               << end_frame << " hit its memory limit; it was determinized "
+               << "with a smaller beam.";
+    return false;
+  }
+  return true;
+}
+
+int32 SingleUtteranceNnet3Decoder::NumFramesDeterminized() const {
+  return decoder_.NumFramesInRawLatticeChunks();
 }
 
 void SingleUtteranceNnet3Decoder::GetBestPath(bool end_of_utterance,
@@ -34,6 +34,7 @@
 #include "online2/online-endpoint.h"
 #include "online2/online-nnet2-feature-pipeline.h"
 #include "decoder/lattice-faster-online-decoder.h"
+#include "lat/determinize-lattice-incremental.h"
 #include "hmm/transition-model.h"
 #include "hmm/posterior.h"
 
@@ -75,6 +76,39 @@ class SingleUtteranceNnet3Decoder {
   void GetLattice(bool end_of_utterance,
                   CompactLattice *clat) const;
 
+  /// This is for streaming lattice output from long utterances: it outputs
+  /// the determinized lattice for the part of the utterance up to the latest
+  /// frame (not after frame max_num_frames) where the best path can no longer
+  /// change, and frees the decoder's tokens for that part; see
+  /// LatticeFasterOnlineDecoder::GetFrozenRawLattice() for details.  Returns
+  /// false if there was no such frame.  The lattices it outputs, followed by
+  /// the one from GetLattice() at the end of the utterance, cover the whole
+  /// utterance.  Like GetLattice(), the output has the acoustic scaling in it.
+  bool GetFrozenLattice(int32 max_num_frames, CompactLattice *clat);
+
+  /// Returns the number of frames covered by the lattices that
+  /// GetFrozenLattice() has output so far.
+  int32 NumFramesFrozen() const;
+
+  /// This is for determinizing the lattice incrementally as we decode, so
+  /// that GetLattice() at the end of the utterance only has to determinize
+  /// the frames after the last call to this (see class
+  /// LatticeIncrementalDeterminizer).  It determinizes the raw lattice up to
+  /// frame end_frame, where NumFramesDeterminized() < end_frame <=
+  /// NumFramesDecoded(); it is best to stay some way behind the decoder (say,
+  /// by a second or so), since the tokens on the last few frames are the ones
+  /// that will mostly be pruned away.  Returns false if there was a problem
+  /// getting the raw lattice (e.g. no tokens survived on some frame), in
+  /// which case nothing is determinized, or if the determinization hit its
+  /// memory limit (see LatticeIncrementalDeterminizer::AcceptRawLatticeChunk()),
+  /// in which case the chunk was still added.  You cannot use this together
+  /// with GetFrozenLattice().
+  bool DeterminizeLatticeChunk(int32 end_frame);
+
+  /// Returns the number of frames determinized by DeterminizeLatticeChunk()
+  /// so far.
+  int32 NumFramesDeterminized() const;
+
   /// Outputs an FST corresponding to the single best path through the current
   /// lattice. If "use_final_probs" is true AND we reached the final-state of
   /// the graph then it will include those as final-probs, else it will treat
@@ -89,6 +123,10 @@ class SingleUtteranceNnet3Decoder {
 
   const LatticeFasterOnlineDecoder &Decoder() const { return decoder_; }
 
+  /// Makes the decoder add per-frame statistics for this utterance to
+  /// 'stats' (see decoder/decoder-stats.h); NULL to stop.
+  void SetDecoderStats(DecoderStats *stats) { decoder_.SetStats(stats); }
+
   ~SingleUtteranceNnet3Decoder() { }
  private:
 
@@ -106,6 +144,8 @@ class SingleUtteranceNnet3Decoder {
 
   LatticeFasterOnlineDecoder decoder_;
 
+  // The lattice determinized so far by DeterminizeLatticeChunk().
+  LatticeIncrementalDeterminizer determinizer_;
 };
 
 
@@ -103,10 +103,13 @@ int main(int argc, char *argv[]) {
     nnet3::NnetSimpleLoopedComputationOptions decodable_opts;
     LatticeFasterDecoderConfig decoder_opts;
     OnlineEndpointConfig endpoint_opts;
+    DecoderStatsOptions stats_opts;
 
     BaseFloat chunk_length_secs = 0.18;
     bool do_endpointing = false;
     bool online = true;
+    int32 lattice_chunk_frames = 0;
+    int32 determinize_chunk_frames = 0;
 
     po.Register("chunk-length", &chunk_length_secs,
                 "Length of chunk size in seconds, that we process.  Set to <= 0 "
@@ -124,6 +127,21 @@ int main(int argc, char *argv[]) {
                 "--use-most-recent-ivector=true and --greedy-ivector-extractor=true "
                 "in the file given to --ivector-extraction-config, and "
                 "--chunk-length=-1.");
+    po.Register("lattice-chunk-frames", &lattice_chunk_frames,
+                "If >0, determinize the lattice in pieces as we decode, "
+                "freeing the decoder's memory for the part of the utterance "
+                "already output, and keeping at least this many (output) "
+                "frames undeterminized; this is for long recordings.  Paths "
+                "through the lattice that cross the boundaries between pieces "
+                "through other than the best path are lost.  If you use "
+                "endpointing, it should be more than the trailing silence "
+                "the endpoint rules look at.");
+    po.Register("determinize-chunk-frames", &determinize_chunk_frames,
+                "If >0, determinize the lattice incrementally as we decode, "
+                "keeping at least this many (output) frames undeterminized, "
+                "so that there is less to do at the end of the utterance. "
+                "Unlike --lattice-chunk-frames, this gives the same lattice "
+                "as determinizing it all at the end (up to pruning).");
     po.Register("num-threads-startup", &g_num_threads,
                 "Number of threads used when initializing iVector extractor.");
 
@@ -131,6 +149,7 @@ int main(int argc, char *argv[]) {
     decodable_opts.Register(&po);
     decoder_opts.Register(&po);
     endpoint_opts.Register(&po);
+    stats_opts.Register(&po);
 
 
     po.Read(argc, argv);
@@ -139,6 +158,9 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       return 1;
     }
+    if (lattice_chunk_frames > 0 && determinize_chunk_frames > 0)
+      KALDI_ERR << "You cannot use both --lattice-chunk-frames and "
+                << "--determinize-chunk-frames.";
 
     std::string nnet3_rxfilename = po.GetArg(1),
         fst_rxfilename = po.GetArg(2),
@@ -188,6 +210,7 @@ int main(int argc, char *argv[]) {
     SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
     RandomAccessTableReader<WaveHolder> wav_reader(wav_rspecifier);
     CompactLatticeWriter clat_writer(clat_wspecifier);
+    DecoderStatsWriter stats_writer(stats_opts);
 
     OnlineTimingStats timing_stats;
 
@@ -219,6 +242,9 @@ int main(int argc, char *argv[]) {
         SingleUtteranceNnet3Decoder decoder(decoder_opts, trans_model,
                                             decodable_info,
                                             *decode_fst, &feature_pipeline);
+        DecoderStats decoder_stats;
+        if (stats_writer.IsOpen())
+          decoder.SetDecoderStats(&decoder_stats);
         OnlineTimer decoding_timer(utt);
 
         BaseFloat samp_freq = wave_data.SampFreq();
@@ -232,6 +258,12 @@ int main(int argc, char *argv[]) {
 
         int32 samp_offset = 0;
         std::vector<std::pair<int32, BaseFloat> > delta_weights;
+        // The lattices for the frozen parts of the utterance, if
+        // --lattice-chunk-frames > 0.
+        std::vector<CompactLattice> clat_chunks;
+        // Set to false if determinizing a chunk fails, after which the rest
+        // of the utterance is determinized at the end.
+        bool determinize_chunks = (determinize_chunk_frames > 0);
 
         while (samp_offset < data.Dim()) {
           int32 samp_remaining = data.Dim() - samp_offset;
@@ -261,12 +293,41 @@ int main(int argc, char *argv[]) {
           if (do_endpointing && decoder.EndpointDetected(endpoint_opts)) {
             break;
           }
+
+          if (lattice_chunk_frames > 0 &&
+              decoder.NumFramesDecoded() - decoder.NumFramesFrozen() >=
+              2 * lattice_chunk_frames) {
+            CompactLattice clat_chunk;
+            if (decoder.GetFrozenLattice(
+                    decoder.NumFramesDecoded() - lattice_chunk_frames,
+                    &clat_chunk))
+              clat_chunks.push_back(clat_chunk);
+          }
+          if (determinize_chunks &&
+              decoder.NumFramesDecoded() - decoder.NumFramesDeterminized() >=
+              2 * determinize_chunk_frames &&
+              !decoder.DeterminizeLatticeChunk(
+                  decoder.NumFramesDecoded() - determinize_chunk_frames)) {
+            KALDI_WARN << "Failed to determinize lattice chunk for utterance "
+                       << utt << "; determinizing the rest at the end.";
+            determinize_chunks = false;
+          }
         }
         decoder.FinalizeDecoding();
+        if (stats_writer.IsOpen())
+          stats_writer.Write(utt, decoder_stats);
 
         CompactLattice clat;
         bool end_of_utterance = true;
         decoder.GetLattice(end_of_utterance, &clat);
+        if (!clat_chunks.empty()) {
+          for (size_t j = 1; j < clat_chunks.size(); j++)
+            fst::Concat(&(clat_chunks[0]), clat_chunks[j]);
+          fst::Concat(&(clat_chunks[0]), clat);
+          clat = clat_chunks[0];
+          KALDI_VLOG(2) << "Output lattice for utterance " << utt << " in "
+                        << (clat_chunks.size() + 1) << " pieces.";
+        }
 
         GetDiagnosticsAndPrintOutput(utt, word_syms, clat,
                                      &num_frames, &tot_like);
@@ -288,6 +349,7 @@ int main(int argc, char *argv[]) {
       }
     }
     timing_stats.Print(online);
+    stats_writer.Close();
 
     KALDI_LOG << "Decoded " << num_done << " utterances, "
               << num_err << " with errors.";
@@ -20,6 +20,7 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <stdexcept>
 #include "base/kaldi-common.h"
 #include "util/kaldi-thread.h"
 
@@ -122,12 +123,87 @@ void TestTaskSequencer() {
     KALDI_ASSERT(task_output[i] == i);
 }
 
+// A stand-in for a sequential table reader, for TestProcessTableInParallel().
+class MyTableReader {
+ public:
+  explicit MyTableReader(int32 num_items): num_items_(num_items), i_(0) { }
+  bool Done() const { return i_ >= num_items_; }
+  std::string Key() const {
+    std::ostringstream os;
+    os << "key" << i_;
+    return os.str();
+  }
+  const int32 &Value() const { return i_; }
+  void FreeCurrent() { }
+  void Next() { i_++; }
+ private:
+  int32 num_items_;
+  int32 i_;
+};
+
+// Squares the integers, and checks that they are written in order.
+class MyTableProcessor {
+ public:
+  typedef int32 Input;
+  typedef int32 Output;
+  MyTableProcessor(): num_written_(0) { }
+
+  void Process(const std::string &key, int32 *input, int32 *output) const {
+    // Take a random amount of time, so that the outputs become ready out of
+    // order.
+    Sleep(1.0e-06 * (Rand() % 100));
+    *output = *input * *input;
+  }
+
+  void Write(const std::string &key, int32 *output) {
+    std::ostringstream os;
+    os << "key" << num_written_;
+    KALDI_ASSERT(key == os.str() && *output == num_written_ * num_written_);
+    num_written_++;
+  }
+
+  int32 NumWritten() const { return num_written_; }
+ private:
+  int32 num_written_;
+};
+
+void TestProcessTableInParallel() {
+  TaskSequencerConfig config;
+  config.num_threads = 1 + Rand() % 20;
+  int32 num_items = Rand() % 100;
+  MyTableReader reader(num_items);
+  MyTableProcessor processor;
+  ProcessTableInParallel(config, &reader, &processor);
+  KALDI_ASSERT(processor.NumWritten() == num_items);
+}
+
+void TestThreadPool() {
+  ThreadPool pool(1 + Rand() % 8);
+  for (int32 n = 0; n < 100; n++) {
+    int32 num_jobs = Rand() % 20;
+    std::vector<int32> done(num_jobs, 0);
+    pool.Run(num_jobs, [&done](int32 i) { done[i]++; });
+    for (int32 i = 0; i < num_jobs; i++)
+      KALDI_ASSERT(done[i] == 1);
+  }
+  bool caught = false;
+  try {
+    pool.Run(5, [](int32 i) {
+        if (i == 3) throw std::runtime_error("expected error"); });
+  } catch (const std::exception &e) {
+    caught = true;
+  }
+  KALDI_ASSERT(caught);
+}
 
 }  // end namespace kaldi.
 
 int main() {
   using namespace kaldi;
   TestThreads();
+  TestThreadPool();
   for (int32 i = 0; i < 1000; i++)
     TestTaskSequencer();
+  for (int32 i = 0; i < 100; i++)
+    TestProcessTableInParallel();
 }
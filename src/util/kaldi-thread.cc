@@ -28,6 +28,76 @@ MultiThreadable::~MultiThreadable() {
   // default implementation does nothing
 }
 
+ThreadPool::ThreadPool(int32 num_threads):
+    job_(NULL), num_jobs_(0), next_job_(0), num_jobs_done_(0), stop_(false) {
+  KALDI_ASSERT(num_threads > 0);
+  for (int32 i = 1; i < num_threads; i++)
+    threads_.push_back(std::thread(&ThreadPool::ThreadMain, this));
+}
+
+void ThreadPool::Run(int32 num_jobs,
+                     const std::function<void(int32)> &job) {
+  if (num_jobs <= 0)
+    return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  KALDI_ASSERT(job_ == NULL && "ThreadPool::Run() called re-entrantly");
+  job_ = &job;
+  num_jobs_ = num_jobs;
+  next_job_ = 0;
+  num_jobs_done_ = 0;
+  if (num_jobs > 1)
+    work_cond_.notify_all();
+  RunJobs(&lock);
+  while (num_jobs_done_ < num_jobs_)
+    done_cond_.wait(lock);
+  job_ = NULL;
+  if (exception_) {
+    std::exception_ptr e = exception_;
+    exception_ = nullptr;
+    std::rethrow_exception(e);
+  }
+}
+
+void ThreadPool::RunJobs(std::unique_lock<std::mutex> *lock) {
+  while (job_ != NULL && next_job_ < num_jobs_) {
+    int32 i = next_job_++;
+    const std::function<void(int32)> &job = *job_;
+    lock->unlock();
+    std::exception_ptr e;
+    try {
+      job(i);
+    } catch (...) {
+      e = std::current_exception();
+    }
+    lock->lock();
+    if (e && !exception_)
+      exception_ = e;
+    if (++num_jobs_done_ == num_jobs_)
+      done_cond_.notify_all();
+  }
+}
+
+void ThreadPool::ThreadMain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    while (!stop_ && (job_ == NULL || next_job_ >= num_jobs_))
+      work_cond_.wait(lock);
+    if (stop_)
+      return;
+    RunJobs(&lock);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cond_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++)
+    threads_[i].join();
+}
+
 
 
 }  // end namespace kaldi
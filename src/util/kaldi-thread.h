@@ -22,7 +22,13 @@
 #ifndef KALDI_THREAD_KALDI_THREAD_H_
 #define KALDI_THREAD_KALDI_THREAD_H_ 1
 
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <vector>
 #include "itf/options-itf.h"
 #include "util/kaldi-semaphore.h"
 
@@ -52,6 +58,17 @@
 // destructor to have side effects such as outputting data.
 // Note: the destructor of TaskSequencer will wait for any remaining jobs that
 // are still running and will call the destructors.
+//
+// The class ThreadPool is for code that needs to split a small amount of work
+// between threads very often (e.g. on every frame of decoding), where the cost
+// of starting new threads each time would outweigh the gain.  Its threads are
+// started once and wait for work between calls to its Run() function.
+//
+// The function ProcessTableInParallel() uses TaskSequencer for the most common
+// case of this, a program that reads a table with a sequential reader and
+// writes something for each item: you give it a "processor" object that says
+// how to compute the output for an item (this is done in parallel) and how to
+// write it (this is done in order), and it does the rest.
 
 
 namespace kaldi {
@@ -152,6 +169,48 @@ template<class C> void RunMultiThreaded(const C &c_in) {
 }
 
 
+/// Class ThreadPool keeps a fixed set of threads that wait for work, so that
+/// work can be split between threads many times a second without the cost of
+/// creating threads each time.  Run() calls job(i) for i = 0 ... num_jobs - 1,
+/// using the pool's threads and the calling thread, and returns when all of
+/// them have finished.  If any job throws, Run() rethrows the first exception
+/// after all the jobs have finished.  Run() must not be called from more than
+/// one thread at a time, or from inside a job.
+class ThreadPool {
+ public:
+  /// 'num_threads' is the total number of threads that will run jobs,
+  /// including the thread that calls Run(); the pool starts num_threads - 1
+  /// threads.
+  explicit ThreadPool(int32 num_threads);
+
+  /// Returns the number of threads, including the one that calls Run().
+  int32 NumThreads() const { return threads_.size() + 1; }
+
+  void Run(int32 num_jobs, const std::function<void(int32)> &job);
+
+  ~ThreadPool();
+ private:
+  // Runs jobs until there are none left to claim; 'lock' must hold mutex_.
+  void RunJobs(std::unique_lock<std::mutex> *lock);
+  // The function that the pool's threads run.
+  void ThreadMain();
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable work_cond_;  // signalled when there is new work.
+  std::condition_variable done_cond_;  // signalled when all jobs are done.
+  // The following are protected by mutex_.
+  const std::function<void(int32)> *job_;  // NULL if there is no work.
+  int32 num_jobs_;
+  int32 next_job_;
+  int32 num_jobs_done_;
+  std::exception_ptr exception_;
+  bool stop_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+
 struct TaskSequencerConfig {
   int32 num_threads;
   int32 num_threads_total;
@@ -279,6 +338,82 @@ class TaskSequencer {
 
 };
 
+
+// This is the task class used by ProcessTableInParallel(); see there.
+template<class Processor>
+class TableProcessorTask {
+ public:
+  TableProcessorTask(Processor *processor, const std::string &key,
+                     const typename Processor::Input &input):
+      processor_(processor), key_(key), input_(input) { }
+
+  void operator () () {
+    processor_->Process(key_, &input_, &output_);
+  }
+
+  ~TableProcessorTask() {
+    processor_->Write(key_, &output_);
+  }
+ private:
+  Processor *processor_;
+  std::string key_;
+  typename Processor::Input input_;
+  typename Processor::Output output_;
+};
+
+/**
+   ProcessTableInParallel() processes all the items of a sequential table
+   reader with up to config.num_threads threads, and writes the outputs in the
+   same order as the items were read, so the output of a program that uses it
+   does not depend on the number of threads.  The class Processor must
+   have:
+
+     typedef ... Input;   // A copy of each item is made as
+                          // Input(reader->Value()).
+     typedef ... Output;  // Default-constructed for each item.
+
+     // Computes the output for an item.  This will be called from several
+     // threads at once, so it must be thread-safe: normally, it will only
+     // read the state of the processor (models and options), which is why
+     // it is const.  It may modify *input.
+     void Process(const std::string &key, Input *input,
+                  Output *output) const;
+
+     // Writes the output for an item.  This is called for one item at a
+     // time, in the order of the input, so it may write to table writers or
+     // streams and update counts of successes and failures.
+     void Write(const std::string &key, Output *output);
+
+   If config.num_threads is 1 (the default), no threads are created: each
+   item is processed and written in the calling thread before the next one is
+   read, as in a program that does not use threads.  Because the items are
+   copied and the copies may stay in memory until they are written, memory use
+   grows with config.num_threads_total (see TaskSequencerConfig).
+*/
+template<class Processor, class SequentialReader>
+void ProcessTableInParallel(const TaskSequencerConfig &config,
+                            SequentialReader *reader,
+                            Processor *processor) {
+  if (config.num_threads <= 1) {
+    for (; !reader->Done(); reader->Next()) {
+      std::string key = reader->Key();
+      typename Processor::Input input(reader->Value());
+      reader->FreeCurrent();
+      typename Processor::Output output;
+      processor->Process(key, &input, &output);
+      processor->Write(key, &output);
+    }
+    return;
+  }
+  TaskSequencer<TableProcessorTask<Processor> > sequencer(config);
+  for (; !reader->Done(); reader->Next()) {
+    sequencer.Run(new TableProcessorTask<Processor>(processor, reader->Key(),
+                                                    reader->Value()));
+    reader->FreeCurrent();
+  }
+  sequencer.Wait();
+}
+
 } // namespace kaldi
 
 #endif  // KALDI_THREAD_KALDI_THREAD_H_
@@ -0,0 +1,78 @@
+// util/memory-mapped-file-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/memory-mapped-file.h"
+#include <cstdio>
+#include <fstream>
+
+namespace kaldi {
+
+void UnitTestMemoryMappedFile() {
+  std::string filename = "tmpf";
+  std::vector<char> contents(Rand() % 100000);
+  for (size_t i = 0; i < contents.size(); i++)
+    contents[i] = static_cast<char>(Rand() % 256);
+  {
+    std::ofstream os(filename.c_str(), std::ios::out | std::ios::binary);
+    if (!contents.empty())
+      os.write(&(contents[0]), contents.size());
+    KALDI_ASSERT(os.good());
+  }
+  {
+    MemoryMappedFile file(filename);
+    KALDI_ASSERT(file.Size() == contents.size());
+    KALDI_ASSERT(file.Filename() == filename);
+    for (size_t i = 0; i < contents.size(); i++)
+      KALDI_ASSERT(file.Data()[i] == contents[i]);
+  }
+  std::remove(filename.c_str());
+}
+
+void UnitTestMemoryMappedFileEmpty() {
+  std::string filename = "tmpf";
+  {
+    std::ofstream os(filename.c_str(), std::ios::out | std::ios::binary);
+  }
+  {
+    MemoryMappedFile file(filename);
+    KALDI_ASSERT(file.Size() == 0 && file.Data() == NULL);
+  }
+  std::remove(filename.c_str());
+}
+
+void UnitTestMemoryMappedFileMissing() {
+  bool threw = false;
+  try {
+    MemoryMappedFile file("nonexistent-file-for-memory-mapped-file-test");
+  } catch(const std::exception &e) {
+    threw = true;
+  }
+  KALDI_ASSERT(threw);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    UnitTestMemoryMappedFile();
+  UnitTestMemoryMappedFileEmpty();
+  UnitTestMemoryMappedFileMissing();
+  std::cout << "Test OK.\n";
+}
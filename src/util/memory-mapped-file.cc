@@ -0,0 +1,89 @@
+// util/memory-mapped-file.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/memory-mapped-file.h"
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+namespace kaldi {
+
+#ifndef _MSC_VER
+
+MemoryMappedFile::MemoryMappedFile(const std::string &filename):
+    filename_(filename), data_(NULL), size_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1)
+    KALDI_ERR << "Could not open file " << filename << " for mapping: "
+              << strerror(errno);
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    KALDI_ERR << "Could not stat file " << filename << ": " << strerror(err);
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  if (size_ != 0) {
+    void *addr = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      int err = errno;
+      close(fd);
+      KALDI_ERR << "Could not map file " << filename << " into memory: "
+                << strerror(err);
+    }
+    data_ = static_cast<const char*>(addr);
+  }
+  close(fd);  // The mapping stays valid after the file is closed.
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+  if (data_ != NULL && buffer_.empty())
+    munmap(const_cast<char*>(data_), size_);
+}
+
+#else  // _MSC_VER
+
+MemoryMappedFile::MemoryMappedFile(const std::string &filename):
+    filename_(filename), data_(NULL), size_(0) {
+  std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!is.good())
+    KALDI_ERR << "Could not open file " << filename;
+  is.seekg(0, std::ios::end);
+  size_ = static_cast<size_t>(is.tellg());
+  is.seekg(0, std::ios::beg);
+  if (size_ != 0) {
+    buffer_.resize(size_);
+    if (!is.read(&(buffer_[0]), size_))
+      KALDI_ERR << "Error reading file " << filename;
+    data_ = &(buffer_[0]);
+  }
+}
+
+MemoryMappedFile::~MemoryMappedFile() { }
+
+#endif  // _MSC_VER
+
+}  // namespace kaldi
@@ -0,0 +1,63 @@
+// util/memory-mapped-file.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_MEMORY_MAPPED_FILE_H_
+#define KALDI_UTIL_MEMORY_MAPPED_FILE_H_
+
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// MemoryMappedFile maps a whole file read-only into memory, so that large
+/// read-only objects (e.g. decoding graphs) can be used in place without
+/// being read and parsed.  The pages are loaded lazily by the operating
+/// system, and processes that map the same file share them.
+///
+/// The filename must be an actual file, not an rxfilename such as a pipe or
+/// "-".  On platforms without mmap(), the file is read into memory instead.
+class MemoryMappedFile {
+ public:
+  /// Maps the file; throws (KALDI_ERR) if it cannot be opened or mapped.
+  explicit MemoryMappedFile(const std::string &filename);
+
+  /// Returns the start of the file's contents (NULL if the file is empty).
+  const char *Data() const { return data_; }
+
+  /// Returns the size of the file, in bytes.
+  size_t Size() const { return size_; }
+
+  const std::string &Filename() const { return filename_; }
+
+  ~MemoryMappedFile();
+
+ private:
+  std::string filename_;
+  const char *data_;
+  size_t size_;
+  std::vector<char> buffer_;  // Only used if we could not mmap() the file.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MemoryMappedFile);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_MEMORY_MAPPED_FILE_H_
@@ -0,0 +1,116 @@
+// util/memory-pool-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/memory-pool.h"
+#include "base/timer.h"
+#include <set>
+
+namespace kaldi {
+
+// A struct similar in layout to the decoder's ForwardLink.
+struct TestLink {
+  TestLink *next_tok;
+  int32 ilabel;
+  int32 olabel;
+  float graph_cost;
+  float acoustic_cost;
+  TestLink *next;
+  TestLink(int32 ilabel, int32 olabel, TestLink *next):
+      next_tok(NULL), ilabel(ilabel), olabel(olabel), graph_cost(0.0),
+      acoustic_cost(0.0), next(next) { }
+};
+
+void TestMemoryPool() {
+  MemoryPool<TestLink> pool(1 + Rand() % 100);
+  std::set<TestLink*> live;
+  for (int32 i = 0; i < 10000; i++) {
+    if (live.empty() || Rand() % 3 != 0) {
+      int32 ilabel = Rand() % 1000;
+      TestLink *link = pool.New(ilabel, ilabel + 1, static_cast<TestLink*>(NULL));
+      KALDI_ASSERT(link->ilabel == ilabel && link->olabel == ilabel + 1 &&
+                   link->next == NULL);
+      KALDI_ASSERT(live.count(link) == 0);  // must not be handed out twice.
+      live.insert(link);
+    } else {
+      std::set<TestLink*>::iterator iter = live.begin();
+      std::advance(iter, Rand() % live.size());
+      pool.Delete(*iter);
+      live.erase(iter);
+    }
+    KALDI_ASSERT(pool.NumInUse() == live.size() &&
+                 pool.NumAllocated() >= live.size());
+  }
+  for (std::set<TestLink*>::iterator iter = live.begin(); iter != live.end();
+       ++iter)
+    pool.Delete(*iter);
+  KALDI_ASSERT(pool.NumInUse() == 0);
+}
+
+// This compares the speed of the pool with plain new/delete, using an
+// allocation pattern (allocate a chain of objects, then free it) that is
+// similar to what happens in the decoders.
+void TestMemoryPoolSpeed() {
+  int32 num_rounds = 200, chain_length = 10000;
+  double pool_time, heap_time;
+  {
+    Timer timer;
+    MemoryPool<TestLink> pool;
+    for (int32 r = 0; r < num_rounds; r++) {
+      TestLink *head = NULL;
+      for (int32 i = 0; i < chain_length; i++)
+        head = pool.New(i, i, head);
+      while (head != NULL) {
+        TestLink *next = head->next;
+        pool.Delete(head);
+        head = next;
+      }
+    }
+    pool_time = timer.Elapsed();
+  }
+  {
+    Timer timer;
+    for (int32 r = 0; r < num_rounds; r++) {
+      TestLink *head = NULL;
+      for (int32 i = 0; i < chain_length; i++)
+        head = new TestLink(i, i, head);
+      while (head != NULL) {
+        TestLink *next = head->next;
+        delete head;
+        head = next;
+      }
+    }
+    heap_time = timer.Elapsed();
+  }
+  KALDI_LOG << "For " << (num_rounds * chain_length) << " allocations, "
+            << "MemoryPool took " << pool_time << " seconds, new/delete took "
+            << heap_time << " seconds.";
+}
+
+
+}  // end namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 5; i++)
+    TestMemoryPool();
+  TestMemoryPoolSpeed();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,127 @@
+// util/memory-pool.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_MEMORY_POOL_H_
+#define KALDI_UTIL_MEMORY_POOL_H_
+#include <vector>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "base/kaldi-common.h"
+
+
+/* This header provides a simple fixed-size object pool, used in the decoders
+   to allocate the many small objects (tokens and forward links) they create and
+   destroy on every frame.  Objects are carved out of large blocks, and freed
+   objects are put on a singly linked free-list for reuse, so in the steady
+   state there are no calls to the global heap at all.  Memory is only returned
+   to the system when the pool is destroyed; this is intended, as a decoder
+   object is normally reused for many utterances and will need about the same
+   amount of memory each time.
+
+   This is the same memory-management strategy that HashList (see
+   hash-list.h) uses internally for its Elems, made generic.  The class is not
+   thread safe; the intention is that each decoder object has its own pools,
+   which avoids the malloc contention that arises when many decoder threads in
+   the same process allocate from the global heap.
+
+   See memory-pool-test.cc for an example of how to use this object.
+*/
+
+
+namespace kaldi {
+
+template<class T> class MemoryPool {
+ public:
+  /// The constructor takes the number of objects to allocate in each block.
+  explicit MemoryPool(size_t block_size = 1024):
+      block_size_(block_size), freed_head_(NULL), num_in_use_(0) {
+    KALDI_ASSERT(block_size > 0);
+  }
+
+  /// Think of this like "new T(args...)": it constructs a new object in
+  /// memory owned by the pool, and returns it.
+  template<typename... Args>
+  inline T *New(Args&&... args) {
+    if (freed_head_ == NULL)
+      AllocateBlock();
+    Slot *slot = freed_head_;
+    freed_head_ = slot->next;
+    num_in_use_++;
+    return new (static_cast<void*>(slot)) T(std::forward<Args>(args)...);
+  }
+
+  /// Think of this like "delete t": it calls the destructor of t and returns
+  /// its memory to the pool, for reuse by subsequent calls to New().  t must
+  /// have been obtained from New() on this same object.
+  inline void Delete(T *t) {
+    t->~T();
+    Slot *slot = reinterpret_cast<Slot*>(t);
+    slot->next = freed_head_;
+    freed_head_ = slot;
+    num_in_use_--;
+  }
+
+  /// Returns the number of objects currently allocated with New() and not
+  /// yet freed with Delete().
+  size_t NumInUse() const { return num_in_use_; }
+
+  /// Returns the total number of objects the pool has memory for.
+  size_t NumAllocated() const { return blocks_.size() * block_size_; }
+
+  ~MemoryPool() {
+    if (num_in_use_ != 0) {
+      KALDI_WARN << "Possible memory leak: " << num_in_use_
+                 << " objects were not returned to the MemoryPool";
+    }
+    for (size_t i = 0; i < blocks_.size(); i++)
+      delete [] blocks_[i];
+  }
+
+ private:
+  // A Slot is a chunk of memory big enough (and suitably aligned) to hold
+  // either a T or, while it's on the free list, a pointer to the next free
+  // Slot.
+  union Slot {
+    Slot *next;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  void AllocateBlock() {
+    Slot *block = new Slot[block_size_];
+    for (size_t i = 0; i + 1 < block_size_; i++)
+      block[i].next = block + i + 1;
+    block[block_size_ - 1].next = freed_head_;
+    freed_head_ = block;
+    blocks_.push_back(block);
+  }
+
+  size_t block_size_;  // Number of objects to allocate in one block.
+  Slot *freed_head_;  // Head of the list of free slots.
+  size_t num_in_use_;  // Number of objects currently handed out.
+  std::vector<Slot*> blocks_;  // The allocated blocks.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MemoryPool);
+};
+
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_MEMORY_POOL_H_
@@ -0,0 +1,142 @@
+// util/open-hash-list-inl.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_OPEN_HASH_LIST_INL_H_
+#define KALDI_UTIL_OPEN_HASH_LIST_INL_H_
+
+// Do not include this file directly.  It is included by open-hash-list.h
+
+
+namespace kaldi {
+
+template<class I, class T> OpenHashList<I, T>::OpenHashList():
+    list_head_(NULL), list_tail_(NULL), hash_size_(0), hash_shift_(64),
+    num_elems_(0) {
+  SetSize(16);
+}
+
+template<class I, class T> void OpenHashList<I, T>::SetSize(size_t size) {
+  KALDI_ASSERT(num_elems_ == 0 && list_head_ == NULL);  // make sure empty.
+  if (size > hash_size_)
+    Rehash(size);
+}
+
+template<class I, class T> void OpenHashList<I, T>::Rehash(size_t size) {
+  size_t new_size = 8;
+  int32 log_size = 3;
+  while (new_size < size) {
+    new_size *= 2;
+    log_size++;
+  }
+  if (new_size == hash_size_)
+    return;
+  std::vector<Slot> new_slots(new_size);
+  for (size_t i = 0; i < new_size; i++)
+    new_slots[i].elem = NULL;
+  std::vector<Slot> old_slots;
+  std::vector<size_t> old_used_slots;
+  old_slots.swap(slots_);
+  slots_.swap(new_slots);
+  used_slots_.swap(old_used_slots);
+  hash_size_ = new_size;
+  hash_shift_ = 64 - log_size;
+  num_elems_ = 0;
+  for (size_t i = 0; i < old_used_slots.size(); i++)
+    InsertIntoTable(old_slots[old_used_slots[i]].elem);
+}
+
+template<class I, class T>
+typename OpenHashList<I, T>::Elem* OpenHashList<I, T>::Clear() {
+  // Clears the hashtable and gives ownership of the currently contained list
+  // to the user.
+  std::vector<size_t>::const_iterator iter = used_slots_.begin(),
+      end = used_slots_.end();
+  for (; iter != end; ++iter)
+    slots_[*iter].elem = NULL;  // this is how we indicate "empty".
+  used_slots_.clear();
+  num_elems_ = 0;
+  Elem *ans = list_head_;
+  list_head_ = NULL;
+  list_tail_ = NULL;
+  return ans;
+}
+
+template<class I, class T>
+inline typename OpenHashList<I, T>::Elem* OpenHashList<I, T>::Find(I key) {
+  size_t mask = hash_size_ - 1;
+  for (size_t index = HashIndex(key); ; index = (index + 1) & mask) {
+    const Slot &slot = slots_[index];
+    if (slot.elem == NULL)
+      return NULL;  // Not found.
+    if (slot.key == key)
+      return slot.elem;
+  }
+}
+
+template<class I, class T>
+inline void OpenHashList<I, T>::InsertIntoTable(Elem *elem) {
+  size_t mask = hash_size_ - 1, index = HashIndex(elem->key);
+  while (slots_[index].elem != NULL)
+    index = (index + 1) & mask;
+  slots_[index].key = elem->key;
+  slots_[index].elem = elem;
+  used_slots_.push_back(index);
+  num_elems_++;
+}
+
+template<class I, class T>
+inline void OpenHashList<I, T>::Insert(I key, T val) {
+  // Keep the load factor below 3/4, or probe sequences get long.
+  if (4 * (num_elems_ + 1) > 3 * hash_size_)
+    Rehash(2 * hash_size_);
+  Elem *elem = New();
+  elem->key = key;
+  elem->val = val;
+  elem->tail = NULL;
+  if (list_tail_ == NULL)
+    list_head_ = elem;
+  else
+    list_tail_->tail = elem;
+  list_tail_ = elem;
+  InsertIntoTable(elem);
+}
+
+template<class I, class T>
+inline void OpenHashList<I, T>::InsertMore(I key, T val) {
+  Elem *e = Find(key);
+  KALDI_ASSERT(e != NULL);  // assume one element is already here
+  // Find the last of the elements with this key; they are consecutive in the
+  // list.  We don't need to put the new element in the table, as Find() only
+  // returns the first one.
+  while (e->tail != NULL && e->tail->key == key)
+    e = e->tail;
+  Elem *elem = New();
+  elem->key = key;
+  elem->val = val;
+  elem->tail = e->tail;
+  e->tail = elem;
+  if (list_tail_ == e)
+    list_tail_ = elem;
+}
+
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_OPEN_HASH_LIST_INL_H_
@@ -0,0 +1,187 @@
+// util/open-hash-list-test.cc
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/open-hash-list.h"
+#include "util/hash-list.h"
+#include "base/timer.h"
+#include <map>  // for baseline.
+#include <cstdlib>
+#include <iostream>
+
+namespace kaldi {
+
+template<class Int, class T> void TestOpenHashList() {
+  typedef typename OpenHashList<Int, T>::Elem Elem;
+
+  OpenHashList<Int, T> hash;
+  hash.SetSize(200);  // must be called before use.
+  std::map<Int, T> m1;
+  for (size_t j = 0; j < 50; j++) {
+    Int key = Rand() % 200;
+    T val = Rand() % 50;
+    m1[key] = val;
+    Elem *e = hash.Find(key);
+    if (e) e->val = val;
+    else  hash.Insert(key, val);
+  }
+
+  std::map<Int, T> m2;
+
+  for (int i = 0; i < 100; i++) {
+    m2.clear();
+    for (typename std::map<Int, T>::const_iterator iter = m1.begin();
+        iter != m1.end();
+        iter++) {
+      m2[iter->first + 1] = iter->second;
+    }
+    std::swap(m1, m2);
+
+    Elem *h = hash.Clear(), *tmp;
+
+    // note: the size may be too small; the table will grow as needed.
+    hash.SetSize(Rand() % 100);
+
+    for (; h != NULL; h = tmp) {
+      hash.Insert(h->key + 1, h->val);
+      tmp = h->tail;
+      hash.Delete(h);  // think of this like calling delete.
+    }
+
+    // Now make sure h and m2 are the same.
+    const Elem *list = hash.GetList();
+    size_t count = 0;
+    for (; list != NULL; list = list->tail, count++) {
+      KALDI_ASSERT(m1[list->key] == list->val);
+    }
+
+    for (size_t j = 0; j < 10; j++) {
+      Int key = Rand() % 200;
+      bool found_m1 = (m1.find(key) != m1.end());
+      Elem *e = hash.Find(key);
+      KALDI_ASSERT((e != NULL) == found_m1);
+      if (found_m1)
+        KALDI_ASSERT(m1[key] == e->val);
+    }
+
+    KALDI_ASSERT(m1.size() == count);
+  }
+  for (Elem *h = hash.Clear(), *tmp; h != NULL; h = tmp) {
+    tmp = h->tail;
+    hash.Delete(h);
+  }
+}
+
+
+// Tests that InsertMore() keeps elements with the same key together, after
+// the first one, and that the list is otherwise in insertion order.
+void TestOpenHashListInsertMore() {
+  typedef OpenHashList<int32, int32>::Elem Elem;
+  OpenHashList<int32, int32> hash;
+  std::vector<int32> keys;
+  for (int32 i = 0; i < 100; i++) {
+    int32 key = Rand() % 50;
+    if (hash.Find(key) == NULL) {
+      hash.Insert(key, i);
+      keys.push_back(key);
+    } else {
+      hash.InsertMore(key, i);
+    }
+  }
+  std::vector<int32> seen_keys;
+  for (const Elem *e = hash.GetList(); e != NULL; e = e->tail) {
+    if (seen_keys.empty() || seen_keys.back() != e->key) {
+      seen_keys.push_back(e->key);
+      KALDI_ASSERT(hash.Find(e->key)->val == e->val);
+    } else {
+      KALDI_ASSERT(e->val > hash.Find(e->key)->val);
+    }
+  }
+  KALDI_ASSERT(seen_keys == keys);
+  for (Elem *h = hash.Clear(), *tmp; h != NULL; h = tmp) {
+    tmp = h->tail;
+    hash.Delete(h);
+  }
+}
+
+
+// Times the decoder-like access pattern (each frame, look up or insert a set of
+// keys derived from those of the previous frame) for HashList and
+// OpenHashList.
+template<class HashType> double TimeHashType(int32 num_keys,
+                                             int32 num_frames) {
+  typedef typename HashType::Elem Elem;
+  HashType hash;
+  hash.SetSize(2 * num_keys);
+  for (int32 i = 0; i < num_keys; i++)
+    hash.Insert(i * 17, i);
+  Timer timer;
+  int64 num_found = 0;
+  for (int32 f = 0; f < num_frames; f++) {
+    Elem *h = hash.Clear(), *tmp;
+    hash.SetSize(2 * num_keys);
+    for (; h != NULL; h = tmp) {
+      for (int32 j = 0; j < 3; j++) {
+        int32 key = (h->key * 31 + j * 7919 + f) % (20 * num_keys);
+        Elem *e = hash.Find(key);
+        if (e != NULL) num_found++;
+        else if (j == 0) hash.Insert(key, h->val);
+      }
+      tmp = h->tail;
+      hash.Delete(h);
+    }
+  }
+  double ans = timer.Elapsed();
+  for (Elem *h = hash.Clear(), *tmp; h != NULL; h = tmp) {
+    tmp = h->tail;
+    hash.Delete(h);
+  }
+  KALDI_VLOG(2) << "num-found = " << num_found;
+  return ans;
+}
+
+void TestOpenHashListSpeed() {
+  int32 num_keys = 20000, num_frames = 100;
+  double hash_list_time =
+      TimeHashType<HashList<int32, int32> >(num_keys, num_frames),
+      open_hash_list_time =
+      TimeHashType<OpenHashList<int32, int32> >(num_keys, num_frames);
+  KALDI_LOG << "For " << num_keys << " keys and " << num_frames
+            << " frames, HashList took " << hash_list_time
+            << " seconds and OpenHashList took " << open_hash_list_time;
+}
+
+
+}  // end namespace kaldi
+
+
+
+int main() {
+  using namespace kaldi;
+  for (size_t i = 0;i < 3;i++) {
+    TestOpenHashList<int, unsigned int>();
+    TestOpenHashList<unsigned int, int>();
+    TestOpenHashList<int16, int32>();
+    TestOpenHashList<char, unsigned char>();
+    TestOpenHashList<unsigned char, int>();
+    TestOpenHashListInsertMore();
+  }
+  TestOpenHashListSpeed();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,156 @@
+// util/open-hash-list.h
+
+// Copyright 2026  agent
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_OPEN_HASH_LIST_H_
+#define KALDI_UTIL_OPEN_HASH_LIST_H_
+#include <vector>
+#include "util/stl-utils.h"
+#include "util/memory-pool.h"
+
+
+/* This header provides OpenHashList, a drop-in replacement for HashList (see
+   hash-list.h) that has exactly the same interface and the same "list" part,
+   but a different "hash" part.  HashList keeps its buckets as ranges of the
+   linked list of Elems, so Find() has to follow Elem pointers (one cache miss
+   per Elem visited, even for keys that are not present).  OpenHashList instead
+   uses open addressing with linear probing on a flat array of (key, Elem*)
+   slots; the key is stored in the slot, so a lookup normally touches a single
+   cache line and only dereferences the Elem that matches.  Probing is
+   sequential in memory, which the hardware prefetcher handles well.
+
+   The number of slots is always a power of two, and we use multiplicative
+   ("Fibonacci") hashing so that consecutive keys, which are common since
+   FST state-ids are dense, are spread out.  The table grows automatically
+   if it becomes more than 3/4 full, so SetSize() is only a hint, but the
+   decoders call it with about twice the number of tokens, as for HashList.
+
+   The order of the list returned by GetList() and Clear() is the order of
+   insertion (HashList's order depends on the hash).  The decoders visit
+   tokens in list order, so with the two types they may number lattice states
+   differently, and (because the order in which epsilon arcs are processed
+   differs) the raw lattices may differ slightly in which redundant arcs they
+   contain.  The best path is not affected.
+
+   See open-hash-list-test.cc for an example of how to use this object.
+*/
+
+
+namespace kaldi {
+
+template<class I, class T> class OpenHashList {
+ public:
+  struct Elem {
+    I key;
+    T val;
+    Elem *tail;
+  };
+
+  /// Constructor takes no arguments.
+  /// Call SetSize to inform it of the likely size.
+  OpenHashList();
+
+  /// Clears the hash and gives the head of the current list to the user;
+  /// ownership is transferred to the user (the user must call Delete()
+  /// for each element in the list, at his/her leisure).
+  Elem *Clear();
+
+  /// Gives the head of the current list to the user.  Ownership retained in the
+  /// class.
+  const Elem *GetList() const { return list_head_; }
+
+  /// Think of this like delete().  It is to be called for each Elem in turn
+  /// after you "obtained ownership" by doing Clear().
+  inline void Delete(Elem *e) { pool_.Delete(e); }
+
+  /// This should probably not be needed to be called directly by the user.
+  /// Think of it as opposite to Delete();
+  inline Elem *New() { return pool_.New(); }
+
+  /// Find tries to find this element in the current list using the hashtable.
+  /// It returns NULL if not present.  The Elem it returns is not owned by the
+  /// user, it is part of the internal list owned by this object, but the user
+  /// is free to modify the "val" element.
+  inline Elem *Find(I key);
+
+  /// Insert inserts a new element into the hashtable/stored list.  By calling
+  /// this, the user asserts that it is not already present (e.g. Find was
+  /// called and returned NULL).
+  inline void Insert(I key, T val);
+
+  /// InsertMore inserts another element with the same key into the stored
+  /// list, directly after the existing element(s) with that key.  By calling
+  /// this, the user asserts that one element with that key is already present.
+  /// Find() will return the first one of the elements with the same key.
+  inline void InsertMore(I key, T val);
+
+  /// SetSize tells the object how many slots to allocate (it is rounded up to
+  /// a power of two); it should typically be at least twice the number of
+  /// objects we expect to go in the structure.  It must be called while the
+  /// hash is empty (e.g. after Clear() or after initializing the object, but
+  /// before adding anything to the hash).  It never shrinks the table.
+  void SetSize(size_t sz);
+
+  /// Returns current number of slots.
+  inline size_t Size() { return hash_size_; }
+
+  /// The destructor itself does nothing; any Elems that were never returned
+  /// with Delete() are reported by the destructor of the MemoryPool pool_.
+  ~OpenHashList() { }
+
+ private:
+  struct Slot {
+    I key;
+    Elem *elem;  // NULL if this slot is empty.
+  };
+
+  inline size_t HashIndex(I key) const {
+    return static_cast<size_t>(
+        (static_cast<uint64>(key) * 11400714819323198485ull) >> hash_shift_);
+  }
+
+  // Resizes the table to 'size' slots (a power of two) and re-inserts the
+  // elements that are currently in the hash.
+  void Rehash(size_t size);
+
+  // Inserts 'elem' into the table (not into the list).
+  inline void InsertIntoTable(Elem *elem);
+
+  Elem *list_head_;  // head of currently stored list.
+  Elem *list_tail_;  // tail of currently stored list.
+
+  size_t hash_size_;  // number of slots, a power of two.
+  int32 hash_shift_;  // 64 - log2(hash_size_).
+  size_t num_elems_;  // number of elements currently in the table.
+
+  std::vector<Slot> slots_;
+  std::vector<size_t> used_slots_;  // indexes of the occupied slots, so
+                                    // Clear() doesn't have to scan the table.
+
+  MemoryPool<Elem> pool_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(OpenHashList);
+};
+
+
+}  // end namespace kaldi
+
+#include "util/open-hash-list-inl.h"
+
+#endif  // KALDI_UTIL_OPEN_HASH_LIST_H_